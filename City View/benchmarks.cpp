@@ -0,0 +1,1011 @@
+#include "benchmarks.h"
+#include "entities.h"
+#include "facades.h"
+#include "flock.h"
+#include "frame_pacer.h"
+#include "gl_ext.h"
+#include "instancing.h"
+#include "lod.h"
+#include "logger.h"
+#include "particles.h"
+#include "scene.h"
+#include "simulation.h"
+#include "task_pool.h"
+#include "timing.h"
+#include "water.h"
+#include <GL/glut.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Time draws until minMs has passed (at least minFrames), return ms/frame
+template <typename Draw>
+static double timeDraws(Draw draw, int minFrames, double minMs) {
+    glClear(GL_COLOR_BUFFER_BIT);
+    draw(); // Warm-up, so uploads and shader compilation are not measured
+    glFinish();
+
+    int frames = 0;
+    BenchClock::time_point start = BenchClock::now();
+    while (frames < minFrames || msSince(start) < minMs) {
+        glClear(GL_COLOR_BUFFER_BIT);
+        draw();
+        glFinish(); // Count the GPU work, not just command submission
+        ++frames;
+    }
+    return msSince(start) / frames;
+}
+
+// ---------- INSTANCING ----------
+
+static const int NUM_BENCH_PROPS = 4;
+
+static double timeFrames(InstancedProp* props, int minFrames, double minMs) {
+    return timeDraws([&]() {
+        for (int p = 0; p < NUM_BENCH_PROPS; ++p) props[p].draw();
+    }, minFrames, minMs);
+}
+
+void runInstancingBenchmark() {
+    const int counts[] = {10, 100, 1000, 10000, 100000};
+    const int NUM_COUNTS = sizeof(counts) / sizeof(counts[0]);
+
+    // Same prop meshes the scene uses, in local coordinates
+    InstancedProp props[NUM_BENCH_PROPS];
+    MeshBuilder mb;
+    drawTree(mb, 0.0f, 0.0f);
+    props[0].setMesh(mb);
+    mb.clear();
+    drawStreetLight(mb, 0.0f, 0.0f);
+    props[1].setMesh(mb);
+    mb.clear();
+    drawBuilding(mb, 0.0f, 0.0f, 1.0f, 1.0f);
+    props[2].setMesh(mb);
+    mb.clear();
+    drawRealisticCar(mb);
+    props[3].setMesh(mb);
+
+    int meshVertices = 0;
+    for (int p = 0; p < NUM_BENCH_PROPS; ++p) meshVertices += props[p].meshVertexCount();
+
+    printf("Instancing benchmark (%s)\n", glGetString(GL_RENDERER));
+    printf("Hardware instancing: %s\n", hasInstancing ? "yes" : "no (fallback only)");
+    printf("Mesh vertices per set (tree + light + building + car): %d\n\n", meshVertices);
+    printf("%10s %10s %16s %14s %14s %9s\n",
+           "per type", "total", "draw calls", "instanced ms", "per-draw ms", "speedup");
+
+    std::mt19937 rng(1234); // Fixed seed so runs are comparable
+    std::uniform_real_distribution<float> posX(0.0f, 800.0f);
+    std::uniform_real_distribution<float> posY(0.0f, 600.0f);
+    std::uniform_int_distribution<int> variant(0, NUM_PROP_VARIANTS - 1);
+
+    for (int c = 0; c < NUM_COUNTS; ++c) {
+        int n = counts[c];
+        std::vector<PropInstance> instances(n);
+        for (int p = 0; p < NUM_BENCH_PROPS; ++p) {
+            for (int i = 0; i < n; ++i) {
+                PropInstance& inst = instances[i];
+                inst.x = posX(rng);
+                inst.y = posY(rng);
+                // Small props so a dense city still fits the viewport
+                inst.scaleX = (p == 2) ? 12.0f : 0.2f;
+                inst.scaleY = (p == 2) ? 18.0f : 0.2f;
+                inst.variant = (float)variant(rng);
+            }
+            props[p].setInstances(instances);
+        }
+
+        instancingEnabled = true;
+        double instancedMs = timeFrames(props, 3, 250.0);
+        instancingEnabled = false;
+        double perDrawMs = timeFrames(props, 1, 250.0);
+        instancingEnabled = true;
+
+        char drawCalls[32];
+        snprintf(drawCalls, sizeof(drawCalls), "%d / %d", NUM_BENCH_PROPS, n * NUM_BENCH_PROPS);
+        printf("%10d %10d %16s %14.3f %14.3f %8.1fx\n", n, n * NUM_BENCH_PROPS, drawCalls,
+               instancedMs, perDrawMs, perDrawMs / instancedMs);
+        fflush(stdout);
+    }
+
+    for (int p = 0; p < NUM_BENCH_PROPS; ++p) props[p].release();
+}
+
+// ---------- FACADES ----------
+
+void runFacadeBenchmark() {
+    const int counts[] = {1000, 10000, 100000};
+    const int NUM_COUNTS = sizeof(counts) / sizeof(counts[0]);
+    const int grids[][2] = {{2, 3}, {4, 6}, {8, 4}};
+    const int NUM_GRIDS = sizeof(grids) / sizeof(grids[0]);
+
+    printf("Facade benchmark (%s)\n", glGetString(GL_RENDERER));
+    printf("Hardware instancing: %s\n\n", hasInstancing ? "yes" : "no (fallback only)");
+    printf("%10s %8s %14s %14s %14s %14s %9s\n",
+           "buildings", "grid", "polygon verts", "polygon ms", "facade verts", "facade ms", "speedup");
+
+    std::mt19937 rng(1234); // Fixed seed so runs are comparable
+    std::uniform_real_distribution<float> posX(0.0f, 800.0f);
+    std::uniform_real_distribution<float> posY(0.0f, 600.0f);
+
+    for (int g = 0; g < NUM_GRIDS; ++g) {
+        // A unit building with this grid, as one polygon per window
+        FacadeInstance unit = makeFacade(PropInstance{0.0f, 0.0f, 1.0f, 1.0f, 0.0f});
+        unit.columns = (GLubyte)grids[g][0];
+        unit.rows = (GLubyte)grids[g][1];
+        MeshBuilder mb;
+        buildFacadeGeometry(mb, unit);
+        InstancedProp polygons;
+        polygons.setMesh(mb);
+
+        for (int c = 0; c < NUM_COUNTS; ++c) {
+            int n = counts[c];
+            std::vector<PropInstance> instances(n);
+            std::vector<FacadeInstance> facades(n);
+            for (int i = 0; i < n; ++i) {
+                PropInstance inst = {posX(rng), posY(rng), 24.0f, 36.0f, 0.0f};
+                instances[i] = inst;
+                facades[i] = makeFacade(inst);
+                facades[i].columns = unit.columns;
+                facades[i].rows = unit.rows;
+            }
+            polygons.setInstances(instances);
+            FacadeBuffer buffer;
+            buffer.set(facades);
+            FacadeRenderer renderer;
+
+            double polygonMs = timeDraws([&]() { polygons.draw(); }, 3, 250.0);
+            double facadeMs = timeDraws([&]() { renderer.draw(buffer); }, 3, 250.0);
+
+            char grid[16];
+            snprintf(grid, sizeof(grid), "%dx%d", grids[g][0], grids[g][1]);
+            printf("%10d %8s %14d %14.3f %14d %14.3f %8.1fx\n", n, grid, n * polygons.meshVertexCount(),
+                   polygonMs, n * FACADE_VERTICES, facadeMs, polygonMs / facadeMs);
+            fflush(stdout);
+            renderer.release();
+            buffer.release();
+        }
+        polygons.release();
+    }
+}
+
+// ---------- ENTITY UPDATES ----------
+
+void runEntityBenchmark() {
+    const int counts[] = {1000, 10000, 100000, 1000000};
+    const int NUM_COUNTS = sizeof(counts) / sizeof(counts[0]);
+    const SimdLevel levels[] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+    const int NUM_LEVELS = sizeof(levels) / sizeof(levels[0]);
+    const int VERIFY_TICKS = 1000;
+
+    SimdLevel best = bestSimdLevel();
+    printf("Entity update benchmark (best kernel on this CPU: %s)\n\n", simdLevelName(best));
+    printf("%10s %8s %18s %10s\n", "entities", "kernel", "M updates/sec", "speedup");
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> startX(-600.0f, 850.0f);
+    std::uniform_real_distribution<float> speed(0.5f, 15.0f);
+
+    for (int c = 0; c < NUM_COUNTS; ++c) {
+        int n = counts[c];
+        std::vector<float> initialX(n), velX(n), wrapMax(n, 850.0f), wrapReset(n, -120.0f);
+        for (int i = 0; i < n; ++i) {
+            initialX[i] = startX(rng);
+            velX[i] = speed(rng);
+        }
+
+        std::vector<float> reference;
+        double scalarRate = 0.0;
+        for (int l = 0; l < NUM_LEVELS && levels[l] <= best; ++l) {
+            // Same ticks from the same start must give bit-identical positions
+            std::vector<float> x = initialX;
+            for (int t = 0; t < VERIFY_TICKS; ++t) {
+                advanceEntities(levels[l], &x[0], &velX[0], &wrapMax[0], &wrapReset[0], n);
+            }
+            bool identical = true;
+            if (reference.empty()) {
+                reference = x;
+            } else {
+                identical = memcmp(&reference[0], &x[0], n * sizeof(float)) == 0;
+            }
+
+            long long updates = 0;
+            BenchClock::time_point start = BenchClock::now();
+            while (msSince(start) < 200.0) {
+                for (int t = 0; t < 10; ++t) {
+                    advanceEntities(levels[l], &x[0], &velX[0], &wrapMax[0], &wrapReset[0], n);
+                }
+                updates += 10LL * n;
+            }
+            double rate = updates / (msSince(start) * 1000.0); // Millions per second
+            if (levels[l] == SIMD_SCALAR) scalarRate = rate;
+
+            printf("%10d %8s %18.1f %9.2fx%s\n", n, simdLevelName(levels[l]), rate,
+                   rate / scalarRate, identical ? "" : "  MISMATCH vs scalar");
+            fflush(stdout);
+        }
+    }
+}
+
+// ---------- WATER ----------
+
+// One evaluation of a columns x rows grid: four waves per row, with the
+// phase changing from row to row like WaterSurface::evaluate()
+static void evaluateBenchGrid(SimdLevel level, bool reference, std::vector<float>& heights,
+                              const std::vector<float>& x, int rows, float time) {
+    const int cycles[] = {9, 14, 23, 37};
+    const float amplitudes[] = {3.0f, 1.8f, 1.1f, 0.6f};
+    int columns = (int)x.size();
+    for (int r = 0; r < rows; ++r) {
+        float* h = &heights[(size_t)r * columns];
+        std::fill(h, h + columns, 0.0f);
+        for (int w = 0; w < 4; ++w) {
+            float k = cycles[w] * 2.0f * (float)M_PI / SEA_WIDTH;
+            float phase = std::fmod(0.03f * r * (w + 1) - (1.0f + 0.5f * w) * time, 2.0f * (float)M_PI);
+            if (reference) {
+                addWaveReference(h, &x[0], columns, amplitudes[w], k, phase);
+            } else {
+                addWave(level, h, &x[0], columns, amplitudes[w], k, phase);
+            }
+        }
+    }
+}
+
+void runWaterBenchmark() {
+    const int grids[][2] = {{256, 32}, {1024, 128}, {4096, 512}};
+    const int NUM_GRIDS = sizeof(grids) / sizeof(grids[0]);
+    const SimdLevel levels[] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+    const int NUM_LEVELS = sizeof(levels) / sizeof(levels[0]);
+
+    SimdLevel best = bestSimdLevel();
+    printf("Water height field benchmark, 4 waves per sample (best kernel on this CPU: %s)\n\n", simdLevelName(best));
+    printf("%10s %9s %18s %10s %12s\n", "grid", "kernel", "M samples/sec", "speedup", "max error");
+
+    for (int g = 0; g < NUM_GRIDS; ++g) {
+        int columns = grids[g][0], rows = grids[g][1];
+        std::vector<float> x(columns);
+        for (int c = 0; c < columns; ++c) x[c] = c * SEA_WIDTH / columns;
+        char gridName[32];
+        snprintf(gridName, sizeof(gridName), "%dx%d", columns, rows);
+
+        // std::sin first, as the reference for both accuracy and speed
+        std::vector<float> reference((size_t)columns * rows), heights((size_t)columns * rows);
+        std::vector<float> fastScalar, scratch((size_t)columns * rows);
+        double stdRate = 0.0;
+        for (int l = -1; l < NUM_LEVELS && (l < 0 || levels[l] <= best); ++l) {
+            bool isReference = l < 0;
+            std::vector<float>& out = isReference ? reference : heights;
+            evaluateBenchGrid(isReference ? SIMD_SCALAR : levels[l], isReference, out, x, rows, 12.5f);
+
+            float maxError = 0.0f;
+            bool identical = true;
+            if (!isReference) {
+                for (size_t i = 0; i < out.size(); ++i) maxError = std::max(maxError, std::fabs(out[i] - reference[i]));
+                // Every fast kernel must match the scalar one bit for bit
+                if (fastScalar.empty()) {
+                    fastScalar = out;
+                } else {
+                    identical = memcmp(&fastScalar[0], &out[0], out.size() * sizeof(float)) == 0;
+                }
+            }
+
+            long long samples = 0;
+            float time = 0.0f;
+            BenchClock::time_point start = BenchClock::now();
+            while (msSince(start) < 200.0) {
+                evaluateBenchGrid(isReference ? SIMD_SCALAR : levels[l], isReference, scratch, x, rows, time);
+                time += 0.03f;
+                samples += 4LL * columns * rows;
+            }
+            double rate = samples / (msSince(start) * 1000.0); // Millions per second
+            if (isReference) stdRate = rate;
+
+            char error[16] = "";
+            if (!isReference) snprintf(error, sizeof(error), "%.2e", maxError);
+            printf("%10s %9s %18.1f %9.2fx %12s%s\n", gridName, isReference ? "std::sin" : simdLevelName(levels[l]),
+                   rate, rate / stdRate, error, identical ? "" : "  MISMATCH vs scalar");
+            fflush(stdout);
+        }
+    }
+}
+
+// ---------- FLOCK ----------
+
+void runFlockBenchmark() {
+    // At the same density, then the largest flock in the scene's own sky,
+    // where the cells are far more crowded
+    const int sizes[] = {1000, 10000, 100000, 100000};
+    const bool inSky[] = {false, false, false, true};
+    const int NUM_SIZES = sizeof(sizes) / sizeof(sizes[0]);
+    // The scalar kernel on one thread, then the best one on 1 to 8
+    const int threads[] = {1, 1, 2, 4, 8};
+    const int NUM_THREADS = sizeof(threads) / sizeof(threads[0]);
+    const float AREA_PER_BIRD = 300.0f; // Crowded: about 3 birds per cell (the scene's sky has 1 per 9 cells)
+    const int SETTLE_TICKS = 100;       // Let flocks form before measuring
+
+    SimdLevel best = std::min(bestSimdLevel(), SIMD_SSE2); // The flock has no AVX2 kernel
+    printf("Flock benchmark: %.0f square units of sky per bird when scaled, the scene's sky otherwise, "
+           "%u hardware threads, best kernel %s\n\n", AREA_PER_BIRD, std::thread::hardware_concurrency(), simdLevelName(best));
+    printf("%8s %6s %7s %8s %9s %9s %9s %10s %8s %10s %8s\n", "birds", "sky", "kernel", "threads", "grid ms",
+           "query ms", "tick ms", "ns/query", "tested", "neighbors", "speedup");
+
+    for (int c = 0; c < NUM_SIZES; ++c) {
+        // A band four times wider than tall, growing with the flock so the
+        // density stays the same
+        float width = 2.0f * std::sqrt(sizes[c] * AREA_PER_BIRD);
+        FlockBounds bounds = {0.0f, width, 0.0f, width / 4.0f};
+        if (inSky[c]) bounds = SKY_BOUNDS;
+        SimState initial;
+        initial.traffic.clear();
+        initial.entities.clear();
+        initial.birds.populate(sizes[c], bounds, DEFAULT_FLOCK_SEED);
+
+        unsigned long long reference = 0;
+        double serialMs = 0.0;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            TaskPool pool;
+            pool.start(threads[t]);
+            SimdLevel level = t == 0 ? SIMD_SCALAR : best;
+
+            // Birds only read the last tick, so any thread count or kernel gives the same flock
+            SimState s = initial;
+            s.birds.setSimdLevel(level);
+            for (int i = 0; i < SETTLE_TICKS; ++i) stepSimulation(s, &pool);
+            unsigned long long checksum = stateChecksum(s);
+            if (t == 0) reference = checksum;
+
+            double gridMs = 0.0, steerMs = 0.0;
+            long long candidates = 0, neighbors = 0;
+            int ticks = 0;
+            BenchClock::time_point start = BenchClock::now();
+            while (ticks < 10 || msSince(start) < 300.0) {
+                stepSimulation(s, &pool);
+                const FlockStats& stats = s.birds.getStats();
+                gridMs += stats.gridMs;
+                steerMs += stats.steerMs;
+                candidates += stats.candidates;
+                neighbors += stats.neighbors;
+                ++ticks;
+            }
+            double tickMs = msSince(start) / ticks;
+            if (t == 0) serialMs = tickMs;
+            double queries = (double)ticks * sizes[c];
+
+            printf("%8d %6s %7s %8d %9.3f %9.3f %9.3f %10.1f %8.1f %10.1f %7.2fx%s\n", sizes[c],
+                   inSky[c] ? "scene" : "scaled", simdLevelName(level), threads[t], gridMs / ticks, steerMs / ticks, tickMs, steerMs * 1e6 / queries, candidates / queries,
+                   neighbors / queries, serialMs / tickMs, checksum == reference ? "" : "  MISMATCH vs scalar");
+            fflush(stdout);
+        }
+    }
+}
+
+// ---------- PARTICLES ----------
+
+// Smoke-like particles filling the default screen, living 1.5 to 2.5 s
+static const ParticleStyle BENCH_PARTICLE_STYLE = {12.0f, 0.6f, 2.0f, 6.0f, {230, 230, 230, 200}, {200, 200, 200, 0}};
+static const ParticleBurst BENCH_PARTICLE_BURST = {400.0f, 300.0f, 0.0f, 10.0f, 400.0f, 300.0f, 20.0f, 2.0f, 0.5f};
+
+struct ParticleFrameTimes {
+    double spawnMs = 0.0, updateMs = 0.0, buildMs = 0.0, drawMs = 0.0;
+};
+
+// One 60 Hz frame of a pool kept at about its target live count
+static void stepBenchParticles(ParticlePool& pool, SimdLevel level, int perFrame, ParticleFrameTimes& times) {
+    BenchClock::time_point start = BenchClock::now();
+    pool.spawn(BENCH_PARTICLE_BURST, perFrame);
+    times.spawnMs += msSince(start);
+    start = BenchClock::now();
+    pool.update(1.0f / 60.0f, level);
+    times.updateMs += msSince(start);
+}
+
+void runParticleBenchmark() {
+    const int counts[] = {10000, 100000, 500000, 1000000};
+    const int NUM_COUNTS = sizeof(counts) / sizeof(counts[0]);
+    const SimdLevel levels[] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+    const int NUM_LEVELS = sizeof(levels) / sizeof(levels[0]);
+    const int WARMUP_FRAMES = 180; // Past the longest life: spawns and deaths balance
+    const int FRAMES = 60;
+    const int DRAW_FRAMES = 10; // Software renderers take seconds at 1M
+    const double BUDGET_MS = 1000.0 / 60.0;
+
+    SimdLevel best = bestSimdLevel();
+    printf("Particle benchmark (%s, best kernel on this CPU: %s)\n", glGetString(GL_RENDERER), simdLevelName(best));
+    printf("One 60 Hz frame of a single pool in steady state; draw includes glFinish\n\n");
+    printf("%9s %8s %9s %10s %9s %9s %9s %10s\n", "live", "kernel", "spawn ms", "update ms", "build ms",
+           "draw ms", "total ms", "60 fps");
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0.0, 800.0, 0.0, 600.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    float pixelsPerUnit = viewport[2] / 800.0f;
+
+    ParticleBatch batch;
+    std::vector<ParticleVertex> vertices, scalarVertices;
+    for (int c = 0; c < NUM_COUNTS; ++c) {
+        // Spawn as many per frame as die, with a margin for the spread of lives
+        int perFrame = counts[c] / (int)(BENCH_PARTICLE_BURST.life * 60.0f);
+        ParticlePool warm(counts[c] + counts[c] / 2, BENCH_PARTICLE_STYLE);
+        ParticleFrameTimes ignored;
+        for (int f = 0; f < WARMUP_FRAMES; ++f) stepBenchParticles(warm, SIMD_SCALAR, perFrame, ignored);
+        warm.buildVertices(vertices); // Grow the vertex array outside the timing
+
+        for (int l = 0; l < NUM_LEVELS && levels[l] <= best; ++l) {
+            // Every level runs the same frames from the same state
+            ParticlePool pool = warm;
+            ParticleFrameTimes times;
+            for (int f = 0; f < FRAMES; ++f) stepBenchParticles(pool, levels[l], perFrame, times);
+
+            bool identical = true;
+            bool drawn = levels[l] == best;
+            int builds = drawn ? DRAW_FRAMES : 1;
+            for (int f = 0; f < builds; ++f) {
+                BenchClock::time_point start = BenchClock::now();
+                pool.buildVertices(vertices);
+                times.buildMs += msSince(start);
+                if (!drawn) continue;
+                start = BenchClock::now();
+                glClear(GL_COLOR_BUFFER_BIT);
+                batch.draw(vertices, BENCH_PARTICLE_STYLE, pixelsPerUnit);
+                glFinish();
+                times.drawMs += msSince(start);
+            }
+            if (levels[l] == SIMD_SCALAR) {
+                scalarVertices = vertices;
+            } else {
+                identical = vertices.size() == scalarVertices.size() &&
+                            memcmp(&vertices[0], &scalarVertices[0], vertices.size() * sizeof(ParticleVertex)) == 0;
+            }
+
+            double spawnMs = times.spawnMs / FRAMES, updateMs = times.updateMs / FRAMES;
+            double buildMs = times.buildMs / builds;
+            if (drawn) {
+                double drawMs = times.drawMs / DRAW_FRAMES;
+                double total = spawnMs + updateMs + buildMs + drawMs;
+                printf("%9d %8s %9.3f %10.3f %9.3f %9.3f %9.3f %10s%s\n", pool.liveCount(), simdLevelName(levels[l]),
+                       spawnMs, updateMs, buildMs, drawMs, total, total <= BUDGET_MS ? "yes" : "no",
+                       identical ? "" : "  MISMATCH vs scalar");
+            } else {
+                printf("%9d %8s %9.3f %10.3f %9.3f %9s %9s %10s%s\n", pool.liveCount(), simdLevelName(levels[l]),
+                       spawnMs, updateMs, buildMs, "-", "-", "", identical ? "" : "  MISMATCH vs scalar");
+            }
+            fflush(stdout);
+        }
+    }
+    batch.release();
+}
+
+// ---------- TRAFFIC ----------
+
+void runTrafficBenchmark() {
+    const int totals[] = {10000, 100000, 1000000};
+    const int NUM_TOTALS = sizeof(totals) / sizeof(totals[0]);
+    const int threads[] = {1, 2, 4, 8};
+    const int NUM_THREADS = sizeof(threads) / sizeof(threads[0]);
+    const int LANES_PER_DIRECTION = 8;
+    const int VERIFY_TICKS = 100;
+
+    printf("Traffic benchmark: %d lanes each way, %u hardware threads\n\n",
+           LANES_PER_DIRECTION, std::thread::hardware_concurrency());
+    printf("%10s %8s %18s %9s\n", "vehicles", "threads", "M vehicles/sec", "scaling");
+
+    for (int c = 0; c < NUM_TOTALS; ++c) {
+        SimState initial;
+        initial.traffic.populate(LANES_PER_DIRECTION, totals[c] / (2 * LANES_PER_DIRECTION));
+        int vehicles = initial.traffic.vehicleCount();
+
+        unsigned long long reference = 0;
+        double serialRate = 0.0;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            TaskPool pool;
+            pool.start(threads[t]);
+
+            // Lanes are independent, so any thread count gives the same state
+            SimState s = initial;
+            for (int i = 0; i < VERIFY_TICKS; ++i) stepSimulation(s, &pool);
+            unsigned long long checksum = stateChecksum(s);
+            if (t == 0) reference = checksum;
+
+            long long updates = 0;
+            BenchClock::time_point start = BenchClock::now();
+            while (msSince(start) < 300.0) {
+                for (int i = 0; i < 10; ++i) stepSimulation(s, &pool);
+                updates += 10LL * vehicles;
+            }
+            double rate = updates / (msSince(start) * 1000.0); // Millions per second
+            if (t == 0) serialRate = rate;
+
+            printf("%10d %8d %18.1f %8.2fx%s\n", vehicles, threads[t], rate, rate / serialRate,
+                   checksum == reference ? "" : "  MISMATCH vs 1 thread");
+            fflush(stdout);
+        }
+    }
+
+    // One crowded lane settles, then the player car (vehicle 0) brakes
+    // hard. Vehicle k is k places behind it.
+    const int PER_LANE = 40;
+    const int SETTLE_TICKS = 2000, BRAKE_TICKS = 100, WATCH_TICKS = 1000;
+    const int watched[] = {1, 2, 5, 10, 20, 30};
+    const int NUM_WATCHED = sizeof(watched) / sizeof(watched[0]);
+
+    SimState s;
+    s.traffic.populate(1, PER_LANE);
+    for (int i = 0; i < SETTLE_TICKS; ++i) stepSimulation(s);
+    float cruise = s.traffic.lane(0).vel[0];
+
+    std::vector<int> reacted(PER_LANE, -1);
+    std::vector<float> slowest(PER_LANE, cruise);
+    float playerSpeed = s.carSpeed;
+    for (int tick = 0; tick < WATCH_TICKS; ++tick) {
+        s.carSpeed = tick < BRAKE_TICKS ? 1.0f : playerSpeed;
+        stepSimulation(s);
+        for (int k = 1; k < PER_LANE; ++k) {
+            if (reacted[k] < 0 && s.traffic.lane(0).vel[k] < 0.95f * cruise) reacted[k] = tick;
+            slowest[k] = std::min(slowest[k], s.traffic.lane(0).vel[k]);
+        }
+    }
+
+    printf("\nShockwave: %d cars in one lane at %.2f units/tick; the first brakes to 1 for %.1f s\n\n",
+           PER_LANE, cruise, BRAKE_TICKS * SIM_TICK_SECONDS);
+    printf("%14s %16s %14s\n", "cars behind", "5% slower after", "lowest speed");
+    for (int w = 0; w < NUM_WATCHED; ++w) {
+        int k = watched[w];
+        if (reacted[k] < 0) {
+            printf("%14d %16s %14.2f\n", k, "never", slowest[k]);
+        } else {
+            printf("%14d %15.2fs %14.2f\n", k, reacted[k] * SIM_TICK_SECONDS, slowest[k]);
+        }
+    }
+}
+
+// ---------- VIEW CULLING ----------
+
+// Whole display() frames; the warm-up one rebuilds the index and refills
+// the instance buffers
+static double timeSceneFrames(int minFrames, double minMs) {
+    return timeDraws(display, minFrames, minMs);
+}
+
+const float SCREEN_WIDTH = 800.0f;
+
+// The default street repeated n times, every SCREEN_WIDTH units. The
+// layout points into the vectors, so it lives as long as the street.
+struct RepeatedStreet {
+    std::vector<Building> buildings;
+    std::vector<ScenePoint> trees, lights, mosques, playgrounds, benches;
+    SceneLayout layout;
+};
+
+static void buildRepeatedStreet(int n, RepeatedStreet& street) {
+    std::vector<Building>& buildings = street.buildings;
+    std::vector<ScenePoint>& trees = street.trees;
+    std::vector<ScenePoint>& lights = street.lights;
+    std::vector<ScenePoint>& mosques = street.mosques;
+    std::vector<ScenePoint>& playgrounds = street.playgrounds;
+    std::vector<ScenePoint>& benches = street.benches;
+    for (int k = 0; k < n; ++k) {
+        float dx = k * SCREEN_WIDTH;
+        Building b0 = {100.0f + dx, 200.0f, 60.0f, 80.0f};
+        Building b1 = {300.0f + dx, 200.0f, 80.0f, 120.0f};
+        Building b2 = {450.0f + dx, 200.0f, 50.0f, 70.0f};
+        buildings.push_back(b0);
+        buildings.push_back(b1);
+        buildings.push_back(b2);
+        for (int i = 0; i < 3; ++i) {
+            ScenePoint light = {150.0f + 200.0f * i + dx, 200.0f};
+            ScenePoint tree = {750.0f - 50.0f * i + dx, 200.0f};
+            lights.push_back(light);
+            trees.push_back(tree);
+        }
+        ScenePoint mosque = {20.0f + dx, 200.0f};
+        ScenePoint playground = {500.0f + dx, 200.0f};
+        ScenePoint bench = {620.0f + dx, 200.0f};
+        mosques.push_back(mosque);
+        playgrounds.push_back(playground);
+        benches.push_back(bench);
+    }
+
+    SceneLayout& layout = street.layout;
+    layout.buildings = &buildings[0];
+    layout.numBuildings = buildings.size();
+    layout.trees = &trees[0];
+    layout.numTrees = trees.size();
+    layout.streetLights = &lights[0];
+    layout.numStreetLights = lights.size();
+    layout.mosques = &mosques[0];
+    layout.numMosques = mosques.size();
+    layout.playgrounds = &playgrounds[0];
+    layout.numPlaygrounds = playgrounds.size();
+    layout.benches = &benches[0];
+    layout.numBenches = benches.size();
+}
+
+// The generated layouts only live for one row; the scene index built from
+// each is the last thing that reads them.
+void runCullingBenchmark() {
+    const int screens[] = {1, 10, 100, 1000, 10000};
+    const int NUM_SIZES = sizeof(screens) / sizeof(screens[0]);
+
+    printf("View culling benchmark (%s)\n", glGetString(GL_RENDERER));
+    printf("World: the default street repeated every %.0f units, default view\n\n", SCREEN_WIDTH);
+    printf("%8s %10s %8s %8s %12s %14s %9s\n",
+           "screens", "entities", "drawn", "culled", "culled ms", "unculled ms", "speedup");
+
+    // Measures drawing the static layers, so they must not come from the cache
+    bool cacheWasEnabled = staticCacheEnabled;
+    staticCacheEnabled = false;
+
+    for (int s = 0; s < NUM_SIZES; ++s) {
+        int n = screens[s];
+        RepeatedStreet street;
+        buildRepeatedStreet(n, street);
+        const SceneLayout& layout = street.layout;
+        setSceneLayout(layout);
+
+        cullingEnabled = true;
+        double culledMs = timeSceneFrames(3, 250.0);
+        CullStats stats = lastCullStats;
+
+        // Re-submit everything; setSceneLayout() forces the instance refill
+        cullingEnabled = false;
+        setSceneLayout(layout);
+        double unculledMs = timeSceneFrames(1, 250.0);
+        cullingEnabled = true;
+
+        printf("%8d %10zu %8d %8d %12.3f %14.3f %8.1fx\n", n, layout.totalCount(),
+               stats.drawn, stats.culled, culledMs, unculledMs, unculledMs / culledMs);
+        fflush(stdout);
+    }
+    staticCacheEnabled = cacheWasEnabled;
+}
+
+// ---------- STATIC LAYER CACHE ----------
+
+void runStaticCacheBenchmark() {
+    const float zooms[] = {1.0f, 0.5f, 0.25f};
+    const int NUM_ZOOMS = sizeof(zooms) / sizeof(zooms[0]);
+
+    printf("Static layer cache benchmark (%s)\n", glGetString(GL_RENDERER));
+    printf("World: the default street repeated 16 times; zooming out shows more of it\n\n");
+    printf("%6s %14s %16s %14s %12s %10s %9s\n",
+           "zoom", "static verts", "uncached verts", "cached verts", "uncached ms", "cached ms", "speedup");
+
+    RepeatedStreet street;
+    buildRepeatedStreet(16, street);
+    setSceneLayout(street.layout);
+    bool cacheWasEnabled = staticCacheEnabled;
+    float centerX = camera.getCenterX(), centerY = camera.getCenterY(), zoom = camera.getZoom();
+    camera.setCenter(16 * SCREEN_WIDTH / 2.0f, centerY);
+
+    for (int z = 0; z < NUM_ZOOMS; ++z) {
+        camera.setZoom(zooms[z]);
+
+        staticCacheEnabled = false;
+        double uncachedMs = timeSceneFrames(3, 250.0);
+        StaticCacheStats uncached = lastStaticCache;
+
+        staticCacheEnabled = true;
+        double cachedMs = timeSceneFrames(3, 250.0);
+        StaticCacheStats cached = lastStaticCache;
+
+        printf("%6.2f %14d %16d %14d %12.3f %10.3f %8.1fx\n", zooms[z], uncached.staticVertices,
+               uncached.totalVertices, cached.totalVertices, uncachedMs, cachedMs, uncachedMs / cachedMs);
+        fflush(stdout);
+    }
+
+    staticCacheEnabled = cacheWasEnabled;
+    camera.setCenter(centerX, centerY);
+    camera.setZoom(zoom);
+}
+
+// The static cache is off, so every frame draws the levels it picked
+void runLodBenchmark() {
+    const float zooms[] = {2.0f, 1.0f, 0.5f, 0.25f};
+    const int NUM_ZOOMS = sizeof(zooms) / sizeof(zooms[0]);
+
+    printf("Level of detail benchmark (%s)\n", glGetString(GL_RENDERER));
+    printf("World: the default street repeated 16 times; vertices are those of curved and distant objects\n\n");
+    printf("%6s %12s %11s %9s %10s %9s %9s\n",
+           "zoom", "full verts", "LOD verts", "saved", "full ms", "LOD ms", "speedup");
+
+    RepeatedStreet street;
+    buildRepeatedStreet(16, street);
+    setSceneLayout(street.layout);
+    bool cacheWasEnabled = staticCacheEnabled, lodWasEnabled = lodEnabled;
+    float centerX = camera.getCenterX(), centerY = camera.getCenterY(), zoom = camera.getZoom();
+    camera.setCenter(16 * SCREEN_WIDTH / 2.0f, centerY);
+    staticCacheEnabled = false;
+
+    for (int z = 0; z < NUM_ZOOMS; ++z) {
+        camera.setZoom(zooms[z]);
+
+        lodEnabled = false;
+        double fullMs = timeSceneFrames(3, 250.0);
+        LodFrameStats full = lastLodFrame;
+
+        lodEnabled = true;
+        double lodMs = timeSceneFrames(3, 250.0);
+        LodFrameStats lod = lastLodFrame;
+
+        printf("%6.2f %12d %11d %8.1f%% %10.3f %9.3f %8.2fx\n", zooms[z], full.vertices, lod.vertices,
+               full.vertices > 0 ? 100.0 * (1.0 - (double)lod.vertices / full.vertices) : 0.0,
+               fullMs, lodMs, fullMs / lodMs);
+        fflush(stdout);
+    }
+
+    staticCacheEnabled = cacheWasEnabled;
+    lodEnabled = lodWasEnabled;
+    camera.setCenter(centerX, centerY);
+    camera.setZoom(zoom);
+}
+
+// The static cache is off, so every frame submits the static layers too
+void runRenderQueueBenchmark() {
+    const float zooms[] = {1.0f, 0.5f, 0.25f};
+    const int NUM_ZOOMS = sizeof(zooms) / sizeof(zooms[0]);
+
+    printf("Render queue benchmark (%s)\n", glGetString(GL_RENDERER));
+    printf("World: the default street repeated 16 times; counts are per frame, for the draws after the sky\n\n");
+    printf("%6s %6s %7s %8s %9s %8s %7s %9s %9s %8s %10s\n", "zoom", "queue", "draws", "programs",
+           "uniforms", "buffers", "arrays", "pointers", "matrices", "total", "frame ms");
+
+    RepeatedStreet street;
+    buildRepeatedStreet(16, street);
+    setSceneLayout(street.layout);
+    bool cacheWasEnabled = staticCacheEnabled, queueWasEnabled = renderQueueEnabled;
+    float centerX = camera.getCenterX(), centerY = camera.getCenterY(), zoom = camera.getZoom();
+    camera.setCenter(16 * SCREEN_WIDTH / 2.0f, centerY);
+    staticCacheEnabled = false;
+
+    for (int z = 0; z < NUM_ZOOMS; ++z) {
+        camera.setZoom(zooms[z]);
+        for (int sorted = 0; sorted < 2; ++sorted) {
+            renderQueueEnabled = sorted != 0;
+            double ms = timeSceneFrames(3, 250.0);
+            const RenderStateCounters& c = lastRenderQueue.state;
+            printf("%6.2f %6s %7lld %8lld %9lld %8lld %7lld %9lld %9lld %8lld %10.3f\n", zooms[z],
+                   sorted ? "sorted" : "off", c.draws, c.programs, c.uniforms, c.buffers, c.arrays,
+                   c.pointers, c.matrices, c.stateChanges(), ms);
+            fflush(stdout);
+        }
+    }
+
+    staticCacheEnabled = cacheWasEnabled;
+    renderQueueEnabled = queueWasEnabled;
+    camera.setCenter(centerX, centerY);
+    camera.setZoom(zoom);
+}
+
+// ---------- FRAME PACING ----------
+
+const double PACING_RUN_MS = 2000.0;
+
+static double clockMs() {
+    return std::chrono::duration<double, std::milli>(BenchClock::now().time_since_epoch()).count();
+}
+
+// One timer callback's worth of work: advance by the real time since the
+// last one, then draw a frame and wait for it
+static void pacedFrame(double& lastAdvanceMs, double nowMs) {
+    advanceScene((nowMs - lastAdvanceMs) / 1000.0);
+    lastAdvanceMs = nowMs;
+    display();
+    glFinish();
+}
+
+// missed < 0: the row has no deadlines to miss
+static void printPacingRow(const char* name, const FrameIntervalHistogram& h, long long frames,
+                           long long skipped, long long missed) {
+    double mean = h.meanIntervalMs();
+    char missedText[24] = "-";
+    if (missed >= 0) snprintf(missedText, sizeof(missedText), "%lld", missed);
+    printf("%-22s %7lld %8lld %7s %10.3f %7.1f %11.3f %10.2f %10.3f\n", name, frames, skipped, missedText,
+           mean, mean > 0.0 ? 1000.0 / mean : 0.0, h.meanJitterMs(), h.jitterPercentileMs(0.99), h.maxJitterMs());
+}
+
+// The pacer driven like the GLUT timer: the timer fires, the pacer says
+// whether to draw and re-arms it in whole milliseconds. changeEvery > 0
+// stands the scene still except every changeEvery-th deadline (input).
+static void runPacer(FramePacer& pacer, int changeEvery) {
+    double start = clockMs(), lastAdvance = start;
+    for (int slot = 0; clockMs() - start < PACING_RUN_MS; ++slot) {
+        double fired = clockMs();
+        bool changed = changeEvery <= 0 || slot % changeEvery == 0;
+        bool draw = pacer.frameDue(fired, changed);
+        int delay = pacer.delayToNextMs(fired);
+        if (draw) {
+            pacedFrame(lastAdvance, fired);
+            pacer.framePresented(clockMs());
+        }
+        std::this_thread::sleep_until(BenchClock::now() +
+            std::chrono::duration<double, std::milli>(fired + delay - clockMs()));
+    }
+}
+
+void runPacingBenchmark() {
+    printf("Frame pacing benchmark (%s)\n", glGetString(GL_RENDERER));
+    printf("%.0f ms of real time per row; jitter is |interval - target|, the target being 60 fps unless stated\n",
+           PACING_RUN_MS);
+    printf("(intervals are only measured between frames for back-to-back deadlines)\n\n");
+    printf("%-22s %7s %8s %7s %10s %7s %11s %10s %10s\n", "mode", "frames", "skipped", "missed",
+           "mean ms", "fps", "jitter ms", "p99 ms", "max ms");
+
+    // Before: a 16 ms timer re-armed from whenever it fired
+    FrameIntervalHistogram fixedTimer;
+    {
+        const double target = 1000.0 / DEFAULT_TARGET_FPS;
+        double start = clockMs(), lastAdvance = start, lastPresent = -1.0;
+        long long frames = 0;
+        while (clockMs() - start < PACING_RUN_MS) {
+            double fired = clockMs();
+            pacedFrame(lastAdvance, fired);
+            double presented = clockMs();
+            if (lastPresent >= 0.0) fixedTimer.record(presented - lastPresent, target);
+            lastPresent = presented;
+            ++frames;
+            std::this_thread::sleep_until(BenchClock::now() +
+                std::chrono::duration<double, std::milli>(fired + 16.0 - clockMs()));
+        }
+        printPacingRow("fixed 16 ms timer", fixedTimer, frames, 0, -1);
+        fflush(stdout);
+    }
+
+    FramePacer at60, at30, onDemand;
+    at60.setMode(PACING_TARGET_FPS);
+    runPacer(at60, 0);
+    printPacingRow("pacer, 60 fps", at60.histogram(), at60.counters().presented, 0, at60.counters().missed);
+    fflush(stdout);
+
+    at30.setTargetFps(30.0);
+    runPacer(at30, 0);
+    printPacingRow("pacer, 30 fps", at30.histogram(), at30.counters().presented, 0, at30.counters().missed);
+    fflush(stdout);
+
+    // Still scene, input twice a second
+    onDemand.setMode(PACING_ON_DEMAND);
+    runPacer(onDemand, 30);
+    printPacingRow("on demand, still", onDemand.histogram(), onDemand.counters().presented,
+                   onDemand.counters().unchanged, onDemand.counters().missed);
+
+    printf("\nIntervals, fixed 16 ms timer:\n");
+    fixedTimer.print(stdout);
+    printf("Intervals, pacer at 60 fps:\n");
+    at60.histogram().print(stdout);
+}
+
+// ---------- PARALLEL FRAME BUILD ----------
+
+void runFrameBuildBenchmark() {
+    const int counts[] = {1000, 4000, 16000};
+    const int NUM_COUNTS = sizeof(counts) / sizeof(counts[0]);
+    const int threads[] = {1, 2, 4, 8};
+    const int NUM_THREADS = sizeof(threads) / sizeof(threads[0]);
+
+    printf("Frame build benchmark (%s, %u hardware threads)\n",
+           glGetString(GL_RENDERER), std::thread::hardware_concurrency());
+    printf("Moving layers (sea, sailboats, ships, cars, birds) built as parallel vertex streams\n\n");
+    printf("%10s %8s %10s %10s %11s %9s\n", "per kind", "threads", "vertices", "build ms", "submit ms", "scaling");
+
+    for (int c = 0; c < NUM_COUNTS; ++c) {
+        populateScene(counts[c]);
+        double serialMs = 0.0;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            setFrameThreads(threads[t]);
+            display(); // Warm-up: buffers and streams grow to size
+            glFinish();
+
+            double buildMs = 0.0, submitMs = 0.0;
+            int frames = 0;
+            BenchClock::time_point start = BenchClock::now();
+            while (frames < 3 || msSince(start) < 250.0) {
+                display();
+                glFinish();
+                buildMs += lastFrameBuild.buildMs;
+                submitMs += lastFrameBuild.submitMs;
+                ++frames;
+            }
+            buildMs /= frames;
+            submitMs /= frames;
+            if (t == 0) serialMs = buildMs;
+
+            printf("%10d %8d %10d %10.3f %11.3f %8.2fx\n", counts[c], threads[t],
+                   lastFrameBuild.vertices, buildMs, submitMs, serialMs / buildMs);
+            fflush(stdout);
+        }
+    }
+    setFrameThreads(0);
+}
+
+// ---------- LOGGER ----------
+
+enum LogBenchMode { LOG_BENCH_SYNC, LOG_BENCH_TEXT, LOG_BENCH_BINARY, NUM_LOG_BENCH_MODES };
+
+struct LogBenchThread {
+    double totalNs = 0.0;
+    double worstNs = 0.0;
+};
+
+// Bursts of key-handler-like events with pauses between, so the writer
+// can catch up unless the bursts outgrow the ring
+static void logBurstsFrom(int thread, LogBenchMode mode, FILE* out, int bursts, int perBurst,
+                          LogBenchThread& result) {
+    for (int b = 0; b < bursts; ++b) {
+        for (int i = 0; i < perBurst; ++i) {
+            float speed = (float)((i + thread) % 15 + 1);
+            BenchClock::time_point start = BenchClock::now();
+            if (mode == LOG_BENCH_SYNC) {
+                fprintf(out, "Car Speed: %g lane %d burst %d\n", speed, thread, b);
+                fflush(out);
+            } else {
+                LOG_EVENT(LOG_INFO, "Car Speed: %g lane %d burst %d", speed, thread, b);
+            }
+            double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+            result.totalNs += ns;
+            result.worstNs = std::max(result.worstNs, ns);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+
+void runLoggerBenchmark() {
+    const int threads[] = {1, 2, 4, 8};
+    const int NUM_THREADS = sizeof(threads) / sizeof(threads[0]);
+    const char* MODE_NAMES[NUM_LOG_BENCH_MODES] = {"fprintf+flush", "async text", "async binary"};
+    const int BURSTS = 50, PER_BURST = 1000;
+
+    printf("Logger benchmark: %d bursts of %d events per thread, %d-slot ring, %u hardware threads\n\n",
+           BURSTS, PER_BURST, LOG_RING_SLOTS, std::thread::hardware_concurrency());
+    printf("%-14s %8s %12s %12s %10s %10s %10s\n", "mode", "threads", "ns/event", "worst us",
+           "written", "dropped", "drain ms");
+
+    for (int m = 0; m < NUM_LOG_BENCH_MODES; ++m) {
+        LogBenchMode mode = (LogBenchMode)m;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            FILE* out = tmpfile();
+            if (!out) {
+                printf("Cannot create a temporary file\n");
+                return;
+            }
+            if (mode != LOG_BENCH_SYNC) startLogger(out, mode == LOG_BENCH_TEXT ? LOG_TEXT : LOG_BINARY);
+
+            std::vector<LogBenchThread> results(threads[t]);
+            std::vector<std::thread> workers;
+            for (int i = 0; i < threads[t]; ++i) {
+                workers.push_back(std::thread(logBurstsFrom, i, mode, out, BURSTS, PER_BURST, std::ref(results[i])));
+            }
+            for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+
+            BenchClock::time_point drainStart = BenchClock::now();
+            long long written = (long long)threads[t] * BURSTS * PER_BURST, dropped = 0;
+            if (mode != LOG_BENCH_SYNC) {
+                stopLogger();
+                LogStats stats = loggerStats();
+                written = stats.written;
+                dropped = stats.dropped;
+            }
+            double drainMs = msSince(drainStart);
+            fclose(out);
+
+            double totalNs = 0.0, worstNs = 0.0;
+            for (size_t i = 0; i < results.size(); ++i) {
+                totalNs += results[i].totalNs;
+                worstNs = std::max(worstNs, results[i].worstNs);
+            }
+            printf("%-14s %8d %12.1f %12.1f %10lld %10lld %10.2f\n", MODE_NAMES[m], threads[t],
+                   totalNs / ((double)threads[t] * BURSTS * PER_BURST), worstNs / 1000.0, written, dropped, drainMs);
+            fflush(stdout);
+        }
+    }
+}
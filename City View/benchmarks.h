@@ -0,0 +1,73 @@
+#ifndef CITY_VIEW_BENCHMARKS_H
+#define CITY_VIEW_BENCHMARKS_H
+
+// Command-line benchmark modes. Each expects a current GL context with
+// init() applied and prints its results to stdout.
+
+// --bench-instancing: frame time for trees, street lights, buildings and
+// cars as the instance count grows from 10 to 100k, instanced vs. one
+// draw per instance.
+void runInstancingBenchmark();
+
+// --bench-facades: frame time for 1k to 100k buildings with 6 to 32
+// windows, one polygon per window vs. one procedural facade quad.
+void runFacadeBenchmark();
+
+// --bench-entities: entity-store update throughput, scalar vs. SSE2 vs.
+// AVX2 kernels, from 1k to 1M entities. Needs no GL context.
+void runEntityBenchmark();
+
+// --bench-water: water height field kernel throughput, std::sin vs. the
+// polynomial sine in scalar, SSE2 and AVX2, with the largest height error
+// against std::sin. Needs no GL context.
+void runWaterBenchmark();
+
+// --bench-traffic: traffic update throughput with 1 to 8 threads, from
+// 10k to 1M vehicles, and how far a hard brake spreads back along a lane.
+// Needs no GL context.
+void runTrafficBenchmark();
+
+// --bench-particles: spawn, update (scalar vs. SSE2 vs. AVX2), vertex
+// build and draw time per 60 Hz frame with 10k to 1M live particles.
+void runParticleBenchmark();
+
+// --bench-flock: boids tick time with 1 to 8 threads, from 1k to 100k
+// birds, split into the grid rebuild and the neighbor queries. Needs no
+// GL context.
+void runFlockBenchmark();
+
+// --bench-culling: frame time at the default view as the world grows
+// from 1 to 10k screens wide, with and without view culling.
+void runCullingBenchmark();
+
+// --bench-static-cache: frame time and vertices submitted per frame with
+// the static layers redrawn every frame vs. copied from the layer cache,
+// at zoom levels that show one to four screens of street.
+void runStaticCacheBenchmark();
+
+// --bench-lod: frame time and vertices of the curved and distant objects
+// at full detail vs. with levels of detail, from zoom 2 to zoom 0.25.
+void runLodBenchmark();
+
+// --bench-render-queue: GL state changes, draw calls and frame time with
+// the static layers redrawn every frame, submitted in painter's order one
+// draw at a time vs. through the sorted render queue, from zoom 1 to 0.25.
+void runRenderQueueBenchmark();
+
+// --bench-pacing: frame intervals, jitter and missed deadlines over two
+// seconds of real time with the old fixed 16 ms timer, with the frame
+// pacer at 60 and 30 fps, and on demand with the scene standing still.
+void runPacingBenchmark();
+
+// --bench-frame-build: time to generate the moving layers' vertex streams
+// with 1 to 8 frame threads, from 1k to 16k moving objects per kind.
+void runFrameBuildBenchmark();
+
+// --bench-logger: cost per event on the logging thread and worst single
+// call, with 1 to 8 threads logging in bursts, writing each line straight
+// to the file (what std::endl does) vs. through the asynchronous logger
+// as text and binary; events dropped and time to drain at the end. Needs
+// no GL context.
+void runLoggerBenchmark();
+
+#endif
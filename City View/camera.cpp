@@ -0,0 +1,74 @@
+#include "camera.h"
+#include <GL/glu.h>
+#include <algorithm>
+
+const float Camera::DEFAULT_CENTER_X = 400.0f;
+const float Camera::DEFAULT_CENTER_Y = 300.0f;
+const float Camera::MIN_ZOOM = 0.25f;
+const float Camera::MAX_ZOOM = 8.0f;
+
+static void ortho(const Bounds& b) {
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(b.minX, b.maxX, b.minY, b.maxY);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+void Camera::setBaseSize(float width, float height) {
+    baseWidth = width;
+    baseHeight = height;
+}
+
+void Camera::setCenter(float x, float y) {
+    centerX = x;
+    centerY = y;
+    clampCenter();
+}
+
+void Camera::setZoom(float z) {
+    zoom = std::max(MIN_ZOOM, std::min(z, MAX_ZOOM));
+}
+
+void Camera::reset() {
+    zoom = 1.0f;
+    setCenter(DEFAULT_CENTER_X, DEFAULT_CENTER_Y);
+}
+
+void Camera::pan(float fractionX, float fractionY) {
+    setCenter(centerX + fractionX * baseWidth / zoom, centerY + fractionY * baseHeight / zoom);
+}
+
+void Camera::zoomBy(float factor) {
+    setZoom(zoom * factor);
+}
+
+void Camera::setLimits(const Bounds& b) {
+    limits = b;
+    clampCenter();
+}
+
+void Camera::clampCenter() {
+    centerX = std::max(limits.minX, std::min(centerX, limits.maxX));
+    centerY = std::max(limits.minY, std::min(centerY, limits.maxY));
+}
+
+Bounds Camera::view() const {
+    float halfW = 0.5f * baseWidth / zoom;
+    float halfH = 0.5f * baseHeight / zoom;
+    Bounds b = {centerX - halfW, centerY - halfH, centerX + halfW, centerY + halfH};
+    return b;
+}
+
+Bounds Camera::baseView() const {
+    Bounds b = {DEFAULT_CENTER_X - 0.5f * baseWidth, DEFAULT_CENTER_Y - 0.5f * baseHeight,
+                DEFAULT_CENTER_X + 0.5f * baseWidth, DEFAULT_CENTER_Y + 0.5f * baseHeight};
+    return b;
+}
+
+void Camera::applyProjection() const {
+    ortho(view());
+}
+
+void Camera::applyBaseProjection() const {
+    ortho(baseView());
+}
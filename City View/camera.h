@@ -0,0 +1,47 @@
+#ifndef CITY_VIEW_CAMERA_H
+#define CITY_VIEW_CAMERA_H
+
+#include "geometry.h"
+
+// Pannable, zoomable 2D camera. At zoom 1 centred on the default point it
+// gives exactly the original gluOrtho2D ranges, so the classic 800x600
+// view is unchanged; the world itself can be many screens wide.
+class Camera {
+public:
+    // Size of the view at zoom 1 (800x600, or 1000x800 for the wide ortho)
+    void setBaseSize(float width, float height);
+    void setCenter(float x, float y);
+    void setZoom(float zoom);
+    void reset(); // Back to the default centre and zoom 1
+
+    // Move by a fraction of the current view size (1 = a whole screen)
+    void pan(float fractionX, float fractionY);
+    void zoomBy(float factor); // > 1 zooms in
+
+    // Keep the centre inside these bounds (the world extent)
+    void setLimits(const Bounds& limits);
+
+    Bounds view() const;      // Visible world rectangle
+    Bounds baseView() const;  // View at the default centre and zoom 1 (screen-fixed layers)
+    void applyProjection() const;
+    void applyBaseProjection() const;
+
+    float getCenterX() const { return centerX; }
+    float getCenterY() const { return centerY; }
+    float getZoom() const { return zoom; }
+
+    static const float DEFAULT_CENTER_X;
+    static const float DEFAULT_CENTER_Y;
+    static const float MIN_ZOOM;
+    static const float MAX_ZOOM;
+
+private:
+    void clampCenter();
+
+    float baseWidth = 800.0f, baseHeight = 600.0f;
+    float centerX = DEFAULT_CENTER_X, centerY = DEFAULT_CENTER_Y;
+    float zoom = 1.0f;
+    Bounds limits = {-1e30f, -1e30f, 1e30f, 1e30f}; // Unlimited until the world is known
+};
+
+#endif
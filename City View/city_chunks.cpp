@@ -0,0 +1,321 @@
+#include "city_chunks.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// ---------- GENERATION ----------
+
+size_t ChunkContent::byteSize() const {
+    size_t bytes = road.size() * sizeof(Vertex);
+    for (int l = 0; l < NUM_STATIC_LAYERS; ++l) bytes += layers[l].size() * sizeof(PropInstance);
+    bytes += facades.size() * sizeof(FacadeInstance);
+    return bytes;
+}
+
+// Mix seed and chunk index so neighbouring chunks get unrelated streams
+static uint32_t chunkSeed(uint32_t seed, int index) {
+    uint32_t h = seed ^ 0x9e3779b9u;
+    h ^= (uint32_t)index + 0x7f4a7c15u + (h << 6) + (h >> 2);
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+static void addProp(ChunkContent& out, int layer, float x, float y, float sx, float sy, float variant) {
+    PropInstance inst = {x, y, sx, sy, variant};
+    out.layers[layer].push_back(inst);
+}
+
+void generateChunk(uint32_t seed, int index, ChunkContent& out) {
+    PROFILE_SCOPE("generateChunk");
+    std::mt19937 rng(chunkSeed(seed, index));
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_int_distribution<int> variant(0, NUM_PROP_VARIANTS - 1);
+    float x0 = index * CHUNK_WIDTH;
+    const float GROUND_Y = 200.0f;
+
+    out.index = index;
+    out.cancelled = false;
+    for (int l = 0; l < NUM_STATIC_LAYERS; ++l) out.layers[l].clear();
+    out.facades.clear();
+
+    // Road strip, sometimes with a zebra crossing
+    MeshBuilder mb;
+    mb.setOrigin(x0, 0.0f);
+    drawRoad(mb);
+    if (unit(rng) < 0.3f) {
+        float crossX = 100.0f + unit(rng) * 550.0f;
+        mb.setColor(rgb(1.0f, 1.0f, 1.0f));
+        for (int k = 0; k < 6; ++k) mb.rect(crossX + k * 10.0f, 153.0f, 5.0f, 44.0f);
+    }
+    out.road = mb.getVertices();
+
+    // Seafront lots from the left edge to the park: buildings with the
+    // odd mosque or playground
+    float x = 10.0f + unit(rng) * 30.0f;
+    while (x < 560.0f) {
+        float pick = unit(rng);
+        if (pick < 0.06f && x + 80.0f < 600.0f) {
+            addProp(out, LAYER_MOSQUES, x0 + x, GROUND_Y, 1.0f, 1.0f, 0.0f);
+            x += 80.0f;
+        } else if (pick < 0.12f && x + 160.0f < 600.0f) {
+            addProp(out, LAYER_PLAYGROUNDS, x0 + x + 50.0f, GROUND_Y, 1.0f, 1.0f, 0.0f);
+            x += 160.0f;
+        } else {
+            float w = 40.0f + unit(rng) * 50.0f;
+            float h = 60.0f + unit(rng) * 100.0f;
+            PropInstance building = {x0 + x, GROUND_Y, w, h, (float)variant(rng)};
+            out.facades.push_back(makeFacade(building));
+            x += w;
+        }
+        x += 10.0f + unit(rng) * 60.0f;
+    }
+
+    // Street lights at the original 200-unit spacing
+    for (float lx = 150.0f; lx < CHUNK_WIDTH; lx += 200.0f) {
+        addProp(out, LAYER_STREET_LIGHTS, x0 + lx, GROUND_Y, 1.0f, 1.0f, 0.0f);
+    }
+
+    // Park at the right end: a bench and a few trees
+    if (unit(rng) < 0.4f) {
+        addProp(out, LAYER_BENCHES, x0 + 620.0f + unit(rng) * 20.0f, GROUND_Y, 1.0f, 1.0f, 0.0f);
+    }
+    int trees = (int)(unit(rng) * 5.0f);
+    for (int t = 0; t < trees; ++t) {
+        addProp(out, LAYER_TREES, x0 + 620.0f + unit(rng) * 160.0f, GROUND_Y, 1.0f, 1.0f, (float)variant(rng));
+    }
+}
+
+// ---------- STREAMING ----------
+
+void ChunkStreamer::start(uint32_t s, int workers, size_t budgetBytes) {
+    stop();
+    seed = s;
+    budget = budgetBytes;
+    stats = StreamStats();
+    firstVisible = 0;
+    lastVisible = -1;
+    direction = 1;
+    active = true;
+    pool.start(workers);
+}
+
+void ChunkStreamer::stop() {
+    if (!active) return;
+    pool.stop(); // Running tasks finish, so nothing touches finished afterwards
+    releaseAll();
+    active = false;
+}
+
+ChunkStreamer::~ChunkStreamer() {
+    pool.stop();
+    discardContents();
+}
+
+void ChunkStreamer::releaseAll() {
+    for (std::map<int, Chunk>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        it->second.road.release();
+        for (int l = 0; l < NUM_STATIC_LAYERS; ++l) it->second.layers[l].release();
+        it->second.facades.release();
+    }
+    discardContents();
+}
+
+void ChunkStreamer::discardContents() {
+    chunks.clear();
+    lru.clear();
+    for (size_t i = 0; i < finished.size(); ++i) delete finished[i];
+    finished.clear();
+    for (size_t i = 0; i < uploadQueue.size(); ++i) delete uploadQueue[i];
+    uploadQueue.clear();
+}
+
+void ChunkStreamer::request(int index) {
+    if (chunks.count(index)) return;
+    chunks[index]; // Pending entry, so it is only requested once
+    ++stats.pending;
+
+    uint32_t chunkSeedValue = seed;
+    pool.submit([this, chunkSeedValue, index]() {
+        ChunkContent* content = new ChunkContent();
+        content->index = index;
+        // Skip the work if the camera has already moved on
+        if (index < wantedFirst.load() || index > wantedLast.load()) {
+            content->cancelled = true;
+        } else {
+            generateChunk(chunkSeedValue, index, *content);
+        }
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finished.push_back(content);
+    });
+}
+
+void ChunkStreamer::adoptFinished() {
+    std::vector<ChunkContent*> done;
+    {
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        done.swap(finished);
+    }
+    for (size_t i = 0; i < done.size(); ++i) {
+        if (done[i]->cancelled) {
+            chunks.erase(done[i]->index); // Requested again if it comes back into view
+            --stats.pending;
+            ++stats.cancelled;
+            delete done[i];
+        } else {
+            ++stats.generated;
+            uploadQueue.push_back(done[i]);
+        }
+    }
+
+    // Bounded GL work per frame; visible chunks jump the queue
+    std::stable_partition(uploadQueue.begin(), uploadQueue.end(), [this](const ChunkContent* c) {
+        return c->index >= firstVisible && c->index <= lastVisible;
+    });
+    for (int n = 0; n < MAX_UPLOADS_PER_FRAME && !uploadQueue.empty(); ++n) {
+        ChunkContent* content = uploadQueue.front();
+        uploadQueue.pop_front();
+        upload(content);
+        delete content;
+    }
+}
+
+void ChunkStreamer::upload(ChunkContent* content) {
+    Chunk& chunk = chunks[content->index];
+    chunk.road.upload(content->road);
+    chunk.instanceCount = 0;
+    for (int l = 0; l < NUM_STATIC_LAYERS; ++l) {
+        chunk.layers[l].set(content->layers[l]);
+        chunk.instanceCount += (int)content->layers[l].size();
+    }
+    chunk.facades.set(content->facades);
+    chunk.instanceCount += (int)content->facades.size();
+    chunk.bytes = content->byteSize();
+    chunk.ready = true;
+    lru.push_front(content->index);
+    chunk.lruPos = lru.begin();
+
+    --stats.pending;
+    ++stats.resident;
+    ++stats.uploaded;
+    stats.residentBytes += chunk.bytes;
+    stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes);
+}
+
+void ChunkStreamer::touch(Chunk& chunk) {
+    if (chunk.ready) {
+        lru.splice(lru.begin(), lru, chunk.lruPos);
+    }
+}
+
+void ChunkStreamer::evictOverBudget() {
+    while (stats.residentBytes > budget && !lru.empty()) {
+        int index = lru.back();
+        if (index >= wantedFirst.load() && index <= wantedLast.load()) {
+            break; // Everything older is still in use; the budget is too small for the view
+        }
+        lru.pop_back();
+        Chunk& chunk = chunks[index];
+        chunk.road.release();
+        for (int l = 0; l < NUM_STATIC_LAYERS; ++l) chunk.layers[l].release();
+        chunk.facades.release();
+        stats.residentBytes -= chunk.bytes;
+        --stats.resident;
+        ++stats.evicted;
+        chunks.erase(index);
+    }
+}
+
+void ChunkStreamer::update(const Bounds& view) {
+    if (!active) return;
+
+    firstVisible = (int)std::floor(view.minX / CHUNK_WIDTH);
+    lastVisible = (int)std::floor(view.maxX / CHUNK_WIDTH);
+
+    float centerX = 0.5f * (view.minX + view.maxX);
+    if (centerX > lastCenterX) {
+        direction = 1;
+    } else if (centerX < lastCenterX) {
+        direction = -1;
+    }
+    lastCenterX = centerX;
+
+    // Visible chunks, PREFETCH_CHUNKS ahead of the motion and one behind
+    int first = firstVisible - (direction < 0 ? PREFETCH_CHUNKS : 1);
+    int last = lastVisible + (direction > 0 ? PREFETCH_CHUNKS : 1);
+    wantedFirst.store(first);
+    wantedLast.store(last);
+
+    adoptFinished();
+
+    for (int i = firstVisible; i <= lastVisible; ++i) request(i);
+    if (direction > 0) {
+        for (int i = lastVisible + 1; i <= last; ++i) request(i);
+        for (int i = firstVisible - 1; i >= first; --i) request(i);
+    } else {
+        for (int i = firstVisible - 1; i >= first; --i) request(i);
+        for (int i = lastVisible + 1; i <= last; ++i) request(i);
+    }
+
+    bool missing = false;
+    for (int i = first; i <= last; ++i) {
+        Chunk& chunk = chunks[i];
+        touch(chunk);
+        if (!chunk.ready && i >= firstVisible && i <= lastVisible) missing = true;
+    }
+    if (missing) ++stats.missingFrames;
+
+    evictOverBudget();
+}
+
+// ---------- DRAWING ----------
+
+int ChunkStreamer::queueRoads(RenderQueue& queue, int renderLayer) const {
+    int vertices = 0;
+    for (int i = firstVisible; i <= lastVisible; ++i) {
+        std::map<int, Chunk>::const_iterator it = chunks.find(i);
+        if (it == chunks.end() || !it->second.ready) continue;
+        queue.drawMesh(renderLayer, it->second.road);
+        vertices += it->second.road.vertexCount();
+    }
+    return vertices;
+}
+
+int ChunkStreamer::queueProps(RenderQueue& queue, int renderLayer, int layer, const InstancedProp& prop) const {
+    int instances = 0;
+    for (int i = firstVisible; i <= lastVisible; ++i) {
+        std::map<int, Chunk>::const_iterator it = chunks.find(i);
+        if (it == chunks.end() || !it->second.ready) continue;
+        queue.drawProp(renderLayer, prop, it->second.layers[layer]);
+        instances += it->second.layers[layer].size();
+    }
+    return instances;
+}
+
+int ChunkStreamer::queueFacades(RenderQueue& queue, int renderLayer, const FacadeRenderer& renderer) const {
+    int facades = 0;
+    for (int i = firstVisible; i <= lastVisible; ++i) {
+        std::map<int, Chunk>::const_iterator it = chunks.find(i);
+        if (it == chunks.end() || !it->second.ready) continue;
+        const FacadeBuffer& buffer = it->second.facades;
+        queue.drawCustom(renderLayer, [&renderer, &buffer]() {
+            renderer.draw(buffer);
+            return buffer.size() * FACADE_VERTICES;
+        });
+        facades += it->second.facades.size();
+    }
+    return facades;
+}
+
+void ChunkStreamer::countInstances(int& drawn, int& culled) const {
+    drawn = culled = 0;
+    for (std::map<int, Chunk>::const_iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        if (!it->second.ready) continue;
+        if (it->first >= firstVisible && it->first <= lastVisible) {
+            drawn += it->second.instanceCount;
+        } else {
+            culled += it->second.instanceCount;
+        }
+    }
+}
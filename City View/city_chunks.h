@@ -0,0 +1,128 @@
+#ifndef CITY_VIEW_CITY_CHUNKS_H
+#define CITY_VIEW_CITY_CHUNKS_H
+
+#include "facades.h"
+#include "geometry.h"
+#include "instancing.h"
+#include "render_queue.h"
+#include "scene.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Endless seaside city streamed in CHUNK_WIDTH strips. Workers generate a
+// chunk's props and road from (seed, index) into plain arrays; the render
+// thread only uploads finished chunks, a few per frame, so generation
+// never stalls a frame.
+
+const float CHUNK_WIDTH = 800.0f; // One screen, same as a terrain tile
+
+// Worker output, laid out exactly as the GPU buffers want it
+struct ChunkContent {
+    int index = 0;
+    bool cancelled = false; // Scrolled out of range before it was generated
+    std::vector<PropInstance> layers[NUM_STATIC_LAYERS]; // Buildings are in facades instead
+    std::vector<FacadeInstance> facades;
+    std::vector<Vertex> road;
+
+    size_t byteSize() const;
+};
+
+// Deterministic: the same seed and index always give the same chunk.
+// Touches no GL or global state, so it is safe on any thread.
+void generateChunk(uint32_t seed, int index, ChunkContent& out);
+
+struct StreamStats {
+    int resident = 0;             // Uploaded chunks
+    int pending = 0;              // Queued, generating or waiting for upload
+    size_t residentBytes = 0;
+    size_t peakBytes = 0;
+    unsigned long long generated = 0;
+    unsigned long long uploaded = 0;
+    unsigned long long evicted = 0;
+    unsigned long long cancelled = 0;
+    unsigned long long missingFrames = 0; // Frames with a visible chunk not ready yet
+};
+
+class ChunkStreamer {
+public:
+    ChunkStreamer() {}
+    ~ChunkStreamer(); // Joins the workers; GL objects go away with the context
+
+    // workers <= 0 picks a default; budgetBytes bounds the uploaded chunks
+    void start(uint32_t seed, int workers, size_t budgetBytes);
+    void stop();
+    bool isActive() const { return active; }
+
+    // Once per frame on the render thread: adopt finished chunks, request
+    // and prefetch chunks around the view, evict past the memory budget
+    void update(const Bounds& view);
+
+    // Queue every ready chunk under the view into renderLayer of queue
+    // (road, one prop layer, or the building facades). Return the
+    // vertices and instances queued. Chunk roads never overlap, so they
+    // may share a layer.
+    int queueRoads(RenderQueue& queue, int renderLayer) const;
+    int queueProps(RenderQueue& queue, int renderLayer, int layer, const InstancedProp& prop) const;
+    int queueFacades(RenderQueue& queue, int renderLayer, const FacadeRenderer& renderer) const;
+
+    // Instances in visible chunks vs. resident chunks outside the view
+    void countInstances(int& drawn, int& culled) const;
+
+    const StreamStats& getStats() const { return stats; }
+    int workerCount() const { return pool.threadCount(); }
+    size_t getBudget() const { return budget; }
+
+    static const int PREFETCH_CHUNKS = 2;       // Ahead of the camera's motion
+    static const int MAX_UPLOADS_PER_FRAME = 2;
+
+private:
+    ChunkStreamer(const ChunkStreamer&);
+    ChunkStreamer& operator=(const ChunkStreamer&);
+
+    struct Chunk {
+        bool ready = false; // Uploaded and drawable
+        size_t bytes = 0;
+        int instanceCount = 0;
+        StaticMesh road;
+        InstanceBuffer layers[NUM_STATIC_LAYERS];
+        FacadeBuffer facades;
+        std::list<int>::iterator lruPos;
+    };
+
+    void request(int index);
+    void adoptFinished();
+    void upload(ChunkContent* content);
+    void touch(Chunk& chunk);
+    void evictOverBudget();
+    void releaseAll();
+    void discardContents();
+
+    WorkerPool pool;
+    uint32_t seed = 0;
+    size_t budget = 0;
+    bool active = false;
+
+    std::map<int, Chunk> chunks; // Ready and pending, by index
+    std::list<int> lru;          // Ready chunks, most recently used first
+
+    std::mutex finishedMutex;
+    std::vector<ChunkContent*> finished; // Handed over by the workers
+    std::deque<ChunkContent*> uploadQueue;
+
+    // Window of chunks still worth generating, read by the workers
+    std::atomic<int> wantedFirst{0};
+    std::atomic<int> wantedLast{-1};
+
+    int firstVisible = 0, lastVisible = -1;
+    float lastCenterX = 0.0f;
+    int direction = 1; // Last horizontal motion of the view (+1 right, -1 left)
+    StreamStats stats;
+};
+
+#endif
@@ -0,0 +1,460 @@
+#include "command_trace.h"
+#include "lod.h"
+#include "palette.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+// ---------- RECORDING ----------
+
+void TraceStream::beginScope(const char* name) {
+    record(TRACE_SCOPE_BEGIN, owner->nameIndex(name));
+}
+
+void TraceStream::append(const Vertex* triangles, int count) {
+    record(TRACE_APPEND, owner->modelIndex(triangles, count));
+}
+
+TraceStream* CommandTrace::openStream(Color color, uint8_t palette, float originX, float originY,
+                                      float scaleX, float scaleY, int lodLevel) {
+    std::lock_guard<std::mutex> lock(mutex);
+    streams.emplace_back(this);
+    TraceStream* stream = &streams.back();
+    stream->record(TRACE_STREAM, color, palette, originX, originY, scaleX, scaleY, (uint8_t)lodLevel);
+    return stream;
+}
+
+void CommandTrace::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    streams.clear();
+    names.clear();
+    models.clear();
+    modelSources.clear();
+}
+
+// Names are string literals, but compare them by value: the same function
+// can be inlined into several translation units
+uint16_t CommandTrace::nameIndex(const char* name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (names[i] == name) return (uint16_t)i;
+    }
+    names.push_back(name);
+    return (uint16_t)(names.size() - 1);
+}
+
+// Models are static tables, so one copy per table is enough
+uint16_t CommandTrace::modelIndex(const Vertex* triangles, int count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < modelSources.size(); ++i) {
+        if (modelSources[i] == triangles && (int)models[i].size() == count) return (uint16_t)i;
+    }
+    modelSources.push_back(triangles);
+    models.push_back(std::vector<Vertex>(triangles, triangles + count));
+    return (uint16_t)(models.size() - 1);
+}
+
+size_t CommandTrace::commandBytes() const {
+    size_t n = 0;
+    for (size_t s = 0; s < streams.size(); ++s) n += streams[s].getBytes().size();
+    return n;
+}
+
+// ---------- DECODING ----------
+
+// Reads operands back in the order TraceStream::record() wrote them.
+// Past the end it reads zeros and fails, and then stays done.
+class TraceReader {
+public:
+    TraceReader(const unsigned char* p, size_t n) : at(p), end(p + n) {}
+
+    bool done() const { return failed || at >= end; }
+    bool ok() const { return !failed; }
+    void fail() { failed = true; }
+
+    void read(void* out, size_t n) {
+        if ((size_t)(end - at) < n) {
+            memset(out, 0, n);
+            failed = true;
+            return;
+        }
+        memcpy(out, at, n);
+        at += n;
+    }
+    template <typename T>
+    T get() {
+        T value;
+        read(&value, sizeof(T));
+        return value;
+    }
+
+private:
+    const unsigned char* at;
+    const unsigned char* end;
+    bool failed = false;
+};
+
+struct TraceState {
+    Color color;
+    uint8_t palette;
+    float lineWidth; // Of the last line; < 0 before the first
+};
+
+// Decode the commands and apply them to mb. visit(op, name, verticesAdded,
+// redundant color, line width or -1) sees each one after it ran. Returns
+// false, having stopped, at a command that is cut short or refers to a
+// name, model, palette entry or level that does not exist.
+template <typename Visit>
+static bool replayCommands(const std::vector<unsigned char>& bytes, const std::vector<std::string>& names,
+                           const std::vector<std::vector<Vertex> >& models, MeshBuilder& mb,
+                           std::vector<int>& scopes, TraceState& state, Visit visit) {
+    TraceReader in(bytes.empty() ? nullptr : &bytes[0], bytes.size());
+    while (!in.done()) {
+        TraceOp op = (TraceOp)in.get<uint8_t>();
+        size_t before = mb.getVertices().size();
+        bool redundant = false;
+        float width = -1.0f;
+        switch (op) {
+            case TRACE_STREAM: {
+                state.color = in.get<Color>();
+                state.palette = in.get<uint8_t>();
+                state.lineWidth = -1.0f;
+                float ox = in.get<float>(), oy = in.get<float>(), sx = in.get<float>(), sy = in.get<float>();
+                uint8_t level = in.get<uint8_t>();
+                if (state.palette >= NUM_PALETTE_ENTRIES || level >= NUM_LOD_LEVELS) return false;
+                if (state.palette) mb.setColor((PaletteEntry)state.palette); else mb.setColor(state.color);
+                mb.setOrigin(ox, oy);
+                mb.setScale(sx, sy);
+                mb.setLodLevel(level);
+                scopes.clear();
+                break;
+            }
+            case TRACE_SCOPE_BEGIN: {
+                uint16_t name = in.get<uint16_t>();
+                if (name >= names.size()) return false;
+                scopes.push_back(name);
+                break;
+            }
+            case TRACE_SCOPE_END:
+                if (!scopes.empty()) scopes.pop_back();
+                break;
+            case TRACE_COLOR: {
+                Color c = in.get<Color>();
+                redundant = state.palette == 0 && memcmp(&c, &state.color, sizeof(Color)) == 0;
+                state.color = c;
+                state.palette = 0;
+                mb.setColor(c);
+                break;
+            }
+            case TRACE_PALETTE: {
+                uint8_t entry = in.get<uint8_t>();
+                if (entry >= NUM_PALETTE_ENTRIES) return false;
+                redundant = state.palette == entry;
+                state.palette = entry;
+                mb.setColor((PaletteEntry)entry);
+                break;
+            }
+            case TRACE_ORIGIN: {
+                float x = in.get<float>();
+                mb.setOrigin(x, in.get<float>());
+                break;
+            }
+            case TRACE_SCALE: {
+                float x = in.get<float>();
+                mb.setScale(x, in.get<float>());
+                break;
+            }
+            case TRACE_LOD: {
+                uint8_t level = in.get<uint8_t>();
+                if (level >= NUM_LOD_LEVELS) return false;
+                mb.setLodLevel(level);
+                break;
+            }
+            case TRACE_TRIANGLE: {
+                float v[6];
+                in.read(v, sizeof(v));
+                mb.triangle(v[0], v[1], v[2], v[3], v[4], v[5]);
+                break;
+            }
+            case TRACE_QUAD: {
+                float v[8];
+                in.read(v, sizeof(v));
+                mb.quad(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+                break;
+            }
+            case TRACE_RECT: {
+                float v[4];
+                in.read(v, sizeof(v));
+                mb.rect(v[0], v[1], v[2], v[3]);
+                break;
+            }
+            case TRACE_POLYGON: {
+                int count = in.get<uint16_t>();
+                std::vector<float> xy(2 * count);
+                if (count > 0) in.read(&xy[0], xy.size() * sizeof(float));
+                mb.polygon(xy.empty() ? nullptr : &xy[0], count);
+                break;
+            }
+            case TRACE_FAN: {
+                float v[4];
+                in.read(v, sizeof(v));
+                int segments = in.get<uint16_t>();
+                float start = in.get<float>();
+                mb.fan(v[0], v[1], v[2], v[3], segments, start, in.get<float>());
+                break;
+            }
+            case TRACE_LINE: {
+                float v[5];
+                in.read(v, sizeof(v));
+                mb.line(v[0], v[1], v[2], v[3], v[4]);
+                width = v[4];
+                break;
+            }
+            case TRACE_APPEND: {
+                uint16_t index = in.get<uint16_t>();
+                if (index >= models.size()) return false;
+                const std::vector<Vertex>& model = models[index];
+                mb.append(model.empty() ? nullptr : &model[0], (int)model.size());
+                break;
+            }
+            default:
+                return false; // Not a command: the rest cannot be decoded
+        }
+        if (!in.ok()) return false; // Cut short; the missing operands read as zeros
+        const char* name = scopes.empty() ? nullptr : names[scopes.back()].c_str();
+        visit(op, name, (int)(mb.getVertices().size() - before), redundant, width);
+    }
+    return true;
+}
+
+void CommandTrace::replay(MeshBuilder& mb) const {
+    std::vector<int> scopes;
+    TraceState state;
+    for (size_t s = 0; s < streams.size(); ++s) {
+        replayCommands(streams[s].getBytes(), names, models, mb, scopes, state,
+                       [](TraceOp, const char*, int, bool, float) {});
+    }
+}
+
+long long CommandTrace::commandCount() const {
+    MeshBuilder mb;
+    std::vector<int> scopes;
+    TraceState state;
+    long long count = 0;
+    for (size_t s = 0; s < streams.size(); ++s) {
+        replayCommands(streams[s].getBytes(), names, models, mb, scopes, state,
+                       [&count](TraceOp, const char*, int, bool, float) { ++count; });
+    }
+    return count;
+}
+
+// ---------- ANALYSIS ----------
+
+static bool isPrimitive(TraceOp op) {
+    return op >= TRACE_TRIANGLE && op <= TRACE_APPEND;
+}
+
+std::vector<TraceScopeStats> CommandTrace::analyse() const {
+    std::vector<TraceScopeStats> stats;
+    std::map<std::string, size_t> index;
+    MeshBuilder mb;
+    std::vector<int> scopes;
+    TraceState state;
+    for (size_t s = 0; s < streams.size(); ++s) {
+        replayCommands(streams[s].getBytes(), names, models, mb, scopes, state,
+                       [&](TraceOp op, const char* name, int vertices, bool redundant, float width) {
+            if (op == TRACE_STREAM || op == TRACE_SCOPE_END) return;
+            std::string key = name ? name : "(none)";
+            std::map<std::string, size_t>::iterator it = index.find(key);
+            if (it == index.end()) {
+                it = index.insert(std::make_pair(key, stats.size())).first;
+                stats.push_back(TraceScopeStats());
+                stats.back().name = key;
+            }
+            TraceScopeStats& st = stats[it->second];
+            if (op == TRACE_SCOPE_BEGIN) {
+                ++st.calls;
+                return;
+            }
+            ++st.commands;
+            st.primitives += isPrimitive(op) ? 1 : 0;
+            st.vertices += vertices;
+            if (op == TRACE_COLOR || op == TRACE_PALETTE) {
+                ++st.colorChanges;
+                st.redundantColors += redundant ? 1 : 0;
+            }
+            if (op == TRACE_LINE) {
+                ++st.lines;
+                st.widthChanges += width != state.lineWidth ? 1 : 0;
+                state.lineWidth = width;
+            }
+        });
+        mb.clear();
+    }
+    return stats;
+}
+
+void CommandTrace::printAnalysis(FILE* out) const {
+    std::vector<TraceScopeStats> stats = analyse();
+    TraceScopeStats total;
+    total.name = "total";
+    fprintf(out, "%-22s %6s %8s %10s %9s %8s %9s %7s %9s\n", "draw function", "calls", "commands",
+            "begin/end", "vertices", "colors", "redundant", "lines", "width chg");
+    for (size_t i = 0; i <= stats.size(); ++i) {
+        const TraceScopeStats& s = i < stats.size() ? stats[i] : total;
+        fprintf(out, "%-22.22s %6lld %8lld %10lld %9lld %8lld %9lld %7lld %9lld\n", s.name.c_str(), s.calls,
+                s.commands, s.primitives, s.vertices, s.colorChanges, s.redundantColors, s.lines, s.widthChanges);
+        if (i < stats.size()) {
+            total.calls += s.calls;
+            total.commands += s.commands;
+            total.primitives += s.primitives;
+            total.vertices += s.vertices;
+            total.colorChanges += s.colorChanges;
+            total.redundantColors += s.redundantColors;
+            total.lines += s.lines;
+            total.widthChanges += s.widthChanges;
+        }
+    }
+}
+
+// ---------- FILES ----------
+
+bool CommandTrace::save(const char* path) const {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        std::cerr << "Trace: cannot write " << path << std::endl;
+        return false;
+    }
+    TraceFileHeader header;
+    memcpy(header.magic, TRACE_FILE_MAGIC, 4);
+    header.version = TRACE_FILE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.nameCount = (uint32_t)names.size();
+    header.modelCount = (uint32_t)models.size();
+    header.reserved = 0;
+    header.commandBytes = commandBytes();
+    fwrite(&header, sizeof(header), 1, f);
+    for (size_t i = 0; i < names.size(); ++i) {
+        uint16_t length = (uint16_t)names[i].size();
+        fwrite(&length, sizeof(length), 1, f);
+        fwrite(names[i].data(), 1, length, f);
+    }
+    for (size_t i = 0; i < models.size(); ++i) {
+        uint32_t count = (uint32_t)models[i].size();
+        fwrite(&count, sizeof(count), 1, f);
+        if (count > 0) fwrite(&models[i][0], sizeof(Vertex), count, f);
+    }
+    for (size_t s = 0; s < streams.size(); ++s) {
+        const std::vector<unsigned char>& bytes = streams[s].getBytes();
+        if (!bytes.empty()) fwrite(&bytes[0], 1, bytes.size(), f);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    if (!ok) std::cerr << "Trace: cannot write " << path << std::endl;
+    return ok;
+}
+
+// The loaded commands become one stream; their TRACE_STREAM markers
+// still separate the builders they came from
+bool CommandTrace::load(const char* path) {
+    clear();
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        std::cerr << "Trace: cannot open " << path << std::endl;
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint64_t left = fileSize > (long)sizeof(TraceFileHeader) ? (uint64_t)fileSize - sizeof(TraceFileHeader) : 0;
+
+    TraceFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1;
+    if (!ok || memcmp(header.magic, TRACE_FILE_MAGIC, 4) != 0) {
+        std::cerr << "Trace: " << path << " is not a .cvtrace file" << std::endl;
+        fclose(f);
+        return false;
+    }
+    if (header.version != TRACE_FILE_VERSION || header.vertexSize != sizeof(Vertex)) {
+        std::cerr << "Trace: " << path << " has version " << header.version << ", expected "
+                  << TRACE_FILE_VERSION << std::endl;
+        fclose(f);
+        return false;
+    }
+    // Every size is checked against what is left of the file before it is allocated
+    for (uint32_t i = 0; ok && i < header.nameCount; ++i) {
+        uint16_t length = 0;
+        ok = left >= sizeof(length) && fread(&length, sizeof(length), 1, f) == 1;
+        left -= ok ? sizeof(length) : 0;
+        ok = ok && length <= left;
+        std::string name(ok ? length : 0, ' ');
+        ok = ok && (length == 0 || fread(&name[0], 1, length, f) == length);
+        left -= ok ? length : 0;
+        names.push_back(name);
+    }
+    for (uint32_t i = 0; ok && i < header.modelCount; ++i) {
+        uint32_t count = 0;
+        ok = left >= sizeof(count) && fread(&count, sizeof(count), 1, f) == 1;
+        left -= ok ? sizeof(count) : 0;
+        ok = ok && (uint64_t)count * sizeof(Vertex) <= left;
+        models.push_back(std::vector<Vertex>(ok ? count : 0));
+        ok = ok && (count == 0 || fread(&models.back()[0], sizeof(Vertex), count, f) == count);
+        left -= ok ? (uint64_t)count * sizeof(Vertex) : 0;
+        modelSources.push_back(nullptr);
+    }
+    ok = ok && header.commandBytes == left;
+    std::vector<unsigned char> bytes(ok ? (size_t)header.commandBytes : 0);
+    ok = ok && (bytes.empty() || fread(&bytes[0], 1, bytes.size(), f) == bytes.size());
+    fclose(f);
+
+    // Decode it all once, so replay and analysis only ever see valid commands
+    MeshBuilder scratch;
+    std::vector<int> scopes;
+    TraceState state;
+    ok = ok && replayCommands(bytes, names, models, scratch, scopes, state,
+                              [](TraceOp, const char*, int, bool, float) {});
+    if (!ok) {
+        std::cerr << "Trace: " << path << " is corrupt" << std::endl;
+        clear();
+        return false;
+    }
+    streams.emplace_back(this);
+    streams.back().setBytes(bytes);
+    return true;
+}
+
+// ---------- REPLAY ----------
+
+int runTraceReplay(const char* path, int frames) {
+    CommandTrace trace;
+    if (!trace.load(path)) return 1;
+    long long commands = trace.commandCount();
+    printf("Trace: %s, %lld commands in %zu bytes (%.1f bytes per command)\n\n", path, commands,
+           trace.commandBytes(), commands ? (double)trace.commandBytes() / commands : 0.0);
+    trace.printAnalysis(stdout);
+
+    typedef std::chrono::steady_clock Clock;
+    MeshBuilder mb;
+    StaticMesh mesh;
+    double replayMs = 0.0, drawMs = 0.0;
+    for (int frame = 0; frame < frames; ++frame) {
+        Clock::time_point start = Clock::now();
+        mb.clear();
+        trace.replay(mb);
+        Clock::time_point replayed = Clock::now();
+        mesh.upload(mb);
+        mesh.draw();
+        glFinish();
+        replayMs += std::chrono::duration<double, std::milli>(replayed - start).count();
+        drawMs += std::chrono::duration<double, std::milli>(Clock::now() - replayed).count();
+    }
+    mesh.release();
+
+    printf("\nReplay:      %d times, %d vertices each\n", frames, (int)mb.getVertices().size());
+    printf("Commands:    %.3f ms per replay (%.1f M commands/s)\n", replayMs / frames,
+           replayMs > 0.0 ? commands * frames / replayMs / 1000.0 : 0.0);
+    printf("Upload+draw: %.3f ms per replay\n", drawMs / frames);
+    return 0;
+}
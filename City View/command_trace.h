@@ -0,0 +1,150 @@
+#ifndef CITY_VIEW_COMMAND_TRACE_H
+#define CITY_VIEW_COMMAND_TRACE_H
+
+#include "geometry.h"
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Recording of the geometry commands the draw functions issue. The draw
+// functions are the old immediate-mode code moved onto MeshBuilder:
+// setColor() was glColor, line() was glLineWidth plus GL_LINES, and each
+// fan, polygon or rect was a glBegin/glEnd pair. A MeshBuilder with a
+// trace attached also appends every such call to a compact binary stream,
+// tagged with the draw function (PROFILE_MESH_SCOPE) it came from, so one
+// frame's commands can be saved, replayed headless at full speed and
+// analysed without the live app.
+//
+// File layout (.cvtrace, little-endian):
+//   TraceFileHeader
+//   names: uint16 length + characters, nameCount times
+//   models: uint32 vertex count + Vertex records, modelCount times
+//   commands: one TraceOp byte, then its operands
+
+enum TraceOp : uint8_t {
+    TRACE_STREAM,           // A builder's state as recording starts: Color, uint8 palette, origin, scale, uint8 LOD
+    TRACE_SCOPE_BEGIN,      // uint16 name
+    TRACE_SCOPE_END,
+    TRACE_COLOR,            // Color
+    TRACE_PALETTE,          // uint8 entry
+    TRACE_ORIGIN,           // x, y
+    TRACE_SCALE,            // sx, sy
+    TRACE_LOD,              // uint8 level
+    TRACE_TRIANGLE,         // 6 floats
+    TRACE_QUAD,             // 8 floats
+    TRACE_RECT,             // x, y, width, height
+    TRACE_POLYGON,          // uint16 count, then count x,y pairs
+    TRACE_FAN,              // cx, cy, radiusX, radiusY, uint16 segments, start angle, end angle
+    TRACE_LINE,             // x0, y0, x1, y1, width
+    TRACE_APPEND,           // uint16 model
+    NUM_TRACE_OPS
+};
+
+const char TRACE_FILE_MAGIC[4] = {'C', 'V', 'T', 'R'};
+const uint32_t TRACE_FILE_VERSION = 2;
+
+struct TraceFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize; // sizeof(Vertex), checked on load
+    uint32_t nameCount;
+    uint32_t modelCount;
+    uint32_t reserved;
+    uint64_t commandBytes;
+};
+
+class CommandTrace;
+
+// The commands of one MeshBuilder, in the order it received them
+class TraceStream {
+public:
+    explicit TraceStream(CommandTrace* owner) : owner(owner) {}
+
+    // One command and its operands, copied as they are
+    template <typename... Operands>
+    void record(TraceOp op, Operands... operands) {
+        bytes.push_back(op);
+        int expand[] = {0, (put(operands), 0)...};
+        (void)expand;
+    }
+    void recordPoints(const float* xy, int count) { putBytes(xy, sizeof(float) * 2 * count); }
+    void beginScope(const char* name);
+    void append(const Vertex* triangles, int count);
+
+    const std::vector<unsigned char>& getBytes() const { return bytes; }
+    void setBytes(const std::vector<unsigned char>& b) { bytes = b; }
+
+private:
+    template <typename T>
+    void put(T value) { putBytes(&value, sizeof(value)); }
+    void putBytes(const void* data, size_t n) {
+        const unsigned char* p = (const unsigned char*)data;
+        bytes.insert(bytes.end(), p, p + n);
+    }
+
+    CommandTrace* owner;
+    std::vector<unsigned char> bytes;
+};
+
+// Totals for one draw function over a trace
+struct TraceScopeStats {
+    std::string name;
+    long long calls = 0;          // Times the function ran
+    long long commands = 0;
+    long long primitives = 0;     // Commands that emit geometry: a glBegin/glEnd pair each
+    long long vertices = 0;
+    long long colorChanges = 0;   // setColor() calls
+    long long redundantColors = 0; // ... that set the color already current
+    long long lines = 0;          // line() calls, each with its own width
+    long long widthChanges = 0;   // ... whose width differs from the line before
+};
+
+class CommandTrace {
+public:
+    CommandTrace() {}
+
+    // A stream for a builder with the given state; streams are replayed in
+    // the order they were opened. Safe to record from several threads, one
+    // stream per thread.
+    TraceStream* openStream(Color color, uint8_t palette, float originX, float originY,
+                            float scaleX, float scaleY, int lodLevel);
+    void clear();
+
+    bool save(const char* path) const;
+    bool load(const char* path); // Prints the reason and returns false on a bad file
+
+    // Re-issue every command into mb, which must not be recording
+    void replay(MeshBuilder& mb) const;
+    // Per draw function, in order of first appearance; commands outside
+    // any function are listed as "(none)"
+    std::vector<TraceScopeStats> analyse() const;
+    void printAnalysis(FILE* out) const;
+
+    long long commandCount() const;
+    size_t commandBytes() const;
+    size_t streamCount() const { return streams.size(); }
+
+private:
+    CommandTrace(const CommandTrace&);
+    CommandTrace& operator=(const CommandTrace&);
+    friend class TraceStream;
+
+    uint16_t nameIndex(const char* name);
+    uint16_t modelIndex(const Vertex* triangles, int count);
+
+    std::deque<TraceStream> streams; // Deque: streams stay put while others are opened
+    std::vector<std::string> names;
+    std::vector<std::vector<Vertex> > models;
+    std::vector<const Vertex*> modelSources; // Where each recorded model came from
+    std::mutex mutex;
+};
+
+// --replay-trace: load a trace, print its analysis and replay it frames
+// times into a mesh that is uploaded and drawn, with the time per replay.
+// Needs a GL context. Returns the process exit code.
+int runTraceReplay(const char* path, int frames);
+
+#endif
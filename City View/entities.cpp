@@ -0,0 +1,94 @@
+#include "entities.h"
+#include <cstring>
+
+// ---------- KERNELS ----------
+
+CITY_VIEW_NO_VECTORIZE
+static void advanceScalar(float* x, const float* velX, const float* wrapMax,
+                          const float* wrapReset, int begin, int n) {
+    for (int i = begin; i < n; ++i) {
+        float nx = x[i] + velX[i];
+        x[i] = (nx > wrapMax[i]) ? wrapReset[i] : nx;
+    }
+}
+
+#ifdef CITY_VIEW_X86_SIMD
+
+__attribute__((target("sse2")))
+static int advanceSSE2(float* x, const float* velX, const float* wrapMax,
+                       const float* wrapReset, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 nx = _mm_add_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(velX + i));
+        __m128 wrapped = _mm_cmpgt_ps(nx, _mm_loadu_ps(wrapMax + i));
+        // Select reset where wrapped, the new position elsewhere
+        __m128 result = _mm_or_ps(_mm_and_ps(wrapped, _mm_loadu_ps(wrapReset + i)),
+                                  _mm_andnot_ps(wrapped, nx));
+        _mm_storeu_ps(x + i, result);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int advanceAVX2(float* x, const float* velX, const float* wrapMax,
+                       const float* wrapReset, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 nx = _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(velX + i));
+        __m256 wrapped = _mm256_cmp_ps(nx, _mm256_loadu_ps(wrapMax + i), _CMP_GT_OQ);
+        _mm256_storeu_ps(x + i, _mm256_blendv_ps(nx, _mm256_loadu_ps(wrapReset + i), wrapped));
+    }
+    return i;
+}
+
+#endif
+
+void advanceEntities(SimdLevel level, float* x, const float* velX,
+                     const float* wrapMax, const float* wrapReset, int n) {
+    int done = 0;
+#ifdef CITY_VIEW_X86_SIMD
+    if (level == SIMD_AVX2) {
+        done = advanceAVX2(x, velX, wrapMax, wrapReset, n);
+    } else if (level == SIMD_SSE2) {
+        done = advanceSSE2(x, velX, wrapMax, wrapReset, n);
+    }
+#else
+    (void)level;
+#endif
+    advanceScalar(x, velX, wrapMax, wrapReset, done, n); // Remainder
+}
+
+// ---------- EntityStore ----------
+
+int EntityStore::add(EntityKind kind, float x, float y, float velX, float wrapMax, float wrapReset) {
+    EntityBlock& b = blocks[kind];
+    b.posX.push_back(x);
+    b.posY.push_back(y);
+    b.prevX.push_back(x);
+    b.velX.push_back(velX);
+    b.wrapMax.push_back(wrapMax);
+    b.wrapReset.push_back(wrapReset);
+    return b.size() - 1;
+}
+
+void EntityStore::clear() {
+    for (int k = 0; k < NUM_ENTITY_KINDS; ++k) {
+        blocks[k] = EntityBlock();
+    }
+}
+
+void EntityStore::update(SimdLevel level) {
+    for (int k = 0; k < NUM_ENTITY_KINDS; ++k) {
+        EntityBlock& b = blocks[k];
+        int n = b.size();
+        if (n == 0) continue;
+        memcpy(&b.prevX[0], &b.posX[0], n * sizeof(float));
+        advanceEntities(level, &b.posX[0], &b.velX[0], &b.wrapMax[0], &b.wrapReset[0], n);
+    }
+}
+
+int EntityStore::totalCount() const {
+    int total = 0;
+    for (int k = 0; k < NUM_ENTITY_KINDS; ++k) total += blocks[k].size();
+    return total;
+}
@@ -0,0 +1,64 @@
+#ifndef CITY_VIEW_ENTITIES_H
+#define CITY_VIEW_ENTITIES_H
+
+#include "simd.h"
+#include <vector>
+
+// Structure-of-arrays store for everything that moves along the X-axis
+// on its own (cars follow each other, see traffic.h, and birds flock,
+// see flock.h).
+// Each kind owns one block of contiguous arrays, so a tick is a single
+// vectorized pass per kind: x += velX, then wrap x > wrapMax to wrapReset.
+
+enum EntityKind {
+    ENTITY_BOAT,
+    ENTITY_SAILBOAT,
+    NUM_ENTITY_KINDS
+};
+
+struct EntityBlock {
+    std::vector<float> posX;
+    std::vector<float> posY;
+    std::vector<float> prevX;     // Position before the last tick, for interpolation
+    std::vector<float> velX;      // Units per tick
+    std::vector<float> wrapMax;   // Past this X the entity re-enters...
+    std::vector<float> wrapReset; // ...at this X
+
+    int size() const { return (int)posX.size(); }
+};
+
+class EntityStore {
+public:
+    // Returns the index of the new entity within its kind
+    int add(EntityKind kind, float x, float y, float velX, float wrapMax, float wrapReset);
+    void clear();
+
+    void setVelocity(EntityKind kind, int index, float velX) { blocks[kind].velX[index] = velX; }
+
+    // Advance every entity by one tick
+    void update(SimdLevel level);
+    void update() { update(bestSimdLevel()); }
+
+    int count(EntityKind kind) const { return blocks[kind].size(); }
+    int totalCount() const;
+    const EntityBlock& block(EntityKind kind) const { return blocks[kind]; }
+
+    // Position between the previous and current tick. An entity that
+    // wrapped during the tick snaps to its new position.
+    float interpolatedX(EntityKind kind, int index, float alpha) const {
+        const EntityBlock& b = blocks[kind];
+        float prev = b.prevX[index];
+        float cur = b.posX[index];
+        return cur < prev ? cur : prev + (cur - prev) * alpha;
+    }
+
+private:
+    EntityBlock blocks[NUM_ENTITY_KINDS];
+};
+
+// The update kernel on raw arrays (exposed for the benchmark).
+// All levels produce bit-identical results.
+void advanceEntities(SimdLevel level, float* x, const float* velX,
+                     const float* wrapMax, const float* wrapReset, int n);
+
+#endif
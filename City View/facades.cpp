@@ -0,0 +1,295 @@
+#include "facades.h"
+#include "gl_ext.h"
+#include "palette.h"
+#include "shader.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// ---------- PARAMETERS ----------
+
+// About one window column and one floor per this many units
+static const float FACADE_WINDOW_SPACING = 36.0f;
+static const int MAX_FACADE_COLUMNS = 10;
+
+// Each row is a band of the facade; its window spans this part of it
+static const float WINDOW_BOTTOM = 3.0f / 7.0f;
+static const float WINDOW_TOP = 6.0f / 7.0f;
+
+// Murmur3 finalizer
+static uint32_t mixBits(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t floatBits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+FacadeInstance makeFacade(const PropInstance& building) {
+    FacadeInstance f;
+    f.x = building.x;
+    f.y = building.y;
+    f.width = building.scaleX;
+    f.height = building.scaleY;
+
+    int columns = std::max(2, std::min(MAX_FACADE_COLUMNS, (int)(f.width / FACADE_WINDOW_SPACING)));
+    int rows = std::max(3, (int)(f.height / FACADE_WINDOW_SPACING));
+    rows = std::min(rows, MAX_FACADE_WINDOWS / columns);
+    f.columns = (GLubyte)columns;
+    f.rows = (GLubyte)rows;
+    f.pad[0] = f.pad[1] = 0;
+
+    // Some buildings are mostly dark at night, others mostly lit
+    uint32_t seed = mixBits(floatBits(f.x) ^ mixBits(floatBits(f.y) ^ mixBits(floatBits(f.width))));
+    uint32_t occupancy = 300 + mixBits(seed) % 650; // Per mille
+    uint32_t lit = 0;
+    for (int k = 0; k < columns * rows; ++k) {
+        if (mixBits(seed + 0x9e3779b9u * (uint32_t)(k + 1)) % 1000 < occupancy) lit |= 1u << k;
+    }
+    f.lit[0] = (GLushort)(lit & 0xffffu);
+    f.lit[1] = (GLushort)(lit >> 16);
+
+    f.wall = variantTint(paletteTable[PAL_BUILDING_WALL].day, building.variant);
+    return f;
+}
+
+void makeFacades(const std::vector<PropInstance>& buildings, std::vector<FacadeInstance>& out) {
+    out.clear();
+    out.reserve(buildings.size());
+    for (size_t i = 0; i < buildings.size(); ++i) out.push_back(makeFacade(buildings[i]));
+}
+
+static bool windowLit(const FacadeInstance& f, int k) {
+    return (f.lit[k >> 4] >> (k & 15)) & 1;
+}
+
+// The wall keeps the palette's day-to-night ratio
+static GLubyte darkenChannel(GLubyte c, GLubyte day, GLubyte night, float blend) {
+    float scale = 1.0f + ((float)night / day - 1.0f) * blend;
+    return (GLubyte)std::min(255.0f, c * scale + 0.5f);
+}
+
+void buildFacadeGeometry(MeshBuilder& mb, const FacadeInstance& f) {
+    const PaletteColors& wallEntry = paletteTable[PAL_BUILDING_WALL];
+    float blend = getNightBlend();
+    Color wall = {darkenChannel(f.wall.r, wallEntry.day.r, wallEntry.night.r, blend),
+                  darkenChannel(f.wall.g, wallEntry.day.g, wallEntry.night.g, blend),
+                  darkenChannel(f.wall.b, wallEntry.day.b, wallEntry.night.b, blend), f.wall.a};
+    Color glow = paletteColor(PAL_BUILDING_WINDOW);
+    Color glass = paletteColor(PAL_BUILDING_WINDOW_DARK);
+
+    mb.setOrigin(f.x, f.y);
+    mb.setColor(wall);
+    mb.rect(0, 0, f.width, f.height);
+
+    float slotW = f.width / (2 * f.columns + 1);
+    float rowH = f.height / f.rows;
+    for (int r = 0; r < f.rows; ++r) {
+        for (int c = 0; c < f.columns; ++c) {
+            mb.setColor(windowLit(f, r * f.columns + c) ? glow : glass);
+            mb.rect((2 * c + 1) * slotW, (r + WINDOW_BOTTOM) * rowH, slotW, (WINDOW_TOP - WINDOW_BOTTOM) * rowH);
+        }
+    }
+    mb.setOrigin(0, 0);
+}
+
+// ---------- SHADER ----------
+
+enum {
+    ATTRIB_CORNER = 0,
+    ATTRIB_FACADE_RECT = 1,
+    ATTRIB_FACADE_LIT = 2,
+    ATTRIB_FACADE_GRID = 3,
+    ATTRIB_FACADE_WALL = 4
+};
+
+// Follows paletteShaderCode() and the entry defines below. vCell is the
+// position in window slots: x counts the 2 * columns + 1 alternating
+// wall and window slots, y the rows.
+static const char* facadeVertexMain =
+    "attribute vec2 corner;\n"
+    "attribute vec4 facadeRect;\n" // x, y, width, height
+    "attribute vec2 facadeLit;\n"
+    "attribute vec2 facadeGrid;\n" // columns, rows
+    "attribute vec4 facadeWall;\n"
+    "varying vec2 vCell;\n"
+    "varying vec2 vLit;\n"
+    "varying float vColumns;\n"
+    "varying vec4 vWall;\n"
+    "varying vec4 vGlass;\n"
+    "varying vec4 vGlow;\n"
+    "void main() {\n"
+    "    vec2 p = facadeRect.xy + corner * facadeRect.zw;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(p, 0.0, 1.0);\n"
+    "    vCell = corner * vec2(2.0 * facadeGrid.x + 1.0, facadeGrid.y);\n"
+    "    vLit = facadeLit;\n"
+    "    vColumns = facadeGrid.x;\n"
+    "    vec3 nightScale = paletteNight[FACADE_WALL].rgb / paletteDay[FACADE_WALL].rgb;\n"
+    "    vWall = vec4(facadeWall.rgb * mix(vec3(1.0), nightScale, nightBlend), facadeWall.a);\n"
+    "    vGlass = paletteColor(vec4(0.0), float(FACADE_GLASS));\n"
+    "    vGlow = paletteColor(vec4(0.0), float(FACADE_GLOW));\n"
+    "}\n";
+
+static const char* facadeFragmentSrc =
+    "#version 120\n"
+    "varying vec2 vCell;\n"
+    "varying vec2 vLit;\n"
+    "varying float vColumns;\n"
+    "varying vec4 vWall;\n"
+    "varying vec4 vGlass;\n"
+    "varying vec4 vGlow;\n"
+    "void main() {\n"
+    "    float columns = floor(vColumns + 0.5);\n"
+    "    float slot = floor(vCell.x);\n"
+    "    float row = floor(vCell.y);\n"
+    "    float v = vCell.y - row;\n"
+    "    if (mod(slot, 2.0) < 0.5 || slot >= 2.0 * columns || v < 3.0 / 7.0 || v >= 6.0 / 7.0) {\n"
+    "        gl_FragColor = vWall;\n"
+    "        return;\n"
+    "    }\n"
+    "    float k = row * columns + (slot - 1.0) * 0.5;\n"
+    "    float bits = floor((k < 16.0 ? vLit.x : vLit.y) + 0.5);\n"
+    "    float lit = mod(floor(bits / exp2(mod(k, 16.0))), 2.0);\n"
+    "    gl_FragColor = lit > 0.5 ? vGlow : vGlass;\n"
+    "}\n";
+
+// Unit quad, two triangles
+static const float quadCorners[FACADE_VERTICES * 2] = {
+    0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f,
+    0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f
+};
+
+static GLuint facadeProgram = 0;
+static bool facadeProgramTried = false;
+
+static GLuint getFacadeProgram() {
+    if (!facadeProgramTried) {
+        facadeProgramTried = true;
+        char entries[128];
+        snprintf(entries, sizeof(entries), "#define FACADE_WALL %d\n#define FACADE_GLASS %d\n#define FACADE_GLOW %d\n",
+                 (int)PAL_BUILDING_WALL, (int)PAL_BUILDING_WINDOW_DARK, (int)PAL_BUILDING_WINDOW);
+        std::string vertexSrc = "#version 120\n" + paletteShaderCode() + entries + facadeVertexMain;
+        const char* attribs[] = {"corner", "facadeRect", "facadeLit", "facadeGrid", "facadeWall"};
+        facadeProgram = buildProgram(vertexSrc.c_str(), facadeFragmentSrc, attribs, 5);
+    }
+    return facadeProgram;
+}
+
+// ---------- BUFFERS ----------
+
+void FacadeBuffer::set(const FacadeInstance* facades, int n) {
+    count = n;
+    if (hasInstancing) {
+        if (vbo == 0) {
+            extGenBuffers(1, &vbo);
+        }
+        extBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (n > capacity) {
+            extBufferData(GL_ARRAY_BUFFER, n * sizeof(FacadeInstance), facades, GL_DYNAMIC_DRAW);
+            capacity = n;
+        } else if (n > 0) {
+            extBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(FacadeInstance), facades);
+        }
+        extBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    // The fallback path needs the facades on the CPU side
+    copy.assign(facades, facades + n);
+}
+
+void FacadeBuffer::release() {
+    if (vbo != 0) {
+        extDeleteBuffers(1, &vbo);
+        vbo = 0;
+    }
+    capacity = 0;
+    count = 0;
+    copy.clear();
+}
+
+// ---------- DRAWING ----------
+
+void FacadeRenderer::draw(const FacadeBuffer& facades) const {
+    if (facades.size() == 0) return;
+
+    if (hasInstancing && instancingEnabled && facades.getBuffer() != 0 && getFacadeProgram()) {
+        drawInstanced(facades);
+    } else {
+        drawFallback(facades);
+    }
+}
+
+void FacadeRenderer::drawInstanced(const FacadeBuffer& facades) const {
+    if (quadVbo == 0) {
+        extGenBuffers(1, &quadVbo);
+        extBindBuffer(GL_ARRAY_BUFFER, quadVbo);
+        extBufferData(GL_ARRAY_BUFFER, sizeof(quadCorners), quadCorners, GL_STATIC_DRAW);
+    }
+
+    extUseProgram(facadeProgram);
+    setPaletteUniforms(facadeProgram);
+
+    extBindBuffer(GL_ARRAY_BUFFER, quadVbo);
+    extEnableVertexAttribArray(ATTRIB_CORNER);
+    extVertexAttribPointer(ATTRIB_CORNER, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    // Per-instance attributes, advanced once per building
+    extBindBuffer(GL_ARRAY_BUFFER, facades.getBuffer());
+    extEnableVertexAttribArray(ATTRIB_FACADE_RECT);
+    extVertexAttribPointer(ATTRIB_FACADE_RECT, 4, GL_FLOAT, GL_FALSE, sizeof(FacadeInstance),
+                           (const void*)offsetof(FacadeInstance, x));
+    extVertexAttribDivisor(ATTRIB_FACADE_RECT, 1);
+    extEnableVertexAttribArray(ATTRIB_FACADE_LIT);
+    extVertexAttribPointer(ATTRIB_FACADE_LIT, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(FacadeInstance),
+                           (const void*)offsetof(FacadeInstance, lit));
+    extVertexAttribDivisor(ATTRIB_FACADE_LIT, 1);
+    extEnableVertexAttribArray(ATTRIB_FACADE_GRID);
+    extVertexAttribPointer(ATTRIB_FACADE_GRID, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(FacadeInstance),
+                           (const void*)offsetof(FacadeInstance, columns));
+    extVertexAttribDivisor(ATTRIB_FACADE_GRID, 1);
+    extEnableVertexAttribArray(ATTRIB_FACADE_WALL);
+    extVertexAttribPointer(ATTRIB_FACADE_WALL, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(FacadeInstance),
+                           (const void*)offsetof(FacadeInstance, wall));
+    extVertexAttribDivisor(ATTRIB_FACADE_WALL, 1);
+
+    extDrawArraysInstanced(GL_TRIANGLES, 0, FACADE_VERTICES, facades.size());
+
+    extVertexAttribDivisor(ATTRIB_FACADE_WALL, 0);
+    extVertexAttribDivisor(ATTRIB_FACADE_GRID, 0);
+    extVertexAttribDivisor(ATTRIB_FACADE_LIT, 0);
+    extVertexAttribDivisor(ATTRIB_FACADE_RECT, 0);
+    extDisableVertexAttribArray(ATTRIB_FACADE_WALL);
+    extDisableVertexAttribArray(ATTRIB_FACADE_GRID);
+    extDisableVertexAttribArray(ATTRIB_FACADE_LIT);
+    extDisableVertexAttribArray(ATTRIB_FACADE_RECT);
+    extDisableVertexAttribArray(ATTRIB_CORNER);
+    extBindBuffer(GL_ARRAY_BUFFER, 0);
+    extUseProgram(0);
+}
+
+// Every window as its own pair of triangles, colors baked for this call
+void FacadeRenderer::drawFallback(const FacadeBuffer& facades) const {
+    fallbackBuilder.clear();
+    const FacadeInstance* data = facades.getClientData();
+    for (int i = 0; i < facades.size(); ++i) buildFacadeGeometry(fallbackBuilder, data[i]);
+    fallbackMesh.upload(fallbackBuilder);
+    fallbackMesh.draw();
+}
+
+void FacadeRenderer::release() {
+    if (quadVbo != 0) {
+        extDeleteBuffers(1, &quadVbo);
+        quadVbo = 0;
+    }
+    fallbackBuilder.clear();
+    fallbackMesh.release();
+}
@@ -0,0 +1,76 @@
+#ifndef CITY_VIEW_FACADES_H
+#define CITY_VIEW_FACADES_H
+
+#include "geometry.h"
+#include "instancing.h"
+#include <vector>
+
+// Building facades: each building is one instanced quad, and a fragment
+// shader paints its windows from per-instance parameters (grid size, a
+// bitset of the windows lit at night, and the wall color). A building
+// costs the same six vertices however many windows it has.
+//
+// Windows keep the original drawBuilding() layout: a grid of columns
+// with gaps as wide as the windows, each row a band of the facade with
+// the window in the upper part. By day every window shows the glass
+// color; at night the lit ones glow and the rest stay dark.
+
+const int MAX_FACADE_WINDOWS = 32;
+const int FACADE_VERTICES = 6; // Two triangles per building
+
+struct FacadeInstance {
+    float x, y, width, height;
+    GLushort lit[2];          // Bit row * columns + column, low half then high half
+    GLubyte columns, rows;    // columns * rows <= MAX_FACADE_WINDOWS
+    GLubyte pad[2];
+    Color wall;               // Day color, darkened by the palette at night
+};
+
+// Facade of a building prop: a window grid that grows with its size (2x3
+// for the built-in buildings), the wall tinted by the prop's variant, and
+// a random night occupancy seeded by its position, so the same building
+// is always lit the same way.
+FacadeInstance makeFacade(const PropInstance& building);
+void makeFacades(const std::vector<PropInstance>& buildings, std::vector<FacadeInstance>& out);
+
+// Triangles of a facade with the current day/night colors baked in, as
+// the quad would show them. Used without shaders and by the benchmark.
+void buildFacadeGeometry(MeshBuilder& mb, const FacadeInstance& facade);
+
+// A list of facades in its own buffer, like InstanceBuffer
+class FacadeBuffer {
+public:
+    void set(const FacadeInstance* facades, int count);
+    void set(const std::vector<FacadeInstance>& facades) {
+        set(facades.empty() ? nullptr : &facades[0], (int)facades.size());
+    }
+    void release();
+
+    int size() const { return count; }
+    GLuint getBuffer() const { return vbo; }
+    const FacadeInstance* getClientData() const { return copy.empty() ? nullptr : &copy[0]; }
+
+private:
+    GLuint vbo = 0;
+    int capacity = 0;
+    int count = 0;
+    std::vector<FacadeInstance> copy; // Kept for the fallback path
+};
+
+// Draw a list with one instanced call, or (without instancing, or when
+// instancingEnabled is off) as baked geometry rebuilt for the call.
+class FacadeRenderer {
+public:
+    void draw(const FacadeBuffer& facades) const;
+    void release();
+
+private:
+    void drawInstanced(const FacadeBuffer& facades) const;
+    void drawFallback(const FacadeBuffer& facades) const;
+
+    mutable GLuint quadVbo = 0;
+    mutable MeshBuilder fallbackBuilder;
+    mutable StaticMesh fallbackMesh;
+};
+
+#endif
@@ -0,0 +1,350 @@
+#include "flock.h"
+#include "task_pool.h"
+#include "timing.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// ---------- MODEL ----------
+
+// Tuned so the scene's few dozen birds gather into small, loose flocks
+// that drift right at about the original birds' 3 units per tick
+const float NEIGHBOR_RADIUS = 30.0f;   // Also the grid's cell size
+const float SEPARATION_RADIUS = 12.0f;
+const int MAX_NEIGHBORS = 16;          // A bird stops looking after the group that brings more than this
+const int SCAN_GROUP = 16;             // Birds scanned between checks of that count; a multiple of 4
+const float SEPARATION = 0.04f;
+const float ALIGNMENT = 0.05f;
+const float COHESION = 0.004f;
+const float WIND_SPEED = 3.0f;
+const float WIND_PULL = 0.01f;
+const float EDGE_MARGIN = 40.0f;       // Birds start turning this far from the band's edges
+const float EDGE_TURN = 0.12f;
+const float MIN_SPEED = 2.0f;
+const float MAX_SPEED = 4.5f;
+const int BIRDS_PER_TASK = 1024;
+const int MIN_PARALLEL_BIRDS = 2048;   // Fewer are not worth waking the pool for
+
+static void resizeBirds(FlockBirds& b, int n) {
+    b.posX.resize(n);
+    b.posY.resize(n);
+    b.velX.resize(n);
+    b.velY.resize(n);
+    b.prevX.resize(n);
+    b.prevY.resize(n);
+    b.wingPhase.resize(n);
+}
+
+// ---------- Flock ----------
+
+void Flock::populate(int count, const FlockBounds& newBounds, unsigned int seed) {
+    clear();
+    bounds = newBounds;
+    int n = std::max(0, count);
+    resizeBirds(birds, n);
+
+    unsigned int rng = seed ? seed : 1u; // xorshift32, the same flock on every platform
+    float r[4];
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            r[j] = (rng >> 8) * (1.0f / 16777216.0f); // [0, 1)
+        }
+        birds.posX[i] = bounds.minX + r[0] * (bounds.maxX - bounds.minX);
+        birds.posY[i] = bounds.minY + EDGE_MARGIN + r[1] * std::max(0.0f, bounds.maxY - bounds.minY - 2.0f * EDGE_MARGIN);
+        birds.velX[i] = WIND_SPEED;
+        birds.velY[i] = (r[2] - 0.5f) * 2.0f;
+        birds.wingPhase[i] = r[3] * 6.2831853f;
+    }
+    birds.prevX = birds.posX;
+    birds.prevY = birds.posY;
+
+    // Cells at least a neighbor radius wide, so a query never needs more
+    // than the 3 x 3 around its own. Three columns minimum keep wrapped
+    // neighbors distinct.
+    columns = std::max(3, (int)((bounds.maxX - bounds.minX) / NEIGHBOR_RADIUS));
+    rows = std::max(1, (int)std::ceil((bounds.maxY - bounds.minY) / NEIGHBOR_RADIUS));
+    cellStart.assign(columns * rows + 1, 0);
+}
+
+void Flock::clear() {
+    resizeBirds(birds, 0);
+    resizeBirds(sorted, 0);
+    cellOf.clear();
+    cellStart.clear();
+    columns = rows = 0;
+    stats = FlockStats{0.0, 0.0, 0, 0};
+}
+
+int Flock::cellColumn(float x) const {
+    int c = (int)((x - bounds.minX) * columns / (bounds.maxX - bounds.minX));
+    return std::min(std::max(c, 0), columns - 1);
+}
+
+int Flock::cellRow(float y) const {
+    // Birds may stray past the band for a moment: they join the edge rows
+    int r = (int)((y - bounds.minY) * (1.0f / NEIGHBOR_RADIUS));
+    return std::min(std::max(r, 0), rows - 1);
+}
+
+// Counting sort of the birds into cell order: count, prefix sum, then a
+// stable scatter, so equal inputs always give the same order
+void Flock::rebuildGrid() {
+    int n = size();
+    resizeBirds(sorted, n + 3); // Padding for the last SSE2 group
+    cellOf.resize(n);
+    std::fill(cellStart.begin(), cellStart.end(), 0);
+    for (int i = 0; i < n; ++i) {
+        int cell = cellRow(birds.posY[i]) * columns + cellColumn(birds.posX[i]);
+        cellOf[i] = cell;
+        ++cellStart[cell + 1];
+    }
+    for (int c = 0; c < columns * rows; ++c) cellStart[c + 1] += cellStart[c];
+
+    for (int i = 0; i < n; ++i) {
+        int s = cellStart[cellOf[i]]++;
+        sorted.posX[s] = birds.posX[i];
+        sorted.posY[s] = birds.posY[i];
+        sorted.velX[s] = birds.velX[i];
+        sorted.velY[s] = birds.velY[i];
+        sorted.wingPhase[s] = birds.wingPhase[i];
+    }
+    // The scatter advanced every start to the next cell's: shift them back
+    for (int c = columns * rows; c > 0; --c) cellStart[c] = cellStart[c - 1];
+    cellStart[0] = 0;
+}
+
+// ---------- NEIGHBOR SCAN ----------
+
+// What one bird sees of the others, as four lane sums. Whatever the
+// kernel, the birds of a run are dealt to the lanes in turn and the lanes
+// are added up the same way, so every kernel gives bit-identical sums.
+// (AVX2 would need eight lanes, so it runs the SSE2 kernel.)
+struct Neighborhood {
+    float near[4];              // Birds within the radius, the bird itself included
+    float sumX[4], sumY[4];     // Their offsets
+    float sumVX[4], sumVY[4];   // Their velocities
+    float sepX[4], sepY[4];     // Pushes away from the closest
+};
+
+static float laneTotal(const float* lanes) {
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+// Whether a bird is near is a coin toss, so every bird of the run is
+// added in, weighted 0 or 1, rather than branched on. The bird itself
+// counts too, at distance 0.
+CITY_VIEW_NO_VECTORIZE
+static void scanScalar(Neighborhood& n, const float* sx, const float* sy, const float* svx, const float* svy,
+                       int begin, int end, float x, float y, float width) {
+    const float halfWidth = 0.5f * width;
+    const float radius2 = NEIGHBOR_RADIUS * NEIGHBOR_RADIUS;
+    const float separation2 = SEPARATION_RADIUS * SEPARATION_RADIUS;
+    for (int j = begin; j < end; ++j) {
+        int l = (j - begin) & 3;
+        float dx = sx[j] - x;
+        dx = (dx - (dx > halfWidth ? width : 0.0f)) + (dx < -halfWidth ? width : 0.0f); // Across the seam
+        float dy = sy[j] - y;
+        float d2 = dx * dx + dy * dy;
+        float in = d2 < radius2 ? 1.0f : 0.0f;
+        float push = std::max(separation2 - d2, 0.0f) * (1.0f / separation2); // 1 when touching
+        n.near[l] += in;
+        n.sumX[l] += in * dx;
+        n.sumY[l] += in * dy;
+        n.sumVX[l] += in * svx[j];
+        n.sumVY[l] += in * svy[j];
+        n.sepX[l] -= push * dx;
+        n.sepY[l] -= push * dy;
+    }
+}
+
+#ifdef CITY_VIEW_X86_SIMD
+
+// The last group of a run is masked rather than finished by the scalar
+// kernel: it may read up to three birds past the run, into the next cell
+// or the padding after the last bird
+__attribute__((target("sse2")))
+static void scanSSE2(Neighborhood& n, const float* sx, const float* sy, const float* svx, const float* svy,
+                    int begin, int end, float x, float y, float width) {
+    const __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y), vwidth = _mm_set1_ps(width);
+    const __m128 halfWidth = _mm_set1_ps(0.5f * width), minusHalfWidth = _mm_set1_ps(-0.5f * width);
+    const __m128 radius2 = _mm_set1_ps(NEIGHBOR_RADIUS * NEIGHBOR_RADIUS);
+    const __m128 separation2 = _mm_set1_ps(SEPARATION_RADIUS * SEPARATION_RADIUS);
+    const __m128 invSeparation2 = _mm_set1_ps(1.0f / (SEPARATION_RADIUS * SEPARATION_RADIUS));
+    const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    const __m128i lanes = _mm_set_epi32(3, 2, 1, 0), vend = _mm_set1_epi32(end);
+    __m128 near = _mm_loadu_ps(n.near), sumX = _mm_loadu_ps(n.sumX), sumY = _mm_loadu_ps(n.sumY);
+    __m128 sumVX = _mm_loadu_ps(n.sumVX), sumVY = _mm_loadu_ps(n.sumVY);
+    __m128 sepX = _mm_loadu_ps(n.sepX), sepY = _mm_loadu_ps(n.sepY);
+    for (int j = begin; j < end; j += 4) {
+        __m128 valid = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32(j), lanes), vend));
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(sx + j), vx);
+        dx = _mm_add_ps(_mm_sub_ps(dx, _mm_and_ps(_mm_cmpgt_ps(dx, halfWidth), vwidth)),
+                        _mm_and_ps(_mm_cmplt_ps(dx, minusHalfWidth), vwidth));
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(sy + j), vy);
+        __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 in = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(d2, radius2), valid), one);
+        __m128 push = _mm_and_ps(_mm_mul_ps(_mm_max_ps(_mm_sub_ps(separation2, d2), zero), invSeparation2), valid);
+        near = _mm_add_ps(near, in);
+        sumX = _mm_add_ps(sumX, _mm_mul_ps(in, dx));
+        sumY = _mm_add_ps(sumY, _mm_mul_ps(in, dy));
+        sumVX = _mm_add_ps(sumVX, _mm_mul_ps(in, _mm_loadu_ps(svx + j)));
+        sumVY = _mm_add_ps(sumVY, _mm_mul_ps(in, _mm_loadu_ps(svy + j)));
+        sepX = _mm_sub_ps(sepX, _mm_mul_ps(push, dx));
+        sepY = _mm_sub_ps(sepY, _mm_mul_ps(push, dy));
+    }
+    _mm_storeu_ps(n.near, near);
+    _mm_storeu_ps(n.sumX, sumX);
+    _mm_storeu_ps(n.sumY, sumY);
+    _mm_storeu_ps(n.sumVX, sumVX);
+    _mm_storeu_ps(n.sumVY, sumVY);
+    _mm_storeu_ps(n.sepX, sepX);
+    _mm_storeu_ps(n.sepY, sepY);
+}
+
+#endif
+
+// Add sorted birds [begin, end) to the neighborhood, SCAN_GROUP at a
+// time, until near counts more than MAX_NEIGHBORS. However crowded the
+// cells, a query tests at most a group past that. Groups are whole lane
+// cycles, so every kernel still stops at the same bird. Returns the birds
+// tested.
+static int scanRun(SimdLevel level, Neighborhood& n, float& near, const float* sx, const float* sy,
+                   const float* svx, const float* svy, int begin, int end, float x, float y, float width) {
+    int j = begin;
+    for (; j < end && near <= MAX_NEIGHBORS; j += SCAN_GROUP) {
+        int groupEnd = std::min(j + SCAN_GROUP, end);
+#ifdef CITY_VIEW_X86_SIMD
+        if (level != SIMD_SCALAR) {
+            scanSSE2(n, sx, sy, svx, svy, j, groupEnd, x, y, width);
+        } else {
+            scanScalar(n, sx, sy, svx, svy, j, groupEnd, x, y, width);
+        }
+#else
+        (void)level;
+        scanScalar(n, sx, sy, svx, svy, j, groupEnd, x, y, width);
+#endif
+        near = laneTotal(n.near);
+    }
+    return std::min(j, end) - begin;
+}
+
+// Steer and move sorted birds [begin, end), writing the new state to birds
+void Flock::steer(int begin, int end, long long& candidates, long long& neighbors) {
+    const float width = bounds.maxX - bounds.minX;
+    const float* sx = &sorted.posX[0];
+    const float* sy = &sorted.posY[0];
+    const float* svx = &sorted.velX[0];
+    const float* svy = &sorted.velY[0];
+    const int* starts = &cellStart[0];
+    long long tested = 0, found = 0;
+
+    for (int i = begin; i < end; ++i) {
+        float x = sx[i], y = sy[i], vx = svx[i], vy = svy[i];
+        int column = cellColumn(x), row = cellRow(y);
+        Neighborhood n;
+        memset(&n, 0, sizeof(n));
+
+        // The three cells of a row are one run of the sorted birds, unless
+        // they wrap around the seam. The bird's own row goes first, from the
+        // bird itself, so it always counts itself and then the birds of its
+        // own cell; the scan stops once it counts more than MAX_NEIGHBORS.
+        static const int ROW_ORDER[3] = {0, -1, 1};
+        float near = 0.0f;
+        for (int k = 0; k < 3 && near <= MAX_NEIGHBORS; ++k) {
+            int r = row + ROW_ORDER[k];
+            if (r < 0 || r >= rows) continue;
+            const int* rowStarts = starts + r * columns;
+            int first = rowStarts[std::max(column - 1, 0)];
+            int last = rowStarts[std::min(column + 2, columns)];
+            if (k == 0) {
+                tested += scanRun(simdLevel, n, near, sx, sy, svx, svy, i, last, x, y, width);
+                tested += scanRun(simdLevel, n, near, sx, sy, svx, svy, first, i, x, y, width);
+            } else {
+                tested += scanRun(simdLevel, n, near, sx, sy, svx, svy, first, last, x, y, width);
+            }
+            if (column == 0 || column == columns - 1) {
+                int wrapped = column == 0 ? columns - 1 : 0;
+                tested += scanRun(simdLevel, n, near, sx, sy, svx, svy, rowStarts[wrapped], rowStarts[wrapped + 1],
+                                  x, y, width);
+            }
+        }
+        int count = (int)near - 1; // Not counting itself
+        float sumX = laneTotal(n.sumX), sumY = laneTotal(n.sumY);
+        float sumVX = laneTotal(n.sumVX) - vx, sumVY = laneTotal(n.sumVY) - vy;
+        float sepX = laneTotal(n.sepX), sepY = laneTotal(n.sepY);
+        found += count;
+
+        float ax = WIND_PULL * (WIND_SPEED - vx), ay = 0.0f;
+        if (count > 0) {
+            float inv = 1.0f / count;
+            ax += SEPARATION * sepX + ALIGNMENT * (sumVX * inv - vx) + COHESION * sumX * inv;
+            ay += SEPARATION * sepY + ALIGNMENT * (sumVY * inv - vy) + COHESION * sumY * inv;
+        }
+        if (y < bounds.minY + EDGE_MARGIN) ay += EDGE_TURN * (bounds.minY + EDGE_MARGIN - y) / EDGE_MARGIN;
+        if (y > bounds.maxY - EDGE_MARGIN) ay -= EDGE_TURN * (y - bounds.maxY + EDGE_MARGIN) / EDGE_MARGIN;
+
+        vx += ax;
+        vy += ay;
+        float speed = std::sqrt(vx * vx + vy * vy);
+        float limited = std::min(std::max(speed, MIN_SPEED), MAX_SPEED);
+        if (speed > 0.0f) {
+            vx *= limited / speed;
+            vy *= limited / speed;
+        } else {
+            vx = limited;
+        }
+
+        float nx = x + vx;
+        nx = nx >= bounds.maxX ? nx - width : (nx < bounds.minX ? nx + width : nx);
+        birds.posX[i] = nx;
+        birds.posY[i] = std::min(std::max(y + vy, bounds.minY), bounds.maxY); // Crowds push some to the edge
+        birds.velX[i] = vx;
+        birds.velY[i] = vy;
+        birds.prevX[i] = x;
+        birds.prevY[i] = y;
+        birds.wingPhase[i] = sorted.wingPhase[i];
+    }
+    candidates = tested;
+    neighbors = found;
+}
+
+void Flock::update(TaskPool* pool) {
+    int n = size();
+    if (n == 0) return;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    rebuildGrid();
+    stats.gridMs = msSince(start);
+
+    start = std::chrono::steady_clock::now();
+    int tasks = (n + BIRDS_PER_TASK - 1) / BIRDS_PER_TASK;
+    taskCandidates.assign(tasks, 0);
+    taskNeighbors.assign(tasks, 0);
+    if (pool && n >= MIN_PARALLEL_BIRDS) {
+        pool->run(tasks, [this, n](int t) {
+            steer(t * BIRDS_PER_TASK, std::min(n, (t + 1) * BIRDS_PER_TASK), taskCandidates[t], taskNeighbors[t]);
+        });
+    } else {
+        for (int t = 0; t < tasks; ++t) {
+            steer(t * BIRDS_PER_TASK, std::min(n, (t + 1) * BIRDS_PER_TASK), taskCandidates[t], taskNeighbors[t]);
+        }
+    }
+    stats.steerMs = msSince(start);
+
+    stats.candidates = stats.neighbors = 0;
+    for (int t = 0; t < tasks; ++t) {
+        stats.candidates += taskCandidates[t];
+        stats.neighbors += taskNeighbors[t];
+    }
+}
+
+float Flock::interpolatedX(int i, float alpha) const {
+    float prev = birds.prevX[i];
+    float cur = birds.posX[i];
+    if (std::fabs(cur - prev) > 0.5f * (bounds.maxX - bounds.minX)) return cur; // Wrapped
+    return prev + (cur - prev) * alpha;
+}
@@ -0,0 +1,93 @@
+#ifndef CITY_VIEW_FLOCK_H
+#define CITY_VIEW_FLOCK_H
+
+#include "simd.h"
+#include <vector>
+
+class TaskPool;
+
+// Birds: a boids flock. Every tick each bird steers away from the birds
+// crowding it (separation), towards their mean heading (alignment) and
+// towards their centre (cohesion), while the wind carries the flock
+// towards +x like the original birds.
+//
+// Neighbors come from a uniform grid with cells one neighbor radius wide,
+// rebuilt every tick by a counting sort that also reorders the birds into
+// cell order, so a query scans three short, contiguous runs (one per
+// row of cells), four birds at a time with SSE2. A tick only reads the
+// sorted copy of the previous state, so birds are updated in parallel and
+// the result depends on neither the thread count nor the kernel.
+//
+// The flock flies in a band of sky that wraps around in x: birds leaving
+// on the right re-enter on the left, and they see their neighbors across
+// the seam. Distances are world units, speeds units per tick.
+
+struct FlockBounds {
+    float minX, maxX; // Wraps around
+    float minY, maxY; // Birds turn back before reaching these, and never pass them
+};
+
+// Where the original two birds flew: their wrap and their bobbing band
+const FlockBounds SKY_BOUNDS = {-50.0f, 850.0f, 240.0f, 470.0f};
+const int DEFAULT_FLOCK_SIZE = 24;
+const unsigned int DEFAULT_FLOCK_SEED = 2024;
+
+struct FlockBirds {
+    std::vector<float> posX, posY;
+    std::vector<float> velX, velY;
+    std::vector<float> prevX, prevY; // Before the last tick, for interpolation
+    std::vector<float> wingPhase;    // Radians, so birds do not flap in step
+
+    int size() const { return (int)posX.size(); }
+};
+
+// Cost of the last tick
+struct FlockStats {
+    double gridMs;        // Counting sort into cells
+    double steerMs;       // Neighbor queries, steering and integration
+    long long candidates; // Birds tested against the neighbor radius
+    long long neighbors;  // Birds within it; a query stops within one scan group of passing MAX_NEIGHBORS
+};
+
+class Flock {
+public:
+    // count birds scattered over the bounds, flying right. The same seed
+    // gives the same flock.
+    void populate(int count, const FlockBounds& bounds, unsigned int seed);
+    void clear();
+
+    // Advance every bird by one tick, on the pool when given
+    void update(TaskPool* pool);
+    void setSimdLevel(SimdLevel level) { simdLevel = level; }
+
+    int size() const { return birds.size(); }
+    const FlockBirds& getBirds() const { return birds; }
+    const FlockBounds& getBounds() const { return bounds; }
+    const FlockStats& getStats() const { return stats; }
+
+    // Position between the last two ticks. A bird that wrapped during the
+    // tick snaps to its new place.
+    float interpolatedX(int i, float alpha) const;
+    float interpolatedY(int i, float alpha) const {
+        return birds.prevY[i] + (birds.posY[i] - birds.prevY[i]) * alpha;
+    }
+
+private:
+    void rebuildGrid();
+    void steer(int begin, int end, long long& candidates, long long& neighbors);
+    int cellColumn(float x) const;
+    int cellRow(float y) const;
+
+    FlockBounds bounds = SKY_BOUNDS;
+    SimdLevel simdLevel = bestSimdLevel();
+    FlockBirds birds;
+    FlockBirds sorted; // Last tick's state in cell order, read by the queries
+    FlockStats stats = {0.0, 0.0, 0, 0};
+
+    int columns = 0, rows = 0;
+    std::vector<int> cellOf;    // Cell of each bird, before sorting
+    std::vector<int> cellStart; // First sorted bird of each cell, then the total
+    std::vector<long long> taskCandidates, taskNeighbors;
+};
+
+#endif
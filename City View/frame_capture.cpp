@@ -0,0 +1,353 @@
+#include "frame_capture.h"
+#include "gl_ext.h"
+#include "timing.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+typedef std::chrono::steady_clock CaptureClock;
+
+// ---------- PNG ----------
+
+// Uncompressed: deflate "stored" blocks need no zlib, and the writer
+// stays far ahead of the frame rate
+
+static unsigned long crcTable[256];
+
+static void initCrcTable() {
+    for (unsigned long n = 0; n < 256; ++n) {
+        unsigned long c = n;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+        crcTable[n] = c;
+    }
+}
+
+static unsigned long crc32(unsigned long crc, const unsigned char* data, size_t n) {
+    crc ^= 0xffffffffUL;
+    for (size_t i = 0; i < n; ++i) crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffUL;
+}
+
+static void putBigEndian(std::vector<unsigned char>& out, unsigned long v) {
+    out.push_back((unsigned char)(v >> 24));
+    out.push_back((unsigned char)(v >> 16));
+    out.push_back((unsigned char)(v >> 8));
+    out.push_back((unsigned char)v);
+}
+
+// Length, type, data and CRC of one chunk; data starts at out[start]
+static void closeChunk(std::vector<unsigned char>& out, size_t start) {
+    unsigned long length = (unsigned long)(out.size() - start - 4);
+    for (int i = 0; i < 4; ++i) out[start - 4 + i] = (unsigned char)(length >> (24 - 8 * i));
+    putBigEndian(out, crc32(0, &out[start], out.size() - start));
+}
+
+static size_t openChunk(std::vector<unsigned char>& out, const char* type) {
+    putBigEndian(out, 0); // Length, filled in by closeChunk()
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    return start;
+}
+
+static void encodePNG(const std::vector<unsigned char>& rgba, int width, int height,
+                      std::vector<unsigned char>& out) {
+    static const unsigned char SIGNATURE[8] = {137, 'P', 'N', 'G', 13, 10, 26, 10};
+    out.assign(SIGNATURE, SIGNATURE + 8);
+
+    size_t chunk = openChunk(out, "IHDR");
+    putBigEndian(out, width);
+    putBigEndian(out, height);
+    const unsigned char format[5] = {8, 2, 0, 0, 0}; // 8-bit RGB, no interlace
+    out.insert(out.end(), format, format + 5);
+    closeChunk(out, chunk);
+
+    // Rows top-down, each behind filter type 0
+    size_t rowBytes = (size_t)width * 3 + 1;
+    size_t rawBytes = rowBytes * height;
+    chunk = openChunk(out, "IDAT");
+    out.push_back(0x78); // zlib header: deflate, 32K window, no dictionary
+    out.push_back(0x01);
+    unsigned long adlerA = 1, adlerB = 0;
+    size_t blockLeft = 0, rawLeft = rawBytes;
+    for (int y = height - 1; y >= 0; --y) {
+        const unsigned char* src = &rgba[(size_t)y * width * 4];
+        for (size_t i = 0; i < rowBytes; ++i) {
+            if (blockLeft == 0) {
+                blockLeft = std::min(rawLeft, (size_t)65535);
+                out.push_back(blockLeft == rawLeft ? 1 : 0); // Final block, stored
+                out.push_back((unsigned char)blockLeft);
+                out.push_back((unsigned char)(blockLeft >> 8));
+                out.push_back((unsigned char)~blockLeft);
+                out.push_back((unsigned char)(~blockLeft >> 8));
+            }
+            unsigned char byte = i == 0 ? 0 : src[(i - 1) / 3 * 4 + (i - 1) % 3];
+            out.push_back(byte);
+            adlerA = (adlerA + byte) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+            --blockLeft;
+            --rawLeft;
+        }
+    }
+    putBigEndian(out, (adlerB << 16) | adlerA);
+    closeChunk(out, chunk);
+
+    chunk = openChunk(out, "IEND");
+    closeChunk(out, chunk);
+}
+
+// ---------- Y4M ----------
+
+static unsigned char clampByte(int v) {
+    return (unsigned char)std::max(0, std::min(255, v));
+}
+
+// Full-range BT.601 (C420jpeg), fixed point; chroma from 2x2 averages
+static void encodeY4MFrame(const std::vector<unsigned char>& rgba, int width, int height,
+                           std::vector<unsigned char>& out) {
+    int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    out.resize((size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight);
+    unsigned char* luma = &out[0];
+    unsigned char* cb = luma + (size_t)width * height;
+    unsigned char* cr = cb + (size_t)chromaWidth * chromaHeight;
+
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* src = &rgba[(size_t)(height - 1 - y) * width * 4];
+        for (int x = 0; x < width; ++x, src += 4) {
+            luma[(size_t)y * width + x] = (unsigned char)((77 * src[0] + 150 * src[1] + 29 * src[2] + 128) >> 8);
+        }
+    }
+    for (int cy = 0; cy < chromaHeight; ++cy) {
+        for (int cx = 0; cx < chromaWidth; ++cx) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int dy = 0; dy < 2 && 2 * cy + dy < height; ++dy) {
+                for (int dx = 0; dx < 2 && 2 * cx + dx < width; ++dx) {
+                    const unsigned char* p = &rgba[((size_t)(height - 1 - 2 * cy - dy) * width + 2 * cx + dx) * 4];
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                    ++n;
+                }
+            }
+            r /= n;
+            g /= n;
+            b /= n;
+            size_t i = (size_t)cy * chromaWidth + cx;
+            cb[i] = clampByte((-43 * r - 85 * g + 128 * b + 32896) >> 8); // + 128.5 before the shift
+            cr[i] = clampByte((128 * r - 107 * g - 21 * b + 32896) >> 8);
+        }
+    }
+}
+
+// ---------- CAPTURE ----------
+
+bool FrameCapture::start(const std::string& p, int w, int h, int fpsNumerator, int fpsDenominator) {
+    stop();
+    if (w <= 0 || h <= 0) return false;
+    path = p;
+    width = w;
+    height = h;
+    format = (path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0) ? CAPTURE_Y4M : CAPTURE_PNG;
+    if (format == CAPTURE_Y4M) {
+        video = fopen(path.c_str(), "wb");
+        if (!video) {
+            fprintf(stderr, "Capture: cannot write %s\n", path.c_str());
+            return false;
+        }
+        fprintf(video, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", width, height, fpsNumerator, fpsDenominator);
+    } else {
+        // Fail now rather than on every frame when the directory is missing or read-only
+        std::string probe = path + "/frame_probe.png";
+        FILE* f = fopen(probe.c_str(), "wb");
+        if (!f) {
+            fprintf(stderr, "Capture: cannot write to directory %s\n", path.c_str());
+            return false;
+        }
+        fclose(f);
+        remove(probe.c_str());
+    }
+    initCrcTable();
+
+    size_t frameBytes = (size_t)width * height * 4;
+    if (hasPixelBuffers) {
+        extGenBuffers(CAPTURE_PBO_RING, pixelBuffers);
+        for (int i = 0; i < CAPTURE_PBO_RING; ++i) {
+            extBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+            extBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, nullptr, GL_STREAM_READ);
+            ringFrame[i] = -1;
+        }
+        extBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    slots.assign(CAPTURE_QUEUE_FRAMES, std::vector<unsigned char>(frameBytes));
+    slotFrame.assign(CAPTURE_QUEUE_FRAMES, 0);
+    freeSlots.clear();
+    for (int i = CAPTURE_QUEUE_FRAMES - 1; i >= 0; --i) freeSlots.push_back(i);
+    queued.clear();
+    counters = CaptureStats{0, 0, 0, 0.0, 0.0};
+    nextFrame = 0;
+    stopping = false;
+    active = true;
+    writer = std::thread(&FrameCapture::writerLoop, this);
+    return true;
+}
+
+int FrameCapture::acquireSlot(bool wait) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (wait) released.wait(lock, [this] { return !freeSlots.empty(); });
+    if (freeSlots.empty()) {
+        ++counters.dropped;
+        return -1;
+    }
+    int slot = freeSlots.back();
+    freeSlots.pop_back();
+    return slot;
+}
+
+void FrameCapture::submit(int slot, long long frame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slotFrame[slot] = frame;
+        queued.push_back(slot);
+    }
+    wake.notify_one();
+}
+
+// Hand the frame in one ring buffer to the writer. Only the final flush
+// waits for a free slot.
+void FrameCapture::copyPixelBuffer(int ring, bool wait) {
+    if (ringFrame[ring] < 0) return;
+    int slot = acquireSlot(wait);
+    if (slot >= 0) {
+        extBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[ring]);
+        const void* pixels = extMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (pixels) {
+            memcpy(&slots[slot][0], pixels, slots[slot].size());
+            extUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            submit(slot, ringFrame[ring]);
+        } else {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeSlots.push_back(slot);
+            ++counters.dropped;
+        }
+    }
+    ringFrame[ring] = -1;
+}
+
+void FrameCapture::captureFrame() {
+    if (!active) return;
+    CaptureClock::time_point start = CaptureClock::now();
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] != width || viewport[3] != height) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++counters.dropped; // The video keeps the size it started with
+        return;
+    }
+
+    long long frame = nextFrame++;
+    if (hasPixelBuffers) {
+        // The buffer read back CAPTURE_PBO_RING frames ago is ready by now
+        int ring = (int)(frame % CAPTURE_PBO_RING);
+        copyPixelBuffer(ring, false);
+        extBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[ring]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        extBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        ringFrame[ring] = frame;
+    } else {
+        int slot = acquireSlot(false);
+        if (slot >= 0) {
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &slots[slot][0]);
+            submit(slot, frame);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++counters.captured;
+    counters.readbackMs += msSince(start);
+}
+
+void FrameCapture::stop() {
+    if (!active) return;
+    if (hasPixelBuffers) {
+        // Oldest first, so a video keeps its frames in order
+        for (long long f = nextFrame; f < nextFrame + CAPTURE_PBO_RING; ++f) {
+            copyPixelBuffer((int)(f % CAPTURE_PBO_RING), true);
+        }
+        extDeleteBuffers(CAPTURE_PBO_RING, pixelBuffers);
+        memset(pixelBuffers, 0, sizeof(pixelBuffers));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    if (video) {
+        fclose(video);
+        video = nullptr;
+    }
+    slots.clear();
+    active = false;
+}
+
+CaptureStats FrameCapture::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void FrameCapture::printReport(FILE* out) {
+    CaptureStats s = stats();
+    fprintf(out, "Capture:     %lld frames read back, %lld written to %s, %lld dropped; "
+                 "%.3f ms per frame on the render thread, %.3f ms per frame on the writer\n",
+            s.captured, s.written, path.c_str(), s.dropped,
+            s.captured ? s.readbackMs / s.captured : 0.0, s.written ? s.writeMs / s.written : 0.0);
+}
+
+// ---------- WRITER ----------
+
+void FrameCapture::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return stopping || !queued.empty(); });
+        if (queued.empty()) break; // Stopping, and everything is written
+        int slot = queued.front();
+        queued.pop_front();
+        long long frame = slotFrame[slot];
+        lock.unlock();
+
+        CaptureClock::time_point start = CaptureClock::now();
+        bool ok = writeFrame(slots[slot], frame);
+        double ms = msSince(start);
+
+        lock.lock();
+        freeSlots.push_back(slot);
+        if (ok) {
+            ++counters.written;
+            counters.writeMs += ms;
+        } else {
+            ++counters.dropped;
+        }
+        released.notify_one();
+    }
+}
+
+bool FrameCapture::writeFrame(const std::vector<unsigned char>& rgba, long long frame) {
+    if (format == CAPTURE_Y4M) {
+        encodeY4MFrame(rgba, width, height, scratch);
+        fputs("FRAME\n", video);
+        return fwrite(&scratch[0], 1, scratch.size(), video) == scratch.size();
+    }
+
+    encodePNG(rgba, width, height, scratch);
+    char name[1024];
+    snprintf(name, sizeof(name), "%s/frame_%05lld.png", path.c_str(), frame);
+    FILE* f = fopen(name, "wb");
+    if (!f) {
+        fprintf(stderr, "Capture: cannot write %s\n", name);
+        return false;
+    }
+    bool ok = fwrite(&scratch[0], 1, scratch.size(), f) == scratch.size();
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,95 @@
+#ifndef CITY_VIEW_FRAME_CAPTURE_H
+#define CITY_VIEW_FRAME_CAPTURE_H
+
+#include <GL/glut.h>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Recording of the displayed frames. Each frame is read back into the
+// next of CAPTURE_PBO_RING pixel buffer objects, which returns at once;
+// a buffer is only mapped when the ring comes back round to it, by which
+// time the GPU has long finished the copy, so neither the readback nor
+// the swap waits. The mapped pixels go into a slot of a bounded queue and
+// a writer thread turns them into a Y4M video or a numbered PNG sequence.
+// When every slot is still waiting for the writer the frame is dropped
+// and counted, and rendering carries on.
+//
+// Without pixel buffer objects frames are read back synchronously; the
+// writing still happens on the writer thread.
+
+const int CAPTURE_PBO_RING = 3;     // Frames between a readback and its copy
+const int CAPTURE_QUEUE_FRAMES = 8; // Frames waiting for the writer
+
+enum CaptureFormat {
+    CAPTURE_Y4M, // One 4:2:0 video file, full-range BT.601
+    CAPTURE_PNG  // DIR/frame_00000.png ..., numbered by frame (drops leave gaps)
+};
+
+struct CaptureStats {
+    long long captured; // Frames read back
+    long long written;
+    long long dropped;  // The queue was full, the frame had another size, or it could not be written
+    double readbackMs;  // Render thread: readbacks, mapping and copying
+    double writeMs;     // Writer thread: conversion and file output
+};
+
+class FrameCapture {
+public:
+    FrameCapture() {}
+    ~FrameCapture() { stop(); }
+
+    // A path ending in .y4m records a video at fpsNumerator / fpsDenominator
+    // frames per second; any other path is an existing directory for PNGs.
+    // Frames must be width x height. Needs the GL context.
+    bool start(const std::string& path, int width, int height, int fpsNumerator, int fpsDenominator);
+    // Read back the frame just drawn into the bound framebuffer (before the swap)
+    void captureFrame();
+    // Finish the readbacks in flight, wait for the writer to empty the
+    // queue and close the output. Needs the GL context.
+    void stop();
+
+    bool isActive() const { return active; }
+    CaptureStats stats();
+    void printReport(FILE* out);
+
+private:
+    FrameCapture(const FrameCapture&);
+    FrameCapture& operator=(const FrameCapture&);
+
+    int acquireSlot(bool wait); // -1 when none is free and !wait
+    void submit(int slot, long long frame);
+    void copyPixelBuffer(int ring, bool wait);
+    void writerLoop();
+    bool writeFrame(const std::vector<unsigned char>& rgba, long long frame);
+
+    bool active = false;
+    CaptureFormat format = CAPTURE_Y4M;
+    std::string path;
+    FILE* video = nullptr;
+    int width = 0, height = 0;
+
+    GLuint pixelBuffers[CAPTURE_PBO_RING] = {};
+    long long ringFrame[CAPTURE_PBO_RING] = {}; // Frame read back into each buffer; -1 when idle
+    long long nextFrame = 0;
+
+    // Queue slots hold bottom-up RGBA rows, as glReadPixels returns them
+    std::vector<std::vector<unsigned char> > slots;
+    std::vector<long long> slotFrame;
+    std::vector<int> freeSlots;
+    std::deque<int> queued;
+    std::mutex mutex;
+    std::condition_variable wake;     // Writer: a frame was queued, or stop
+    std::condition_variable released; // Render thread: a slot came free
+    bool stopping = false;
+    std::thread writer;
+
+    CaptureStats counters = {0, 0, 0, 0.0, 0.0};
+    std::vector<unsigned char> scratch; // Writer's output buffer
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+const char* pacingModeName(PacingMode mode) {
+    switch (mode) {
+        case PACING_TARGET_FPS: return "target fps";
+        case PACING_VSYNC: return "vsync";
+        case PACING_ON_DEMAND: return "on demand";
+        default: return "?";
+    }
+}
+
+// ---------- HISTOGRAM ----------
+
+void FrameIntervalHistogram::record(double intervalMs, double targetMs) {
+    double jitter = std::fabs(intervalMs - targetMs);
+    ++intervals[std::min(INTERVAL_BUCKETS - 1, (int)intervalMs)];
+    ++jitters[std::min(JITTER_BUCKETS - 1, (int)(jitter / JITTER_BUCKET_MS))];
+    ++frames;
+    intervalSum += intervalMs;
+    jitterSum += jitter;
+    jitterMax = std::max(jitterMax, jitter);
+}
+
+void FrameIntervalHistogram::reset() {
+    *this = FrameIntervalHistogram();
+}
+
+double FrameIntervalHistogram::jitterPercentileMs(double p) const {
+    if (frames == 0) return 0.0;
+    long long rank = (long long)std::ceil(p * frames), seen = 0;
+    for (int b = 0; b < JITTER_BUCKETS - 1; ++b) {
+        seen += jitters[b];
+        if (seen >= rank) return (b + 1) * JITTER_BUCKET_MS;
+    }
+    return jitterMax;
+}
+
+void FrameIntervalHistogram::print(FILE* out) const {
+    long long most = *std::max_element(intervals, intervals + INTERVAL_BUCKETS);
+    for (int b = 0; b < INTERVAL_BUCKETS; ++b) {
+        if (intervals[b] == 0) continue;
+        int bar = (int)((intervals[b] * 40 + most - 1) / most);
+        fprintf(out, "  %s%2d ms |%-40s %lld\n", b == INTERVAL_BUCKETS - 1 ? ">=" : "  ", b,
+                std::string(bar, '#').c_str(), intervals[b]);
+    }
+}
+
+// ---------- SCHEDULE ----------
+
+void FramePacer::setMode(PacingMode m) {
+    mode = m;
+    resetStats();
+}
+
+void FramePacer::setTargetFps(double f) {
+    fps = std::max(1.0, f);
+    resetStats();
+}
+
+bool FramePacer::frameDue(double nowMs, bool changed) {
+    if (deadline < 0.0) deadline = nowMs;
+    if (!visible) {
+        ++stats.hidden;
+        lastPresent = -1.0;
+        return false;
+    }
+    if (mode == PACING_ON_DEMAND && !changed && !dirty) {
+        ++stats.unchanged;
+        lastPresent = -1.0;
+        return false;
+    }
+    dirty = false;
+    pending = true;
+    return true;
+}
+
+void FramePacer::framePresented(double nowMs) {
+    if (!pending) {
+        ++stats.extra;
+        return;
+    }
+    // Only back-to-back deadlines give an interval; a skipped one would
+    // look like a stall
+    if (lastPresent >= 0.0) intervals.record(nowMs - lastPresent, intervalMs());
+    lastPresent = nowMs;
+    pending = false;
+    ++stats.presented;
+}
+
+int FramePacer::delayToNextMs(double nowMs) {
+    double interval = intervalMs();
+    if (deadline < 0.0) deadline = nowMs;
+    deadline += interval;
+    if (mode == PACING_VSYNC && lastPresent >= 0.0) {
+        // Snap to the refresh phase: the last swap returned just after a
+        // refresh, and the next ones come a whole number of intervals later
+        double phase = lastPresent - VSYNC_LEAD_MS;
+        deadline = phase + std::floor((deadline - phase) / interval + 0.5) * interval;
+    }
+    if (nowMs > deadline) {
+        long long late = (long long)((nowMs - deadline) / interval) + 1;
+        stats.missed += late;
+        deadline += late * interval;
+    }
+    return (int)(deadline - nowMs + 0.5);
+}
+
+void FramePacer::resetStats() {
+    intervals.reset();
+    stats = FramePacingCounters{0, 0, 0, 0, 0};
+    deadline = -1.0;
+    lastPresent = -1.0;
+    pending = false;
+    dirty = true;
+}
+
+void FramePacer::printReport(FILE* out) const {
+    fprintf(out, "Frame pacing: %s, target %.1f fps (%.3f ms)\n", pacingModeName(mode), fps, intervalMs());
+    fprintf(out, "  %lld frames on schedule, %lld extra; mean interval %.3f ms (%.1f fps)\n",
+            stats.presented, stats.extra, intervals.meanIntervalMs(),
+            intervals.meanIntervalMs() > 0.0 ? 1000.0 / intervals.meanIntervalMs() : 0.0);
+    fprintf(out, "  Jitter: mean %.3f ms, p99 %.2f ms, max %.3f ms\n",
+            intervals.meanJitterMs(), intervals.jitterPercentileMs(0.99), intervals.maxJitterMs());
+    fprintf(out, "  Missed deadlines: %lld; skipped: %lld unchanged, %lld hidden\n",
+            stats.missed, stats.unchanged, stats.hidden);
+    intervals.print(out);
+}
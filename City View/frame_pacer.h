@@ -0,0 +1,104 @@
+#ifndef CITY_VIEW_FRAME_PACER_H
+#define CITY_VIEW_FRAME_PACER_H
+
+#include <cstdio>
+
+// Frame scheduling for the window. Deadlines are kept on an absolute
+// schedule (first deadline + n * interval) rather than "now + interval",
+// so timer jitter and frame time never add up to drift: a late timer is
+// followed by a shorter wait, and a frame that overruns a whole interval
+// drops that deadline (a missed deadline) instead of bunching up the
+// frames after it.
+//
+// The pacer never reads a clock itself. Times are milliseconds from any
+// fixed origin, so the benchmark can drive it exactly like the GLUT timer.
+
+enum PacingMode {
+    PACING_TARGET_FPS, // A frame every 1/fps seconds
+    PACING_VSYNC,      // Swap interval 1; each deadline follows the last swap
+    PACING_ON_DEMAND,  // Target FPS, but only when something changed
+    NUM_PACING_MODES
+};
+
+const char* pacingModeName(PacingMode mode);
+
+const double DEFAULT_TARGET_FPS = 60.0;
+const double VSYNC_LEAD_MS = 2.0;       // Wake this early; the swap waits for the refresh
+const int INTERVAL_BUCKETS = 64;        // 1 ms each; the last one holds everything longer
+const int JITTER_BUCKETS = 32;          // JITTER_BUCKET_MS each; the last one holds the rest
+const double JITTER_BUCKET_MS = 0.25;
+
+// Intervals between consecutive frames, and their jitter: how far each
+// one strays from the target interval
+class FrameIntervalHistogram {
+public:
+    void record(double intervalMs, double targetMs);
+    void reset();
+
+    long long count() const { return frames; }
+    double meanIntervalMs() const { return frames ? intervalSum / frames : 0.0; }
+    double meanJitterMs() const { return frames ? jitterSum / frames : 0.0; }
+    double maxJitterMs() const { return jitterMax; }
+    // Upper edge of the bucket holding the p-th percentile (0..1)
+    double jitterPercentileMs(double p) const;
+    const long long* intervalBuckets() const { return intervals; }
+    const long long* jitterBuckets() const { return jitters; }
+
+    // Non-empty interval buckets as a bar chart
+    void print(FILE* out) const;
+
+private:
+    long long intervals[INTERVAL_BUCKETS] = {};
+    long long jitters[JITTER_BUCKETS] = {};
+    long long frames = 0;
+    double intervalSum = 0.0, jitterSum = 0.0, jitterMax = 0.0;
+};
+
+struct FramePacingCounters {
+    long long presented; // Frames drawn for a deadline
+    long long extra;     // Frames drawn outside the schedule (input, expose)
+    long long missed;    // Deadlines that passed while the frame before ran long
+    long long unchanged; // Deadlines skipped in PACING_ON_DEMAND, nothing had moved
+    long long hidden;    // Deadlines skipped while the window was hidden
+};
+
+class FramePacer {
+public:
+    // Both restart the schedule and the statistics
+    void setMode(PacingMode m);
+    void setTargetFps(double fps);
+
+    PacingMode getMode() const { return mode; }
+    double getTargetFps() const { return fps; }
+    double intervalMs() const { return 1000.0 / fps; }
+
+    void setVisible(bool v) { visible = v; }
+    // Draw at the next deadline even if nothing moved (PACING_ON_DEMAND)
+    void invalidate() { dirty = true; }
+
+    // A deadline was reached at nowMs: whether to draw a frame for it.
+    // changed tells whether the scene moved since the last deadline.
+    bool frameDue(double nowMs, bool changed);
+    // A frame was swapped to the screen at nowMs
+    void framePresented(double nowMs);
+    // Whole milliseconds until the next deadline (for glutTimerFunc)
+    int delayToNextMs(double nowMs);
+
+    const FrameIntervalHistogram& histogram() const { return intervals; }
+    const FramePacingCounters& counters() const { return stats; }
+    void resetStats();
+    void printReport(FILE* out) const;
+
+private:
+    PacingMode mode = PACING_TARGET_FPS;
+    double fps = DEFAULT_TARGET_FPS;
+    double deadline = -1.0;    // Of the frame being drawn; < 0 before the first
+    double lastPresent = -1.0; // < 0 when the last deadline drew no frame
+    bool pending = false;      // frameDue() said yes, framePresented() not yet called
+    bool visible = true;
+    bool dirty = true;
+    FrameIntervalHistogram intervals;
+    FramePacingCounters stats = {0, 0, 0, 0, 0};
+};
+
+#endif
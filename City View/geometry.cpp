@@ -0,0 +1,281 @@
+#include "geometry.h"
+#include "command_trace.h"
+#include "gl_ext.h"
+#include "lod.h"
+#include "palette.h"
+#include "render_queue.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+static GLubyte toByte(float v) {
+    if (v <= 0.0f) return 0;
+    if (v >= 1.0f) return 255;
+    return (GLubyte)(v * 255.0 + 0.5); // Round to nearest
+}
+
+Color rgb(float r, float g, float b, float a) {
+    Color c = {toByte(r), toByte(g), toByte(b), toByte(a)};
+    return c;
+}
+
+Color rgbub(GLubyte r, GLubyte g, GLubyte b) {
+    Color c = {r, g, b, 255};
+    return c;
+}
+
+// ---------- MeshBuilder ----------
+
+Bounds MeshBuilder::bounds() const {
+    if (vertices.empty()) {
+        Bounds none = {0.0f, 0.0f, 0.0f, 0.0f};
+        return none;
+    }
+    Bounds b = {vertices[0].x, vertices[0].y, vertices[0].x, vertices[0].y};
+    for (size_t i = 1; i < vertices.size(); ++i) {
+        b.minX = std::min(b.minX, vertices[i].x);
+        b.minY = std::min(b.minY, vertices[i].y);
+        b.maxX = std::max(b.maxX, vertices[i].x);
+        b.maxY = std::max(b.maxY, vertices[i].y);
+    }
+    return b;
+}
+
+void MeshBuilder::setColor(PaletteEntry entry) {
+    if (trace) trace->record(TRACE_PALETTE, (uint8_t)entry);
+    applyPalette(entry);
+}
+
+void MeshBuilder::applyPalette(PaletteEntry entry) {
+    color = paletteColor(entry);
+    palette = entry;
+    // The palette shader hides entries itself; baked geometry has to leave them out
+    hidden = !paletteOnGpu() && !paletteVisible(entry);
+}
+
+void MeshBuilder::emit(float x, float y) {
+    Vertex v = {originX + x * scaleX, originY + y * scaleY, color, palette};
+    vertices.push_back(v);
+}
+
+// ---------- Recording (see command_trace.h) ----------
+
+void MeshBuilder::startTrace(CommandTrace& commands) {
+    trace = commands.openStream(color, palette, originX, originY, scaleX, scaleY, lodLevel);
+}
+
+void MeshBuilder::recordColor() {
+    trace->record(TRACE_COLOR, color);
+}
+
+void MeshBuilder::recordOrigin() {
+    trace->record(TRACE_ORIGIN, originX, originY);
+}
+
+void MeshBuilder::recordScale() {
+    trace->record(TRACE_SCALE, scaleX, scaleY);
+}
+
+void MeshBuilder::recordLodLevel() {
+    trace->record(TRACE_LOD, (uint8_t)lodLevel);
+}
+
+// ---------- Primitives ----------
+
+void MeshBuilder::addTriangle(float x0, float y0, float x1, float y1, float x2, float y2) {
+    if (hidden) return;
+    emit(x0, y0);
+    emit(x1, y1);
+    emit(x2, y2);
+}
+
+void MeshBuilder::addQuad(float x0, float y0, float x1, float y1,
+                          float x2, float y2, float x3, float y3) {
+    addTriangle(x0, y0, x1, y1, x2, y2);
+    addTriangle(x0, y0, x2, y2, x3, y3);
+}
+
+void MeshBuilder::triangle(float x0, float y0, float x1, float y1, float x2, float y2) {
+    if (trace) trace->record(TRACE_TRIANGLE, x0, y0, x1, y1, x2, y2);
+    addTriangle(x0, y0, x1, y1, x2, y2);
+}
+
+void MeshBuilder::quad(float x0, float y0, float x1, float y1,
+                       float x2, float y2, float x3, float y3) {
+    if (trace) trace->record(TRACE_QUAD, x0, y0, x1, y1, x2, y2, x3, y3);
+    addQuad(x0, y0, x1, y1, x2, y2, x3, y3);
+}
+
+void MeshBuilder::rect(float x, float y, float width, float height) {
+    if (trace) trace->record(TRACE_RECT, x, y, width, height);
+    addQuad(x, y, x + width, y, x + width, y + height, x, y + height);
+}
+
+void MeshBuilder::polygon(const float* xy, int count) {
+    if (trace) {
+        trace->record(TRACE_POLYGON, (uint16_t)count);
+        trace->recordPoints(xy, count);
+    }
+    for (int i = 1; i + 1 < count; ++i) {
+        addTriangle(xy[0], xy[1], xy[2 * i], xy[2 * i + 1], xy[2 * i + 2], xy[2 * i + 3]);
+    }
+}
+
+void MeshBuilder::noteArcError(float error) {
+    maxArcError = std::max(maxArcError, error * std::max(std::fabs(scaleX), std::fabs(scaleY)));
+}
+
+void MeshBuilder::fan(float cx, float cy, float radiusX, float radiusY,
+                      int segments, float startAngle, float endAngle) {
+    if (trace) trace->record(TRACE_FAN, cx, cy, radiusX, radiusY, (uint16_t)segments, startAngle, endAngle);
+    segments = lodSegments(segments, lodLevel);
+    noteArcError(arcChordError(std::max(std::fabs(radiusX), std::fabs(radiusY)), endAngle - startAngle, segments));
+    float step = (endAngle - startAngle) / segments;
+    float prevX = cx + std::cos(startAngle) * radiusX;
+    float prevY = cy + std::sin(startAngle) * radiusY;
+    for (int i = 1; i <= segments; ++i) {
+        float ang = startAngle + i * step;
+        float x = cx + std::cos(ang) * radiusX;
+        float y = cy + std::sin(ang) * radiusY;
+        addTriangle(cx, cy, prevX, prevY, x, y);
+        prevX = x;
+        prevY = y;
+    }
+}
+
+void MeshBuilder::circle(float cx, float cy, float radius, int segments) {
+    fan(cx, cy, radius, radius, segments, 0.0f, 2.0f * 3.14159265358979323846f);
+}
+
+void MeshBuilder::line(float x0, float y0, float x1, float y1, float width) {
+    if (trace) trace->record(TRACE_LINE, x0, y0, x1, y1, width);
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float len = std::sqrt(dx * dx + dy * dy);
+    if (len <= 0.0f) return;
+    // Half-width offset perpendicular to the segment
+    float nx = -dy / len * width * 0.5f;
+    float ny = dx / len * width * 0.5f;
+    addQuad(x0 + nx, y0 + ny, x0 - nx, y0 - ny, x1 - nx, y1 - ny, x1 + nx, y1 + ny);
+}
+
+void MeshBuilder::append(const Vertex* triangles, int count) {
+    if (trace) trace->append(triangles, count);
+    bool bake = !paletteOnGpu();
+    for (int i = 0; i + 2 < count; i += 3) {
+        Color c = triangles[i].color;
+        PaletteEntry entry = (PaletteEntry)triangles[i].palette;
+        if (entry != 0 && bake) {
+            if (!paletteVisible(entry)) continue;
+            c = paletteColor(entry);
+        }
+        for (int k = 0; k < 3; ++k) {
+            const Vertex& t = triangles[i + k];
+            Vertex v = {originX + t.x * scaleX, originY + t.y * scaleY, c, t.palette};
+            vertices.push_back(v);
+        }
+    }
+}
+
+// ---------- StaticMesh ----------
+
+void StaticMesh::upload(const std::vector<Vertex>& verts) {
+    count = (int)verts.size();
+
+    if (hasVertexBuffers) {
+        if (vbo == 0) {
+            extGenBuffers(1, &vbo);
+        }
+        extBindBuffer(GL_ARRAY_BUFFER, vbo);
+        extBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(Vertex),
+                      verts.empty() ? nullptr : &verts[0], GL_STATIC_DRAW);
+        extBindBuffer(GL_ARRAY_BUFFER, 0);
+        clientCopy.clear();
+    } else {
+        clientCopy = verts;
+    }
+}
+
+void drawVertexRange(RenderState& state, GLuint buffer, const Vertex* clientData, int first, int count) {
+    const char* base = buffer != 0 ? nullptr : (const char*)clientData;
+    state.bindArrayBuffer(buffer);
+    if (bindPaletteProgram(state)) {
+        state.enableClientArrays(false, false);
+        state.enableAttribs((1u << PALETTE_ATTRIB_POSITION) | (1u << PALETTE_ATTRIB_COLOR) |
+                            (1u << PALETTE_ATTRIB_ENTRY));
+        state.attribPointer(PALETTE_ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                            base + offsetof(Vertex, x), 0);
+        state.attribPointer(PALETTE_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+                            base + offsetof(Vertex, color), 0);
+        state.attribPointer(PALETTE_ATTRIB_ENTRY, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex),
+                            base + offsetof(Vertex, palette), 0);
+    } else {
+        state.useProgram(0);
+        state.enableAttribs(0);
+        state.enableClientArrays(true, true);
+        state.vertexPointer(sizeof(Vertex), base + offsetof(Vertex, x));
+        state.colorPointer(sizeof(Vertex), base + offsetof(Vertex, color));
+    }
+    state.drawArrays(first, count);
+}
+
+void StaticMesh::draw() const {
+    if (count == 0) return;
+    RenderState state;
+    drawVertexRange(state, vbo, getClientData(), 0, count);
+    state.reset();
+}
+
+void StaticMesh::release() {
+    if (vbo != 0) {
+        extDeleteBuffers(1, &vbo);
+        vbo = 0;
+    }
+    clientCopy.clear();
+    count = 0;
+}
+
+void DynamicMesh::upload(const std::vector<const std::vector<Vertex>*>& streams, std::vector<int>& firstVertex) {
+    firstVertex.resize(streams.size() + 1);
+    count = 0;
+    for (size_t i = 0; i < streams.size(); ++i) {
+        firstVertex[i] = count;
+        count += (int)streams[i]->size();
+    }
+    firstVertex[streams.size()] = count;
+
+    if (hasVertexBuffers) {
+        if (vbo == 0) {
+            extGenBuffers(1, &vbo);
+        }
+        orphanArrayBuffer(vbo, capacity, (size_t)count * sizeof(Vertex));
+        for (size_t i = 0; i < streams.size(); ++i) {
+            if (streams[i]->empty()) continue;
+            extBufferSubData(GL_ARRAY_BUFFER, firstVertex[i] * sizeof(Vertex),
+                             streams[i]->size() * sizeof(Vertex), &(*streams[i])[0]);
+        }
+        extBindBuffer(GL_ARRAY_BUFFER, 0);
+    } else {
+        clientCopy.clear();
+        for (size_t i = 0; i < streams.size(); ++i) {
+            clientCopy.insert(clientCopy.end(), streams[i]->begin(), streams[i]->end());
+        }
+    }
+}
+
+void DynamicMesh::draw(int first, int n) const {
+    if (n <= 0) return;
+    RenderState state;
+    drawVertexRange(state, vbo, getClientData(), first, n);
+    state.reset();
+}
+
+void DynamicMesh::release() {
+    if (vbo != 0) {
+        extDeleteBuffers(1, &vbo);
+        vbo = 0;
+    }
+    capacity = 0;
+    clientCopy.clear();
+    count = 0;
+}
@@ -0,0 +1,160 @@
+#ifndef CITY_VIEW_GEOMETRY_H
+#define CITY_VIEW_GEOMETRY_H
+
+#include <GL/glut.h>
+#include <vector>
+
+// Retained geometry: draw functions append triangles to a MeshBuilder,
+// which is uploaded once into a StaticMesh and drawn with a single call.
+
+struct Color {
+    GLubyte r, g, b, a;
+};
+
+Color rgb(float r, float g, float b, float a = 1.0f); // Same ranges as glColor3f/4f
+Color rgbub(GLubyte r, GLubyte g, GLubyte b);        // Same ranges as glColor3ub
+
+// One channel blended from a to b, t in [0, 1]
+inline GLubyte mixChannel(GLubyte a, GLubyte b, float t) {
+    return (GLubyte)(a + (b - a) * t + 0.5f);
+}
+
+enum PaletteEntry : unsigned char; // palette.h
+class CommandTrace; // command_trace.h
+class TraceStream;
+class RenderState;  // render_queue.h
+
+struct Vertex {
+    float x, y;
+    Color color;
+    GLubyte palette; // PaletteEntry, 0 for the fixed color above
+};
+
+// Axis-aligned rectangle in world units
+struct Bounds {
+    float minX, minY, maxX, maxY;
+
+    bool overlaps(const Bounds& o) const {
+        return minX <= o.maxX && o.minX <= maxX && minY <= o.maxY && o.minY <= maxY;
+    }
+};
+
+class MeshBuilder {
+public:
+    // Current color, origin and scale, mirroring glColor*, glTranslatef and glScalef
+    void setColor(Color c) {
+        color = c; palette = 0; hidden = false;
+        if (trace) recordColor();
+    }
+    void setColor(PaletteEntry entry); // Day/night color, see palette.h
+    void setOrigin(float x, float y) {
+        originX = x; originY = y;
+        if (trace) recordOrigin();
+    }
+    void setScale(float sx, float sy) { // Applied before the origin
+        scaleX = sx; scaleY = sy;
+        if (trace) recordScale();
+    }
+    float getOriginX() const { return originX; }
+    float getOriginY() const { return originY; }
+    // Detail level for arcs (see lod.h): fan() and circle() use fewer segments
+    void setLodLevel(int level) {
+        lodLevel = level;
+        if (trace) recordLodLevel();
+    }
+    int getLodLevel() const { return lodLevel; }
+
+    void triangle(float x0, float y0, float x1, float y1, float x2, float y2);
+    void quad(float x0, float y0, float x1, float y1,
+              float x2, float y2, float x3, float y3);
+    void rect(float x, float y, float width, float height);
+    // Convex polygon from interleaved x,y pairs (replaces GL_POLYGON)
+    void polygon(const float* xy, int count);
+    // Elliptical arc fan around (cx, cy), like a GL_TRIANGLE_FAN loop
+    void fan(float cx, float cy, float radiusX, float radiusY,
+             int segments, float startAngle, float endAngle);
+    void circle(float cx, float cy, float radius, int segments);
+    // Line of the given width expanded to a quad (replaces GL_LINES + glLineWidth)
+    void line(float x0, float y0, float x1, float y1, float width);
+    // Ready-made triangles (see models.h) at the current origin and scale.
+    // Their palette entries are baked or hidden like setColor() would.
+    void append(const Vertex* triangles, int count);
+
+    void clear() { vertices.clear(); maxArcError = 0.0f; }
+    // Largest chord error of the arcs added since clear(), in world units
+    float arcError() const { return maxArcError; }
+    void noteArcError(float error); // For ready-made triangles, in local units
+    const std::vector<Vertex>& getVertices() const { return vertices; }
+    Bounds bounds() const; // Extent of all vertices, empty mesh gives a zero rect
+
+    // Record the calls above from here on into a new stream of trace,
+    // starting from the current color, origin, scale and detail level
+    void startTrace(CommandTrace& trace);
+    void setTrace(TraceStream* stream) { trace = stream; } // nullptr stops recording
+    TraceStream* getTrace() const { return trace; }
+
+private:
+    void emit(float x, float y);
+    // The primitives without recording, for the ones built from them
+    void addTriangle(float x0, float y0, float x1, float y1, float x2, float y2);
+    void addQuad(float x0, float y0, float x1, float y1,
+                 float x2, float y2, float x3, float y3);
+    void applyPalette(PaletteEntry entry);
+    void recordColor();
+    void recordOrigin();
+    void recordScale();
+    void recordLodLevel();
+
+    std::vector<Vertex> vertices;
+    Color color = {255, 255, 255, 255};
+    GLubyte palette = 0;
+    bool hidden = false; // Baked palette color that is not visible now
+    float originX = 0.0f, originY = 0.0f;
+    float scaleX = 1.0f, scaleY = 1.0f;
+    int lodLevel = 0;
+    float maxArcError = 0.0f;
+    TraceStream* trace = nullptr;
+};
+
+// Geometry rebuilt every frame, uploaded from several vertex streams into
+// one buffer (orphaned each frame) and drawn in ranges.
+class DynamicMesh {
+public:
+    // Concatenate the streams in order; returns the first vertex of each
+    void upload(const std::vector<const std::vector<Vertex>*>& streams, std::vector<int>& firstVertex);
+    void draw(int first, int count) const;
+    void release();
+    int vertexCount() const { return count; }
+    GLuint getBuffer() const { return vbo; } // 0 when using client-side arrays
+    const Vertex* getClientData() const { return clientCopy.empty() ? nullptr : &clientCopy[0]; }
+
+private:
+    GLuint vbo = 0;
+    size_t capacity = 0;
+    std::vector<Vertex> clientCopy;
+    int count = 0;
+};
+
+class StaticMesh {
+public:
+    // Replace the mesh contents. Uses a VBO when available, otherwise
+    // keeps a copy for client-side vertex arrays.
+    void upload(const MeshBuilder& builder) { upload(builder.getVertices()); }
+    void upload(const std::vector<Vertex>& verts);
+    void draw() const;
+    void release();
+    int vertexCount() const { return count; }
+    GLuint getBuffer() const { return vbo; } // 0 when using client-side arrays
+    const Vertex* getClientData() const { return clientCopy.empty() ? nullptr : &clientCopy[0]; }
+
+private:
+    GLuint vbo = 0;
+    std::vector<Vertex> clientCopy;
+    int count = 0;
+};
+
+// Triangles [first, first + count) of a vertex buffer, or of client
+// memory when buffer is 0, through the palette shader when there is one
+void drawVertexRange(RenderState& state, GLuint buffer, const Vertex* clientData, int first, int count);
+
+#endif
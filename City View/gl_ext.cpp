@@ -0,0 +1,186 @@
+#include "gl_ext.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+PFNGLGENBUFFERSPROC    extGenBuffers = nullptr;
+PFNGLDELETEBUFFERSPROC extDeleteBuffers = nullptr;
+PFNGLBINDBUFFERPROC    extBindBuffer = nullptr;
+PFNGLBUFFERDATAPROC    extBufferData = nullptr;
+PFNGLBUFFERSUBDATAPROC extBufferSubData = nullptr;
+
+PFNGLCREATESHADERPROC             extCreateShader = nullptr;
+PFNGLDELETESHADERPROC             extDeleteShader = nullptr;
+PFNGLSHADERSOURCEPROC             extShaderSource = nullptr;
+PFNGLCOMPILESHADERPROC            extCompileShader = nullptr;
+PFNGLGETSHADERIVPROC              extGetShaderiv = nullptr;
+PFNGLGETSHADERINFOLOGPROC         extGetShaderInfoLog = nullptr;
+PFNGLCREATEPROGRAMPROC            extCreateProgram = nullptr;
+PFNGLDELETEPROGRAMPROC            extDeleteProgram = nullptr;
+PFNGLATTACHSHADERPROC             extAttachShader = nullptr;
+PFNGLBINDATTRIBLOCATIONPROC       extBindAttribLocation = nullptr;
+PFNGLLINKPROGRAMPROC              extLinkProgram = nullptr;
+PFNGLGETPROGRAMIVPROC             extGetProgramiv = nullptr;
+PFNGLGETPROGRAMINFOLOGPROC        extGetProgramInfoLog = nullptr;
+PFNGLUSEPROGRAMPROC               extUseProgram = nullptr;
+PFNGLGETUNIFORMLOCATIONPROC       extGetUniformLocation = nullptr;
+PFNGLUNIFORM1FPROC                extUniform1f = nullptr;
+PFNGLUNIFORM3FVPROC               extUniform3fv = nullptr;
+PFNGLUNIFORM4FVPROC               extUniform4fv = nullptr;
+PFNGLENABLEVERTEXATTRIBARRAYPROC  extEnableVertexAttribArray = nullptr;
+PFNGLDISABLEVERTEXATTRIBARRAYPROC extDisableVertexAttribArray = nullptr;
+PFNGLVERTEXATTRIBPOINTERPROC      extVertexAttribPointer = nullptr;
+
+PFNGLVERTEXATTRIBDIVISORPROC   extVertexAttribDivisor = nullptr;
+PFNGLDRAWARRAYSINSTANCEDPROC   extDrawArraysInstanced = nullptr;
+
+PFNGLGENFRAMEBUFFERSPROC         extGenFramebuffers = nullptr;
+PFNGLDELETEFRAMEBUFFERSPROC      extDeleteFramebuffers = nullptr;
+PFNGLBINDFRAMEBUFFERPROC         extBindFramebuffer = nullptr;
+PFNGLFRAMEBUFFERTEXTURE2DPROC    extFramebufferTexture2D = nullptr;
+PFNGLFRAMEBUFFERRENDERBUFFERPROC extFramebufferRenderbuffer = nullptr;
+PFNGLCHECKFRAMEBUFFERSTATUSPROC  extCheckFramebufferStatus = nullptr;
+PFNGLGENRENDERBUFFERSPROC        extGenRenderbuffers = nullptr;
+PFNGLDELETERENDERBUFFERSPROC     extDeleteRenderbuffers = nullptr;
+PFNGLBINDRENDERBUFFERPROC        extBindRenderbuffer = nullptr;
+PFNGLRENDERBUFFERSTORAGEPROC     extRenderbufferStorage = nullptr;
+PFNGLBLITFRAMEBUFFERPROC         extBlitFramebuffer = nullptr;
+
+PFNGLGENQUERIESPROC          extGenQueries = nullptr;
+PFNGLDELETEQUERIESPROC       extDeleteQueries = nullptr;
+PFNGLQUERYCOUNTERPROC        extQueryCounter = nullptr;
+PFNGLGETQUERYOBJECTIVPROC    extGetQueryObjectiv = nullptr;
+PFNGLGETQUERYOBJECTUI64VPROC extGetQueryObjectui64v = nullptr;
+PFNGLGETINTEGER64VPROC       extGetInteger64v = nullptr;
+
+PFNGLMAPBUFFERPROC   extMapBuffer = nullptr;
+PFNGLUNMAPBUFFERPROC extUnmapBuffer = nullptr;
+
+bool hasVertexBuffers = false;
+bool hasShaders = false;
+bool hasInstancing = false;
+bool hasFramebuffers = false;
+bool hasTimerQueries = false;
+bool hasPixelBuffers = false;
+
+// GLX hands out non-null pointers even for unsupported names, so every
+// feature is also gated on the context version or extension string.
+static bool versionAtLeast(int major, int minor) {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int ctxMajor = 0, ctxMinor = 0;
+    if (!version || sscanf(version, "%d.%d", &ctxMajor, &ctxMinor) != 2) {
+        return false;
+    }
+    return ctxMajor > major || (ctxMajor == major && ctxMinor >= minor);
+}
+
+static bool hasExtension(const char* name) {
+    const char* list = (const char*)glGetString(GL_EXTENSIONS);
+    if (!list) return false;
+    size_t len = strlen(name);
+    for (const char* p = strstr(list, name); p; p = strstr(p + len, name)) {
+        bool startOk = (p == list || p[-1] == ' ');
+        bool endOk = (p[len] == ' ' || p[len] == '\0');
+        if (startOk && endOk) return true;
+    }
+    return false;
+}
+
+// Look up a core name first, then the ARB-suffixed alias.
+static GLProc lookup(GLProcLoader loader, const char* core, const char* arb) {
+    GLProc proc = loader(core);
+    if (!proc && arb) {
+        proc = loader(arb);
+    }
+    return proc;
+}
+
+void loadGLExtensions(GLProcLoader loader) {
+    extGenBuffers    = (PFNGLGENBUFFERSPROC)lookup(loader, "glGenBuffers", "glGenBuffersARB");
+    extDeleteBuffers = (PFNGLDELETEBUFFERSPROC)lookup(loader, "glDeleteBuffers", "glDeleteBuffersARB");
+    extBindBuffer    = (PFNGLBINDBUFFERPROC)lookup(loader, "glBindBuffer", "glBindBufferARB");
+    extBufferData    = (PFNGLBUFFERDATAPROC)lookup(loader, "glBufferData", "glBufferDataARB");
+    extBufferSubData = (PFNGLBUFFERSUBDATAPROC)lookup(loader, "glBufferSubData", "glBufferSubDataARB");
+
+    hasVertexBuffers = (versionAtLeast(1, 5) || hasExtension("GL_ARB_vertex_buffer_object")) &&
+                       extGenBuffers && extDeleteBuffers && extBindBuffer &&
+                       extBufferData && extBufferSubData;
+
+    extCreateShader             = (PFNGLCREATESHADERPROC)lookup(loader, "glCreateShader", nullptr);
+    extDeleteShader             = (PFNGLDELETESHADERPROC)lookup(loader, "glDeleteShader", nullptr);
+    extShaderSource             = (PFNGLSHADERSOURCEPROC)lookup(loader, "glShaderSource", nullptr);
+    extCompileShader            = (PFNGLCOMPILESHADERPROC)lookup(loader, "glCompileShader", nullptr);
+    extGetShaderiv              = (PFNGLGETSHADERIVPROC)lookup(loader, "glGetShaderiv", nullptr);
+    extGetShaderInfoLog         = (PFNGLGETSHADERINFOLOGPROC)lookup(loader, "glGetShaderInfoLog", nullptr);
+    extCreateProgram            = (PFNGLCREATEPROGRAMPROC)lookup(loader, "glCreateProgram", nullptr);
+    extDeleteProgram            = (PFNGLDELETEPROGRAMPROC)lookup(loader, "glDeleteProgram", nullptr);
+    extAttachShader             = (PFNGLATTACHSHADERPROC)lookup(loader, "glAttachShader", nullptr);
+    extBindAttribLocation       = (PFNGLBINDATTRIBLOCATIONPROC)lookup(loader, "glBindAttribLocation", nullptr);
+    extLinkProgram              = (PFNGLLINKPROGRAMPROC)lookup(loader, "glLinkProgram", nullptr);
+    extGetProgramiv             = (PFNGLGETPROGRAMIVPROC)lookup(loader, "glGetProgramiv", nullptr);
+    extGetProgramInfoLog        = (PFNGLGETPROGRAMINFOLOGPROC)lookup(loader, "glGetProgramInfoLog", nullptr);
+    extUseProgram               = (PFNGLUSEPROGRAMPROC)lookup(loader, "glUseProgram", nullptr);
+    extGetUniformLocation       = (PFNGLGETUNIFORMLOCATIONPROC)lookup(loader, "glGetUniformLocation", nullptr);
+    extUniform1f                = (PFNGLUNIFORM1FPROC)lookup(loader, "glUniform1f", nullptr);
+    extUniform3fv               = (PFNGLUNIFORM3FVPROC)lookup(loader, "glUniform3fv", nullptr);
+    extUniform4fv               = (PFNGLUNIFORM4FVPROC)lookup(loader, "glUniform4fv", nullptr);
+    extEnableVertexAttribArray  = (PFNGLENABLEVERTEXATTRIBARRAYPROC)lookup(loader, "glEnableVertexAttribArray", nullptr);
+    extDisableVertexAttribArray = (PFNGLDISABLEVERTEXATTRIBARRAYPROC)lookup(loader, "glDisableVertexAttribArray", nullptr);
+    extVertexAttribPointer      = (PFNGLVERTEXATTRIBPOINTERPROC)lookup(loader, "glVertexAttribPointer", nullptr);
+
+    hasShaders = versionAtLeast(2, 0) && extCreateShader && extDeleteShader && extShaderSource && extCompileShader &&
+                 extGetShaderiv && extGetShaderInfoLog && extCreateProgram && extDeleteProgram &&
+                 extAttachShader && extBindAttribLocation && extLinkProgram && extGetProgramiv &&
+                 extGetProgramInfoLog && extUseProgram && extGetUniformLocation && extUniform1f &&
+                 extUniform3fv && extUniform4fv && extEnableVertexAttribArray &&
+                 extDisableVertexAttribArray && extVertexAttribPointer;
+
+    extVertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC)lookup(loader, "glVertexAttribDivisor", "glVertexAttribDivisorARB");
+    extDrawArraysInstanced = (PFNGLDRAWARRAYSINSTANCEDPROC)lookup(loader, "glDrawArraysInstanced", "glDrawArraysInstancedARB");
+
+    bool instancingSupported = versionAtLeast(3, 3) ||
+        (hasExtension("GL_ARB_instanced_arrays") && hasExtension("GL_ARB_draw_instanced"));
+    hasInstancing = instancingSupported && hasVertexBuffers && hasShaders &&
+                    extVertexAttribDivisor && extDrawArraysInstanced;
+
+    extGenFramebuffers         = (PFNGLGENFRAMEBUFFERSPROC)lookup(loader, "glGenFramebuffers", nullptr);
+    extDeleteFramebuffers      = (PFNGLDELETEFRAMEBUFFERSPROC)lookup(loader, "glDeleteFramebuffers", nullptr);
+    extBindFramebuffer         = (PFNGLBINDFRAMEBUFFERPROC)lookup(loader, "glBindFramebuffer", nullptr);
+    extFramebufferTexture2D    = (PFNGLFRAMEBUFFERTEXTURE2DPROC)lookup(loader, "glFramebufferTexture2D", nullptr);
+    extFramebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC)lookup(loader, "glFramebufferRenderbuffer", nullptr);
+    extCheckFramebufferStatus  = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)lookup(loader, "glCheckFramebufferStatus", nullptr);
+    extGenRenderbuffers        = (PFNGLGENRENDERBUFFERSPROC)lookup(loader, "glGenRenderbuffers", nullptr);
+    extDeleteRenderbuffers     = (PFNGLDELETERENDERBUFFERSPROC)lookup(loader, "glDeleteRenderbuffers", nullptr);
+    extBindRenderbuffer        = (PFNGLBINDRENDERBUFFERPROC)lookup(loader, "glBindRenderbuffer", nullptr);
+    extRenderbufferStorage     = (PFNGLRENDERBUFFERSTORAGEPROC)lookup(loader, "glRenderbufferStorage", nullptr);
+    extBlitFramebuffer         = (PFNGLBLITFRAMEBUFFERPROC)lookup(loader, "glBlitFramebuffer", nullptr);
+
+    hasFramebuffers = (versionAtLeast(3, 0) || hasExtension("GL_ARB_framebuffer_object")) &&
+                      extGenFramebuffers && extDeleteFramebuffers && extBindFramebuffer &&
+                      extFramebufferTexture2D && extFramebufferRenderbuffer &&
+                      extCheckFramebufferStatus && extGenRenderbuffers && extDeleteRenderbuffers &&
+                      extBindRenderbuffer && extRenderbufferStorage && extBlitFramebuffer;
+
+    extGenQueries          = (PFNGLGENQUERIESPROC)lookup(loader, "glGenQueries", "glGenQueriesARB");
+    extDeleteQueries       = (PFNGLDELETEQUERIESPROC)lookup(loader, "glDeleteQueries", "glDeleteQueriesARB");
+    extQueryCounter        = (PFNGLQUERYCOUNTERPROC)lookup(loader, "glQueryCounter", nullptr);
+    extGetQueryObjectiv    = (PFNGLGETQUERYOBJECTIVPROC)lookup(loader, "glGetQueryObjectiv", "glGetQueryObjectivARB");
+    extGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)lookup(loader, "glGetQueryObjectui64v", nullptr);
+    extGetInteger64v       = (PFNGLGETINTEGER64VPROC)lookup(loader, "glGetInteger64v", nullptr);
+
+    hasTimerQueries = (versionAtLeast(3, 3) || hasExtension("GL_ARB_timer_query")) &&
+                      extGenQueries && extDeleteQueries && extQueryCounter &&
+                      extGetQueryObjectiv && extGetQueryObjectui64v && extGetInteger64v;
+
+    extMapBuffer   = (PFNGLMAPBUFFERPROC)lookup(loader, "glMapBuffer", "glMapBufferARB");
+    extUnmapBuffer = (PFNGLUNMAPBUFFERPROC)lookup(loader, "glUnmapBuffer", "glUnmapBufferARB");
+
+    hasPixelBuffers = (versionAtLeast(2, 1) || hasExtension("GL_ARB_pixel_buffer_object")) &&
+                      hasVertexBuffers && extMapBuffer && extUnmapBuffer;
+}
+
+void orphanArrayBuffer(GLuint buffer, size_t& capacity, size_t bytes) {
+    extBindBuffer(GL_ARRAY_BUFFER, buffer);
+    capacity = std::max(capacity, bytes);
+    extBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+}
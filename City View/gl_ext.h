@@ -0,0 +1,91 @@
+#ifndef CITY_VIEW_GL_EXT_H
+#define CITY_VIEW_GL_EXT_H
+
+#include <GL/glut.h>
+#include <GL/freeglut_ext.h> // glutGetProcAddress
+#include <GL/glext.h>
+#include <cstddef>
+
+// Entry points above OpenGL 1.1. On Windows opengl32.dll only exports 1.1,
+// so everything newer is fetched at runtime through a proc-address loader.
+
+typedef void (*GLProc)();
+typedef GLProc (*GLProcLoader)(const char* name);
+
+// Buffer objects (OpenGL 1.5)
+extern PFNGLGENBUFFERSPROC    extGenBuffers;
+extern PFNGLDELETEBUFFERSPROC extDeleteBuffers;
+extern PFNGLBINDBUFFERPROC    extBindBuffer;
+extern PFNGLBUFFERDATAPROC    extBufferData;
+extern PFNGLBUFFERSUBDATAPROC extBufferSubData;
+
+// Shaders (OpenGL 2.0)
+extern PFNGLCREATESHADERPROC             extCreateShader;
+extern PFNGLDELETESHADERPROC             extDeleteShader;
+extern PFNGLSHADERSOURCEPROC             extShaderSource;
+extern PFNGLCOMPILESHADERPROC            extCompileShader;
+extern PFNGLGETSHADERIVPROC              extGetShaderiv;
+extern PFNGLGETSHADERINFOLOGPROC         extGetShaderInfoLog;
+extern PFNGLCREATEPROGRAMPROC            extCreateProgram;
+extern PFNGLDELETEPROGRAMPROC            extDeleteProgram;
+extern PFNGLATTACHSHADERPROC             extAttachShader;
+extern PFNGLBINDATTRIBLOCATIONPROC       extBindAttribLocation;
+extern PFNGLLINKPROGRAMPROC              extLinkProgram;
+extern PFNGLGETPROGRAMIVPROC             extGetProgramiv;
+extern PFNGLGETPROGRAMINFOLOGPROC        extGetProgramInfoLog;
+extern PFNGLUSEPROGRAMPROC               extUseProgram;
+extern PFNGLGETUNIFORMLOCATIONPROC       extGetUniformLocation;
+extern PFNGLUNIFORM1FPROC                extUniform1f;
+extern PFNGLUNIFORM3FVPROC               extUniform3fv;
+extern PFNGLUNIFORM4FVPROC               extUniform4fv;
+extern PFNGLENABLEVERTEXATTRIBARRAYPROC  extEnableVertexAttribArray;
+extern PFNGLDISABLEVERTEXATTRIBARRAYPROC extDisableVertexAttribArray;
+extern PFNGLVERTEXATTRIBPOINTERPROC      extVertexAttribPointer;
+
+// Instancing (OpenGL 3.3, or ARB_instanced_arrays + ARB_draw_instanced)
+extern PFNGLVERTEXATTRIBDIVISORPROC   extVertexAttribDivisor;
+extern PFNGLDRAWARRAYSINSTANCEDPROC   extDrawArraysInstanced;
+
+// Framebuffer objects (OpenGL 3.0 or ARB_framebuffer_object)
+extern PFNGLGENFRAMEBUFFERSPROC         extGenFramebuffers;
+extern PFNGLDELETEFRAMEBUFFERSPROC      extDeleteFramebuffers;
+extern PFNGLBINDFRAMEBUFFERPROC         extBindFramebuffer;
+extern PFNGLFRAMEBUFFERTEXTURE2DPROC    extFramebufferTexture2D;
+extern PFNGLFRAMEBUFFERRENDERBUFFERPROC extFramebufferRenderbuffer;
+extern PFNGLCHECKFRAMEBUFFERSTATUSPROC  extCheckFramebufferStatus;
+extern PFNGLGENRENDERBUFFERSPROC        extGenRenderbuffers;
+extern PFNGLDELETERENDERBUFFERSPROC     extDeleteRenderbuffers;
+extern PFNGLBINDRENDERBUFFERPROC        extBindRenderbuffer;
+extern PFNGLRENDERBUFFERSTORAGEPROC     extRenderbufferStorage;
+extern PFNGLBLITFRAMEBUFFERPROC         extBlitFramebuffer;
+
+// Timer queries (OpenGL 3.3 or ARB_timer_query)
+extern PFNGLGENQUERIESPROC          extGenQueries;
+extern PFNGLDELETEQUERIESPROC       extDeleteQueries;
+extern PFNGLQUERYCOUNTERPROC        extQueryCounter;
+extern PFNGLGETQUERYOBJECTIVPROC    extGetQueryObjectiv;
+extern PFNGLGETQUERYOBJECTUI64VPROC extGetQueryObjectui64v;
+extern PFNGLGETINTEGER64VPROC       extGetInteger64v;
+
+// Mapping buffers (OpenGL 1.5), for pixel buffer objects (OpenGL 2.1 or
+// ARB_pixel_buffer_object)
+extern PFNGLMAPBUFFERPROC   extMapBuffer;
+extern PFNGLUNMAPBUFFERPROC extUnmapBuffer;
+
+extern bool hasVertexBuffers; // True when all buffer object entry points resolved
+extern bool hasShaders;       // True when all shader entry points resolved
+extern bool hasInstancing;    // True when shaders, VBOs and instanced draws are all usable
+extern bool hasFramebuffers;  // True when framebuffer objects are usable
+extern bool hasTimerQueries;  // True when GPU timestamps can be queried
+extern bool hasPixelBuffers;  // True when buffer objects can take glReadPixels output and be mapped
+
+// Resolve the extension entry points for the current context.
+// Must be called after a context has been made current.
+void loadGLExtensions(GLProcLoader loader = glutGetProcAddress);
+
+// Bind buffer to GL_ARRAY_BUFFER and orphan last frame's storage so the
+// driver never waits on it. The new storage is capacity bytes, grown to
+// fit bytes, ready for extBufferSubData(); the buffer stays bound.
+void orphanArrayBuffer(GLuint buffer, size_t& capacity, size_t bytes);
+
+#endif
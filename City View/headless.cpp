@@ -0,0 +1,277 @@
+#include "headless.h"
+#include "command_trace.h"
+#include "gl_ext.h"
+#include "platform.h"
+#include "scene.h"
+#include "simulation.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define CITY_VIEW_HAVE_EGL
+#endif
+
+#ifdef CITY_VIEW_HAVE_EGL
+
+// ---------- OFFSCREEN CONTEXT ----------
+
+struct HeadlessContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    GLuint fbo = 0;
+    GLuint colorBuffer = 0;
+};
+
+static GLProc eglLoader(const char* name) {
+    return (GLProc)eglGetProcAddress(name);
+}
+
+static EGLDisplay openDisplay() {
+    // Mesa's surfaceless platform needs neither X11 nor a GPU (llvmpipe)
+    const char* clientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (clientExts && getPlatformDisplay && strstr(clientExts, "EGL_MESA_platform_surfaceless")) {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY) return display;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static bool createContext(HeadlessContext& ctx, int width, int height) {
+    ctx.display = openDisplay();
+    if (ctx.display == EGL_NO_DISPLAY || !eglInitialize(ctx.display, nullptr, nullptr)) {
+        fprintf(stderr, "Headless: no EGL display available\n");
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "Headless: EGL has no desktop OpenGL support\n");
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint numConfigs = 0;
+    eglChooseConfig(ctx.display, configAttribs, &config, 1, &numConfigs);
+
+    ctx.context = eglCreateContext(ctx.display, numConfigs > 0 ? config : (EGLConfig)nullptr,
+                                   EGL_NO_CONTEXT, nullptr);
+    if (ctx.context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx.context)) {
+        fprintf(stderr, "Headless: could not create a surfaceless GL context (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    loadGLExtensions(eglLoader);
+    if (!hasFramebuffers) {
+        fprintf(stderr, "Headless: framebuffer objects are not supported\n");
+        return false;
+    }
+
+    // Render target replacing the window's back buffer
+    extGenRenderbuffers(1, &ctx.colorBuffer);
+    extBindRenderbuffer(GL_RENDERBUFFER, ctx.colorBuffer);
+    extRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    extGenFramebuffers(1, &ctx.fbo);
+    extBindFramebuffer(GL_FRAMEBUFFER, ctx.fbo);
+    extFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ctx.colorBuffer);
+    if (extCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Headless: offscreen framebuffer is incomplete\n");
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+static void destroyContext(HeadlessContext& ctx) {
+    if (ctx.fbo) extDeleteFramebuffers(1, &ctx.fbo);
+    if (ctx.colorBuffer) extDeleteRenderbuffers(1, &ctx.colorBuffer);
+    if (ctx.display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (ctx.context != EGL_NO_CONTEXT) eglDestroyContext(ctx.display, ctx.context);
+        eglTerminate(ctx.display);
+    }
+}
+
+// ---------- OUTPUT ----------
+
+static bool writePPM(const char* path, int width, int height, const std::vector<unsigned char>& rgb) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    // GL rows start at the bottom
+    for (int y = height - 1; y >= 0; --y) {
+        fwrite(&rgb[(size_t)y * width * 3], 1, (size_t)width * 3, f);
+    }
+    fclose(f);
+    return true;
+}
+
+static void printFrameStats(std::vector<double> frameMs) {
+    if (frameMs.empty()) return;
+    std::sort(frameMs.begin(), frameMs.end());
+    size_t n = frameMs.size();
+    double total = 0.0;
+    for (size_t i = 0; i < n; ++i) total += frameMs[i];
+    size_t p99 = (size_t)(0.99 * n);
+    if (p99 >= n) p99 = n - 1;
+
+    printf("Frames:      %zu\n", n);
+    printf("Min:         %.3f ms\n", frameMs[0]);
+    printf("Median:      %.3f ms\n", frameMs[n / 2]);
+    printf("p99:         %.3f ms\n", frameMs[p99]);
+    printf("Max:         %.3f ms\n", frameMs[n - 1]);
+    printf("Mean:        %.3f ms\n", total / n);
+    printf("Frames/sec:  %.1f\n", n * 1000.0 / total);
+}
+
+int runHeadless(const HeadlessOptions& opts) {
+    headlessMode = true;
+
+    HeadlessContext ctx;
+    if (!createContext(ctx, opts.width, opts.height)) {
+        destroyContext(ctx);
+        return 1;
+    }
+    printf("Headless renderer: %s (%s)\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+    setHeadlessClock(0);
+    init();
+    // One simulation tick per frame: 1000 / SIM_TICK_MS frames per second
+    if (opts.capturePath && !frameCapture.start(opts.capturePath, opts.width, opts.height, 1000, SIM_TICK_MS)) {
+        destroyContext(ctx);
+        return 1;
+    }
+
+    if (opts.benchmark) {
+        opts.benchmark();
+        destroyContext(ctx);
+        return 0;
+    }
+    if (opts.replayPath) {
+        int result = runTraceReplay(opts.replayPath, opts.frames);
+        destroyContext(ctx);
+        return result;
+    }
+
+    std::vector<double> frameMs;
+    frameMs.reserve(opts.frames);
+    std::vector<unsigned char> pixels;
+    if (opts.dumpDir) {
+        pixels.resize((size_t)opts.width * opts.height * 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    }
+
+    double drawnSum = 0.0, culledSum = 0.0;
+    double vertexSum = 0.0, staticVertexSum = 0.0;
+    int cacheHits = 0;
+    double particleSum = 0.0, spawnMsSum = 0.0, updateMsSum = 0.0, particleDrawMsSum = 0.0;
+    double lodVertexSum = 0.0, lodFullVertexSum = 0.0;
+    RenderQueueStats queueSum = {0, 0, {0, 0, 0, 0, 0, 0, 0}};
+    for (int frame = 0; frame < opts.frames; ++frame) {
+        // Exactly one simulation tick per frame on a virtual clock, so
+        // frames are reproducible regardless of how fast they render
+        setHeadlessClock((frame + 1) * SIM_TICK_MS);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        advanceScene(SIM_TICK_SECONDS);
+        display();
+        glFinish(); // Include the rasterization work, not just submission
+        frameMs.push_back(std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count());
+        drawnSum += lastCullStats.drawn;
+        culledSum += lastCullStats.culled;
+        vertexSum += lastStaticCache.totalVertices;
+        staticVertexSum += lastStaticCache.staticVertices;
+        cacheHits += lastStaticCache.hit ? 1 : 0;
+        particleSum += lastParticleFrame.live;
+        spawnMsSum += lastParticleFrame.spawnMs;
+        updateMsSum += lastParticleFrame.updateMs;
+        particleDrawMsSum += lastParticleFrame.drawMs;
+        lodVertexSum += lastLodFrame.vertices;
+        lodFullVertexSum += lastLodFrame.fullVertices;
+        queueSum.items += lastRenderQueue.items;
+        queueSum.batches += lastRenderQueue.batches;
+        queueSum.state.add(lastRenderQueue.state);
+
+        if (opts.dumpDir) {
+            glReadPixels(0, 0, opts.width, opts.height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/frame_%05d.ppm", opts.dumpDir, frame);
+            if (!writePPM(path, opts.width, opts.height, pixels)) {
+                fprintf(stderr, "Headless: cannot write %s\n", path);
+                destroyContext(ctx);
+                return 1;
+            }
+        }
+    }
+
+    // The first frame pays for uploads and shader compilation
+    printf("First frame: %.3f ms\n", frameMs[0]);
+    if (frameMs.size() > 1) {
+        frameMs.erase(frameMs.begin());
+    }
+    printFrameStats(frameMs);
+    printf("Entities:    %.1f drawn, %.1f culled per frame\n",
+           drawnSum / opts.frames, culledSum / opts.frames);
+    printf("Vertices:    %.0f per frame, %.0f of them static; static cache reused in %d of %d frames\n",
+           vertexSum / opts.frames, staticVertexSum / opts.frames, cacheHits, opts.frames);
+    printf("Particles:   %.0f live; spawn %.3f ms, update %.3f ms, draw %.3f ms per frame\n",
+           particleSum / opts.frames, spawnMsSum / opts.frames, updateMsSum / opts.frames,
+           particleDrawMsSum / opts.frames);
+    printf("LOD:         %.0f vertices per frame for curved and distant objects, %.0f at full detail (%.1f%% fewer)\n",
+           lodVertexSum / opts.frames, lodFullVertexSum / opts.frames,
+           lodFullVertexSum > 0.0 ? 100.0 * (1.0 - lodVertexSum / lodFullVertexSum) : 0.0);
+    printf("Draws:       %.1f queued, %.1f after merging; %.1f GL state changes per frame (%s)\n",
+           (double)queueSum.items / opts.frames, (double)queueSum.batches / opts.frames,
+           (double)queueSum.state.stateChanges() / opts.frames,
+           renderQueueEnabled ? "sorted render queue" : "render queue off");
+    if (inputRecording.eventCount() > 0) {
+        printf("Input:       %zu of %zu recorded events (inputs and checkpoints) played, the recording ends at tick %llu; ",
+               inputRecording.eventsPlayed(), inputRecording.eventCount(),
+               (unsigned long long)inputRecording.getEndTick());
+        if (inputRecording.getMismatches() > 0) {
+            printf("state diverged from the recording after tick %llu, by tick %llu\n",
+                   (unsigned long long)inputRecording.getLastMatchTick(),
+                   (unsigned long long)inputRecording.getFirstMismatchTick());
+        } else {
+            printf("every state checked matched the recording\n");
+        }
+    }
+    if (frameCapture.isActive()) {
+        frameCapture.stop();
+        frameCapture.printReport(stdout);
+    }
+    if (opts.tracePath) {
+        CommandTrace trace;
+        recordCommandTrace(trace);
+        if (!trace.save(opts.tracePath)) {
+            destroyContext(ctx);
+            return 1;
+        }
+        long long commands = trace.commandCount();
+        printf("Trace:       %lld commands from %zu builders in %zu bytes, written to %s\n\n", commands,
+               trace.streamCount(), trace.commandBytes(), opts.tracePath);
+        trace.printAnalysis(stdout);
+    }
+    destroyContext(ctx);
+    return 0;
+}
+
+#else
+
+int runHeadless(const HeadlessOptions&) {
+    fprintf(stderr, "Headless mode needs EGL and is only available on Linux builds\n");
+    return 1;
+}
+
+#endif
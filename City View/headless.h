@@ -0,0 +1,22 @@
+#ifndef CITY_VIEW_HEADLESS_H
+#define CITY_VIEW_HEADLESS_H
+
+// Offscreen rendering without a window (EGL surfaceless + framebuffer
+// object), for benchmarking on machines without a GPU or display.
+
+struct HeadlessOptions {
+    int frames = 300;             // --frames N
+    int width = 850;              // --size WxH (matches the GLUT window)
+    int height = 600;
+    const char* dumpDir = nullptr; // --dump-ppm DIR, writes frame_00000.ppm ...
+    const char* capturePath = nullptr; // --capture FILE.y4m or DIR, through FrameCapture
+    const char* tracePath = nullptr;  // --record-trace FILE, the commands of the frame after the last
+    const char* replayPath = nullptr; // --replay-trace FILE, replayed frames times instead of the scene
+    void (*benchmark)() = nullptr; // Run this instead of the frame loop
+};
+
+// Renders opts.frames frames of the scene as fast as possible and prints
+// min/median/p99 frame time and frames/sec. Returns the process exit code.
+int runHeadless(const HeadlessOptions& opts);
+
+#endif
@@ -0,0 +1,151 @@
+#include "input_recording.h"
+#include "logger.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static double inputClockMs() {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void InputRecording::begin(const SimState& s, const InputView& v) {
+    events.clear();
+    view = v;
+    startTick = s.tick;
+    startChecksum = stateChecksum(s);
+    startMs = inputClockMs();
+    recording = true;
+    playing = false;
+}
+
+void InputRecording::record(InputKind kind, int code, int state, const SimState& s) {
+    InputEvent e = {};
+    e.tick = s.tick;
+    e.checksum = stateChecksum(s);
+    e.timeMs = (uint32_t)(inputClockMs() - startMs);
+    e.kind = kind;
+    e.code = (uint8_t)code;
+    e.state = (uint8_t)state;
+    events.push_back(e);
+}
+
+void InputRecording::checkpoint(const SimState& s) {
+    if ((s.tick - startTick) % INPUT_CHECK_TICKS == 0) record(INPUT_CHECKPOINT, 0, 0, s);
+}
+
+size_t InputRecording::inputCount() const {
+    size_t n = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+        n += events[i].kind != INPUT_CHECKPOINT && events[i].kind != INPUT_END ? 1 : 0;
+    }
+    return n;
+}
+
+void InputRecording::end(const SimState& s) {
+    if (!recording) return;
+    record(INPUT_END, 0, 0, s);
+    recording = false;
+}
+
+bool InputRecording::save(const char* path) const {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        std::cerr << "Input: cannot write " << path << std::endl;
+        return false;
+    }
+    InputFileHeader header = {}; // Padding included, so a session always gives the same file
+    memcpy(header.magic, INPUT_FILE_MAGIC, 4);
+    header.version = INPUT_FILE_VERSION;
+    header.eventCount = (uint32_t)events.size();
+    header.startTick = startTick;
+    header.startChecksum = startChecksum;
+    header.view = view;
+    fwrite(&header, sizeof(header), 1, f);
+    if (!events.empty()) fwrite(&events[0], sizeof(InputEvent), events.size(), f);
+    bool ok = !ferror(f);
+    fclose(f);
+    if (!ok) std::cerr << "Input: cannot write " << path << std::endl;
+    return ok;
+}
+
+bool InputRecording::load(const char* path) {
+    events.clear();
+    recording = playing = false;
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        std::cerr << "Input: cannot open " << path << std::endl;
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    InputFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1;
+    if (!ok || memcmp(header.magic, INPUT_FILE_MAGIC, 4) != 0) {
+        std::cerr << "Input: " << path << " is not a .cvinput file" << std::endl;
+        fclose(f);
+        return false;
+    }
+    if (header.version != INPUT_FILE_VERSION) {
+        std::cerr << "Input: " << path << " has version " << header.version << ", expected "
+                  << INPUT_FILE_VERSION << std::endl;
+        fclose(f);
+        return false;
+    }
+    // The events must fill the rest of the file exactly, checked before allocating them
+    ok = header.eventCount > 0 &&
+         (uint64_t)header.eventCount * sizeof(InputEvent) == (uint64_t)fileSize - sizeof(InputFileHeader);
+    events.resize(ok ? header.eventCount : 0);
+    ok = ok && fread(&events[0], sizeof(InputEvent), events.size(), f) == events.size();
+    fclose(f);
+    for (size_t i = 0; ok && i < events.size(); ++i) {
+        ok = events[i].kind < NUM_INPUT_KINDS && events[i].tick >= (i ? events[i - 1].tick : header.startTick);
+    }
+    if (!ok || events.back().kind != INPUT_END) {
+        std::cerr << "Input: " << path << " is damaged or was not closed" << std::endl;
+        events.clear();
+        return false;
+    }
+    view = header.view;
+    startTick = header.startTick;
+    startChecksum = header.startChecksum;
+    return true;
+}
+
+void InputRecording::startPlayback(const SimState& s) {
+    nextEvent = 0;
+    mismatches = 0;
+    firstMismatchTick = 0;
+    lastMatchTick = startTick;
+    playing = !events.empty();
+    if (s.tick != startTick || stateChecksum(s) != startChecksum) {
+        LOG_EVENT(LOG_WARN, "Input: the scene differs from the one recorded; start with the same options");
+    }
+}
+
+void InputRecording::playDue(const SimState& s, const std::function<void(const InputEvent&)>& dispatch) {
+    while (playing && nextEvent < events.size() && events[nextEvent].tick <= s.tick) {
+        const InputEvent& e = events[nextEvent++];
+        if (e.tick != s.tick || stateChecksum(s) != e.checksum) {
+            if (mismatches++ == 0) {
+                firstMismatchTick = s.tick;
+                LOG_EVENT(LOG_WARN, "Input: playback diverged from the recording after tick %llu, by tick %llu",
+                          (unsigned long long)lastMatchTick, (unsigned long long)s.tick);
+            }
+        } else if (mismatches == 0) {
+            lastMatchTick = s.tick;
+        }
+        if (e.kind == INPUT_CHECKPOINT) {
+            continue;
+        } else if (e.kind == INPUT_END) {
+            playing = false;
+            LOG_EVENT(LOG_INFO, "Input: playback finished at tick %llu, %s", (unsigned long long)s.tick,
+                      mismatches ? "the state differed from the recording" : "every state checked matched the recording");
+        } else {
+            dispatch(e);
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef CITY_VIEW_INPUT_RECORDING_H
+#define CITY_VIEW_INPUT_RECORDING_H
+
+#include "simulation.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Keyboard and mouse input of a session, keyed to the simulation tick it
+// was applied at, so the session can be played back exactly: the
+// simulation only changes through its ticks and these inputs, so giving
+// each input to the same tick reproduces every state, however fast the
+// frames run. Each event also carries the state checksum from just before
+// it, and every INPUT_CHECK_TICKS ticks a checkpoint stores one more, so
+// playback finds the tick a session diverged at to within that many ticks.
+//
+// File layout (.cvinput, little-endian):
+//   InputFileHeader
+//   InputEvent records, eventCount times; the last is INPUT_END
+
+enum InputKind : uint8_t {
+    INPUT_KEY_DOWN,     // code: the character
+    INPUT_KEY_UP,
+    INPUT_SPECIAL_KEY,  // code: GLUT_KEY_*
+    INPUT_MOUSE_BUTTON, // code: button, state: GLUT_DOWN or GLUT_UP
+    INPUT_END,          // Recording stopped; playback ends here
+    INPUT_CHECKPOINT,   // No input, only the state checksum before the tick
+    NUM_INPUT_KINDS
+};
+
+const int INPUT_CHECK_TICKS = 10; // A checkpoint every this many ticks
+
+const char INPUT_FILE_MAGIC[4] = {'C', 'V', 'I', 'N'};
+const uint32_t INPUT_FILE_VERSION = 1;
+
+// What the recording started from besides the simulation: the camera and
+// the sky, restored before playback
+struct InputView {
+    float cameraX, cameraY, cameraZoom;
+    float timeOfDay;
+    uint32_t ortho; // The first orthographic view (Key: O)
+};
+
+struct InputFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t eventCount;
+    uint32_t reserved;
+    uint64_t startTick;
+    uint64_t startChecksum; // stateChecksum() when recording began
+    InputView view;
+};
+
+struct InputEvent {
+    uint64_t tick;     // Applied before this tick was stepped
+    uint64_t checksum; // stateChecksum() just before it was applied
+    uint32_t timeMs;   // Real time since recording began, for reference
+    uint8_t kind;
+    uint8_t code;
+    uint8_t state;
+    uint8_t reserved;
+};
+
+class InputRecording {
+public:
+    // Recording: begin(), record() for each input as it is applied and
+    // checkpoint() before each tick, end()
+    void begin(const SimState& s, const InputView& view);
+    void record(InputKind kind, int code, int state, const SimState& s);
+    void checkpoint(const SimState& s);
+    void end(const SimState& s);
+    bool isRecording() const { return recording; }
+
+    bool save(const char* path) const;
+    bool load(const char* path); // Prints the reason and returns false on a bad file
+
+    // Playback of a loaded recording from state s, which should be the one
+    // recording began from (same options); warns when its checksum differs
+    void startPlayback(const SimState& s);
+    bool isPlaying() const { return playing; }
+    // Hand dispatch every event recorded for s.tick, in order. Playback
+    // stops at INPUT_END.
+    void playDue(const SimState& s, const std::function<void(const InputEvent&)>& dispatch);
+
+    const InputView& getView() const { return view; }
+    uint64_t getStartTick() const { return startTick; }
+    uint64_t getEndTick() const { return events.empty() ? startTick : events.back().tick; }
+    size_t eventCount() const { return events.size(); } // Checkpoints and INPUT_END included
+    size_t inputCount() const;
+    size_t eventsPlayed() const { return nextEvent; }
+    long long getMismatches() const { return mismatches; } // Events whose state checksum differed
+    uint64_t getFirstMismatchTick() const { return firstMismatchTick; }
+    uint64_t getLastMatchTick() const { return lastMatchTick; } // Of the last event that matched before it
+
+private:
+    std::vector<InputEvent> events;
+    InputView view = {0.0f, 0.0f, 1.0f, 12.0f, 1};
+    uint64_t startTick = 0;
+    uint64_t startChecksum = 0;
+    double startMs = 0.0;
+    bool recording = false;
+    bool playing = false;
+    size_t nextEvent = 0;
+    long long mismatches = 0;
+    uint64_t firstMismatchTick = 0;
+    uint64_t lastMatchTick = 0;
+};
+
+#endif
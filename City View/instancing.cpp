@@ -0,0 +1,178 @@
+#include "instancing.h"
+#include "gl_ext.h"
+#include "shader.h"
+#include "palette.h"
+#include "render_queue.h"
+#include <cstddef>
+#include <string>
+
+bool instancingEnabled = true;
+
+// Attribute locations shared by every instanced prop
+enum {
+    ATTRIB_POSITION = 0,
+    ATTRIB_COLOR = 1,
+    ATTRIB_INSTANCE_XFORM = 2,
+    ATTRIB_INSTANCE_VARIANT = 3,
+    ATTRIB_PALETTE_ENTRY = 4
+};
+
+// Follows paletteShaderCode()
+static const char* propVertexMain =
+    "attribute vec2 position;\n"
+    "attribute vec4 color;\n"
+    "attribute float paletteEntry;\n"
+    "attribute vec4 instanceXform;\n" // x, y, scaleX, scaleY
+    "attribute float instanceVariant;\n"
+    "uniform vec3 variantTints[4];\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    vec2 p = instanceXform.xy + position * instanceXform.zw;\n"
+    "    gl_Position = paletteHidden(paletteEntry) ? PALETTE_HIDDEN_POSITION\n"
+    "                : gl_ModelViewProjectionMatrix * vec4(p, 0.0, 1.0);\n"
+    "    vec4 c = paletteColor(color, paletteEntry);\n"
+    "    vColor = vec4(c.rgb * variantTints[int(instanceVariant)], c.a);\n"
+    "}\n";
+
+static const char* propFragmentSrc =
+    "#version 120\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    gl_FragColor = vColor;\n"
+    "}\n";
+
+// Variant 0 is the original palette, the rest are subtle tints
+static const float variantTints[NUM_PROP_VARIANTS * 3] = {
+    1.0f, 1.0f, 1.0f,
+    0.85f, 0.9f, 1.0f,   // Cool
+    1.0f, 0.85f, 0.75f,  // Warm
+    0.75f, 0.75f, 0.75f  // Weathered
+};
+
+Color variantTint(Color c, float variant) {
+    int v = (int)variant;
+    if (v < 0 || v >= NUM_PROP_VARIANTS) v = 0;
+    const float* tint = &variantTints[v * 3];
+    Color out = {(GLubyte)(c.r * tint[0] + 0.5f), (GLubyte)(c.g * tint[1] + 0.5f),
+                 (GLubyte)(c.b * tint[2] + 0.5f), c.a};
+    return out;
+}
+
+static GLuint propProgram = 0;
+static GLint tintLocation = -1;
+static bool propProgramTried = false;
+
+static GLuint getPropProgram() {
+    if (!propProgramTried) {
+        propProgramTried = true;
+        std::string vertexSrc = "#version 120\n" + paletteShaderCode() + propVertexMain;
+        const char* attribs[] = {"position", "color", "instanceXform", "instanceVariant", "paletteEntry"};
+        propProgram = buildProgram(vertexSrc.c_str(), propFragmentSrc, attribs, 5);
+        if (propProgram) {
+            tintLocation = extGetUniformLocation(propProgram, "variantTints");
+        }
+    }
+    return propProgram;
+}
+
+void InstancedProp::setMesh(const MeshBuilder& builder) {
+    mesh.upload(0, builder);
+}
+
+void InstanceBuffer::set(const PropInstance* instances, int n) {
+    count = n;
+    if (hasInstancing) {
+        if (vbo == 0) {
+            extGenBuffers(1, &vbo);
+        }
+        extBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (n > capacity) {
+            extBufferData(GL_ARRAY_BUFFER, n * sizeof(PropInstance), instances, GL_DYNAMIC_DRAW);
+            capacity = n;
+        } else if (n > 0) {
+            extBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(PropInstance), instances);
+        }
+        extBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    // The fallback path needs the instances on the CPU side
+    copy.assign(instances, instances + n);
+}
+
+void InstanceBuffer::release() {
+    if (vbo != 0) {
+        extDeleteBuffers(1, &vbo);
+        vbo = 0;
+    }
+    capacity = 0;
+    count = 0;
+    copy.clear();
+}
+
+void InstancedProp::draw(const InstanceBuffer& instances) const {
+    RenderState state;
+    draw(state, instances);
+    state.reset();
+}
+
+void InstancedProp::draw(RenderState& state, const InstanceBuffer& instances) const {
+    if (instances.size() == 0 || mesh.vertexCount() == 0) return;
+
+    if (hasInstancing && instancingEnabled && mesh.current().getBuffer() != 0 && getPropProgram()) {
+        drawInstanced(state, instances);
+    } else {
+        drawFallback(state, instances);
+    }
+}
+
+// The program, its uniforms and the mesh attributes carry over to the
+// next prop drawn through the same state; only what differs is set again
+void InstancedProp::drawInstanced(RenderState& state, const InstanceBuffer& instances) const {
+    state.useProgram(propProgram);
+    if (state.firstUse(propProgram)) {
+        extUniform3fv(tintLocation, NUM_PROP_VARIANTS, variantTints);
+        setPaletteUniforms(propProgram);
+        state.countUniforms(2);
+    }
+    state.enableClientArrays(false, false);
+    state.enableAttribs((1u << ATTRIB_POSITION) | (1u << ATTRIB_COLOR) | (1u << ATTRIB_PALETTE_ENTRY) |
+                        (1u << ATTRIB_INSTANCE_XFORM) | (1u << ATTRIB_INSTANCE_VARIANT));
+
+    // Per-vertex mesh attributes
+    state.bindArrayBuffer(mesh.current().getBuffer());
+    state.attribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                        (const void*)offsetof(Vertex, x), 0);
+    state.attribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+                        (const void*)offsetof(Vertex, color), 0);
+    state.attribPointer(ATTRIB_PALETTE_ENTRY, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex),
+                        (const void*)offsetof(Vertex, palette), 0);
+
+    // Per-instance attributes, advanced once per instance
+    state.bindArrayBuffer(instances.getBuffer());
+    state.attribPointer(ATTRIB_INSTANCE_XFORM, 4, GL_FLOAT, GL_FALSE, sizeof(PropInstance),
+                        (const void*)offsetof(PropInstance, x), 1);
+    state.attribPointer(ATTRIB_INSTANCE_VARIANT, 1, GL_FLOAT, GL_FALSE, sizeof(PropInstance),
+                        (const void*)offsetof(PropInstance, variant), 1);
+
+    state.drawArraysInstanced(0, mesh.vertexCount(), instances.size());
+}
+
+// One draw per instance through the fixed-function pipeline.
+// Color variants are not applied here.
+void InstancedProp::drawFallback(RenderState& state, const InstanceBuffer& instances) const {
+    state.reset();
+    glMatrixMode(GL_MODELVIEW);
+    const PropInstance* data = instances.getClientData();
+    for (int i = 0; i < instances.size(); ++i) {
+        const PropInstance& inst = data[i];
+        glPushMatrix();
+        glTranslatef(inst.x, inst.y, 0);
+        glScalef(inst.scaleX, inst.scaleY, 1.0f);
+        mesh.draw();
+        glPopMatrix();
+    }
+}
+
+void InstancedProp::release() {
+    mesh.release();
+    ownInstances.release();
+}
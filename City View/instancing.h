@@ -0,0 +1,74 @@
+#ifndef CITY_VIEW_INSTANCING_H
+#define CITY_VIEW_INSTANCING_H
+
+#include "geometry.h"
+#include "lod.h"
+#include <vector>
+
+// Instanced props: one mesh in local coordinates plus a per-instance
+// attribute buffer, drawn with a single glDrawArraysInstanced call.
+
+struct PropInstance {
+    float x, y;           // Placement (like glTranslatef)
+    float scaleX, scaleY; // Size (like glScalef)
+    float variant;        // Color variant, 0 keeps the mesh colors
+};
+
+const int NUM_PROP_VARIANTS = 4;
+
+// A color as the prop shader tints it for a variant
+Color variantTint(Color c, float variant);
+
+// Turn off to force the per-instance fallback (used by the benchmark)
+extern bool instancingEnabled;
+
+// A list of instances in its own buffer. Several lists can be drawn with
+// the same prop mesh (e.g. one per streamed city chunk).
+class InstanceBuffer {
+public:
+    void set(const PropInstance* instances, int count);
+    void set(const std::vector<PropInstance>& instances) {
+        set(instances.empty() ? nullptr : &instances[0], (int)instances.size());
+    }
+    void release();
+
+    int size() const { return count; }
+    GLuint getBuffer() const { return vbo; }
+    const PropInstance* getClientData() const { return copy.empty() ? nullptr : &copy[0]; }
+
+private:
+    GLuint vbo = 0;
+    int capacity = 0;
+    int count = 0;
+    std::vector<PropInstance> copy; // Kept for the fallback path
+};
+
+class InstancedProp {
+public:
+    void setMesh(const MeshBuilder& builder);
+    LodMesh& getMesh() { return mesh; } // For buildLodMesh()
+    const LodMesh& getMesh() const { return mesh; }
+    void selectLod(float pixelsPerUnit) { mesh.select(pixelsPerUnit); }
+    void setInstances(const PropInstance* instances, int count) { ownInstances.set(instances, count); }
+    void setInstances(const std::vector<PropInstance>& instances) { ownInstances.set(instances); }
+    void draw() const { draw(ownInstances); }
+    void draw(const InstanceBuffer& instances) const; // This mesh at someone else's instances
+    // Through a state shared with other draws (see render_queue.h)
+    void draw(RenderState& state, const InstanceBuffer& instances) const;
+    void release();
+
+    const InstanceBuffer& getInstances() const { return ownInstances; }
+    int instanceCount() const { return ownInstances.size(); }
+    int meshVertexCount() const { return mesh.vertexCount(); }     // At the selected level
+    int fullMeshVertexCount() const { return mesh.fullVertexCount(); }
+    int lodLevels() const { return mesh.levelCount(); }
+
+private:
+    void drawInstanced(RenderState& state, const InstanceBuffer& instances) const;
+    void drawFallback(RenderState& state, const InstanceBuffer& instances) const;
+
+    LodMesh mesh;
+    InstanceBuffer ownInstances;
+};
+
+#endif
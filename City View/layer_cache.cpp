@@ -0,0 +1,64 @@
+#include "layer_cache.h"
+#include "gl_ext.h"
+#include <iostream>
+
+bool LayerCache::beginUpdate(int w, int h) {
+    if (!hasFramebuffers || w <= 0 || h <= 0) return false;
+
+    if (fbo == 0 || w != width || h != height) {
+        release();
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+        extGenFramebuffers(1, &fbo);
+        extBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        extFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        bool complete = extCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        extBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+        if (!complete) {
+            std::cerr << "Layer cache: framebuffer incomplete, drawing directly" << std::endl;
+            release();
+            return false;
+        }
+        width = w;
+        height = h;
+    }
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+    extBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    valid = false;
+    return true;
+}
+
+void LayerCache::endUpdate() {
+    extBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+    valid = true;
+}
+
+void LayerCache::draw() const {
+    if (!valid) return;
+    GLint target = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+    extBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    extBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    extBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    extBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+void LayerCache::release() {
+    if (fbo != 0) {
+        extDeleteFramebuffers(1, &fbo);
+        fbo = 0;
+    }
+    if (texture != 0) {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+    width = height = 0;
+    valid = false;
+}
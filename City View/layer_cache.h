@@ -0,0 +1,34 @@
+#ifndef CITY_VIEW_LAYER_CACHE_H
+#define CITY_VIEW_LAYER_CACHE_H
+
+#include <GL/glut.h>
+
+// Offscreen copy of layers that rarely change. The layers are rendered
+// into a texture-backed framebuffer object once, and every later frame
+// copies the texture into the frame with a single blit until the owner
+// invalidates the cache. Needs framebuffer objects; callers draw directly
+// when beginUpdate() returns false.
+class LayerCache {
+public:
+    // Redirect rendering into the cache, resized to width x height.
+    // Returns false, with the current framebuffer still bound, when
+    // framebuffer objects are not available.
+    bool beginUpdate(int width, int height);
+    // Back to the framebuffer that was bound before; the cache is valid
+    void endUpdate();
+    // Copy the cached pixels to the lower-left corner of the bound framebuffer
+    void draw() const;
+
+    void invalidate() { valid = false; }
+    bool isValid() const { return valid; }
+    void release();
+
+private:
+    GLuint fbo = 0;
+    GLuint texture = 0;
+    int width = 0, height = 0;
+    GLint previousFbo = 0;
+    bool valid = false;
+};
+
+#endif
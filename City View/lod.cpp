@@ -0,0 +1,27 @@
+#include "lod.h"
+#include <cmath>
+
+bool lodEnabled = true;
+
+float arcChordError(float radius, float angle, int segments) {
+    return std::fabs(radius) * (1.0f - std::cos(std::fabs(angle) / segments * 0.5f));
+}
+
+void LodMesh::upload(int l, const MeshBuilder& builder) {
+    meshes[l].upload(builder);
+    errors[l] = builder.arcError();
+    levels = l + 1;
+    level = 0;
+}
+
+void LodMesh::select(float pixelsPerUnit) {
+    level = 0;
+    if (!lodEnabled) return;
+    while (level + 1 < levels && errors[level + 1] * pixelsPerUnit <= LOD_TOLERANCE_PIXELS) ++level;
+}
+
+void LodMesh::release() {
+    for (int l = 0; l < NUM_LOD_LEVELS; ++l) meshes[l].release();
+    levels = 0;
+    level = 0;
+}
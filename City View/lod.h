@@ -0,0 +1,78 @@
+#ifndef CITY_VIEW_LOD_H
+#define CITY_VIEW_LOD_H
+
+#include "geometry.h"
+
+// Levels of detail for curved geometry. A mesh with arcs (wheels, domes,
+// foliage, clouds, the sun and moon) is tessellated once per level, each
+// level with about half the arc segments of the one before, and every
+// level remembers its largest chord error (how far a segment strays from
+// the true arc) in world units. Each frame the coarsest level whose error
+// stays under LOD_TOLERANCE_PIXELS at the current zoom is drawn.
+//
+// The view is orthographic, so all instances of a prop have the same size
+// on screen and share one level: the choice costs nothing per instance
+// and instancing is kept.
+
+const int NUM_LOD_LEVELS = 4;
+const int MIN_ARC_SEGMENTS = 6;
+const float LOD_TOLERANCE_PIXELS = 0.25f;
+
+// Objects smaller than this on screen are drawn as simplified silhouettes
+const float SILHOUETTE_PIXELS = 16.0f;
+
+// Turn off to draw everything at full detail (for comparison)
+extern bool lodEnabled;
+
+// Arc segments at a level: halved per level, never below MIN_ARC_SEGMENTS
+// (or the full count, if that is lower)
+constexpr int lodSegments(int segments, int level) {
+    return ((segments + (1 << level) - 1) >> level) >= MIN_ARC_SEGMENTS ? (segments + (1 << level) - 1) >> level
+         : (segments < MIN_ARC_SEGMENTS ? segments : MIN_ARC_SEGMENTS);
+}
+
+// The sagitta of one segment: radius * (1 - cos(angle / segments / 2))
+float arcChordError(float radius, float angle, int segments);
+
+// Every level of one mesh, built with MeshBuilder::setLodLevel()
+class LodMesh {
+public:
+    // Levels are uploaded in order from 0; uploading level 0 alone gives
+    // a mesh without levels of detail
+    void upload(int level, const MeshBuilder& builder);
+    // Pick the coarsest level that looks the same at this zoom
+    void select(float pixelsPerUnit);
+    void draw() const { meshes[level].draw(); }
+    void release();
+
+    const StaticMesh& current() const { return meshes[level]; }
+    int vertexCount() const { return meshes[level].vertexCount(); }
+    int fullVertexCount() const { return meshes[0].vertexCount(); }
+    int levelCount() const { return levels; }
+    int currentLevel() const { return level; }
+
+private:
+    StaticMesh meshes[NUM_LOD_LEVELS];
+    float errors[NUM_LOD_LEVELS] = {0.0f, 0.0f, 0.0f, 0.0f};
+    int levels = 0;
+    int level = 0;
+};
+
+// Build every level of a mesh with draw(builder). A mesh without arcs
+// gets level 0 only. Only level 0 goes into mb's command trace, if any.
+template <typename Draw>
+void buildLodMesh(LodMesh& mesh, MeshBuilder& mb, Draw draw) {
+    TraceStream* trace = mb.getTrace();
+    for (int l = 0; l < NUM_LOD_LEVELS; ++l) {
+        mb.clear();
+        mb.setLodLevel(l);
+        draw(mb);
+        mesh.upload(l, mb);
+        mb.setTrace(nullptr);
+        if (mb.arcError() == 0.0f) break;
+    }
+    mb.setTrace(trace);
+    mb.setLodLevel(0);
+}
+
+#endif
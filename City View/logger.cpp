@@ -0,0 +1,439 @@
+#include "logger.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock LogClock;
+
+LogLevel logLevel = LOG_INFO;
+
+static const char* LEVEL_NAMES[NUM_LOG_LEVELS] = {"debug", "info", "warn", "error"};
+static const char* LEVEL_LABELS[NUM_LOG_LEVELS] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+const char* logLevelName(LogLevel level) {
+    return level < NUM_LOG_LEVELS ? LEVEL_NAMES[level] : "?";
+}
+
+bool parseLogLevel(const char* name, LogLevel& level) {
+    for (int i = 0; i < NUM_LOG_LEVELS; ++i) {
+        if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ---------- Ring ----------
+
+// Bounded multi-producer ring after Vyukov. Each slot's sequence says
+// whose turn it is: equal to a producer's claimed position, the slot is
+// free for it; one past, it holds the event for the writer at that
+// position. Producers claim positions with a compare-and-swap on
+// enqueuePos; only the writer thread moves dequeuePos.
+
+struct LogRecord {
+    std::atomic<uint64_t> sequence;
+    int64_t timeNs;
+    LogSite* site;
+    const char* format;
+    int count;
+    LogArg args[LOG_MAX_ARGS];
+};
+
+static LogRecord ring[LOG_RING_SLOTS];
+static const uint64_t RING_MASK = LOG_RING_SLOTS - 1;
+static std::atomic<uint64_t> enqueuePos(0);
+static uint64_t dequeuePos = 0;
+
+static struct RingInit {
+    RingInit() {
+        for (int i = 0; i < LOG_RING_SLOTS; ++i) ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+} ringInit;
+
+static std::atomic<long long> droppedEvents(0);
+static std::atomic<long long> sampledOutEvents(0);
+static std::atomic<bool> writerIdle(false);
+static std::mutex wakeMutex;
+static std::condition_variable wake;
+
+bool LogSite::wanted() {
+    if (level < logLevel) return false;
+    if (sampleEvery <= 1 || calls.fetch_add(1, std::memory_order_relaxed) % sampleEvery == 0) return true;
+    sampledOutEvents.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void logPush(LogSite& site, const char* format, const LogArg* args, int count) {
+    uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+    LogRecord* r;
+    for (;;) {
+        r = &ring[pos & RING_MASK];
+        uint64_t seq = r->sequence.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            droppedEvents.fetch_add(1, std::memory_order_relaxed); // Full: the writer is a ring behind
+            return;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    r->timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(LogClock::now().time_since_epoch()).count();
+    r->site = &site;
+    r->format = format;
+    r->count = count;
+    for (int i = 0; i < count; ++i) r->args[i] = args[i];
+    r->sequence.store(pos + 1, std::memory_order_release);
+    // No lock: a wake-up lost to the race with the writer going idle only
+    // delays the event to the writer's next timed check
+    if (writerIdle.load(std::memory_order_relaxed)) wake.notify_one();
+}
+
+static bool eventQueued() {
+    return ring[dequeuePos & RING_MASK].sequence.load(std::memory_order_acquire) == dequeuePos + 1;
+}
+
+// Copies the next event out of the ring and frees its slot
+static bool popEvent(LogRecord& out) {
+    if (!eventQueued()) return false;
+    LogRecord& r = ring[dequeuePos & RING_MASK];
+    out.timeNs = r.timeNs;
+    out.site = r.site;
+    out.format = r.format;
+    out.count = r.count;
+    for (int i = 0; i < r.count; ++i) out.args[i] = r.args[i];
+    r.sequence.store(dequeuePos + LOG_RING_SLOTS, std::memory_order_release);
+    ++dequeuePos;
+    return true;
+}
+
+// ---------- Formatting ----------
+
+static int64_t argInt(const LogArg& a) {
+    switch (a.type) {
+        case LOG_ARG_INT: return a.i;
+        case LOG_ARG_UINT: return (int64_t)a.u;
+        case LOG_ARG_DOUBLE: return (int64_t)a.d;
+        default: return 0;
+    }
+}
+
+static double argDouble(const LogArg& a) {
+    switch (a.type) {
+        case LOG_ARG_INT: return (double)a.i;
+        case LOG_ARG_UINT: return (double)a.u;
+        case LOG_ARG_DOUBLE: return a.d;
+        default: return 0.0;
+    }
+}
+
+// printf with the arguments as they were captured: each conversion is
+// handed to snprintf on its own, widened to the 64-bit type the argument
+// was stored as, so a mismatched length modifier cannot misread it
+static void formatEvent(std::string& out, const char* format, const LogArg* args, int count) {
+    int next = 0;
+    char buf[256];
+    for (const char* p = format; *p; ++p) {
+        if (*p != '%') {
+            out += *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            out += '%';
+            ++p;
+            continue;
+        }
+        std::string spec = "%";
+        for (++p; *p && strchr("-+ #0123456789.", *p); ++p) spec += *p;
+        while (*p && strchr("hlLqjzt", *p)) ++p;
+        char conversion = *p;
+        if (!conversion) break;
+        if (next >= count) {
+            out += "<?>";
+            continue;
+        }
+        const LogArg& a = args[next++];
+        switch (conversion) {
+            case 'd': case 'i':
+                snprintf(buf, sizeof(buf), (spec + "lld").c_str(), (long long)argInt(a));
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                snprintf(buf, sizeof(buf), (spec + "ll" + conversion).c_str(), (unsigned long long)argInt(a));
+                break;
+            case 'c':
+                snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int)argInt(a));
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                snprintf(buf, sizeof(buf), (spec + conversion).c_str(), argDouble(a));
+                break;
+            case 's':
+                snprintf(buf, sizeof(buf), (spec + "s").c_str(),
+                         a.type == LOG_ARG_STRING ? (a.s ? a.s : "(null)") : "<number>");
+                break;
+            default:
+                snprintf(buf, sizeof(buf), "<%%%c?>", conversion);
+                break;
+        }
+        out += buf;
+    }
+}
+
+static void formatLine(std::string& out, int64_t ns, LogLevel level, const char* format,
+                       const LogArg* args, int count) {
+    char prefix[48];
+    snprintf(prefix, sizeof(prefix), "[%10.3f] %s ", ns / 1e9, level < NUM_LOG_LEVELS ? LEVEL_LABELS[level] : "?    ");
+    out = prefix;
+    formatEvent(out, format, args, count);
+    out += '\n';
+}
+
+// ---------- Binary log ----------
+
+// File layout (.cvlog, little-endian): LOG_FILE_MAGIC, uint32 version,
+// then records, each a LogRecordKind byte:
+//   LOG_RECORD_SITE:  uint32 id, uint8 level, uint16 length + format
+//   LOG_RECORD_EVENT: int64 ns since start, uint32 site, uint8 count,
+//                     then per argument a LogArgType byte and 8 bytes,
+//                     or for a string a uint16 length + characters
+
+const char LOG_FILE_MAGIC[4] = {'C', 'V', 'L', 'G'};
+const uint32_t LOG_FILE_VERSION = 1;
+
+enum LogRecordKind : uint8_t { LOG_RECORD_SITE = 1, LOG_RECORD_EVENT = 2 };
+
+template <typename T>
+static void put(std::string& out, T value) {
+    out.append((const char*)&value, sizeof(value));
+}
+
+static void putString(std::string& out, const char* s) {
+    size_t n = s ? strlen(s) : 0;
+    if (n > 0xffff) n = 0xffff;
+    put<uint16_t>(out, (uint16_t)n);
+    out.append(s ? s : "", n);
+}
+
+// ---------- Writer ----------
+
+static std::thread writer;
+static bool writerRunning = false;
+static bool stopping = false;  // Under wakeMutex
+static FILE* logOut = nullptr;
+static bool closeLogOut = false;
+static LogFormat logFormat = LOG_TEXT;
+static int64_t startNs = 0;
+static uint32_t sitesWritten = 0;
+static std::vector<LogSite*> sitesSeen; // Site ids belong to one log; cleared on start
+static long long writtenEvents = 0;
+
+static void writeEvent(const LogRecord& e, std::string& buffer) {
+    int64_t ns = e.timeNs - startNs;
+    if (logFormat == LOG_TEXT) {
+        formatLine(buffer, ns, e.site->level, e.format, e.args, e.count);
+    } else {
+        buffer.clear();
+        if (e.site->id == 0) {
+            e.site->id = ++sitesWritten;
+            sitesSeen.push_back(e.site);
+            put<uint8_t>(buffer, LOG_RECORD_SITE);
+            put<uint32_t>(buffer, e.site->id);
+            put<uint8_t>(buffer, e.site->level);
+            putString(buffer, e.format);
+        }
+        put<uint8_t>(buffer, LOG_RECORD_EVENT);
+        put<int64_t>(buffer, ns);
+        put<uint32_t>(buffer, e.site->id);
+        put<uint8_t>(buffer, (uint8_t)e.count);
+        for (int i = 0; i < e.count; ++i) {
+            put<uint8_t>(buffer, e.args[i].type);
+            if (e.args[i].type == LOG_ARG_STRING) putString(buffer, e.args[i].s);
+            else put<uint64_t>(buffer, e.args[i].u);
+        }
+    }
+    fwrite(buffer.data(), 1, buffer.size(), logOut);
+    ++writtenEvents;
+}
+
+static void writerLoop() {
+    LogRecord e;
+    std::string buffer;
+    for (;;) {
+        bool wrote = false;
+        while (popEvent(e)) {
+            writeEvent(e, buffer);
+            wrote = true;
+        }
+        if (wrote) fflush(logOut);
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        if (stopping && !eventQueued()) break;
+        writerIdle.store(true, std::memory_order_relaxed);
+        wake.wait_for(lock, std::chrono::milliseconds(20), [] { return stopping || eventQueued(); });
+        writerIdle.store(false, std::memory_order_relaxed);
+    }
+}
+
+void startLogger(FILE* out, LogFormat format) {
+    stopLogger();
+    logOut = out;
+    closeLogOut = false;
+    logFormat = format;
+    startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(LogClock::now().time_since_epoch()).count();
+    for (size_t i = 0; i < sitesSeen.size(); ++i) sitesSeen[i]->id = 0;
+    sitesSeen.clear();
+    sitesWritten = 0;
+    writtenEvents = 0;
+    droppedEvents.store(0);
+    sampledOutEvents.store(0);
+    if (format == LOG_BINARY) {
+        fwrite(LOG_FILE_MAGIC, 1, 4, logOut);
+        fwrite(&LOG_FILE_VERSION, sizeof(LOG_FILE_VERSION), 1, logOut);
+    }
+    stopping = false;
+    writerRunning = true;
+    writer = std::thread(writerLoop);
+}
+
+bool startLogger(const char* path, LogFormat format) {
+    if (!path) {
+        startLogger(stdout, format);
+        return true;
+    }
+    FILE* f = fopen(path, format == LOG_BINARY ? "wb" : "w");
+    if (!f) {
+        std::cerr << "Log: cannot create " << path << std::endl;
+        return false;
+    }
+    startLogger(f, format);
+    closeLogOut = true;
+    return true;
+}
+
+void stopLogger() {
+    if (!writerRunning) return;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    writerRunning = false;
+
+    long long dropped = droppedEvents.load();
+    if (dropped > 0 && logFormat == LOG_TEXT) {
+        fprintf(logOut, "[%10.3f] %s Log: %lld events dropped, the writer fell a whole ring behind\n",
+                (std::chrono::duration_cast<std::chrono::nanoseconds>(LogClock::now().time_since_epoch()).count() -
+                 startNs) / 1e9, LEVEL_LABELS[LOG_WARN], dropped);
+    }
+    fflush(logOut);
+    if (closeLogOut) fclose(logOut);
+    logOut = nullptr;
+}
+
+LogStats loggerStats() {
+    LogStats s;
+    s.written = writtenEvents;
+    s.dropped = droppedEvents.load();
+    s.sampledOut = sampledOutEvents.load();
+    return s;
+}
+
+// ---------- Decoding ----------
+
+int runLogDecode(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        std::cerr << "Log: cannot open " << path << std::endl;
+        return 1;
+    }
+    std::string data;
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.append(chunk, n);
+    fclose(f);
+
+    size_t at = 0;
+    auto take = [&](void* out, size_t size) {
+        if (at + size > data.size()) return false;
+        memcpy(out, data.data() + at, size);
+        at += size;
+        return true;
+    };
+    std::vector<std::string> strings; // Argument strings of the current event
+    auto takeString = [&](std::string& s) {
+        uint16_t length;
+        if (!take(&length, sizeof(length)) || at + length > data.size()) return false;
+        s.assign(data.data() + at, length);
+        at += length;
+        return true;
+    };
+
+    char magic[4];
+    uint32_t version;
+    if (!take(magic, 4) || memcmp(magic, LOG_FILE_MAGIC, 4) != 0 || !take(&version, sizeof(version))) {
+        std::cerr << "Log: " << path << " is not a binary log" << std::endl;
+        return 1;
+    }
+    if (version != LOG_FILE_VERSION) {
+        std::cerr << "Log: " << path << " is version " << version << ", expected " << LOG_FILE_VERSION << std::endl;
+        return 1;
+    }
+
+    struct Site {
+        LogLevel level;
+        std::string format;
+    };
+    std::vector<Site> sites(1); // Ids start at 1
+    std::string line;
+    long long events = 0;
+    while (at < data.size()) {
+        uint8_t kind = 0;
+        take(&kind, 1);
+        bool ok = true;
+        if (kind == LOG_RECORD_SITE) {
+            uint32_t id;
+            uint8_t level;
+            Site site;
+            ok = take(&id, sizeof(id)) && take(&level, 1) && takeString(site.format) && id == sites.size();
+            site.level = (LogLevel)level;
+            if (ok) sites.push_back(site);
+        } else if (kind == LOG_RECORD_EVENT) {
+            int64_t ns;
+            uint32_t id;
+            uint8_t count = 0;
+            LogArg args[LOG_MAX_ARGS];
+            ok = take(&ns, sizeof(ns)) && take(&id, sizeof(id)) && take(&count, 1) &&
+                 id > 0 && id < sites.size() && count <= LOG_MAX_ARGS;
+            strings.assign(count, std::string());
+            for (int i = 0; ok && i < count; ++i) {
+                ok = take(&args[i].type, 1);
+                if (!ok) break;
+                if (args[i].type == LOG_ARG_STRING) ok = takeString(strings[i]);
+                else ok = take(&args[i].u, sizeof(args[i].u));
+            }
+            if (ok) {
+                for (int i = 0; i < count; ++i) {
+                    if (args[i].type == LOG_ARG_STRING) args[i].s = strings[i].c_str();
+                }
+                formatLine(line, ns, sites[id].level, sites[id].format.c_str(), args, count);
+                fputs(line.c_str(), stdout);
+                ++events;
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Log: " << path << " is damaged at byte " << at << " after " << events << " events" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
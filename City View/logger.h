@@ -0,0 +1,121 @@
+#ifndef CITY_VIEW_LOGGER_H
+#define CITY_VIEW_LOGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+
+// Asynchronous event log. LOG_EVENT() on any thread copies its format
+// pointer and arguments into a slot of a fixed lock-free ring (many
+// producers, one consumer) and returns: no formatting, no I/O, no lock,
+// no allocation. A writer thread formats the events printf-style and
+// writes them as text lines or as a compact binary log (--decode-log
+// turns that back into text). When the ring is full the event is dropped
+// and counted instead of waiting for the writer.
+//
+// Arguments are numbers, bools and strings. Strings are kept by pointer,
+// so they must outlive the writer: literals, pacingModeName() and so on.
+// The format must be a literal too: the binary log writes it once per
+// call site.
+
+enum LogLevel : uint8_t { LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, NUM_LOG_LEVELS };
+
+enum LogFormat {
+    LOG_TEXT,  // "[  12.345] INFO  Car Speed: 7"
+    LOG_BINARY // Format strings once, then raw arguments per event
+};
+
+const int LOG_RING_SLOTS = 4096; // Events waiting for the writer; a power of two
+const int LOG_MAX_ARGS = 6;
+
+extern LogLevel logLevel; // --log-level; events below it cost one compare
+
+const char* logLevelName(LogLevel level);
+bool parseLogLevel(const char* name, LogLevel& level);
+
+// One LOG_EVENT() or LOG_SAMPLED() call site
+struct LogSite {
+    LogLevel level;
+    uint32_t sampleEvery;        // Keep one call in this many
+    std::atomic<uint32_t> calls;
+    uint32_t id = 0;             // Writer thread: number in the binary log, 0 before the first event
+
+    LogSite(LogLevel level, uint32_t sampleEvery) : level(level), sampleEvery(sampleEvery), calls(0) {}
+    bool wanted();
+};
+
+enum LogArgType : uint8_t { LOG_ARG_INT, LOG_ARG_UINT, LOG_ARG_DOUBLE, LOG_ARG_STRING };
+
+struct LogArg {
+    LogArgType type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const char* s;
+    };
+};
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value, LogArg>::type logArg(T value) {
+    LogArg a;
+    if (std::is_signed<T>::value) {
+        a.type = LOG_ARG_INT;
+        a.i = (int64_t)value;
+    } else {
+        a.type = LOG_ARG_UINT;
+        a.u = (uint64_t)value;
+    }
+    return a;
+}
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value, LogArg>::type logArg(T value) {
+    LogArg a;
+    a.type = LOG_ARG_DOUBLE;
+    a.d = (double)value;
+    return a;
+}
+inline LogArg logArg(const char* value) {
+    LogArg a;
+    a.type = LOG_ARG_STRING;
+    a.s = value;
+    return a;
+}
+
+// The hot path: never blocks, drops the event when the ring is full
+void logPush(LogSite& site, const char* format, const LogArg* args, int count);
+
+template <typename... Args>
+void logEvent(LogSite& site, const char* format, Args... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "LOG_EVENT takes at most LOG_MAX_ARGS arguments");
+    const LogArg packed[sizeof...(Args) + 1] = {logArg(args)...};
+    logPush(site, format, packed, (int)sizeof...(Args));
+}
+
+// LOG_EVENT(LOG_INFO, "Car Speed: %g", speed). LOG_SAMPLED() keeps
+// one call in every, for events that come in floods.
+#define LOG_SAMPLED(level, every, ...) do { \
+    static LogSite logSite(level, every); \
+    if (logSite.wanted()) logEvent(logSite, __VA_ARGS__); \
+} while (0)
+#define LOG_EVENT(level, ...) LOG_SAMPLED(level, 1, __VA_ARGS__)
+
+// Start the writer: text to stdout when path is null. Returns false if
+// the file cannot be created. Events logged before are written too.
+bool startLogger(const char* path, LogFormat format);
+void startLogger(FILE* out, LogFormat format); // Left open by stopLogger()
+// Write everything queued, then stop the writer and close its file
+void stopLogger();
+
+struct LogStats {
+    long long written;
+    long long dropped;    // The ring was full
+    long long sampledOut; // Skipped by LOG_SAMPLED()
+};
+LogStats loggerStats(); // Since the last startLogger()
+
+// --decode-log: print a binary log as text. Returns the process exit code.
+int runLogDecode(const char* path);
+
+#endif
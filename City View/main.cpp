@@ -2,413 +2,429 @@
 #include <cmath>
 #include <iostream>
 #include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include "gl_ext.h"
+#include "geometry.h"
+#include "instancing.h"
+#include "facades.h"
+#include "models.h"
+#include "lod.h"
+#include "logger.h"
+#include "command_trace.h"
+#include "render_queue.h"
+#include "frame_pacer.h"
+#include "scene.h"
+#include "timing.h"
+#include "benchmarks.h"
+#include "headless.h"
+#include "platform.h"
+#include "simulation.h"
+#include "scene_file.h"
+#include "camera.h"
+#include "spatial_grid.h"
+#include "city_chunks.h"
+#include "task_pool.h"
+#include "profiler.h"
+#include "palette.h"
+#include "layer_cache.h"
+#include "water.h"
+#include "particles.h"
+#include <random>
 
 #define PI 3.14159265358979323846
 
-// Initial positions and states
-float carPosX = 0.0f;     // Initial position of the car on the X-axis
-float carSpeed = 6.0f;    // Car speed control for realism (Keys: + / -)
-float boatPosX = 0.0f;    // Initial position of the large boat on the X-axis
-float miniBoatPosX = -300.0f; // NEW: Initial position of the mini sailboat
-float birdPosX = 0.0f;    // Bird starting X position
-float birdBasePosY = 300.0f; // Base Y position for bird's flight
+// Moving objects (cars, boats, birds) are owned by the fixed-step simulation
+// and its entity store; display() reads their interpolated positions.
+FixedStepSimulation simulation;
+float sceneTime = 0.0f;   // Simulated seconds this frame, for time-based effects (water, particles, wings)
 bool isOrtho1 = true;     // For toggling between orthographic views (Key: O)
 
 // --- NEW GLOBAL STATE ---
 bool isNightMode = false;
-bool isBraking = false; // NEW: Flag for brake lights/slowing down
+
+// Time of day in hours. The palette's night blend follows it, easing over
+// NIGHT_TRANSITION_SECONDS when N makes it jump between noon and midnight.
+float timeOfDay = 12.0f;
+float dayLengthSeconds = 0.0f; // Real seconds per 24 hours; 0 stops the clock
+const float NIGHT_TRANSITION_SECONDS = 2.0f;
+float bakedNightBlend = -1.0f; // Blend the static meshes were baked at (no palette shader)
+
+// The view into the world; arrow keys pan, Z/X zoom, C resets (see README)
+Camera camera;
+
+// Built-in layout, used unless a .cvscene file is given with --scene
+// (scenes/default.txt holds the same layout in the text format)
 
 // Array for tree positions (Right side of the road)
-float treePositions[][2] = {
+const ScenePoint treePositions[] = {
     {750.0f, 200.0f},
     {700.0f, 200.0f},
     {650.0f, 200.0f},
 };
-const int NUM_TREES = sizeof(treePositions) / sizeof(treePositions[0]);
 
-// Array for building positions (Left side of the road, facing the sea)
-struct Building {
-    float x, y, width, height;
+// Array for street light positions (Left side of the road, Base Y=200)
+const ScenePoint streetLightPositions[] = {
+    {150.0f, 200.0f},
+    {350.0f, 200.0f},
+    {550.0f, 200.0f},
 };
 
-Building buildings[] = {
+// Array for building positions (Left side of the road, facing the sea)
+const Building buildings[] = {
     {100.0f, 200.0f, 60.0f, 80.0f},  // Small building
     {300.0f, 200.0f, 80.0f, 120.0f}, // Tall building
     {450.0f, 200.0f, 50.0f, 70.0f}    // Medium building
 };
-const int NUM_BUILDINGS = sizeof(buildings) / sizeof(buildings[0]);
+
+const ScenePoint mosquePositions[] = {{20.0f, 200.0f}};
+const ScenePoint playgroundPositions[] = {{500.0f, 200.0f}};
+const ScenePoint benchPositions[] = {{620.0f, 200.0f}}; // Bench near the trees/playground
+
+#define ARRAY_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+SceneLayout builtinSceneLayout() {
+    SceneLayout layout;
+    layout.buildings = buildings;
+    layout.numBuildings = ARRAY_COUNT(buildings);
+    layout.trees = treePositions;
+    layout.numTrees = ARRAY_COUNT(treePositions);
+    layout.streetLights = streetLightPositions;
+    layout.numStreetLights = ARRAY_COUNT(streetLightPositions);
+    layout.mosques = mosquePositions;
+    layout.numMosques = ARRAY_COUNT(mosquePositions);
+    layout.playgrounds = playgroundPositions;
+    layout.numPlaygrounds = ARRAY_COUNT(playgroundPositions);
+    layout.benches = benchPositions;
+    layout.numBenches = ARRAY_COUNT(benchPositions);
+    return layout;
+}
+
+// The layout buildSceneIndex() reads from; points into sceneFile when one is mapped
+MappedSceneFile sceneFile;
+SceneLayout sceneLayout = builtinSceneLayout();
+
+// Retained geometry for everything that does not move. Meshes are rebuilt
+// and re-uploaded only when staticSceneDirty is set (e.g. day/night toggle).
+// Every static entity is an instance of a prop mesh; which instances are
+// submitted is decided each frame by culling the spatial grid against the view.
+MeshBuilder staticSceneBuilder;
+LodMesh skyMesh;         // Sun/moon, clouds; fixed to the screen
+StaticMesh roadMesh;     // Road for one TERRAIN_TILE_WIDTH strip of the world (streamed chunks bring their own)
+InstancedProp carProps;
+std::vector<PropInstance> carInstances; // Refilled from the entity store every frame
+bool staticSceneDirty = true;
+
+const float TERRAIN_TILE_WIDTH = 800.0f; // The sea and road repeat every screen width
+
+InstancedProp staticProps[NUM_STATIC_LAYERS];
+Bounds staticPropBounds[NUM_STATIC_LAYERS];   // Local mesh extent of each prop
+std::vector<PropInstance> layerInstances[NUM_STATIC_LAYERS]; // Every instance, from sceneLayout
+std::vector<FacadeInstance> buildingFacades; // Drawn instead of the building prop, one per building instance
+FacadeRenderer facadeRenderer;
+uint32_t layerFirstId[NUM_STATIC_LAYERS + 1]; // Grid ids of layer l are [first[l], first[l + 1])
+SpatialGrid staticGrid;
+int firstTerrainTile = 0, lastTerrainTile = 0;
+bool sceneIndexDirty = true;
+
+// Per-frame culling state
+bool cullingEnabled = true;
+CullStats lastCullStats = {0, 0};
+Bounds culledView = {0.0f, 0.0f, 0.0f, 0.0f};
+bool cullDirty = true;
+std::vector<uint32_t> visibleIds;
+std::vector<PropInstance> visibleInstances;
+std::vector<FacadeInstance> visibleFacadeList;
+FacadeBuffer visibleFacades;
+
+// Moving layers are rebuilt every frame as vertex streams, generated in
+// parallel and submitted in this (painter's) order. Cars are an instanced
+// prop, so their tasks fill carInstances instead of a stream.
+enum DynamicLayer {
+    DYN_SAILBOATS,
+    DYN_SHIPS,
+    DYN_CARS,
+    DYN_BRAKE_LIGHTS,
+    DYN_BIRDS,
+    NUM_DYNAMIC_LAYERS
+};
+
+const int ENTITIES_PER_TASK = 64;
+
+struct FrameTask {
+    int layer;
+    int begin, end; // Entity range
+};
+
+TaskPool framePool;                  // --frame-threads N
+std::vector<FrameTask> frameTasks;
+std::vector<MeshBuilder> taskStreams; // One per task, kept between frames
+std::vector<const std::vector<Vertex>*> streamList;
+std::vector<int> streamFirstVertex;
+DynamicMesh dynamicMesh;
+WaterSurface water; // Evaluated every frame before the boats that float on it (--water-grid)
+const int WATER_ROWS_PER_TASK = 4;
+FrameBuildStats lastFrameBuild = {0.0, 0.0, 0};
+CommandTrace* recordingTrace = nullptr; // Set while recordCommandTrace() draws its frame
+
+// Smoke from the ships' chimneys, spray at their bows, exhaust behind the
+// cars and a glow at their headlights while those are lit. Each emitter
+// spawns a fixed number of particles per second of scene time; pools that
+// are full drop the rest.
+//                                   gravity drag  size      start color           end color
+const ParticleStyle SPRAY_STYLE   = {-160.0f, 0.5f, 3.0f, 1.5f, {255, 255, 255, 230}, {220, 235, 255, 0}};
+const ParticleStyle SMOKE_STYLE   = {12.0f, 0.6f, 8.0f, 26.0f, {230, 230, 230, 210}, {200, 200, 200, 0}};
+const ParticleStyle EXHAUST_STYLE = {6.0f, 0.3f, 3.0f, 10.0f, {120, 120, 120, 150}, {150, 150, 150, 0}};
+const ParticleStyle GLOW_STYLE    = {0.0f, 0.1f, 6.0f, 20.0f, {255, 240, 170, 140}, {255, 220, 120, 0}};
+enum ParticleEffect { EFFECT_SPRAY, EFFECT_SMOKE, EFFECT_EXHAUST, EFFECT_HEADLIGHT_GLOW, NUM_PARTICLE_EFFECTS }; // Drawing order
+const float EFFECT_RATES[NUM_PARTICLE_EFFECTS] = {30.0f, 10.0f, 12.0f, 25.0f}; // Per emitter per second
+ParticlePool particlePools[NUM_PARTICLE_EFFECTS] = {
+    ParticlePool(16384, SPRAY_STYLE), ParticlePool(8192, SMOKE_STYLE), ParticlePool(4096, EXHAUST_STYLE),
+    ParticlePool(4096, GLOW_STYLE)};
+ParticleBatch particleBatches[NUM_PARTICLE_EFFECTS];
+std::vector<ParticleVertex> particleVertices;
+float effectsDue[NUM_PARTICLE_EFFECTS] = {0.0f, 0.0f, 0.0f, 0.0f}; // Fractional particles owed per emitter
+float effectsTime = 0.0f;
+ParticleFrameStats lastParticleFrame = {0, 0, 0.0, 0.0, 0.0};
+
+// Sky, ground and static structures rendered offscreen and reused until
+// the view, time of day, window size or static content changes
+LayerCache staticCache;
+bool staticCacheEnabled = true;
+StaticCacheStats lastStaticCache = {false, 0, 0};
+
+// Levels of detail picked for this frame's zoom (see lod.h)
+bool sailboatSilhouettes = false;
+LodFrameStats lastLodFrame = {0, 0};
+
+// Everything after the sky is drawn through frameQueue, in these layers
+// (the painter's order; see render_queue.h)
+enum RenderLayer {
+    RL_TERRAIN,
+    RL_STATIC_PROPS, // One per StaticLayer
+    RL_WATER = RL_STATIC_PROPS + NUM_STATIC_LAYERS,
+    RL_BOATS,
+    RL_PARTICLES,
+    RL_CARS,
+    RL_BRAKE_LIGHTS_AND_BIRDS,
+    NUM_RENDER_LAYERS
+};
+static const char* const RENDER_LAYER_SCOPES[NUM_RENDER_LAYERS] = {
+    "draw terrain", "draw buildings", "draw street lights", "draw mosques", "draw playgrounds", "draw benches",
+    "draw trees", "draw water", "draw boats", "draw particles", "draw cars", "draw brake lights and birds"
+};
+RenderQueue frameQueue;
+RenderQueueStats lastRenderQueue = {0, 0, {0, 0, 0, 0, 0, 0, 0}};
+
+// What the cached pixels show
+struct StaticCacheKey {
+    Bounds view;
+    float nightBlend;
+    int width, height;
+    unsigned long long chunkUploads; // Streamed chunks only appear once uploaded
+};
+StaticCacheKey staticCacheKey;
+
+// Endless procedural city (--stream-city); replaces sceneLayout when active
+ChunkStreamer chunkStreamer;
+float cameraPanSpeed = 0.0f; // World units per simulated second (--pan-speed)
 
 // Forward declarations for functions that were missing
-void drawSun(float x, float y, float radius);
-void drawCloud(float x, float y);
-void drawTree(float x, float y);
-void drawBirds(float currentBirdY);
-void drawStreetLight(float x, float y); // New declaration for street light
-void drawBench(float x, float y); // Bench declaration
-void drawMiniSailboat(); // NEW: Mini sailboat declaration
+void drawSun(MeshBuilder& mb, float x, float y, float radius);
+void drawMoon(MeshBuilder& mb, float x, float y, float radius);
+void drawCloud(MeshBuilder& mb, float x, float y);
+void drawBird(MeshBuilder& mb, float x, float y, float velX, float velY, float wingPhase);
+void drawBench(MeshBuilder& mb, float x, float y); // Bench declaration
+void drawMiniSailboat(MeshBuilder& mb, float x, float y); // NEW: Mini sailboat declaration
 void setDayMode();
 void setNightMode();
 void handleKeyRelease(unsigned char key, int x, int y); // Key release handler
+bool playRecordedInput();
+bool recordCheckpoint();
 
 // ---------- MODE SWITCHING FUNCTIONS ----------
 
+// Night blend for a time of day: full day 07-17, full night 19-05
+float nightBlendAt(float hours) {
+    float t;
+    if (hours >= 17.0f && hours < 19.0f) {
+        t = (hours - 17.0f) / 2.0f; // Dusk
+    } else if (hours >= 5.0f && hours < 7.0f) {
+        t = 1.0f - (hours - 5.0f) / 2.0f; // Dawn
+    } else {
+        return (hours >= 7.0f && hours < 17.0f) ? 0.0f : 1.0f;
+    }
+    return t * t * (3.0f - 2.0f * t);
+}
+
 void setNightMode() {
     isNightMode = true;
-    glClearColor(0.05f, 0.05f, 0.2f, 1.0f); // Dark blue sky
-    glutPostRedisplay();
+    staticCache.invalidate();
+    timeOfDay = 0.0f; // Midnight; the palette fades over (advanceScene)
+    requestRedisplay();
 }
 
 void setDayMode() {
     isNightMode = false;
-    glClearColor(0.5f, 0.8f, 1.0f, 1.0f);  // Light blue sky
-    glutPostRedisplay();
+    staticCache.invalidate();
+    timeOfDay = 12.0f;
+    requestRedisplay();
+}
+
+// Jump straight to a time of day, without the fade
+void setTimeOfDay(float hours) {
+    timeOfDay = std::fmod(std::fmod(hours, 24.0f) + 24.0f, 24.0f);
+    setNightBlend(nightBlendAt(timeOfDay));
+    isNightMode = getNightBlend() > 0.5f;
+}
+
+// Run the day clock and ease the night blend towards it
+void advanceTimeOfDay(double seconds) {
+    if (dayLengthSeconds > 0.0f) {
+        timeOfDay = std::fmod(timeOfDay + 24.0f * (float)(seconds / dayLengthSeconds), 24.0f);
+        isNightMode = nightBlendAt(timeOfDay) > 0.5f;
+    }
+    float target = nightBlendAt(timeOfDay);
+    float blend = getNightBlend();
+    float step = (float)seconds / NIGHT_TRANSITION_SECONDS;
+    setNightBlend(blend + std::max(-step, std::min(step, target - blend)));
 }
 
 // ---------- Existing functions ----------
 
-void init() {
-    setDayMode(); // Initialize to Day Mode
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
+// Zoom-1 view size: 800x600, or the wider (-100, 900, -100, 700) ortho
+void applyOrthoSize() {
     if (isOrtho1) {
-        gluOrtho2D(0, 800, 0, 600);
+        camera.setBaseSize(800.0f, 600.0f);
     } else {
-        gluOrtho2D(-100, 900, -100, 700);
+        camera.setBaseSize(1000.0f, 800.0f);
     }
+    camera.applyProjection();
+}
+
+void init() {
+    initPalette();
+    for (int l = 0; l < NUM_RENDER_LAYERS; ++l) frameQueue.nameLayer(l, RENDER_LAYER_SCOPES[l]);
+    setTimeOfDay(timeOfDay); // Noon unless --time-of-day says otherwise
+    applyOrthoSize();
 }
 
 // Function to toggle ortho projection
 void toggleOrtho() {
     isOrtho1 = !isOrtho1;
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    if (isOrtho1) {
-        gluOrtho2D(0, 800, 0, 600);
-    } else {
-        gluOrtho2D(-100, 900, -100, 700);
-    }
-    glutPostRedisplay();
+    applyOrthoSize();
+    staticCache.invalidate();
+    requestRedisplay();
 }
 
-// Function to draw the sea with a gradient for depth
-void drawSea() {
-    // Sea color changes based on time of day
-    if (isNightMode) {
-        // Darker sea
-        glBegin(GL_POLYGON);
-        glColor3f(0.0f, 0.1f, 0.3f);
-        glVertex2i(0, 0);
-        glVertex2i(800, 0);
-        glColor3f(0.0f, 0.15f, 0.4f);
-        glVertex2i(800, 150);
-        glVertex2i(0, 150);
-        glEnd();
-
-    } else {
-        // Day sea
-        glBegin(GL_POLYGON);
-        glColor3f(0.0f, 0.4f, 0.8f);
-        glVertex2i(0, 0);
-        glVertex2i(800, 0);
-        glColor3f(0.0f, 0.5f, 1.0f); // Lighter blue near the road (horizon)
-        glVertex2i(800, 150);
-        glVertex2i(0, 150);
-        glEnd();
-    }
+void setSceneLayout(const SceneLayout& layout) {
+    sceneLayout = layout;
+    sceneIndexDirty = true;
+    requestRedisplay();
+}
 
-    // Simple white wave lines for movement realism
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glLineWidth(1.0f);
-    glBegin(GL_LINES);
-    for (int i = 0; i < 800; i += 50) {
-        glVertex2f(i, 50 + sin((i + boatPosX) * 0.1) * 5);
-        glVertex2f(i + 30, 50 + sin((i + 30 + boatPosX) * 0.1) * 5);
-    }
-    glEnd();
+// Animate the sea: lighter blue near the road (horizon), darker at night.
+// Rows are independent, so they are split across the frame pool.
+void updateWater(double time) {
+    PROFILE_SCOPE("updateWater");
+    Color deep = paletteColor(PAL_SEA_DEEP);
+    Color shallow = paletteColor(PAL_SEA_SHALLOW);
+    int rows = water.getRows();
+    framePool.run((rows + WATER_ROWS_PER_TASK - 1) / WATER_ROWS_PER_TASK, [&](int k) {
+        int first = k * WATER_ROWS_PER_TASK;
+        water.evaluate(time, first, std::min(rows, first + WATER_ROWS_PER_TASK), deep, shallow);
+    });
 }
 
 // Function to draw the road
-void drawRoad() {
-    glColor3f(0.3f, 0.3f, 0.3f);  // Gray road
-    glBegin(GL_POLYGON);
-    glVertex2i(0, 150);
-    glVertex2i(800, 150);
-    glVertex2i(800, 200);
-    glVertex2i(0, 200);
-    glEnd();
+void drawRoad(MeshBuilder& mb) {
+    PROFILE_MESH_SCOPE("drawRoad", mb);
+    mb.setColor(rgb(0.3f, 0.3f, 0.3f));  // Gray road
+    mb.rect(0, 150, 800, 50);
 
     // White dashed lines on the road (always white)
-    glColor3f(1.0f, 1.0f, 1.0f);
+    mb.setColor(rgb(1.0f, 1.0f, 1.0f));
     for (int i = 0; i < 800; i += 80) {
-        glBegin(GL_LINES);
-        glVertex2i(i, 175);
-        glVertex2i(i + 40, 175); // Shorter dash
-        glEnd();
+        mb.line(i, 175, i + 40, 175, 1.0f); // Shorter dash
     }
 }
 
 // 🚢 DRAW REALISTIC BOAT 🚢
-void drawShip() {
-    float waveOffset = sin(boatPosX * 0.015f) * 5.0f;
-    float shipYPosition = 65.0f; // Position above water
-
-    glPushMatrix();
-    // 1. Translate the entire ship to its position, including the wave oscillation
-    glTranslatef(boatPosX, shipYPosition + waveOffset, 0);
-
-    // 2. Set the global scale for the ship
-    glScalef(0.7f, 0.7f, 1.0f);
+void drawShip(MeshBuilder& mb, float x, float y) {
+    PROFILE_MESH_SCOPE("drawShip", mb);
+    float waveOffset = water.displacementAt(x, y); // Rides the same surface that is drawn
+    const float scale = 0.7f; // Global scale for the ship
 
     // --- Hull (Bottom - Submerged Reflection) ---
-    glPushMatrix();
-
-    // Apply local flip for the reflection
-    glScalef(1.0f, -1.0f, 1.0f);
-    // Translate down to position the reflection below the waterline (Y=0)
-    glTranslatef(0.0f, -25.0f, 0.0f);
-
-    glColor3f(0.2f, 0.1f, 0.0f); // Darker Brown/Submerged color
-    glBegin(GL_POLYGON);
-    glVertex2f(-100, 0);
-    glVertex2f(-90, 15);
-    glVertex2f(-60, 25);
-    glVertex2f(80, 25);
-    glVertex2f(100, 15);
-    glVertex2f(100, 0);
-    glEnd();
-
-    glPopMatrix(); // Restore transformation state before the flip
-
-    // --- Hull (Top Part Above Water) ---
-    // This is the actual visible hull.
-    glColor3f(0.4f, 0.2f, 0.0f); // Brown
-    glBegin(GL_POLYGON);
-    glVertex2f(-100, 0);
-    glVertex2f(-90, 15);
-    glVertex2f(-60, 25);
-    glVertex2f(80, 25);
-    glVertex2f(100, 15);
-    glVertex2f(100, 0);
-    glEnd();
-
-
-    // --- Upper Deck (Grey) ---
-    // Starts at Y=25
-    glColor3f(0.8f, 0.8f, 0.8f);
-    glBegin(GL_POLYGON);
-    glVertex2f(-60, 25);
-    glVertex2f(80, 25);
-    glVertex2f(60, 45);
-    glVertex2f(-40, 45);
-    glEnd();
-
-    // --- Bridge (White) ---
-    // Starts at Y=45
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glBegin(GL_POLYGON);
-    glVertex2f(-25, 45);
-    glVertex2f(45, 45);
-    glVertex2f(45, 70);
-    glVertex2f(-25, 70);
-    glEnd();
-
-    // --- Windows (Light Yellow/Blue) ---
-    // Windows are lit up at night
-    if (isNightMode) {
-        glColor3f(1.0f, 1.0f, 0.8f); // Lit up yellow
-    } else {
-        glColor3f(0.0f, 0.4f, 0.8f); // Dark blue glass
-    }
-    for (int i = -20; i <= 40; i += 15) {
-        glBegin(GL_POLYGON);
-        glVertex2f(i, 55);
-        glVertex2f(i + 10, 55);
-        glVertex2f(i + 10, 65);
-        glVertex2f(i, 65);
-        glEnd();
-    }
-
-    // --- Chimney (Red) ---
-    // Starts at Y=70
-    glColor3f(0.8f, 0.1f, 0.1f);
-    glBegin(GL_POLYGON);
-    glVertex2f(20, 70);
-    glVertex2f(30, 70);
-    glVertex2f(30, 95);
-    glVertex2f(20, 95);
-    glEnd();
-
-    // --- Smoke (Light Grey, moving effect) ---
-    float smokeY = 95 + sin(glutGet(GLUT_ELAPSED_TIME) / 500.0f) * 5.0f;
-    glColor3f(0.9f, 0.9f, 0.9f);
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(25, smokeY);
-    for (int i = 0; i <= 20; ++i) {
-        float ang = i * 2.0f * PI / 20.0f;
-        glVertex2f(25 + cos(ang) * 10, smokeY + sin(ang) * 10);
-    }
-    glEnd();
-
-    glPopMatrix();
+    // Flipped and moved down so it mirrors the hull below the waterline
+    mb.setOrigin(x, y + waveOffset + 25.0f * scale);
+    mb.setScale(scale, -scale);
+    appendModel(mb, SHIP_REFLECTION_MODEL);
+
+    // Hull, deck, bridge, windows and chimney at the ship's position,
+    // including the wave oscillation. The smoke is a particle effect, see
+    // updateEffects().
+    mb.setOrigin(x, y + waveOffset);
+    mb.setScale(scale, scale);
+    appendModel(mb, SHIP_MODEL);
+
+    mb.setOrigin(0, 0);
+    mb.setScale(1.0f, 1.0f);
 }
 
 
 // ⛵ DRAW MINI SAILBOAT ⛵ (NEW FUNCTION)
-void drawMiniSailboat() {
-    float waveOffset = sin(miniBoatPosX * 0.05f) * 3.0f;
-    float boatYPosition = 120.0f; // Position higher up on the sea for a distant effect
-
-    glPushMatrix();
-    glTranslatef(miniBoatPosX, boatYPosition + waveOffset, 0);
-    glScalef(0.6f, 0.6f, 1.0f); // EDITED: Increased scale from 0.3f to 0.6f
-
-    // --- Hull (Darker Brown) ---
-    glColor3f(0.2f, 0.1f, 0.0f);
-    glBegin(GL_POLYGON);
-    glVertex2f(-20, 0);
-    glVertex2f(20, 0);
-    glVertex2f(15, 10);
-    glVertex2f(-15, 10);
-    glEnd();
-
-    // --- Mast (Thin Black Line) ---
-    glColor3f(0.0f, 0.0f, 0.0f);
-    glLineWidth(2.0f);
-    glBegin(GL_LINES);
-    glVertex2f(0, 10);
-    glVertex2f(0, 60);
-    glEnd();
-
-    // --- Sail (White/Light) ---
-    if (isNightMode) {
-        glColor3f(0.6f, 0.6f, 0.7f); // Dim sail at night
-    } else {
-        glColor3f(1.0f, 1.0f, 1.0f); // Bright white sail
-    }
-    glBegin(GL_TRIANGLES);
-    glVertex2f(0, 60); // Top of mast
-    glVertex2f(0, 10); // Base of mast
-    glVertex2f(40, 20); // Tip of sail
-    glEnd();
+void drawMiniSailboat(MeshBuilder& mb, float x, float y) {
+    PROFILE_MESH_SCOPE("drawMiniSailboat", mb);
+    float waveOffset = water.displacementAt(x, y);
 
-    glPopMatrix();
+    mb.setOrigin(x, y + waveOffset); // y: higher up on the sea for a distant effect
+    mb.setScale(SAILBOAT_SCALE, SAILBOAT_SCALE);
+    // Hull, mast and sail; when it is only a few pixels tall, hull and sail
+    appendModel(mb, sailboatSilhouettes ? SAILBOAT_SILHOUETTE_MODEL : SAILBOAT_MODEL);
+
+    mb.setOrigin(0, 0);
+    mb.setScale(1.0f, 1.0f);
 }
 
 
 // 🚗 DRAW REALISTIC CAR 🚗
-void drawRealisticCar() {
-    glPushMatrix();
-    glTranslatef(carPosX, 0, 0);
-    glScalef(1.0f, 1.0f, 1.0f); // Original scale for road visibility
-
-    // Car Body (Red) - Added simple curves
-    glColor3f(1.0f, 0.0f, 0.0f);
-    glBegin(GL_POLYGON);
-    glVertex2i(45, 200);  // Back bottom
-    glVertex2i(125, 200); // Front bottom
-    glVertex2i(135, 215); // Hood tip
-    glVertex2i(125, 230); // Windshield base front
-    glVertex2i(55, 230);  // Windshield base back
-    glVertex2i(45, 215);  // Back window base
-    glEnd();
-
-    // --- CAR HEADLIGHTS (NEW: Visible ONLY at night) ---
-    if (isNightMode) {
-        glColor4f(1.0f, 1.0f, 0.8f, 0.8f); // Bright yellow/white
-        glBegin(GL_TRIANGLES);
-        // Left Headlight Beam
-        glVertex2f(135, 208); // Source point (car front)
-        glVertex2f(180, 215); // Far wide point
-        glVertex2f(180, 195); // Far narrow point
-
-        // Right Headlight Beam (slightly lower source)
-        glVertex2f(135, 205); // Source point (car front)
-        glVertex2f(180, 212); // Far wide point
-        glVertex2f(180, 192); // Far narrow point
-        glEnd();
-
-        // Draw the visible light sources on the car
-        glColor3f(1.0f, 0.9f, 0.5f);
-        glBegin(GL_QUADS);
-        glVertex2f(135, 206);
-        glVertex2f(137, 206);
-        glVertex2f(137, 214);
-        glVertex2f(135, 214);
-        glEnd();
-    }
-
-    // --- CAR BRAKE LIGHTS (NEW: Visible when braking) ---
-    if (isBraking) {
-        glColor3f(1.0f, 0.0f, 0.0f); // Bright Red
-        glBegin(GL_QUADS);
-        // Left Brake Light (at x=45)
-        glVertex2f(45, 205);
-        glVertex2f(40, 205);
-        glVertex2f(40, 212);
-        glVertex2f(45, 212);
-        glEnd();
-    }
-
-    // Cabin/Roof (Blue)
-    glColor3f(0.0f, 0.0f, 1.0f);
-    glBegin(GL_POLYGON);
-    glVertex2i(60, 230);
-    glVertex2i(120, 230);
-    glVertex2i(110, 245);
-    glVertex2i(70, 245);
-    glEnd();
-
-    // Windshield (Light Blue/Grey)
-    glColor3f(0.7f, 0.8f, 1.0f);
-    glBegin(GL_POLYGON);
-    glVertex2i(120, 230);
-    glVertex2i(110, 245);
-    glVertex2i(70, 245);
-    glVertex2i(60, 230);
-    glEnd();
-
-    // Wheels (Black)
-    glColor3f(0.0f, 0.0f, 0.0f);
-    // Front wheel
-    glBegin(GL_POLYGON);
-    for (float angle = 0; angle < 2 * PI; angle += 0.1f) {
-        glVertex2f(115 + cos(angle) * 8, 195 + sin(angle) * 8);
-    }
-    glEnd();
-    // Back wheel
-    glBegin(GL_POLYGON);
-    for (float angle = 0; angle < 2 * PI; angle += 0.1f) {
-        glVertex2f(60 + cos(angle) * 8, 195 + sin(angle) * 8);
-    }
-    glEnd();
-
-    glPopMatrix();
+// Builds the car model at its road position (x offset 0). It is drawn as
+// an instanced prop translated by each car's position.
+void drawRealisticCar(MeshBuilder& mb) {
+    PROFILE_MESH_SCOPE("drawRealisticCar", mb);
+    // Body, headlights (visible only at night), cabin, windshield and wheels
+    appendModel(mb, CAR_MODELS[mb.getLodLevel()]);
+}
+
+// --- CAR BRAKE LIGHTS (NEW: Visible when braking) ---
+// Drawn over the instanced car; it does not overlap any later car part.
+// For a car placed like a PropInstance: scaleX -1 faces it towards -x
+void drawBrakeLights(MeshBuilder& mb, float x, float y, float scaleX) {
+    PROFILE_MESH_SCOPE("drawBrakeLights", mb);
+    mb.setOrigin(x, y);
+    mb.setScale(scaleX, 1.0f);
+    mb.setColor(rgb(1.0f, 0.0f, 0.0f)); // Bright Red
+    // Left Brake Light (at x=45)
+    mb.rect(40, 205, 5, 7);
+    mb.setOrigin(0, 0);
+    mb.setScale(1.0f, 1.0f);
 }
 
 // 🏙️ DRAW BUILDING 🏙️
-void drawBuilding(float x, float y, float width, float height) {
-    glPushMatrix();
-    glTranslatef(x, y, 0);
+void drawBuilding(MeshBuilder& mb, float x, float y, float width, float height) {
+    PROFILE_MESH_SCOPE("drawBuilding", mb);
+    mb.setOrigin(x, y);
 
-    // Main Body (Light Brown/Tan)
-    if (isNightMode) {
-        glColor3ub(100, 80, 50); // Darker building at night
-    } else {
-        glColor3ub(200, 180, 140); // Light Brown/Tan
-    }
-    glBegin(GL_POLYGON);
-    glVertex2f(0, 0);
-    glVertex2f(width, 0);
-    glVertex2f(width, height);
-    glVertex2f(0, height);
-    glEnd();
-
-    // Windows (Lit up or Dark)
-    if (isNightMode) {
-        glColor3f(1.0f, 0.9f, 0.7f); // Yellowish light
-    } else {
-        glColor3f(0.0f, 0.0f, 0.3f); // Dark blue glass
-    }
+    // Main Body (Light Brown/Tan, darker at night)
+    mb.setColor(PAL_BUILDING_WALL);
+    mb.rect(0, 0, width, height);
+
+    // Windows (Dark blue glass, yellowish light at night)
+    mb.setColor(PAL_BUILDING_WINDOW);
 
     float windowW = width / 5.0f;
     float windowH = height / 7.0f;
@@ -417,311 +433,159 @@ void drawBuilding(float x, float y, float width, float height) {
         for (int c = 0; c < 2; ++c) {
             float winX = windowW + c * (width - 3 * windowW);
             float winY = windowH + r * (height / 3.0f);
-
-            glBegin(GL_POLYGON);
-            glVertex2f(winX, winY);
-            glVertex2f(winX + windowW, winY);
-            glVertex2f(winX + windowW, winY + windowH);
-            glVertex2f(winX, winY + windowH);
-            glEnd();
+            mb.rect(winX, winY, windowW, windowH);
         }
     }
 
-    glPopMatrix();
+    mb.setOrigin(0, 0);
 }
 
 // 🕌 DRAW MOSQUE 🕌
-void drawMosque(float x, float y) {
-    glPushMatrix();
-    glTranslatef(x, y, 0);
-
-    // Main Hall (White/Light Grey)
-    if (isNightMode) {
-        glColor3ub(150, 150, 150); // Slightly dimmed
-    } else {
-        glColor3ub(230, 230, 230);
-    }
-    glBegin(GL_POLYGON);
-    glVertex2f(0, 0);
-    glVertex2f(60, 0);
-    glVertex2f(60, 40);
-    glVertex2f(0, 40);
-    glEnd();
-
-    // Dome (Green)
-    glColor3f(0.0f, 0.4f, 0.0f);
-    int numSegments = 30;
-    float radius = 20.0f;
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(30, 40); // Center of the base (where the dome meets the hall)
-    for (int i = 0; i <= numSegments; i++) {
-        float angle = i * PI / numSegments;
-        glVertex2f(30 + cos(angle) * radius, 40 + sin(angle) * radius);
-    }
-    glEnd();
-
-    // Minaret (Tall Tower)
-    glColor3ub(180, 180, 180);
-    glBegin(GL_POLYGON);
-    glVertex2f(60, 0);
-    glVertex2f(70, 0);
-    glVertex2f(70, 100);
-    glVertex2f(60, 100);
-    glEnd();
-
-    // Minaret top (cone)
-    glColor3f(0.0f, 0.4f, 0.0f);
-    glBegin(GL_TRIANGLES);
-    glVertex2f(65, 120);
-    glVertex2f(60, 100);
-    glVertex2f(70, 100);
-    glEnd();
-
-    glPopMatrix();
+void drawMosque(MeshBuilder& mb, float x, float y) {
+    PROFILE_MESH_SCOPE("drawMosque", mb);
+    mb.setOrigin(x, y);
+    // Hall, dome, minaret and its cone
+    appendModel(mb, MOSQUE_MODELS[mb.getLodLevel()]);
+    mb.setOrigin(0, 0);
 }
 
 // 🎠 DRAW PLAYGROUND 🎠
-void drawPlayground(float x, float y) {
-    glPushMatrix();
-    glTranslatef(x, y, 0);
-
-    // Ground (Sand color)
-    if (isNightMode) {
-        glColor3ub(120, 100, 60); // Dark sand
-    } else {
-        glColor3ub(240, 220, 160);
-    }
-    glBegin(GL_POLYGON);
-    glVertex2f(-50, 0);
-    glVertex2f(100, 0);
-    glVertex2f(100, 20);
-    glVertex2f(-50, 20);
-    glEnd();
-
-    // --- FENCE BOUNDARY (NEW) ---
-    glColor3ub(100, 100, 100); // Gray fence color
-    glLineWidth(2.0f);
-    float fenceHeight = 35.0f;
-    float postSpacing = 15.0f;
-
-    // Vertical Posts
-    glBegin(GL_LINES);
-    for (float i = -50; i <= 100; i += postSpacing) {
-        glVertex2f(i, 20);
-        glVertex2f(i, 20 + fenceHeight);
-    }
-    glEnd();
-
-    // Horizontal top rail
-    glBegin(GL_LINES);
-    glVertex2f(-50, 20 + fenceHeight);
-    glVertex2f(100, 20 + fenceHeight);
-    glEnd();
-
-    // Horizontal middle rail
-    glBegin(GL_LINES);
-    glVertex2f(-50, 20 + fenceHeight/2.0f);
-    glVertex2f(100, 20 + fenceHeight/2.0f);
-    glEnd();
-
-
-    // --- Swing Set ---
-    // Posts (Grey)
-    glColor3f(0.5f, 0.5f, 0.5f);
-    glLineWidth(3.0f);
-    glBegin(GL_LINES);
-    glVertex2f(0, 20);
-    glVertex2f(0, 60);
-    glVertex2f(50, 20);
-    glVertex2f(50, 60);
-    glEnd();
-
-    // Top Bar
-    glBegin(GL_LINES);
-    glVertex2f(0, 60);
-    glVertex2f(50, 60);
-    glEnd();
-
-    // Swing Ropes (Black)
-    glColor3f(0.0f, 0.0f, 0.0f);
-    glLineWidth(1.0f);
-    glBegin(GL_LINES);
-    glVertex2f(15, 60);
-    glVertex2f(15, 40);
-    glVertex2f(35, 60);
-    glVertex2f(35, 40);
-    glEnd();
-
-    // Swing Seat (Yellow)
-    glColor3ub(255, 200, 0);
-    glBegin(GL_POLYGON);
-    glVertex2f(10, 40);
-    glVertex2f(40, 40);
-    glVertex2f(40, 35);
-    glVertex2f(10, 35);
-    glEnd();
-
-    // --- Slide ---
-    // Stairs (Brown)
-    glColor3f(0.6f, 0.3f, 0.0f);
-    glBegin(GL_POLYGON);
-    glVertex2f(80, 20);
-    glVertex2f(85, 20);
-    glVertex2f(85, 50);
-    glVertex2f(80, 50);
-    glEnd();
-
-    // Slide chute (Blue)
-    glColor3f(0.0f, 0.5f, 0.8f);
-    glBegin(GL_POLYGON);
-    glVertex2f(85, 50);
-    glVertex2f(70, 30);
-    glVertex2f(75, 30);
-    glVertex2f(85, 55);
-    glEnd();
-
-    glPopMatrix();
+void drawPlayground(MeshBuilder& mb, float x, float y) {
+    PROFILE_MESH_SCOPE("drawPlayground", mb);
+    mb.setOrigin(x, y);
+    // Sand, fence, swing set and slide
+    appendModel(mb, PLAYGROUND_MODEL);
+    mb.setOrigin(0, 0);
 }
 
 // 🌳 DRAW TREE 🌳 (Restored Definition)
-void drawTree(float x, float y) {
+void drawTree(MeshBuilder& mb, float x, float y) {
+    PROFILE_MESH_SCOPE("drawTree", mb);
     // Draw the trunk
-    glColor3f(0.55f, 0.27f, 0.07f);  // Brown color for the trunk
-    glBegin(GL_POLYGON);
-    glVertex2f(x - 10, y);
-    glVertex2f(x + 10, y);
-    glVertex2f(x + 10, y + 40);
-    glVertex2f(x - 10, y + 40);
-    glEnd();
+    mb.setColor(rgb(0.55f, 0.27f, 0.07f));  // Brown color for the trunk
+    mb.rect(x - 10, y, 20, 40);
 
     // Draw the foliage (overlapping circles/fans for a bushier look)
-    if (isNightMode) {
-        glColor3f(0.0f, 0.2f, 0.0f); // Dark green
-    } else {
-        glColor3f(0.0f, 0.5f, 0.0f);  // Bright green
-    }
+    mb.setColor(PAL_FOLIAGE); // Bright green, dark green at night
 
     int numSegments = 20;
     float radius = 30.0f;
 
-    // Bottom-left part
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(x - 15, y + 40 + 10);
-    for (int i = 0; i <= numSegments; i++) {
-        float angle = i * 2.0f * PI / numSegments;
-        glVertex2f(x - 15 + cos(angle) * radius, y + 40 + 10 + sin(angle) * radius);
-    }
-    glEnd();
-
-    // Top-center part
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(x, y + 40 + 30);
-    for (int i = 0; i <= numSegments; i++) {
-        float angle = i * 2.0f * PI / numSegments;
-        glVertex2f(x + cos(angle) * radius * 1.2, y + 40 + 30 + sin(angle) * radius * 1.2);
-    }
-    glEnd();
-
-    // Bottom-right part
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(x + 15, y + 40 + 10);
-    for (int i = 0; i <= numSegments; i++) {
-        float angle = i * 2.0f * PI / numSegments;
-        glVertex2f(x + 15 + cos(angle) * radius, y + 40 + 10 + sin(angle) * radius);
-    }
-    glEnd();
+    mb.circle(x - 15, y + 40 + 10, radius, numSegments);        // Bottom-left part
+    mb.circle(x, y + 40 + 30, radius * 1.2f, numSegments);      // Top-center part
+    mb.circle(x + 15, y + 40 + 10, radius, numSegments);        // Bottom-right part
 }
 
-// 🐦 DRAW BIRDS 🐦 (Restored Definition)
-void drawBirds(float currentBirdY) {
-    if (isNightMode) return; // Hide birds at night
-
-    glPushMatrix();
-    // The bird's Y position now oscillates around birdBasePosY
-    glTranslatef(birdPosX, currentBirdY, 0);
-
-    glColor3f(0.0f, 0.0f, 0.0f);  // Black color for birds
-    glLineWidth(2.0f); // Thicker lines for better visibility
-    // Draw birds as simple "V" shapes
-    glBegin(GL_LINES);
-    // First bird
-    glVertex2f(0.0f, 0.0f);
-    glVertex2f(10.0f, 10.0f);
-    glVertex2f(10.0f, 10.0f);
-    glVertex2f(20.0f, 0.0f);
-
-    // Second bird
-    glVertex2f(30.0f, 5.0f);
-    glVertex2f(40.0f, 15.0f);
-    glVertex2f(40.0f, 15.0f);
-    glVertex2f(50.0f, 5.0f);
-    glEnd();
-
-    glPopMatrix();
+// 🐦 DRAW BIRD 🐦
+// One flock member, centred on x, y: the original "^" of two thick lines,
+// tilted to its heading, with the wingtips flapping up and down
+void drawBird(MeshBuilder& mb, float x, float y, float velX, float velY, float wingPhase) {
+    PROFILE_MESH_SCOPE("drawBirds", mb);
+    float speed = sqrt(velX * velX + velY * velY);
+    float dx = speed > 0.0f ? velX / speed : 1.0f; // Along the heading
+    float dy = speed > 0.0f ? velY / speed : 0.0f;
+    float tip = 3.0f + 7.0f * sin(wingPhase);      // Body above the wingtips, 10 in the original
+
+    mb.setColor(PAL_BIRD);  // Black birds, hidden at night
+    mb.line(x - 10.0f * dx + tip * dy, y - 10.0f * dy - tip * dx, x, y, 2.0f);
+    mb.line(x, y, x + 10.0f * dx + tip * dy, y + 10.0f * dy - tip * dx, 2.0f);
 }
 
 // DRAW BENCH FUNCTION (NEW)
-void drawBench(float x, float y) {
-    glPushMatrix();
-    glTranslatef(x, y, 0);
+void drawBench(MeshBuilder& mb, float x, float y) {
+    PROFILE_MESH_SCOPE("drawBench", mb);
+    mb.setOrigin(x, y);
 
     // Seat (Brown wood)
-    glColor3ub(139, 69, 19);
-    glBegin(GL_QUADS);
-    glVertex2f(-30, 0);
-    glVertex2f(30, 0);
-    glVertex2f(30, 5);
-    glVertex2f(-30, 5);
-    glEnd();
+    mb.setColor(rgbub(139, 69, 19));
+    mb.rect(-30, 0, 60, 5);
 
     // Legs (Black/Dark metal)
-    glColor3f(0.2f, 0.2f, 0.2f);
-    glLineWidth(3.0f);
-    glBegin(GL_LINES);
-    // Back left
-    glVertex2f(-25, 0);
-    glVertex2f(-25, -15);
-    // Back right
-    glVertex2f(25, 0);
-    glVertex2f(25, -15);
-    glEnd();
+    mb.setColor(rgb(0.2f, 0.2f, 0.2f));
+    mb.line(-25, 0, -25, -15, 3.0f); // Back left
+    mb.line(25, 0, 25, -15, 3.0f);   // Back right
 
-    glPopMatrix();
+    mb.setOrigin(0, 0);
 }
 
 
-// Timer function to update positions
-void update(int value) {
-    // Update car position with controlled speed
-    carPosX += carSpeed;
-    if (carPosX > 850) {
-        carPosX = -120;  // Reset car position
-    }
+// Feed real elapsed time to the simulation. While paused (Space) the
+// traffic, boats, birds and camera pan stop, but the sky still fades.
+bool scenePaused = false;
 
-    // Update large boat position
-    boatPosX += 2.0f;
-    if (boatPosX > 800) {
-        boatPosX = -600;  // Reset boat position
+bool advanceScene(double seconds) {
+    PROFILE_SCOPE("advanceScene");
+    float blend = getNightBlend();
+    int ticks = 0;
+    if (inputRecording.isPlaying()) {
+        // Inputs recorded at the current tick, including the one that resumes a pause
+        playRecordedInput();
+    }
+    if (!scenePaused) {
+        if (inputRecording.isPlaying()) {
+            ticks = simulation.advance(seconds, playRecordedInput);
+        } else if (inputRecording.isRecording()) {
+            ticks = simulation.advance(seconds, recordCheckpoint);
+        } else {
+            ticks = simulation.advance(seconds);
+        }
     }
+    if (inputRecording.isRecording() || inputRecording.isPlaying()) {
+        seconds = ticks * SIM_TICK_SECONDS;
+    }
+    advanceTimeOfDay(seconds);
+    if (cameraPanSpeed != 0.0f && !scenePaused) {
+        camera.setCenter(camera.getCenterX() + cameraPanSpeed * (float)seconds, camera.getCenterY());
+    }
+    return !scenePaused || getNightBlend() != blend;
+}
+
+// When the window redraws (see frame_pacer.h); F prints its statistics
+FramePacer framePacer;
 
-    // NEW: Update mini boat position (slower movement)
-    miniBoatPosX += 0.8f;
-    if (miniBoatPosX > 850) {
-        miniBoatPosX = -100; // Reset mini boat position
+FrameCapture frameCapture;
+
+static double pacingClockMs() {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void setPacingMode(PacingMode mode) {
+    framePacer.setMode(mode);
+    if (!setSwapInterval(mode == PACING_VSYNC ? 1 : 0) && mode == PACING_VSYNC) {
+        LOG_EVENT(LOG_WARN, "Vsync is not available; pacing by the timer alone");
     }
+}
 
+// Timer function to update positions. Timer jitter only changes how many
+// ticks run and the interpolation factor, never the animation speed; the
+// pacer re-arms the timer for the next deadline.
+int lastUpdateMs = 0;
 
-    // Update bird position (oscillating flight path)
-    birdPosX += 3.0f;
-    float time_factor = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
-    birdBasePosY = 300.0f + sin(time_factor * 2.0f) * 50.0f;
+void update(int value) {
+    int now = elapsedTimeMs();
+    bool changed = advanceScene((now - lastUpdateMs) / 1000.0);
+    lastUpdateMs = now;
 
-    if (birdPosX > 850) {
-        birdPosX = -50;  // Reset bird position once off-screen
+    double nowMs = pacingClockMs();
+    if (framePacer.frameDue(nowMs, changed)) {
+        requestRedisplay();  // Redraw the scene
     }
+    glutTimerFunc(framePacer.delayToNextMs(nowMs), update, 0);
+}
+
+// Skip redraws while the window is minimized or covered
+void handleVisibility(int state) {
+    framePacer.setVisible(state == GLUT_VISIBLE);
+}
 
-    glutPostRedisplay();  // Redraw the scene
-    glutTimerFunc(30, update, 0);  // Call update again after 30 ms
+// The window is closing and its context is still current: write out the
+// frames still being captured
+void handleClose() {
+    if (frameCapture.isActive()) {
+        frameCapture.stop();
+        frameCapture.printReport(stdout);
+    }
 }
 
 // Keyboard key-down function
@@ -735,201 +599,1080 @@ void handleKeypress(unsigned char key, int x, int y) {
              std::cout << "\a" << std::flush;
         #endif
     } else if (key == '+') {
-        carSpeed = std::min(carSpeed + 1.0f, 15.0f);
-        std::cout << "Car Speed: " << carSpeed << std::endl;
+        SimState& s = simulation.state();
+        s.carSpeed = std::min(s.carSpeed + 1.0f, 15.0f);
+        LOG_EVENT(LOG_INFO, "Car Speed: %g", s.carSpeed);
     } else if (key == '-') {
-        carSpeed = std::max(carSpeed - 1.0f, 1.0f);
-        std::cout << "Car Speed: " << carSpeed << std::endl;
+        SimState& s = simulation.state();
+        s.carSpeed = std::max(s.carSpeed - 1.0f, 1.0f);
+        LOG_EVENT(LOG_INFO, "Car Speed: %g", s.carSpeed);
     } else if (key == 'n' || key == 'N') { // Toggle Night Mode
         if (isNightMode) {
             setDayMode();
         } else {
             setNightMode();
         }
+    } else if (key == 'z' || key == 'Z') { // Camera zoom in/out and reset
+        camera.zoomBy(1.25f);
+        requestRedisplay();
+    } else if (key == 'x' || key == 'X') {
+        camera.zoomBy(1.0f / 1.25f);
+        requestRedisplay();
+    } else if (key == 'c' || key == 'C') {
+        camera.reset();
+        requestRedisplay();
+    } else if (key == 'p' || key == 'P') { // Profiler and its overlay
+        bool on = !profilerEnabled.load(std::memory_order_relaxed);
+        profilerSetEnabled(on);
+        profilerOverlay = on;
+        LOG_EVENT(LOG_INFO, "Profiler %s", on ? "on" : "off");
+        requestRedisplay();
+    } else if (key == 't' || key == 'T') { // Write the recorded trace
+        profilerDump("cityview_profile");
+    } else if (key == ' ') { // Pause and resume the simulation
+        scenePaused = !scenePaused;
+        LOG_EVENT(LOG_INFO, "%s", scenePaused ? "Paused" : "Resumed");
+    } else if (key == 'f' || key == 'F') { // Frame pacing statistics
+        framePacer.printReport(stdout);
+        fflush(stdout);
+    } else if (key == 'm' || key == 'M') { // Next frame pacing mode
+        setPacingMode((PacingMode)((framePacer.getMode() + 1) % NUM_PACING_MODES));
+        LOG_EVENT(LOG_INFO, "Frame pacing: %s", pacingModeName(framePacer.getMode()));
     } else if (key == 'b' || key == 'B') { // NEW: Brake Activation
-        isBraking = true;
-        carSpeed = std::max(carSpeed - 3.0f, 1.0f); // Slow down significantly
-        std::cout << "Car Braking. Speed: " << carSpeed << std::endl;
+        SimState& s = simulation.state();
+        s.isBraking = true;
+        s.carSpeed = std::max(s.carSpeed - 3.0f, 1.0f); // Slow down significantly
+        LOG_EVENT(LOG_INFO, "Car Braking. Speed: %g", s.carSpeed);
     }
 }
 
 // NEW: Keyboard key-up function for releasing the brake
 void handleKeyRelease(unsigned char key, int x, int y) {
     if (key == 'b' || key == 'B') {
-        isBraking = false;
+        SimState& s = simulation.state();
+        s.isBraking = false;
         // Restore speed slightly, capped at 6.0f (default cruise speed)
-        carSpeed = std::min(carSpeed + 2.0f, 6.0f);
-        std::cout << "Brakes released. Speed: " << carSpeed << std::endl;
+        s.carSpeed = std::min(s.carSpeed + 2.0f, 6.0f);
+        LOG_EVENT(LOG_INFO, "Brakes released. Speed: %g", s.carSpeed);
+    }
+}
+
+// Arrow keys pan the camera by a tenth of the view
+void handleSpecialKey(int key, int x, int y) {
+    if (key == GLUT_KEY_LEFT) {
+        camera.pan(-0.1f, 0.0f);
+    } else if (key == GLUT_KEY_RIGHT) {
+        camera.pan(0.1f, 0.0f);
+    } else if (key == GLUT_KEY_UP) {
+        camera.pan(0.0f, 0.1f);
+    } else if (key == GLUT_KEY_DOWN) {
+        camera.pan(0.0f, -0.1f);
     }
+    // Held keys repeat at the keyboard rate: keep one position in eight
+    LOG_SAMPLED(LOG_DEBUG, 8, "Camera at %.0f,%.0f zoom %.2f", camera.getCenterX(), camera.getCenterY(),
+                camera.getZoom());
+    requestRedisplay();
 }
 
-// Mouse function for interaction (unchanged)
+// The window was resized: the cached layers no longer fit
+void handleReshape(int width, int height) {
+    glViewport(0, 0, width, height);
+    staticCache.invalidate();
+}
+
+// Mouse function for interaction; the wheel (buttons 3/4 in freeglut) zooms
 void handleMouse(int button, int state, int x, int y) {
     if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
         // ...
+    } else if ((button == 3 || button == 4) && state == GLUT_DOWN) {
+        camera.zoomBy(button == 3 ? 1.25f : 1.0f / 1.25f);
+        requestRedisplay();
+    }
+}
+
+// ---------- Input recording ----------
+
+InputRecording inputRecording;
+const char* inputRecordPath = nullptr;
+
+static InputView currentInputView() {
+    InputView v;
+    v.cameraX = camera.getCenterX();
+    v.cameraY = camera.getCenterY();
+    v.cameraZoom = camera.getZoom();
+    v.timeOfDay = timeOfDay;
+    v.ortho = isOrtho1 ? 1 : 0;
+    return v;
+}
+
+static void applyInputView(const InputView& v) {
+    camera.setCenter(v.cameraX, v.cameraY);
+    camera.setZoom(v.cameraZoom);
+    setTimeOfDay(v.timeOfDay);
+    isOrtho1 = v.ortho != 0;
+}
+
+static void dispatchInput(const InputEvent& e) {
+    if (e.kind == INPUT_KEY_DOWN) {
+        handleKeypress(e.code, 0, 0);
+    } else if (e.kind == INPUT_KEY_UP) {
+        handleKeyRelease(e.code, 0, 0);
+    } else if (e.kind == INPUT_SPECIAL_KEY) {
+        handleSpecialKey(e.code, 0, 0);
+    } else if (e.kind == INPUT_MOUSE_BUTTON) {
+        handleMouse(e.code, e.state, 0, 0);
+    }
+}
+
+// Before each tick while a recording plays; false once it paused the scene
+bool playRecordedInput() {
+    inputRecording.playDue(simulation.state(), dispatchInput);
+    return !scenePaused;
+}
+
+// Before each tick while recording
+bool recordCheckpoint() {
+    inputRecording.checkpoint(simulation.state());
+    return true;
+}
+
+// Live input from GLUT: recorded against the tick it applies to, and
+// ignored while a recording plays
+static bool takeLiveInput(InputKind kind, int code, int state) {
+    if (inputRecording.isPlaying()) {
+        return false;
+    }
+    if (inputRecording.isRecording()) {
+        inputRecording.record(kind, code, state, simulation.state());
+    }
+    return true;
+}
+
+void onKeyDown(unsigned char key, int x, int y) {
+    if (takeLiveInput(INPUT_KEY_DOWN, key, 0)) handleKeypress(key, x, y);
+}
+
+void onKeyUp(unsigned char key, int x, int y) {
+    if (takeLiveInput(INPUT_KEY_UP, key, 0)) handleKeyRelease(key, x, y);
+}
+
+void onSpecialKey(int key, int x, int y) {
+    if (takeLiveInput(INPUT_SPECIAL_KEY, key, 0)) handleSpecialKey(key, x, y);
+}
+
+void onMouse(int button, int state, int x, int y) {
+    if (takeLiveInput(INPUT_MOUSE_BUTTON, button, state)) handleMouse(button, state, x, y);
+}
+
+void saveInputAtExit() {
+    inputRecording.end(simulation.state());
+    if (inputRecording.save(inputRecordPath)) {
+        printf("Input: %zu inputs over %llu ticks written to %s\n", inputRecording.inputCount(),
+               (unsigned long long)(inputRecording.getEndTick() - inputRecording.getStartTick()), inputRecordPath);
     }
 }
 
 // DRAW STREET LIGHT FUNCTION
-void drawStreetLight(float x, float y) {
-    glPushMatrix();
-    glTranslatef(x, y, 0);
+void drawStreetLight(MeshBuilder& mb, float x, float y) {
+    PROFILE_MESH_SCOPE("drawStreetLight", mb);
+    mb.setOrigin(x, y);
 
     // Pole (Grey)
-    glColor3f(0.4f, 0.4f, 0.4f);
-    glLineWidth(4.0f);
-    glBegin(GL_LINES);
-    glVertex2f(0, 0);
-    glVertex2f(0, 100); // Height
-    glEnd();
+    mb.setColor(rgb(0.4f, 0.4f, 0.4f));
+    mb.line(0, 0, 0, 100, 4.0f); // Height
 
     // Arm (Grey)
-    glLineWidth(3.0f);
-    glBegin(GL_LINES);
-    glVertex2f(0, 100);
-    glVertex2f(20, 100);
-    glEnd();
-
-    // Lamp Head (Light color depends on mode)
-    if (isNightMode) {
-        glColor3f(1.0f, 0.9f, 0.5f); // Bright warm light
-    } else {
-        glColor3f(0.4f, 0.4f, 0.4f); // Dim grey/off during day
+    mb.line(0, 100, 20, 100, 3.0f);
+
+    // Lamp Head (Dim grey/off during day, bright warm light at night)
+    mb.setColor(PAL_STREET_LAMP);
+    mb.triangle(20, 100, 25, 95, 25, 105);
+
+    mb.setOrigin(0, 0);
+}
+
+// Bake every non-moving object into its mesh or instance list, in painter's order
+static void drawSky(MeshBuilder& mb) {
+    drawSun(mb, 700.0f, 500.0f, 40.0f); // The palette shows one of them
+    drawMoon(mb, 700.0f, 500.0f, 40.0f);
+
+    drawCloud(mb, 150.0f, 500.0f);
+    drawCloud(mb, 400.0f, 550.0f);
+    drawCloud(mb, 600.0f, 480.0f);
+}
+
+// The prop of a static layer in local coordinates; buildings are a unit building
+static void drawStaticProp(MeshBuilder& mb, int layer) {
+    switch (layer) {
+        case LAYER_BUILDINGS: drawBuilding(mb, 0.0f, 0.0f, 1.0f, 1.0f); break;
+        case LAYER_STREET_LIGHTS: drawStreetLight(mb, 0.0f, 0.0f); break;
+        case LAYER_MOSQUES: drawMosque(mb, 0.0f, 0.0f); break;
+        case LAYER_PLAYGROUNDS: drawPlayground(mb, 0.0f, 0.0f); break;
+        case LAYER_BENCHES: drawBench(mb, 0.0f, 0.0f); break;
+        case LAYER_TREES: drawTree(mb, 0.0f, 0.0f); break;
+    }
+}
+
+void buildStaticScene() {
+    PROFILE_SCOPE("buildStaticScene");
+    MeshBuilder& mb = staticSceneBuilder;
+
+    // Background elements first, every mesh with its levels of detail
+    buildLodMesh(skyMesh, mb, drawSky);
+
+    mb.clear();
+    drawRoad(mb);
+    roadMesh.upload(mb);
+
+    // One prop mesh per layer. Buildings are drawn as facades; their unit
+    // mesh only gives the extent for culling.
+    for (int l = 0; l < NUM_STATIC_LAYERS; ++l) {
+        mb.clear();
+        drawStaticProp(mb, l);
+        staticPropBounds[l] = mb.bounds(); // Full detail
+        buildLodMesh(staticProps[l].getMesh(), mb, [l](MeshBuilder& b) { drawStaticProp(b, l); });
     }
 
-    glBegin(GL_POLYGON);
-    glVertex2f(20, 100);
-    glVertex2f(25, 95);
-    glVertex2f(25, 105);
-    glEnd();
+    // Car model (headlights depend on the mode); its instance moves every frame
+    buildLodMesh(carProps.getMesh(), mb, drawRealisticCar);
 
-    glPopMatrix();
+    staticSceneDirty = false;
+    bakedNightBlend = getNightBlend();
+    staticCache.invalidate();
 }
 
-// Display callback
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT);
+static void appendPoints(std::vector<PropInstance>& out, const ScenePoint* points, size_t count) {
+    out.clear();
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        PropInstance inst = {points[i].x, points[i].y, 1.0f, 1.0f, 0.0f};
+        out.push_back(inst);
+    }
+}
+
+// Instances of every static entity plus the spatial grid over them. Only
+// needs redoing when the layout changes (prop extents do not depend on
+// the day/night mode), so it runs after buildStaticScene().
+void buildSceneIndex() {
+    PROFILE_SCOPE("buildSceneIndex");
+    std::vector<PropInstance>& buildingInstances = layerInstances[LAYER_BUILDINGS];
+    buildingInstances.clear();
+    buildingInstances.reserve(sceneLayout.numBuildings);
+    for (size_t i = 0; i < sceneLayout.numBuildings; ++i) {
+        const Building& b = sceneLayout.buildings[i];
+        PropInstance inst = {b.x, b.y, b.width, b.height, 0.0f};
+        buildingInstances.push_back(inst);
+    }
+    makeFacades(buildingInstances, buildingFacades);
+    appendPoints(layerInstances[LAYER_STREET_LIGHTS], sceneLayout.streetLights, sceneLayout.numStreetLights);
+    appendPoints(layerInstances[LAYER_MOSQUES], sceneLayout.mosques, sceneLayout.numMosques);
+    appendPoints(layerInstances[LAYER_PLAYGROUNDS], sceneLayout.playgrounds, sceneLayout.numPlaygrounds);
+    appendPoints(layerInstances[LAYER_BENCHES], sceneLayout.benches, sceneLayout.numBenches);
+    appendPoints(layerInstances[LAYER_TREES], sceneLayout.trees, sceneLayout.numTrees);
+
+    // World-space bounds of each instance; ids run through the layers in order
+    std::vector<Bounds> itemBounds;
+    float minAnchorX = 0.0f, maxAnchorX = 0.0f;
+    bool anyAnchor = false;
+    for (int l = 0; l < NUM_STATIC_LAYERS; ++l) {
+        layerFirstId[l] = (uint32_t)itemBounds.size();
+        const Bounds& local = staticPropBounds[l];
+        const std::vector<PropInstance>& instances = layerInstances[l];
+        for (size_t i = 0; i < instances.size(); ++i) {
+            const PropInstance& inst = instances[i];
+            Bounds b = {inst.x + local.minX * inst.scaleX, inst.y + local.minY * inst.scaleY,
+                        inst.x + local.maxX * inst.scaleX, inst.y + local.maxY * inst.scaleY};
+            itemBounds.push_back(b);
+            minAnchorX = anyAnchor ? std::min(minAnchorX, inst.x) : inst.x;
+            maxAnchorX = anyAnchor ? std::max(maxAnchorX, inst.x) : inst.x;
+            anyAnchor = true;
+        }
+    }
+    layerFirstId[NUM_STATIC_LAYERS] = (uint32_t)itemBounds.size();
+    staticGrid.build(itemBounds, 256.0f);
+
+    // Ground under every screen-wide strip that holds an entity
+    firstTerrainTile = anyAnchor ? (int)std::floor(minAnchorX / TERRAIN_TILE_WIDTH) : 0;
+    lastTerrainTile = anyAnchor ? (int)std::floor(maxAnchorX / TERRAIN_TILE_WIDTH) : 0;
+    Bounds limits = {firstTerrainTile * TERRAIN_TILE_WIDTH, 0.0f,
+                     (lastTerrainTile + 1) * TERRAIN_TILE_WIDTH, 600.0f};
+    if (chunkStreamer.isActive()) {
+        limits.minX = -1e30f; // The streamed city has no ends
+        limits.maxX = 1e30f;
+    }
+    camera.setLimits(limits);
+
+    sceneIndexDirty = false;
+    cullDirty = true;
+    staticCache.invalidate();
+}
 
-    // Draw all background elements first
-    drawSea();
-    drawRoad();
+// Submit only the static instances that overlap the view. Instance buffers
+// are refilled only when the view (or the scene) actually changed.
+void cullStaticScene() {
+    PROFILE_SCOPE("cullStaticScene");
+    Bounds view = camera.view();
+    if (!cullDirty && view.minX == culledView.minX && view.minY == culledView.minY &&
+        view.maxX == culledView.maxX && view.maxY == culledView.maxY) {
+        return;
+    }
 
-    if (!isNightMode) {
-        drawSun(700.0f, 500.0f, 40.0f); // Sun only visible during day
+    if (cullingEnabled) {
+        staticGrid.query(view, visibleIds);
     } else {
-        // Draw Moon at night
-        const int segments = 40;
-        glPushMatrix();
-        glTranslatef(700.0f, 500.0f, 0);
-        glBegin(GL_TRIANGLE_FAN);
-        glColor3f(0.8f, 0.8f, 0.8f); // White/Grey moon
-        glVertex2f(0.0f, 0.0f);
-        for (int i = 0; i <= segments; ++i) {
-            float ang = (float)i / (float)segments * 2.0f * PI;
-            glVertex2f(cos(ang) * 40.0f, sin(ang) * 40.0f);
+        visibleIds.resize(layerFirstId[NUM_STATIC_LAYERS]);
+        for (size_t i = 0; i < visibleIds.size(); ++i) visibleIds[i] = (uint32_t)i;
+    }
+
+    // Ids come back sorted, so each layer is one contiguous run
+    size_t k = 0;
+    for (int l = 0; l < NUM_STATIC_LAYERS; ++l) {
+        if (l == LAYER_BUILDINGS) {
+            visibleFacadeList.clear();
+            for (; k < visibleIds.size() && visibleIds[k] < layerFirstId[l + 1]; ++k) {
+                visibleFacadeList.push_back(buildingFacades[visibleIds[k] - layerFirstId[l]]);
+            }
+            visibleFacades.set(visibleFacadeList);
+            continue;
+        }
+        visibleInstances.clear();
+        for (; k < visibleIds.size() && visibleIds[k] < layerFirstId[l + 1]; ++k) {
+            visibleInstances.push_back(layerInstances[l][visibleIds[k] - layerFirstId[l]]);
+        }
+        staticProps[l].setInstances(visibleInstances);
+    }
+
+    int total = (int)layerFirstId[NUM_STATIC_LAYERS];
+    CullStats stats = {(int)visibleIds.size(), total - (int)visibleIds.size()};
+    if (stats.drawn != lastCullStats.drawn || stats.culled != lastCullStats.culled) {
+        char status[96];
+        snprintf(status, sizeof(status), "%d drawn, %d culled", stats.drawn, stats.culled);
+        setWindowStatus(status);
+    }
+    lastCullStats = stats;
+    culledView = view;
+    cullDirty = false;
+    staticCache.invalidate(); // New instance lists
+}
+
+// First vertex of a dynamic layer in the uploaded streams
+int firstTaskOfLayer[NUM_DYNAMIC_LAYERS + 1];
+
+int layerFirstVertex(int layer) {
+    return streamFirstVertex[firstTaskOfLayer[layer]];
+}
+
+static void addFrameTasks(int layer, int count, int perTask) {
+    firstTaskOfLayer[layer] = (int)frameTasks.size();
+    for (int begin = 0; begin < count; begin += perTask) {
+        FrameTask task = {layer, begin, std::min(count, begin + perTask)};
+        frameTasks.push_back(task);
+    }
+}
+
+// Cars facing -x are mirrored about the middle of the mesh (x = 90)
+static PropInstance carInstance(const TrafficSim& traffic, int lane, int i, float alpha) {
+    const TrafficLane& l = traffic.lane(lane);
+    float x = traffic.interpolatedX(lane, i, alpha);
+    float variant = (lane == 0 && i == 0) ? 0.0f : (float)((i + lane) % NUM_PROP_VARIANTS); // Player keeps its colors
+    PropInstance car = {l.direction > 0 ? x : x + 180.0f, l.y, (float)l.direction, 1.0f, variant};
+    return car;
+}
+
+// Generate every moving layer's geometry on the frame pool. Each task
+// writes only its own stream (or its own slice of carInstances), and the
+// GL thread concatenates the streams in task order, which is painter's order.
+void buildMovingLayers() {
+    PROFILE_SCOPE("buildMovingLayers");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    const SimState& state = simulation.state();
+    const EntityStore& entities = state.entities;
+    const float alpha = simulation.alpha();
+    const EntityBlock& sailboats = entities.block(ENTITY_SAILBOAT);
+    const EntityBlock& boats = entities.block(ENTITY_BOAT);
+    const TrafficSim& traffic = state.traffic;
+    const FlockBirds& birds = state.birds.getBirds();
+    const float wingTime = sceneTime * 8.0f; // Radians, a little over one flap per second
+
+    updateWater(simulation.renderTime()); // Before the boats, which sample it
+
+    frameTasks.clear();
+    addFrameTasks(DYN_SAILBOATS, sailboats.size(), ENTITIES_PER_TASK);
+    addFrameTasks(DYN_SHIPS, boats.size(), ENTITIES_PER_TASK);
+    addFrameTasks(DYN_CARS, traffic.vehicleCount(), ENTITIES_PER_TASK * 16);
+    addFrameTasks(DYN_BRAKE_LIGHTS, traffic.vehicleCount(), ENTITIES_PER_TASK * 16);
+    addFrameTasks(DYN_BIRDS, paletteVisible(PAL_BIRD) ? birds.size() : 0, ENTITIES_PER_TASK); // None after dusk
+    firstTaskOfLayer[NUM_DYNAMIC_LAYERS] = (int)frameTasks.size();
+
+    taskStreams.resize(frameTasks.size());
+    carInstances.resize(traffic.vehicleCount());
+    if (recordingTrace) {
+        // Opened here, in task order, so the streams replay in painter's order
+        for (size_t k = 0; k < taskStreams.size(); ++k) taskStreams[k].startTrace(*recordingTrace);
+    }
+
+    framePool.run((int)frameTasks.size(), [&](int k) {
+        const FrameTask& task = frameTasks[k];
+        MeshBuilder& mb = taskStreams[k];
+        mb.clear();
+        int lane = 0; // Of vehicle i, in the traffic layers
+        if (task.layer == DYN_CARS || task.layer == DYN_BRAKE_LIGHTS) lane = traffic.laneOf(task.begin);
+        for (int i = task.begin; i < task.end; ++i) {
+            switch (task.layer) {
+                case DYN_SAILBOATS:
+                    drawMiniSailboat(mb, entities.interpolatedX(ENTITY_SAILBOAT, i, alpha), sailboats.posY[i]);
+                    break;
+                case DYN_SHIPS:
+                    drawShip(mb, entities.interpolatedX(ENTITY_BOAT, i, alpha), boats.posY[i]);
+                    break;
+                case DYN_CARS:
+                case DYN_BRAKE_LIGHTS: {
+                    while (i >= traffic.firstVehicle(lane + 1)) ++lane;
+                    int v = i - traffic.firstVehicle(lane);
+                    if (task.layer == DYN_CARS) {
+                        carInstances[i] = carInstance(traffic, lane, v, alpha);
+                    } else if (traffic.isBraking(lane, v) || (i == 0 && state.isBraking)) { // 'B' lights the player car
+                        PropInstance car = carInstance(traffic, lane, v, alpha);
+                        drawBrakeLights(mb, car.x, car.y, car.scaleX);
+                    }
+                    break;
+                }
+                case DYN_BIRDS:
+                    drawBird(mb, state.birds.interpolatedX(i, alpha), state.birds.interpolatedY(i, alpha),
+                             birds.velX[i], birds.velY[i], birds.wingPhase[i] + wingTime);
+                    break;
+            }
+        }
+    });
+
+    streamList.resize(taskStreams.size());
+    for (size_t k = 0; k < taskStreams.size(); ++k) {
+        streamList[k] = &taskStreams[k].getVertices();
+        taskStreams[k].setTrace(nullptr);
+    }
+
+    lastFrameBuild.buildMs = msSince(start);
+}
+
+
+// Emit from every ship and car at their drawn positions, then advance all
+// particles to the current scene time. Runs after buildMovingLayers(),
+// which evaluates the water the ships ride on.
+void updateEffects() {
+    PROFILE_SCOPE("updateEffects");
+    float dt = std::min(std::max(sceneTime - effectsTime, 0.0f), 0.1f); // Skip ahead after stalls
+    effectsTime = sceneTime;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int perEmitter[NUM_PARTICLE_EFFECTS];
+    for (int e = 0; e < NUM_PARTICLE_EFFECTS; ++e) {
+        effectsDue[e] += EFFECT_RATES[e] * dt;
+        perEmitter[e] = (int)effectsDue[e];
+        effectsDue[e] -= perEmitter[e];
+    }
+
+    const SimState& state = simulation.state();
+    const float alpha = simulation.alpha();
+    const EntityBlock& boats = state.entities.block(ENTITY_BOAT);
+    int spawned = 0;
+    for (int i = 0; i < boats.size(); ++i) {
+        // Chimney top and bow of drawShip(), which is scaled by 0.7
+        float x = state.entities.interpolatedX(ENTITY_BOAT, i, alpha);
+        float y = boats.posY[i] + water.displacementAt(x, boats.posY[i]);
+        ParticleBurst puff = {x + 17.5f, y + 66.5f, -8.0f, 22.0f, 2.0f, 2.0f, 4.0f, 2.5f, 0.8f};
+        ParticleBurst spray = {x + 70.0f, y + 4.0f, 70.0f, 45.0f, 2.0f, 2.0f, 20.0f, 0.5f, 0.2f};
+        spawned += particlePools[EFFECT_SMOKE].spawn(puff, perEmitter[EFFECT_SMOKE]);
+        spawned += particlePools[EFFECT_SPRAY].spawn(spray, perEmitter[EFFECT_SPRAY]);
+    }
+    const TrafficSim& traffic = state.traffic;
+    bool headlightsOn = paletteVisible(PAL_HEADLIGHT); // At night, like the lamp in the car mesh
+    for (int lane = 0; lane < traffic.laneCount(); ++lane) {
+        for (int i = 0; i < traffic.lane(lane).size(); ++i) {
+            // Tailpipe under the rear bumper (x = 45 in the car mesh)
+            PropInstance car = carInstance(traffic, lane, i, alpha);
+            ParticleBurst exhaust = {car.x + 45.0f * car.scaleX, car.y + 203.0f, -25.0f * car.scaleX, 6.0f,
+                                     1.0f, 1.0f, 6.0f, 0.9f, 0.3f};
+            spawned += particlePools[EFFECT_EXHAUST].spawn(exhaust, perEmitter[EFFECT_EXHAUST]);
+            if (headlightsOn) {
+                // The headlight rect at x = 135..137, y = 206..214, drifting ahead of the car
+                ParticleBurst glow = {car.x + 137.0f * car.scaleX, car.y + 210.0f, 30.0f * car.scaleX, 0.0f,
+                                      1.0f, 2.0f, 5.0f, 0.4f, 0.1f};
+                spawned += particlePools[EFFECT_HEADLIGHT_GLOW].spawn(glow, perEmitter[EFFECT_HEADLIGHT_GLOW]);
+            }
         }
-        glEnd();
-        glPopMatrix();
     }
+    lastParticleFrame.spawned = spawned;
+    lastParticleFrame.spawnMs = msSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int e = 0; e < NUM_PARTICLE_EFFECTS; ++e) particlePools[e].update(dt);
+    lastParticleFrame.updateMs = msSince(start);
+}
+
+// One batch per effect, in ParticleEffect order
+int drawEffects(float pixelsPerUnit) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int live = 0;
+    for (int e = 0; e < NUM_PARTICLE_EFFECTS; ++e) {
+        particlePools[e].buildVertices(particleVertices);
+        particleBatches[e].draw(particleVertices, particlePools[e].getStyle(), pixelsPerUnit);
+        live += particlePools[e].liveCount();
+    }
+    lastParticleFrame.live = live;
+    lastParticleFrame.drawMs = msSince(start);
+    return live;
+}
+
+void setFrameThreads(int threads) {
+    framePool.start(threads);
+}
+
+void populateScene(int perKind) {
+    SimState fresh;
+    std::mt19937 rng(42); // Same crowd every run
+    std::uniform_real_distribution<float> seaX(-600.0f, 800.0f);
+    std::uniform_real_distribution<float> sailX(-100.0f, 850.0f);
+    std::uniform_real_distribution<float> boatY(20.0f, 90.0f), sailY(90.0f, 140.0f);
+    fresh.traffic.populate(2, std::max(1, perKind / 4)); // Two lanes each way
+    fresh.birds.populate(perKind, SKY_BOUNDS, DEFAULT_FLOCK_SEED);
+    for (int i = 1; i < perKind; ++i) { // Index 0 of each kind is already there
+        fresh.entities.add(ENTITY_BOAT, seaX(rng), boatY(rng), 2.0f, 800.0f, -600.0f);
+        fresh.entities.add(ENTITY_SAILBOAT, sailX(rng), sailY(rng), 0.8f, 850.0f, -100.0f);
+    }
+    simulation.reset(fresh);
+}
 
-    drawCloud(150.0f, 500.0f);
-    drawCloud(400.0f, 550.0f);
-    drawCloud(600.0f, 480.0f);
+// Drawn/culled counts for streamed chunks, like cullStaticScene() reports
+void updateStreamStatus() {
+    CullStats stats;
+    chunkStreamer.countInstances(stats.drawn, stats.culled);
+    const StreamStats& stream = chunkStreamer.getStats();
+    static int lastResident = -1;
+    if (stats.drawn != lastCullStats.drawn || stats.culled != lastCullStats.culled ||
+        stream.resident != lastResident) {
+        char status[128];
+        snprintf(status, sizeof(status), "%d drawn, %d culled, %d chunks (%zu KB)",
+                 stats.drawn, stats.culled, stream.resident, stream.residentBytes / 1024);
+        setWindowStatus(status);
+        lastResident = stream.resident;
+    }
+    lastCullStats = stats;
+}
 
-    // --- DRAW STATIC STRUCTURES (Non-moving objects) ---
+void printStreamStats() {
+    const StreamStats& stream = chunkStreamer.getStats();
+    printf("Chunks:      %llu generated, %llu uploaded, %llu evicted, %llu cancelled\n",
+           stream.generated, stream.uploaded, stream.evicted, stream.cancelled);
+    printf("Resident:    %d chunks, %zu KB (peak %zu KB, budget %zu KB), %d workers\n",
+           stream.resident, stream.residentBytes / 1024, stream.peakBytes / 1024,
+           chunkStreamer.getBudget() / 1024, chunkStreamer.workerCount());
+    printf("Pop-in:      %llu frames with a visible chunk not ready\n", stream.missingFrames);
+}
 
-    // Draw Buildings on the left side of the road
-    for (int i = 0; i < NUM_BUILDINGS; ++i) {
-        drawBuilding(buildings[i].x, buildings[i].y, buildings[i].width, buildings[i].height);
+// Add drawn geometry to lastLodFrame when it has levels of detail
+static void countLod(int levels, int vertices, int fullVertices) {
+    if (levels > 1) {
+        lastLodFrame.vertices += vertices;
+        lastLodFrame.fullVertices += fullVertices;
     }
+}
 
-    // Draw Street Lights along the left side of the road (Base Y=200)
-    drawStreetLight(150.0f, 200.0f);
-    drawStreetLight(350.0f, 200.0f);
-    drawStreetLight(550.0f, 200.0f);
+// Detail levels for the current zoom (pixelsPerUnit) and, for the
+// screen-fixed sky, window size (skyPixelsPerUnit)
+static void selectLevelsOfDetail(float pixelsPerUnit, float skyPixelsPerUnit) {
+    skyMesh.select(skyPixelsPerUnit);
+    for (int l = 0; l < NUM_STATIC_LAYERS; ++l) staticProps[l].selectLod(pixelsPerUnit);
+    carProps.selectLod(pixelsPerUnit);
+    sailboatSilhouettes = lodEnabled && SAILBOAT_HEIGHT * SAILBOAT_SCALE * pixelsPerUnit < SILHOUETTE_PIXELS;
+}
 
-    // Draw Mosque
-    drawMosque(20.0f, 200.0f);
+// Sky, ground and static structures for the tiles under the view, in
+// painter's order. Returns the vertices submitted.
+int drawStaticLayers(int firstTile, int lastTile) {
+    int vertices = 0;
 
-    // Draw Playground
-    drawPlayground(500.0f, 200.0f);
+    // Light blue sky by day, dark blue at night
+    float night = getNightBlend();
+    glClearColor(0.5f + (0.05f - 0.5f) * night, 0.8f + (0.05f - 0.8f) * night, 1.0f + (0.2f - 1.0f) * night, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    // NEW: Draw Bench near the trees/playground
-    drawBench(620.0f, 200.0f);
+    // The sky stays on screen; it never overlaps the ground at the default
+    // view, so drawing it first keeps the original picture
+    camera.applyBaseProjection();
+    {
+        PROFILE_GPU_SCOPE("draw sky");
+        skyMesh.draw();
+        vertices += skyMesh.vertexCount();
+        countLod(skyMesh.levelCount(), skyMesh.vertexCount(), skyMesh.fullVertexCount());
+        PROFILE_VERTICES(skyMesh.vertexCount());
+    }
+    camera.applyProjection();
 
-    // Draw Trees on the right side of the road
-    for (int i = 0; i < NUM_TREES; ++i) {
-        drawTree(treePositions[i][0], treePositions[i][1]); // Now defined
+    // Road strips under the view (the sea moves, so it is drawn with the
+    // moving layers). Tiles never overlap, so they share a layer.
+    if (chunkStreamer.isActive()) {
+        vertices += chunkStreamer.queueRoads(frameQueue, RL_TERRAIN);
+    } else {
+        for (int t = firstTile; t <= lastTile; ++t) {
+            frameQueue.drawMesh(RL_TERRAIN, roadMesh, t * TERRAIN_TILE_WIDTH, 0.0f);
+            vertices += roadMesh.vertexCount();
+        }
     }
 
-    // Draw moving objects last to ensure they are on top
-    drawMiniSailboat(); // NEW: Draw the smaller sailboat first (appears farther away)
-    drawShip(); // Draw the main ship second
-    drawRealisticCar();
-    drawBirds(birdBasePosY); // Now defined
+    // Static structures: one layer each in the original painter's order
+    for (int l = 0; l < NUM_STATIC_LAYERS; ++l) {
+        int layerVertices;
+        if (l == LAYER_BUILDINGS && chunkStreamer.isActive()) {
+            layerVertices = chunkStreamer.queueFacades(frameQueue, RL_STATIC_PROPS + l, facadeRenderer) * FACADE_VERTICES;
+        } else if (l == LAYER_BUILDINGS) {
+            frameQueue.drawCustom(RL_STATIC_PROPS + l, []() {
+                facadeRenderer.draw(visibleFacades);
+                return visibleFacades.size() * FACADE_VERTICES;
+            });
+            layerVertices = visibleFacades.size() * FACADE_VERTICES;
+        } else {
+            int instances;
+            if (chunkStreamer.isActive()) {
+                instances = chunkStreamer.queueProps(frameQueue, RL_STATIC_PROPS + l, l, staticProps[l]);
+            } else {
+                frameQueue.drawProp(RL_STATIC_PROPS + l, staticProps[l], staticProps[l].getInstances());
+                instances = staticProps[l].instanceCount();
+            }
+            layerVertices = instances * staticProps[l].meshVertexCount();
+            countLod(staticProps[l].lodLevels(), layerVertices, instances * staticProps[l].fullMeshVertexCount());
+        }
+        vertices += layerVertices;
+    }
+    frameQueue.execute(lastRenderQueue);
+    return vertices;
+}
 
-    glutSwapBuffers();
+static bool sameCacheKey(const StaticCacheKey& a, const StaticCacheKey& b) {
+    return a.view.minX == b.view.minX && a.view.minY == b.view.minY && a.view.maxX == b.view.maxX &&
+           a.view.maxY == b.view.maxY && a.nightBlend == b.nightBlend && a.width == b.width &&
+           a.height == b.height && a.chunkUploads == b.chunkUploads;
 }
 
-// ----------------- NEW/ADDED: drawSun and drawCloud -----------------
+// Everything drawn in one frame, before the profiler overlay
+void renderScene() {
+    PROFILE_SCOPE("renderScene");
+
+    // Without the palette shader the colors are baked into the meshes
+    float night = getNightBlend();
+    if (!paletteOnGpu() && night != bakedNightBlend) {
+        staticSceneDirty = true;
+    }
+    if (staticSceneDirty) {
+        buildStaticScene();
+    }
+    if (sceneIndexDirty) {
+        buildSceneIndex();
+    }
+    Bounds view = camera.view();
+    if (chunkStreamer.isActive()) {
+        PROFILE_SCOPE("streamChunks");
+        chunkStreamer.update(view);
+        updateStreamStatus();
+    } else {
+        cullStaticScene();
+    }
+
+    int firstTile = (int)std::floor(view.minX / TERRAIN_TILE_WIDTH);
+    int lastTile = (int)std::floor(view.maxX / TERRAIN_TILE_WIDTH);
+    if (!chunkStreamer.isActive()) {
+        firstTile = std::max(firstTerrainTile, firstTile);
+        lastTile = std::min(lastTerrainTile, lastTile);
+    }
 
-void drawSun(float x, float y, float radius) {
-    const int segments = 40;
-    glPushMatrix();
-    glTranslatef(x, y, 0);
-    glBegin(GL_TRIANGLE_FAN);
-    glColor3f(1.0f, 0.9f, 0.0f);
-    glVertex2f(0.0f, 0.0f);
-    for (int i = 0; i <= segments; ++i) {
-        float ang = (float)i / (float)segments * 2.0f * PI;
-        glVertex2f(cos(ang) * radius, sin(ang) * radius);
+    // Static layers are redrawn only when something they depend on changed;
+    // otherwise the frame starts as a copy of the cached pixels
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    Bounds baseView = camera.baseView();
+    float pixelsPerUnit = viewport[2] / (view.maxX - view.minX);
+    selectLevelsOfDetail(pixelsPerUnit, viewport[2] / (baseView.maxX - baseView.minX));
+    lastLodFrame.vertices = lastLodFrame.fullVertices = 0;
+    RenderQueueStats noDraws = {0, 0, {0, 0, 0, 0, 0, 0, 0}};
+    lastRenderQueue = noDraws;
+
+    StaticCacheKey key = {view, night, viewport[2], viewport[3], chunkStreamer.getStats().uploaded};
+    lastStaticCache.hit = staticCacheEnabled && staticCache.isValid() && sameCacheKey(key, staticCacheKey);
+    lastStaticCache.staticVertices = 0;
+    if (lastStaticCache.hit) {
+        PROFILE_GPU_SCOPE("blit static cache");
+        staticCache.draw();
+    } else if (staticCacheEnabled && staticCache.beginUpdate(viewport[2], viewport[3])) {
+        lastStaticCache.staticVertices = drawStaticLayers(firstTile, lastTile);
+        staticCache.endUpdate();
+        staticCacheKey = key;
+        PROFILE_GPU_SCOPE("blit static cache");
+        staticCache.draw();
+    } else {
+        lastStaticCache.staticVertices = drawStaticLayers(firstTile, lastTile);
+    }
+    camera.applyProjection();
+
+    // Moving objects, interpolated between the last two simulation ticks
+    sceneTime = (float)simulation.renderTime();
+    buildMovingLayers();
+    updateEffects();
+
+    // Nothing static overlaps the sea, so drawing it after the whole
+    // static set is equivalent. Sailboats (farther away) come before the
+    // ships; everything moving is drawn last to stay on top.
+    std::chrono::steady_clock::time_point submitStart = std::chrono::steady_clock::now();
+    {
+        PROFILE_GPU_SCOPE("upload moving layers");
+        water.upload();
+        dynamicMesh.upload(streamList, streamFirstVertex);
+    }
+    int waterVertices = 0;
+    for (int t = firstTile; t <= lastTile; ++t) {
+        frameQueue.drawCustom(RL_WATER, [t]() {
+            glPushMatrix();
+            glTranslatef(t * TERRAIN_TILE_WIDTH, 0.0f, 0.0f);
+            water.draw();
+            glPopMatrix();
+            return water.vertexCount();
+        });
+        waterVertices += water.vertexCount();
     }
-    glEnd();
-    glPopMatrix();
+    int carsFirst = layerFirstVertex(DYN_CARS);
+    frameQueue.drawMesh(RL_BOATS, dynamicMesh, 0, carsFirst);
+
+    // Spray, smoke, exhaust and headlight glow, all under the cars
+    frameQueue.drawCustom(RL_PARTICLES, [pixelsPerUnit]() { return drawEffects(pixelsPerUnit); });
+
+    // Every car in one instanced draw
+    carProps.setInstances(carInstances);
+    frameQueue.drawProp(RL_CARS, carProps, carProps.getInstances());
+    countLod(carProps.lodLevels(), carProps.instanceCount() * carProps.meshVertexCount(),
+             carProps.instanceCount() * carProps.fullMeshVertexCount());
+    int sailboats = simulation.state().entities.block(ENTITY_SAILBOAT).size();
+    lastLodFrame.vertices += sailboats * (sailboatSilhouettes ? SAILBOAT_SILHOUETTE_MODEL.count : SAILBOAT_MODEL.count);
+    lastLodFrame.fullVertices += sailboats * SAILBOAT_MODEL.count;
+
+    // Brake lights and birds
+    frameQueue.drawMesh(RL_BRAKE_LIGHTS_AND_BIRDS, dynamicMesh, carsFirst, dynamicMesh.vertexCount() - carsFirst);
+    frameQueue.execute(lastRenderQueue);
+    lastFrameBuild.submitMs = msSince(submitStart);
+    lastFrameBuild.vertices = dynamicMesh.vertexCount();
+    lastStaticCache.totalVertices = lastStaticCache.staticVertices + waterVertices + dynamicMesh.vertexCount() +
+                                    carProps.instanceCount() * carProps.meshVertexCount();
 }
 
-void drawCloud(float x, float y) {
-    // Cloud color changes slightly at night
-    float r = 1.0f, g = 1.0f, b = 1.0f;
-    if (isNightMode) {
-        r = 0.6f; g = 0.6f; b = 0.7f;
+// Display callback
+void display() {
+    profilerBeginFrame();
+    renderScene();
+    if (frameCapture.isActive()) {
+        PROFILE_SCOPE("frame capture");
+        frameCapture.captureFrame();
+    }
+    profilerEndFrame();
+
+    if (profilerOverlay && !headlessMode) {
+        profilerDrawOverlay(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
     }
+    presentFrame();
+    if (!headlessMode) {
+        framePacer.framePresented(pacingClockMs());
+    }
+}
+
+void recordCommandTrace(CommandTrace& trace) {
+    trace.clear();
+    recordingTrace = &trace;
+    profilerSetTracing(true); // Mesh scopes name the commands
+    staticSceneDirty = true; // Rebuild the static meshes so their commands are in the trace
+    staticSceneBuilder.startTrace(trace);
+    display();
+    staticSceneBuilder.setTrace(nullptr);
+    profilerSetTracing(false);
+    recordingTrace = nullptr;
+}
+
+// ----------------- NEW/ADDED: drawSun, drawMoon and drawCloud -----------------
+
+void drawSun(MeshBuilder& mb, float x, float y, float radius) {
+    PROFILE_MESH_SCOPE("drawSun", mb);
+    mb.setColor(PAL_SUN); // Only visible during day
+    mb.circle(x, y, radius, 40);
+}
+
+void drawMoon(MeshBuilder& mb, float x, float y, float radius) {
+    PROFILE_MESH_SCOPE("drawMoon", mb);
+    mb.setColor(PAL_MOON); // White/Grey moon, only at night
+    mb.circle(x, y, radius, 40);
+}
 
-    // Simple cloud built from overlapping circle fans
+void drawCloud(MeshBuilder& mb, float x, float y) {
+    PROFILE_MESH_SCOPE("drawCloud", mb);
+    // Simple cloud built from overlapping (flattened) circle fans
     int segments = 20;
     float radii[] = {30.0f, 28.0f, 24.0f};
     float offsets[] = { -30.0f, 0.0f, 30.0f };
 
-    glPushMatrix();
-    glTranslatef(x, y, 0);
-    glColor3f(r, g, b);
+    mb.setOrigin(x, y);
+    mb.setColor(PAL_CLOUD); // Changes slightly at night
     for (int c = 0; c < 3; ++c) {
-        glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(offsets[c], 0.0f);
-        for (int i = 0; i <= segments; ++i) {
-            float ang = (float)i / (float)segments * 2.0f * PI;
-            glVertex2f(offsets[c] + cos(ang) * radii[c], sin(ang) * radii[c] * 0.6f);
-        }
-        glEnd();
+        mb.fan(offsets[c], 0.0f, radii[c], radii[c] * 0.6f, segments, 0.0f, 2.0f * PI);
     }
-    glPopMatrix();
+    mb.setOrigin(0, 0);
+}
+
+// --profile in a window: the trace is written when the program exits
+static const char* profileDumpPrefix = nullptr;
+
+static void dumpProfileAtExit() {
+    profilerDump(profileDumpPrefix);
 }
 
 // Main function (updated to register handleKeyRelease)
 int main(int argc, char** argv) {
+    // Command-line modes (see README)
+    bool headless = false;
+    bool simulateOnly = false;
+    unsigned long long simTicks = 10000000ULL;
+    HeadlessOptions headlessOpts;
+    void (*benchmark)() = nullptr;
+    bool streamCity = false;
+    uint32_t streamSeed = 1;
+    int chunkWorkers = 0;
+    int chunkBudgetKb = 16 * 1024;
+    int frameThreads = 0; // Every hardware thread
+    const char* profilePrefix = nullptr;
+    PacingMode pacingMode = PACING_TARGET_FPS;
+    double targetFps = DEFAULT_TARGET_FPS;
+    const char* logPath = nullptr; // Text to stdout
+    const char* replayInputPath = nullptr;
+    bool framesGiven = false;
+    LogFormat logFormat = LOG_TEXT;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            headlessOpts.frames = std::max(1, atoi(argv[++i]));
+            framesGiven = true;
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &headlessOpts.width, &headlessOpts.height);
+        } else if (strcmp(argv[i], "--dump-ppm") == 0 && i + 1 < argc) {
+            headlessOpts.dumpDir = argv[++i];
+        } else if (strcmp(argv[i], "--bench-instancing") == 0) {
+            benchmark = runInstancingBenchmark;
+        } else if (strcmp(argv[i], "--bench-facades") == 0) {
+            benchmark = runFacadeBenchmark;
+        } else if (strcmp(argv[i], "--water-grid") == 0 && i + 1 < argc) {
+            int columns = 0, rows = 0;
+            sscanf(argv[++i], "%dx%d", &columns, &rows);
+            water.setResolution(columns, rows);
+        } else if (strcmp(argv[i], "--bench-water") == 0) {
+            runWaterBenchmark(); // CPU only, no window needed
+            return 0;
+        } else if (strcmp(argv[i], "--bench-entities") == 0) {
+            runEntityBenchmark(); // CPU only, no window needed
+            return 0;
+        } else if (strcmp(argv[i], "--bench-logger") == 0) {
+            runLoggerBenchmark(); // CPU only, no window needed
+            return 0;
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            logPath = argv[++i];
+            logFormat = LOG_TEXT;
+        } else if (strcmp(argv[i], "--log-binary") == 0 && i + 1 < argc) {
+            logPath = argv[++i];
+            logFormat = LOG_BINARY;
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            if (!parseLogLevel(argv[++i], logLevel)) {
+                std::cerr << "Log: unknown level " << argv[i] << " (debug, info, warn or error)" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--decode-log") == 0 && i + 1 < argc) {
+            return runLogDecode(argv[++i]);
+        } else if (strcmp(argv[i], "--record-input") == 0 && i + 1 < argc) {
+            inputRecordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay-input") == 0 && i + 1 < argc) {
+            replayInputPath = argv[++i];
+        } else if (strcmp(argv[i], "--simulate-only") == 0) {
+            simulateOnly = true;
+        } else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+            simTicks = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--camera") == 0 && i + 1 < argc) {
+            float x = Camera::DEFAULT_CENTER_X, y = Camera::DEFAULT_CENTER_Y, zoom = 1.0f;
+            sscanf(argv[++i], "%f,%f,%f", &x, &y, &zoom);
+            camera.setCenter(x, y);
+            camera.setZoom(zoom);
+        } else if (strcmp(argv[i], "--bench-particles") == 0) {
+            benchmark = runParticleBenchmark;
+        } else if (strcmp(argv[i], "--bench-culling") == 0) {
+            benchmark = runCullingBenchmark;
+        } else if (strcmp(argv[i], "--no-culling") == 0) {
+            cullingEnabled = false;
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            targetFps = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--vsync") == 0) {
+            pacingMode = PACING_VSYNC;
+        } else if (strcmp(argv[i], "--on-demand") == 0) {
+            pacingMode = PACING_ON_DEMAND;
+        } else if (strcmp(argv[i], "--bench-pacing") == 0) {
+            benchmark = runPacingBenchmark;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            headlessOpts.capturePath = argv[++i];
+        } else if (strcmp(argv[i], "--record-trace") == 0 && i + 1 < argc) {
+            headlessOpts.tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--replay-trace") == 0 && i + 1 < argc) {
+            headlessOpts.replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--no-render-queue") == 0) {
+            renderQueueEnabled = false;
+        } else if (strcmp(argv[i], "--bench-render-queue") == 0) {
+            benchmark = runRenderQueueBenchmark;
+        } else if (strcmp(argv[i], "--no-lod") == 0) {
+            lodEnabled = false;
+        } else if (strcmp(argv[i], "--bench-lod") == 0) {
+            benchmark = runLodBenchmark;
+        } else if (strcmp(argv[i], "--no-static-cache") == 0) {
+            staticCacheEnabled = false;
+        } else if (strcmp(argv[i], "--bench-static-cache") == 0) {
+            benchmark = runStaticCacheBenchmark;
+        } else if (strcmp(argv[i], "--traffic") == 0 && i + 1 < argc) {
+            int lanes = 2, perLane = 2;
+            sscanf(argv[++i], "%d,%d", &lanes, &perLane);
+            simulation.state().traffic.populate(lanes, perLane);
+        } else if (strcmp(argv[i], "--birds") == 0 && i + 1 < argc) {
+            simulation.state().birds.populate(atoi(argv[++i]), SKY_BOUNDS, DEFAULT_FLOCK_SEED);
+        } else if (strcmp(argv[i], "--bench-flock") == 0) {
+            runFlockBenchmark(); // CPU only, no window needed
+            return 0;
+        } else if (strcmp(argv[i], "--bench-traffic") == 0) {
+            runTrafficBenchmark(); // CPU only, no window needed
+            return 0;
+        } else if (strcmp(argv[i], "--frame-threads") == 0 && i + 1 < argc) {
+            frameThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-frame-build") == 0) {
+            benchmark = runFrameBuildBenchmark;
+        } else if (strcmp(argv[i], "--stream-city") == 0 && i + 1 < argc) {
+            streamCity = true;
+            streamSeed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--chunk-workers") == 0 && i + 1 < argc) {
+            chunkWorkers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk-budget") == 0 && i + 1 < argc) {
+            chunkBudgetKb = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--pan-speed") == 0 && i + 1 < argc) {
+            cameraPanSpeed = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--time-of-day") == 0 && i + 1 < argc) {
+            timeOfDay = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--day-length") == 0 && i + 1 < argc) {
+            dayLengthSeconds = std::max(0.0f, (float)atof(argv[++i]));
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profilePrefix = argv[++i];
+            profilerSetEnabled(true);
+        } else if (strcmp(argv[i], "--convert-scene") == 0 && i + 2 < argc) {
+            const char* textPath = argv[++i];
+            const char* binaryPath = argv[++i];
+            return convertSceneText(textPath, binaryPath) ? 0 : 1;
+        } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (!sceneFile.open(argv[++i])) {
+                return 1;
+            }
+            setSceneLayout(sceneFile.layout());
+            printf("Scene: mapped %zu entities from %s in %.3f ms\n", sceneLayout.totalCount(), argv[i], msSince(start));
+        }
+    }
+
+    if (!startLogger(logPath, logFormat)) {
+        return 1;
+    }
+    atexit(stopLogger); // Writes what is still queued
+
+    if (simulateOnly) {
+        return runSimulationOnly(simulation.state(), simTicks);
+    }
+
+    setFrameThreads(frameThreads);
+    simulation.setTaskPool(&framePool); // Traffic lanes in parallel
+
+    if (streamCity) {
+        chunkStreamer.start(streamSeed, chunkWorkers, (size_t)chunkBudgetKb * 1024);
+    }
+
+    if (inputRecordPath && replayInputPath) {
+        std::cerr << "Input: --record-input and --replay-input cannot be combined" << std::endl;
+        return 1;
+    }
+    if (replayInputPath) {
+        if (!inputRecording.load(replayInputPath)) {
+            return 1;
+        }
+        applyInputView(inputRecording.getView());
+        inputRecording.startPlayback(simulation.state());
+        if (!framesGiven) {
+            // One tick per frame, up to the end of the recording
+            headlessOpts.frames = (int)(inputRecording.getEndTick() - inputRecording.getStartTick() + 1);
+        }
+    }
+
+    if (headless) {
+        if (inputRecordPath) {
+            std::cerr << "Input: nothing to record without a window" << std::endl;
+            return 1;
+        }
+        headlessOpts.benchmark = benchmark;
+        int result = runHeadless(headlessOpts);
+        if (chunkStreamer.isActive() && !benchmark) {
+            printStreamStats();
+        }
+        if (profilePrefix) {
+            profilerPrintSummary();
+            profilerDump(profilePrefix);
+        }
+        return result;
+    }
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
     glutInitWindowSize(850, 600);
     glutInitWindowPosition(100, 100);
     glutCreateWindow("Realistic Scene Animation");
 
+    loadGLExtensions(); // Buffer objects, shaders and instancing
     init();
 
+    // Benchmark modes run against the window's context and exit
+    if (benchmark) {
+        benchmark();
+        return 0;
+    }
+
+    if (profilePrefix) {
+        profileDumpPrefix = profilePrefix;
+        atexit(dumpProfileAtExit); // glutMainLoop() only returns through exit()
+    }
+
     glutDisplayFunc(display);
-    glutTimerFunc(30, update, 0);
-    glutKeyboardFunc(handleKeypress);
-    glutKeyboardUpFunc(handleKeyRelease); // REGISTERED NEW KEY-UP HANDLER
-    glutMouseFunc(handleMouse);
+    framePacer.setTargetFps(targetFps);
+    setPacingMode(pacingMode);
+    if (headlessOpts.capturePath) {
+        // At the target frame rate; frames after a resize are dropped
+        if (!frameCapture.start(headlessOpts.capturePath, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT),
+                                (int)(targetFps + 0.5), 1)) {
+            return 1;
+        }
+        glutCloseFunc(handleClose);
+    }
+    lastUpdateMs = elapsedTimeMs();
+    glutTimerFunc(0, update, 0);
+    glutVisibilityFunc(handleVisibility); // Nothing is drawn while hidden
+    glutKeyboardFunc(onKeyDown);
+    glutKeyboardUpFunc(onKeyUp);   // REGISTERED NEW KEY-UP HANDLER
+    glutSpecialFunc(onSpecialKey); // Arrow keys pan the camera
+    glutMouseFunc(onMouse);
+    glutReshapeFunc(handleReshape);
+
+    if (inputRecordPath) {
+        inputRecording.begin(simulation.state(), currentInputView());
+        atexit(saveInputAtExit); // glutMainLoop() only returns through exit()
+    }
 
     glutMainLoop();
     return 0;
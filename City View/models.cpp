@@ -0,0 +1,436 @@
+#include "models.h"
+#include "palette.h"
+#include <cstddef>
+
+// ---------- COMPILE-TIME TESSELLATION ----------
+//
+// Everything in this section is constexpr (C++11 style: one return per
+// function, recursion instead of loops), so the tables at the bottom are
+// constant-initialized in read-only data. The expansion matches the
+// MeshBuilder calls the models used to make: polygons are fans around
+// their first corner, arcs step by (end - start) / segments, and lines
+// become quads of their width.
+
+struct Paint {
+    Color color;
+    GLubyte palette; // PaletteEntry, 0 for the fixed color
+};
+
+static constexpr GLubyte colorByte(float v) {
+    return v <= 0.0f ? 0 : (v >= 1.0f ? 255 : (GLubyte)(v * 255.0 + 0.5)); // Like rgb()
+}
+
+static constexpr Paint paint(float r, float g, float b) {
+    return Paint{Color{colorByte(r), colorByte(g), colorByte(b), 255}, 0};
+}
+
+static constexpr Paint paintub(GLubyte r, GLubyte g, GLubyte b) {
+    return Paint{Color{r, g, b, 255}, 0};
+}
+
+// The vertex color is ignored for palette entries; append() bakes or hides them
+static constexpr Paint paint(PaletteEntry entry) {
+    return Paint{Color{255, 255, 255, 255}, (GLubyte)entry};
+}
+
+enum PartShape { PART_TRIANGLE, PART_QUAD, PART_RECT, PART_POLYGON, PART_FAN, PART_LINE };
+
+struct ModelPart {
+    PartShape shape;
+    Paint paint;
+    float v[8];          // Corners; x, y, width, height; cx, cy, rx, ry, start, end; or x0, y0, x1, y1, width
+    const float* points; // Polygon corners as x, y pairs
+    int count;           // Polygon corners or arc segments
+};
+
+static constexpr ModelPart triangle(Paint p, float x0, float y0, float x1, float y1, float x2, float y2) {
+    return ModelPart{PART_TRIANGLE, p, {x0, y0, x1, y1, x2, y2, 0.0f, 0.0f}, nullptr, 0};
+}
+
+static constexpr ModelPart quad(Paint p, float x0, float y0, float x1, float y1,
+                                float x2, float y2, float x3, float y3) {
+    return ModelPart{PART_QUAD, p, {x0, y0, x1, y1, x2, y2, x3, y3}, nullptr, 0};
+}
+
+static constexpr ModelPart rect(Paint p, float x, float y, float width, float height) {
+    return ModelPart{PART_RECT, p, {x, y, width, height, 0.0f, 0.0f, 0.0f, 0.0f}, nullptr, 0};
+}
+
+static constexpr ModelPart polygon(Paint p, const float* xy, int count) {
+    return ModelPart{PART_POLYGON, p, {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, xy, count};
+}
+
+static constexpr ModelPart fan(Paint p, float cx, float cy, float radiusX, float radiusY,
+                               int segments, float startAngle, float endAngle) {
+    return ModelPart{PART_FAN, p, {cx, cy, radiusX, radiusY, startAngle, endAngle, 0.0f, 0.0f}, nullptr, segments};
+}
+
+static constexpr ModelPart circle(Paint p, float cx, float cy, float radius, int segments) {
+    return fan(p, cx, cy, radius, radius, segments, 0.0f, 2.0f * 3.14159265358979323846f);
+}
+
+static constexpr ModelPart line(Paint p, float x0, float y0, float x1, float y1, float width) {
+    return ModelPart{PART_LINE, p, {x0, y0, x1, y1, width, 0.0f, 0.0f, 0.0f}, nullptr, 0};
+}
+
+// Math. Sine and cosine are Taylor series in double after reducing the
+// angle to [-pi, pi], which rounds to the same float as std::sin/cos.
+
+static constexpr double CONST_PI = 3.14159265358979323846;
+
+static constexpr double floorConst(double x) {
+    return (double)(long long)x > x ? (double)(long long)x - 1.0 : (double)(long long)x;
+}
+
+static constexpr double reduceAngle(double x) {
+    return x - 2.0 * CONST_PI * floorConst((x + CONST_PI) / (2.0 * CONST_PI));
+}
+
+// sum of (-1)^k x^(2k+1) / (2k+1)!, term is the k-th
+static constexpr double sinSeries(double x2, double term, double sum, int k) {
+    return k == 20 ? sum : sinSeries(x2, -term * x2 / ((2 * k + 2) * (2 * k + 3)), sum + term, k + 1);
+}
+
+// sum of (-1)^k x^(2k) / (2k)!
+static constexpr double cosSeries(double x2, double term, double sum, int k) {
+    return k == 20 ? sum : cosSeries(x2, -term * x2 / ((2 * k + 1) * (2 * k + 2)), sum + term, k + 1);
+}
+
+static constexpr double sinReduced(double x) {
+    return sinSeries(x * x, x, 0.0, 0);
+}
+
+static constexpr double cosReduced(double x) {
+    return cosSeries(x * x, 1.0, 0.0, 0);
+}
+
+static constexpr float sinConst(float x) {
+    return (float)sinReduced(reduceAngle(x));
+}
+
+static constexpr float cosConst(float x) {
+    return (float)cosReduced(reduceAngle(x));
+}
+
+static constexpr double sqrtNewton(double x, double guess, int steps) {
+    return steps == 0 ? guess : sqrtNewton(x, 0.5 * (guess + x / guess), steps - 1);
+}
+
+static constexpr float sqrtConst(float x) {
+    return x <= 0.0f ? 0.0f : (float)sqrtNewton(x, x > 1.0f ? x : 1.0, 64);
+}
+
+// Vertices of one part
+
+struct Point {
+    float x, y;
+};
+
+static constexpr int partVertexCount(const ModelPart& p) {
+    return p.shape == PART_TRIANGLE ? 3
+         : p.shape == PART_POLYGON ? 3 * (p.count - 2)
+         : p.shape == PART_FAN ? 3 * p.count
+         : 6; // Two triangles
+}
+
+// Corners 0, 1, 2 then 0, 2, 3, like MeshBuilder::quad()
+static constexpr int quadCorner(int k) {
+    return k < 3 ? k : (k == 3 ? 0 : k - 2);
+}
+
+static constexpr float lineLength(const ModelPart& p) {
+    return sqrtConst((p.v[2] - p.v[0]) * (p.v[2] - p.v[0]) + (p.v[3] - p.v[1]) * (p.v[3] - p.v[1]));
+}
+
+// Half-width offset perpendicular to the segment
+static constexpr float lineNormalX(const ModelPart& p) {
+    return -(p.v[3] - p.v[1]) / lineLength(p) * p.v[4] * 0.5f;
+}
+
+static constexpr float lineNormalY(const ModelPart& p) {
+    return (p.v[2] - p.v[0]) / lineLength(p) * p.v[4] * 0.5f;
+}
+
+static constexpr Point lineCorner(const ModelPart& p, int c) {
+    return c == 0 ? Point{p.v[0] + lineNormalX(p), p.v[1] + lineNormalY(p)}
+         : c == 1 ? Point{p.v[0] - lineNormalX(p), p.v[1] - lineNormalY(p)}
+         : c == 2 ? Point{p.v[2] - lineNormalX(p), p.v[3] - lineNormalY(p)}
+         : Point{p.v[2] + lineNormalX(p), p.v[3] + lineNormalY(p)};
+}
+
+static constexpr Point rectCorner(const ModelPart& p, int c) {
+    return Point{(c == 1 || c == 2) ? p.v[0] + p.v[2] : p.v[0],
+                 c >= 2 ? p.v[1] + p.v[3] : p.v[1]};
+}
+
+static constexpr Point quadPoint(const ModelPart& p, int c) {
+    return p.shape == PART_QUAD ? Point{p.v[2 * c], p.v[2 * c + 1]}
+         : p.shape == PART_RECT ? rectCorner(p, c)
+         : lineCorner(p, c);
+}
+
+static constexpr Point polygonCorner(const ModelPart& p, int c) {
+    return Point{p.points[2 * c], p.points[2 * c + 1]};
+}
+
+static constexpr Point arcPointAt(const ModelPart& p, float angle) {
+    return Point{p.v[0] + cosConst(angle) * p.v[2], p.v[1] + sinConst(angle) * p.v[3]};
+}
+
+static constexpr Point arcPoint(const ModelPart& p, int i) {
+    return arcPointAt(p, i == 0 ? p.v[4] : p.v[4] + i * ((p.v[5] - p.v[4]) / p.count));
+}
+
+// Triangle t is the centre and arc points t, t + 1
+static constexpr Point fanPoint(const ModelPart& p, int t, int j) {
+    return j == 0 ? Point{p.v[0], p.v[1]} : arcPoint(p, t + j - 1);
+}
+
+static constexpr Point partPoint(const ModelPart& p, int k) {
+    return p.shape == PART_TRIANGLE ? Point{p.v[2 * k], p.v[2 * k + 1]}
+         : p.shape == PART_POLYGON ? polygonCorner(p, k % 3 == 0 ? 0 : k / 3 + k % 3)
+         : p.shape == PART_FAN ? fanPoint(p, k / 3, k % 3)
+         : quadPoint(p, quadCorner(k));
+}
+
+static constexpr Vertex partVertex(const ModelPart& p, int k) {
+    return Vertex{partPoint(p, k).x, partPoint(p, k).y, p.paint.color, p.paint.palette};
+}
+
+static constexpr float absConst(float x) {
+    return x < 0.0f ? -x : x;
+}
+
+static constexpr float maxConst(float a, float b) {
+    return a > b ? a : b;
+}
+
+// Like MeshBuilder::fan(): the sagitta of one arc segment
+static constexpr float partArcError(const ModelPart& p) {
+    return p.shape != PART_FAN ? 0.0f
+         : maxConst(absConst(p.v[2]), absConst(p.v[3])) *
+           (1.0f - cosConst(absConst(p.v[5] - p.v[4]) / p.count * 0.5f));
+}
+
+// Whole models
+
+template <size_t N>
+static constexpr int modelVertexCount(const ModelPart (&parts)[N], size_t i = 0) {
+    return i == N ? 0 : partVertexCount(parts[i]) + modelVertexCount(parts, i + 1);
+}
+
+template <size_t N>
+static constexpr float modelArcError(const ModelPart (&parts)[N], size_t i = 0) {
+    return i == N ? 0.0f : maxConst(partArcError(parts[i]), modelArcError(parts, i + 1));
+}
+
+static constexpr Vertex modelVertex(const ModelPart* parts, int k) {
+    return k < partVertexCount(parts[0]) ? partVertex(parts[0], k)
+                                         : modelVertex(parts + 1, k - partVertexCount(parts[0]));
+}
+
+template <int... I> struct IndexList {};
+template <int N, int... I> struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+template <int... I> struct MakeIndexList<0, I...> { typedef IndexList<I...> type; };
+
+template <int N>
+struct Triangles {
+    Vertex vertices[N];
+};
+
+template <int N, int... I>
+static constexpr Triangles<N> tessellate(const ModelPart* parts, IndexList<I...>) {
+    return Triangles<N>{{modelVertex(parts, I)...}};
+}
+
+// One level of detail of a model. Source::parts(level) lists its parts,
+// with arcs of lodSegments(segments, level) segments.
+template <typename Source, int Level>
+struct ModelLevel {
+    static constexpr typename Source::Parts PARTS = Source::parts(Level);
+    static constexpr int VERTICES = modelVertexCount(PARTS.parts);
+    static constexpr Triangles<VERTICES> TRIANGLES =
+        tessellate<VERTICES>(PARTS.parts, typename MakeIndexList<VERTICES>::type());
+    static constexpr float ARC_ERROR = modelArcError(PARTS.parts);
+};
+
+template <typename Source, int Level>
+constexpr typename Source::Parts ModelLevel<Source, Level>::PARTS;
+template <typename Source, int Level>
+constexpr Triangles<ModelLevel<Source, Level>::VERTICES> ModelLevel<Source, Level>::TRIANGLES;
+
+template <typename Source, int Level>
+static constexpr ModelMesh modelMesh() {
+    return ModelMesh{ModelLevel<Source, Level>::TRIANGLES.vertices, ModelLevel<Source, Level>::VERTICES,
+                     ModelLevel<Source, Level>::ARC_ERROR};
+}
+
+// ---------- CAR ----------
+
+static constexpr float CAR_BODY[] = {
+    45, 200,  // Back bottom
+    125, 200, // Front bottom
+    135, 215, // Hood tip
+    125, 230, // Windshield base front
+    55, 230,  // Windshield base back
+    45, 215   // Back window base
+};
+
+struct CarSource {
+    struct Parts {
+        ModelPart parts[8];
+    };
+    static constexpr Parts parts(int level) {
+        return Parts{{
+            polygon(paint(1.0f, 0.0f, 0.0f), CAR_BODY, 6),
+            // Headlight beams (only at night): source point, far wide point, far narrow point
+            triangle(paint(PAL_HEADLIGHT_BEAM), 135, 208, 180, 215, 180, 195),
+            triangle(paint(PAL_HEADLIGHT_BEAM), 135, 205, 180, 212, 180, 192),
+            rect(paint(PAL_HEADLIGHT), 135, 206, 2, 8),
+            // Cabin/roof, then the windshield over it
+            quad(paint(0.0f, 0.0f, 1.0f), 60, 230, 120, 230, 110, 245, 70, 245),
+            quad(paint(0.7f, 0.8f, 1.0f), 120, 230, 110, 245, 70, 245, 60, 230),
+            // Wheels, 63 segments at full detail like the original 0.1 rad loop
+            circle(paint(0.0f, 0.0f, 0.0f), 115, 195, 8, lodSegments(63, level)),
+            circle(paint(0.0f, 0.0f, 0.0f), 60, 195, 8, lodSegments(63, level))
+        }};
+    }
+};
+
+const ModelMesh CAR_MODELS[NUM_LOD_LEVELS] = {
+    modelMesh<CarSource, 0>(), modelMesh<CarSource, 1>(), modelMesh<CarSource, 2>(), modelMesh<CarSource, 3>()
+};
+
+static_assert(ModelLevel<CarSource, 0>::VERTICES == 3 * 4 + 3 + 3 + 6 + 6 + 6 + 2 * 3 * 63, "car tessellation");
+
+// ---------- SHIP ----------
+
+static constexpr float SHIP_HULL[] = {-100, 0, -90, 15, -60, 25, 80, 25, 100, 15, 100, 0};
+static constexpr float SHIP_DECK[] = {-60, 25, 80, 25, 60, 45, -40, 45};
+
+struct ShipSource {
+    struct Parts {
+        ModelPart parts[9];
+    };
+    static constexpr Parts parts(int) {
+        return Parts{{
+            polygon(paint(0.4f, 0.2f, 0.0f), SHIP_HULL, 6),
+            polygon(paint(0.8f, 0.8f, 0.8f), SHIP_DECK, 4),
+            rect(paint(1.0f, 1.0f, 1.0f), -25, 45, 70, 25), // Bridge
+            // Windows: dark blue glass, lit up yellow at night
+            rect(paint(PAL_SHIP_WINDOW), -20, 55, 10, 10),
+            rect(paint(PAL_SHIP_WINDOW), -5, 55, 10, 10),
+            rect(paint(PAL_SHIP_WINDOW), 10, 55, 10, 10),
+            rect(paint(PAL_SHIP_WINDOW), 25, 55, 10, 10),
+            rect(paint(PAL_SHIP_WINDOW), 40, 55, 10, 10),
+            rect(paint(0.8f, 0.1f, 0.1f), 20, 70, 10, 25) // Chimney
+        }};
+    }
+};
+
+struct ShipReflectionSource {
+    struct Parts {
+        ModelPart parts[1];
+    };
+    static constexpr Parts parts(int) {
+        return Parts{{polygon(paint(0.2f, 0.1f, 0.0f), SHIP_HULL, 6)}};
+    }
+};
+
+const ModelMesh SHIP_MODEL = modelMesh<ShipSource, 0>();
+const ModelMesh SHIP_REFLECTION_MODEL = modelMesh<ShipReflectionSource, 0>();
+
+// ---------- SAILBOAT ----------
+
+static constexpr float SAILBOAT_HULL[] = {-20, 0, 20, 0, 15, 10, -15, 10};
+
+struct SailboatSource {
+    struct Parts {
+        ModelPart parts[3];
+    };
+    static constexpr Parts parts(int) {
+        return Parts{{
+            polygon(paint(0.2f, 0.1f, 0.0f), SAILBOAT_HULL, 4),
+            // Mast, two units wide after scaling like the original 2 px line
+            line(paint(0.0f, 0.0f, 0.0f), 0, 10, 0, 60, 2.0f / SAILBOAT_SCALE),
+            // Sail: top of mast, base of mast, tip
+            triangle(paint(PAL_SAIL), 0, 60, 0, 10, 40, 20)
+        }};
+    }
+};
+
+// Without the mast, which is thinner than a pixel by then
+struct SailboatSilhouetteSource {
+    struct Parts {
+        ModelPart parts[2];
+    };
+    static constexpr Parts parts(int) {
+        return Parts{{
+            polygon(paint(0.2f, 0.1f, 0.0f), SAILBOAT_HULL, 4),
+            triangle(paint(PAL_SAIL), 0, 60, 0, 10, 40, 20)
+        }};
+    }
+};
+
+const ModelMesh SAILBOAT_MODEL = modelMesh<SailboatSource, 0>();
+const ModelMesh SAILBOAT_SILHOUETTE_MODEL = modelMesh<SailboatSilhouetteSource, 0>();
+
+// ---------- MOSQUE ----------
+
+struct MosqueSource {
+    struct Parts {
+        ModelPart parts[4];
+    };
+    static constexpr Parts parts(int level) {
+        return Parts{{
+            rect(paint(PAL_MOSQUE_HALL), 0, 0, 60, 40),
+            // Dome, half fan centered where the dome meets the hall
+            fan(paint(0.0f, 0.4f, 0.0f), 30, 40, 20.0f, 20.0f, lodSegments(30, level), 0.0f, (float)CONST_PI),
+            rect(paintub(180, 180, 180), 60, 0, 10, 100), // Minaret
+            triangle(paint(0.0f, 0.4f, 0.0f), 65, 120, 60, 100, 70, 100) // Minaret top
+        }};
+    }
+};
+
+const ModelMesh MOSQUE_MODELS[NUM_LOD_LEVELS] = {
+    modelMesh<MosqueSource, 0>(), modelMesh<MosqueSource, 1>(),
+    modelMesh<MosqueSource, 2>(), modelMesh<MosqueSource, 3>()
+};
+
+// ---------- PLAYGROUND ----------
+
+static constexpr float FENCE_TOP = 20.0f + 35.0f;
+static constexpr float FENCE_MIDDLE = 20.0f + 35.0f / 2.0f;
+
+// Vertical fence post i, every 15 units from -50 to 100
+static constexpr ModelPart fencePost(int i) {
+    return line(paintub(100, 100, 100), -50.0f + 15.0f * i, 20, -50.0f + 15.0f * i, FENCE_TOP, 2.0f);
+}
+
+struct PlaygroundSource {
+    struct Parts {
+        ModelPart parts[22];
+    };
+    static constexpr Parts parts(int) {
+        return Parts{{
+            rect(paint(PAL_PLAYGROUND_SAND), -50, 0, 150, 20),
+            // Fence
+            fencePost(0), fencePost(1), fencePost(2), fencePost(3), fencePost(4), fencePost(5),
+            fencePost(6), fencePost(7), fencePost(8), fencePost(9), fencePost(10),
+            line(paintub(100, 100, 100), -50, FENCE_TOP, 100, FENCE_TOP, 2.0f),
+            line(paintub(100, 100, 100), -50, FENCE_MIDDLE, 100, FENCE_MIDDLE, 2.0f),
+            // Swing set: posts, top bar, ropes and seat
+            line(paint(0.5f, 0.5f, 0.5f), 0, 20, 0, 60, 3.0f),
+            line(paint(0.5f, 0.5f, 0.5f), 50, 20, 50, 60, 3.0f),
+            line(paint(0.5f, 0.5f, 0.5f), 0, 60, 50, 60, 3.0f),
+            line(paint(0.0f, 0.0f, 0.0f), 15, 60, 15, 40, 1.0f),
+            line(paint(0.0f, 0.0f, 0.0f), 35, 60, 35, 40, 1.0f),
+            rect(paintub(255, 200, 0), 10, 35, 30, 5),
+            // Slide: stairs and chute
+            rect(paint(0.6f, 0.3f, 0.0f), 80, 20, 5, 30),
+            quad(paint(0.0f, 0.5f, 0.8f), 85, 50, 70, 30, 75, 30, 85, 55)
+        }};
+    }
+};
+
+const ModelMesh PLAYGROUND_MODEL = modelMesh<PlaygroundSource, 0>();
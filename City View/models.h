@@ -0,0 +1,37 @@
+#ifndef CITY_VIEW_MODELS_H
+#define CITY_VIEW_MODELS_H
+
+#include "geometry.h"
+#include "lod.h"
+
+// Models tessellated at compile time. The car, ship, mosque and
+// playground are constexpr lists of parts (rectangles, polygons, arcs,
+// lines with a width) that the compiler expands into triangle lists, so
+// drawing one copies a flat static array: no trig, no tessellation and
+// nothing to set up at startup. Coordinates are the local units the
+// draw functions always used; MeshBuilder::append() places them. Models
+// with arcs come in NUM_LOD_LEVELS levels of detail (see lod.h).
+
+struct ModelMesh {
+    const Vertex* vertices;
+    int count;      // A multiple of 3
+    float arcError; // Largest chord error of its arcs, local units
+};
+
+const float SAILBOAT_SCALE = 0.6f;   // As drawn by drawMiniSailboat()
+const float SAILBOAT_HEIGHT = 60.0f; // Waterline to masthead, unscaled
+
+extern const ModelMesh CAR_MODELS[NUM_LOD_LEVELS]; // At its road position, facing +x
+extern const ModelMesh SHIP_MODEL;                 // Unscaled, waterline at y = 0
+extern const ModelMesh SHIP_REFLECTION_MODEL;      // The hull alone, in its submerged color
+extern const ModelMesh SAILBOAT_MODEL;             // Unscaled, waterline at y = 0
+extern const ModelMesh SAILBOAT_SILHOUETTE_MODEL;  // Hull and sail, for sailboats a few pixels tall
+extern const ModelMesh MOSQUE_MODELS[NUM_LOD_LEVELS];
+extern const ModelMesh PLAYGROUND_MODEL;
+
+inline void appendModel(MeshBuilder& mb, const ModelMesh& model) {
+    mb.append(model.vertices, model.count);
+    mb.noteArcError(model.arcError);
+}
+
+#endif
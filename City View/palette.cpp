@@ -0,0 +1,150 @@
+#include "palette.h"
+#include "gl_ext.h"
+#include "render_queue.h"
+#include "shader.h"
+#include <cstdio>
+#include <vector>
+
+static Color hidden(Color c) {
+    c.a = 0;
+    return c;
+}
+
+// Day color, night color; same values as the old per-mode branches
+const PaletteColors paletteTable[NUM_PALETTE_ENTRIES] = {
+    {rgb(1.0f, 1.0f, 1.0f), rgb(1.0f, 1.0f, 1.0f)},                   // PAL_NONE (unused)
+    {rgb(0.0f, 0.4f, 0.8f), rgb(0.0f, 0.1f, 0.3f)},                   // PAL_SEA_DEEP
+    {rgb(0.0f, 0.5f, 1.0f), rgb(0.0f, 0.15f, 0.4f)},                  // PAL_SEA_SHALLOW
+    {rgb(1.0f, 0.9f, 0.0f), hidden(rgb(1.0f, 0.9f, 0.0f))},           // PAL_SUN
+    {hidden(rgb(0.8f, 0.8f, 0.8f)), rgb(0.8f, 0.8f, 0.8f)},           // PAL_MOON
+    {rgb(1.0f, 1.0f, 1.0f), rgb(0.6f, 0.6f, 0.7f)},                   // PAL_CLOUD
+    {rgbub(200, 180, 140), rgbub(100, 80, 50)},                       // PAL_BUILDING_WALL
+    {rgb(0.0f, 0.0f, 0.3f), rgb(1.0f, 0.9f, 0.7f)},                   // PAL_BUILDING_WINDOW
+    {rgb(0.0f, 0.0f, 0.3f), rgb(0.1f, 0.1f, 0.18f)},                  // PAL_BUILDING_WINDOW_DARK
+    {rgbub(230, 230, 230), rgbub(150, 150, 150)},                     // PAL_MOSQUE_HALL
+    {rgbub(240, 220, 160), rgbub(120, 100, 60)},                      // PAL_PLAYGROUND_SAND
+    {rgb(0.0f, 0.5f, 0.0f), rgb(0.0f, 0.2f, 0.0f)},                   // PAL_FOLIAGE
+    {rgb(0.4f, 0.4f, 0.4f), rgb(1.0f, 0.9f, 0.5f)},                   // PAL_STREET_LAMP
+    {rgb(0.0f, 0.4f, 0.8f), rgb(1.0f, 1.0f, 0.8f)},                   // PAL_SHIP_WINDOW
+    {rgb(1.0f, 1.0f, 1.0f), rgb(0.6f, 0.6f, 0.7f)},                   // PAL_SAIL
+    {hidden(rgb(1.0f, 1.0f, 0.8f)), rgb(1.0f, 1.0f, 0.8f, 0.8f)},     // PAL_HEADLIGHT_BEAM
+    {hidden(rgb(1.0f, 0.9f, 0.5f)), rgb(1.0f, 0.9f, 0.5f)},           // PAL_HEADLIGHT
+    {rgb(0.0f, 0.0f, 0.0f), hidden(rgb(0.0f, 0.0f, 0.0f))},           // PAL_BIRD
+};
+
+static float nightBlend = 0.0f;
+
+void setNightBlend(float blend) {
+    nightBlend = blend < 0.0f ? 0.0f : (blend > 1.0f ? 1.0f : blend);
+}
+
+float getNightBlend() {
+    return nightBlend;
+}
+
+Color paletteColor(PaletteEntry entry) {
+    const PaletteColors& p = paletteTable[entry];
+    if (nightBlend <= 0.0f) return p.day;
+    if (nightBlend >= 1.0f) return p.night;
+    Color c = {mixChannel(p.day.r, p.night.r, nightBlend), mixChannel(p.day.g, p.night.g, nightBlend),
+               mixChannel(p.day.b, p.night.b, nightBlend), mixChannel(p.day.a, p.night.a, nightBlend)};
+    return c;
+}
+
+bool paletteVisible(PaletteEntry entry) {
+    return paletteColor(entry).a >= 128;
+}
+
+// ---------- SHADERS ----------
+
+std::string paletteShaderCode() {
+    char size[64];
+    snprintf(size, sizeof(size), "#define PALETTE_SIZE %d\n", (int)NUM_PALETTE_ENTRIES);
+    return std::string(size) +
+        "uniform vec4 paletteDay[PALETTE_SIZE];\n"
+        "uniform vec4 paletteNight[PALETTE_SIZE];\n"
+        "uniform float nightBlend;\n"
+        "const vec4 PALETTE_HIDDEN_POSITION = vec4(2.0, 2.0, 2.0, 1.0);\n" // Outside the clip volume
+        "vec4 paletteColor(vec4 color, float entry) {\n"
+        "    int i = int(entry + 0.5);\n"
+        "    return i == 0 ? color : mix(paletteDay[i], paletteNight[i], nightBlend);\n"
+        "}\n"
+        "bool paletteHidden(float entry) {\n"
+        "    int i = int(entry + 0.5);\n"
+        "    return i != 0 && mix(paletteDay[i].a, paletteNight[i].a, nightBlend) < 0.5;\n"
+        "}\n";
+}
+
+static const char* paletteVertexMain =
+    "attribute vec2 position;\n"
+    "attribute vec4 color;\n"
+    "attribute float paletteEntry;\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    gl_Position = paletteHidden(paletteEntry) ? PALETTE_HIDDEN_POSITION\n"
+    "                : gl_ModelViewProjectionMatrix * vec4(position, 0.0, 1.0);\n"
+    "    vColor = paletteColor(color, paletteEntry);\n"
+    "}\n";
+
+static const char* paletteFragmentSrc =
+    "#version 120\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    gl_FragColor = vColor;\n"
+    "}\n";
+
+// Blend uniform of every program the tables were uploaded to
+struct PaletteProgram {
+    GLuint program;
+    GLint blendLocation;
+};
+
+static std::vector<PaletteProgram> palettePrograms;
+static GLuint paletteProgram = 0;
+
+void setPaletteUniforms(GLuint program) {
+    for (size_t i = 0; i < palettePrograms.size(); ++i) {
+        if (palettePrograms[i].program == program) {
+            extUniform1f(palettePrograms[i].blendLocation, nightBlend);
+            return;
+        }
+    }
+
+    // First use: the tables never change, so they are uploaded once
+    float day[NUM_PALETTE_ENTRIES * 4], night[NUM_PALETTE_ENTRIES * 4];
+    for (int i = 0; i < NUM_PALETTE_ENTRIES; ++i) {
+        const PaletteColors& p = paletteTable[i];
+        const GLubyte d[4] = {p.day.r, p.day.g, p.day.b, p.day.a};
+        const GLubyte n[4] = {p.night.r, p.night.g, p.night.b, p.night.a};
+        for (int k = 0; k < 4; ++k) {
+            day[i * 4 + k] = d[k] / 255.0f;
+            night[i * 4 + k] = n[k] / 255.0f;
+        }
+    }
+    extUniform4fv(extGetUniformLocation(program, "paletteDay"), NUM_PALETTE_ENTRIES, day);
+    extUniform4fv(extGetUniformLocation(program, "paletteNight"), NUM_PALETTE_ENTRIES, night);
+    PaletteProgram entry = {program, extGetUniformLocation(program, "nightBlend")};
+    palettePrograms.push_back(entry);
+    extUniform1f(entry.blendLocation, nightBlend);
+}
+
+void initPalette() {
+    if (paletteProgram != 0) return;
+    std::string vertexSrc = "#version 120\n" + paletteShaderCode() + paletteVertexMain;
+    const char* attribs[] = {"position", "color", "paletteEntry"};
+    paletteProgram = buildProgram(vertexSrc.c_str(), paletteFragmentSrc, attribs, 3);
+}
+
+bool paletteOnGpu() {
+    return paletteProgram != 0;
+}
+
+bool bindPaletteProgram(RenderState& state) {
+    if (paletteProgram == 0) return false;
+    state.useProgram(paletteProgram);
+    if (state.firstUse(paletteProgram)) {
+        setPaletteUniforms(paletteProgram);
+        state.countUniforms(1);
+    }
+    return true;
+}
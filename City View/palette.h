@@ -0,0 +1,78 @@
+#ifndef CITY_VIEW_PALETTE_H
+#define CITY_VIEW_PALETTE_H
+
+#include "geometry.h"
+#include <string>
+
+// Day/night palette. Geometry whose color depends on the time of day
+// stores a palette entry per vertex instead of a fixed color, and the
+// palette shader mixes the entry's day and night colors by one blend
+// factor. Night mode and dusk/dawn transitions therefore only change a
+// uniform. Without shaders the builder bakes the blended color into each
+// vertex instead, and the scene has to be rebuilt when the blend moves.
+//
+// An entry whose blended alpha is below one half is hidden (things that
+// exist only by day or only by night): the shader moves its vertices out
+// of view, and a baking builder does not emit them.
+
+enum PaletteEntry : unsigned char {
+    PAL_NONE = 0,        // Fixed vertex color
+    PAL_SEA_DEEP,
+    PAL_SEA_SHALLOW,
+    PAL_SUN,
+    PAL_MOON,
+    PAL_CLOUD,
+    PAL_BUILDING_WALL,
+    PAL_BUILDING_WINDOW,
+    PAL_BUILDING_WINDOW_DARK, // Unlit at night
+    PAL_MOSQUE_HALL,
+    PAL_PLAYGROUND_SAND,
+    PAL_FOLIAGE,
+    PAL_STREET_LAMP,
+    PAL_SHIP_WINDOW,
+    PAL_SAIL,
+    PAL_HEADLIGHT_BEAM,
+    PAL_HEADLIGHT,
+    PAL_BIRD,
+    NUM_PALETTE_ENTRIES
+};
+
+struct PaletteColors {
+    Color day, night;
+};
+
+extern const PaletteColors paletteTable[NUM_PALETTE_ENTRIES];
+
+// 0 is full day, 1 full night
+void setNightBlend(float blend);
+float getNightBlend();
+
+Color paletteColor(PaletteEntry entry);  // Blended at the current factor
+bool paletteVisible(PaletteEntry entry);
+
+// Build the palette program; GL thread, once a context exists. Until then
+// (or without shaders) builders bake colors.
+void initPalette();
+bool paletteOnGpu();
+
+// GLSL 1.20 declarations for other programs: the palette uniforms,
+// vec4 paletteColor(vec4 color, float entry), bool paletteHidden(float entry)
+// and PALETTE_HIDDEN_POSITION. Programs using it call
+// setPaletteUniforms() while bound.
+std::string paletteShaderCode();
+void setPaletteUniforms(GLuint program);
+
+// Vertex attributes of the palette program
+enum {
+    PALETTE_ATTRIB_POSITION = 0,
+    PALETTE_ATTRIB_COLOR = 1,
+    PALETTE_ATTRIB_ENTRY = 2
+};
+
+class RenderState; // render_queue.h
+
+// Bind the palette program with the current blend. Returns false (and
+// binds nothing) when the fixed-function path has to be used.
+bool bindPaletteProgram(RenderState& state);
+
+#endif
@@ -0,0 +1,262 @@
+#include "particles.h"
+#include "gl_ext.h"
+#include "shader.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Point sprite enables, core since GL 2.0 but missing from old headers
+#ifndef GL_VERTEX_PROGRAM_POINT_SIZE
+#define GL_VERTEX_PROGRAM_POINT_SIZE 0x8642
+#endif
+#ifndef GL_POINT_SPRITE
+#define GL_POINT_SPRITE 0x8861
+#endif
+
+// ---------- KERNELS ----------
+
+CITY_VIEW_NO_VECTORIZE
+static void integrateScalar(float* x, float* y, float* velX, float* velY, float* age,
+                            int begin, int n, float dt, float drag, float gravity) {
+    for (int i = begin; i < n; ++i) {
+        float vx = velX[i] * drag;
+        float vy = velY[i] * drag + gravity * dt;
+        velX[i] = vx;
+        velY[i] = vy;
+        x[i] += vx * dt;
+        y[i] += vy * dt;
+        age[i] += dt;
+    }
+}
+
+#ifdef CITY_VIEW_X86_SIMD
+
+__attribute__((target("sse2")))
+static int integrateSSE2(float* x, float* y, float* velX, float* velY, float* age,
+                         int n, float dt, float drag, float gravity) {
+    const __m128 vdt = _mm_set1_ps(dt), vdrag = _mm_set1_ps(drag), vfall = _mm_set1_ps(gravity * dt);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 vx = _mm_mul_ps(_mm_loadu_ps(velX + i), vdrag);
+        __m128 vy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(velY + i), vdrag), vfall);
+        _mm_storeu_ps(velX + i, vx);
+        _mm_storeu_ps(velY + i, vy);
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(vx, vdt)));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(vy, vdt)));
+        _mm_storeu_ps(age + i, _mm_add_ps(_mm_loadu_ps(age + i), vdt));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int integrateAVX2(float* x, float* y, float* velX, float* velY, float* age,
+                         int n, float dt, float drag, float gravity) {
+    const __m256 vdt = _mm256_set1_ps(dt), vdrag = _mm256_set1_ps(drag), vfall = _mm256_set1_ps(gravity * dt);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vx = _mm256_mul_ps(_mm256_loadu_ps(velX + i), vdrag);
+        __m256 vy = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(velY + i), vdrag), vfall);
+        _mm256_storeu_ps(velX + i, vx);
+        _mm256_storeu_ps(velY + i, vy);
+        _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(vx, vdt)));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(vy, vdt)));
+        _mm256_storeu_ps(age + i, _mm256_add_ps(_mm256_loadu_ps(age + i), vdt));
+    }
+    return i;
+}
+
+#endif
+
+void integrateParticles(SimdLevel level, float* x, float* y, float* velX, float* velY,
+                        float* age, int n, float dt, float drag, float gravity) {
+    int done = 0;
+#ifdef CITY_VIEW_X86_SIMD
+    if (level == SIMD_AVX2) {
+        done = integrateAVX2(x, y, velX, velY, age, n, dt, drag, gravity);
+    } else if (level == SIMD_SSE2) {
+        done = integrateSSE2(x, y, velX, velY, age, n, dt, drag, gravity);
+    }
+#else
+    (void)level;
+#endif
+    integrateScalar(x, y, velX, velY, age, done, n, dt, drag, gravity); // Remainder
+}
+
+// ---------- ParticlePool ----------
+
+ParticlePool::ParticlePool(int capacity, const ParticleStyle& s)
+    : style(s), x(capacity), y(capacity), velX(capacity), velY(capacity), age(capacity), life(capacity) {
+}
+
+int ParticlePool::spawn(const ParticleBurst& b, int count) {
+    int fit = std::min(count, capacity() - live);
+    droppedCount += count - fit;
+    for (int k = 0; k < fit; ++k) {
+        float r[5];
+        for (int j = 0; j < 5; ++j) {
+            rngState ^= rngState << 13;
+            rngState ^= rngState >> 17;
+            rngState ^= rngState << 5;
+            r[j] = (rngState >> 8) * (2.0f / 16777216.0f) - 1.0f; // [-1, 1)
+        }
+        int i = live++;
+        x[i] = b.x + r[0] * b.spreadX;
+        y[i] = b.y + r[1] * b.spreadY;
+        velX[i] = b.velX + r[2] * b.spreadVel;
+        velY[i] = b.velY + r[3] * b.spreadVel;
+        age[i] = 0.0f;
+        life[i] = std::max(0.01f, b.life + r[4] * b.spreadLife);
+    }
+    return fit;
+}
+
+void ParticlePool::update(float dt, SimdLevel level) {
+    if (live == 0 || dt <= 0.0f) return;
+    integrateParticles(level, &x[0], &y[0], &velX[0], &velY[0], &age[0], live, dt,
+                       std::pow(style.drag, dt), style.gravity);
+
+    // Move the last live particle into each dead slot
+    int i = 0;
+    while (i < live) {
+        if (age[i] < life[i]) {
+            ++i;
+            continue;
+        }
+        int last = --live;
+        x[i] = x[last];
+        y[i] = y[last];
+        velX[i] = velX[last];
+        velY[i] = velY[last];
+        age[i] = age[last];
+        life[i] = life[last];
+    }
+}
+
+void ParticlePool::buildVertices(std::vector<ParticleVertex>& out) const {
+    out.resize(live);
+    const Color c0 = style.startColor, c1 = style.endColor;
+    for (int i = 0; i < live; ++i) {
+        float t = std::min(1.0f, age[i] / life[i]);
+        ParticleVertex& v = out[i];
+        v.x = x[i];
+        v.y = y[i];
+        v.size = style.startSize + (style.endSize - style.startSize) * t;
+        v.color.r = mixChannel(c0.r, c1.r, t);
+        v.color.g = mixChannel(c0.g, c1.g, t);
+        v.color.b = mixChannel(c0.b, c1.b, t);
+        v.color.a = mixChannel(c0.a, c1.a, t);
+    }
+}
+
+// ---------- ParticleBatch ----------
+
+enum {
+    ATTRIB_POSITION = 0,
+    ATTRIB_SIZE = 1,
+    ATTRIB_COLOR = 2
+};
+
+static const char* particleVertexSrc =
+    "#version 120\n"
+    "attribute vec2 position;\n"
+    "attribute float size;\n"
+    "attribute vec4 color;\n"
+    "uniform float pixelsPerUnit;\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(position, 0.0, 1.0);\n"
+    "    gl_PointSize = max(1.0, size * pixelsPerUnit);\n"
+    "    vColor = color;\n"
+    "}\n";
+
+// Round puffs that thin out towards the edge
+static const char* particleFragmentSrc =
+    "#version 120\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    vec2 d = gl_PointCoord * 2.0 - 1.0;\n"
+    "    float r2 = dot(d, d);\n"
+    "    if (r2 > 1.0) discard;\n"
+    "    gl_FragColor = vec4(vColor.rgb, vColor.a * (1.0 - r2 * r2));\n"
+    "}\n";
+
+static GLuint particleProgram = 0;
+static GLint pixelsPerUnitLocation = -1;
+static bool particleProgramTried = false;
+
+static GLuint getParticleProgram() {
+    if (!particleProgramTried) {
+        particleProgramTried = true;
+        const char* attribs[] = {"position", "size", "color"};
+        particleProgram = buildProgram(particleVertexSrc, particleFragmentSrc, attribs, 3);
+        if (particleProgram) {
+            pixelsPerUnitLocation = extGetUniformLocation(particleProgram, "pixelsPerUnit");
+        }
+    }
+    return particleProgram;
+}
+
+void ParticleBatch::draw(const std::vector<ParticleVertex>& vertices, const ParticleStyle& style,
+                         float pixelsPerUnit) {
+    if (vertices.empty()) return;
+
+    const char* base = (const char*)&vertices[0];
+    if (hasVertexBuffers) {
+        if (vbo == 0) {
+            extGenBuffers(1, &vbo);
+        }
+        size_t bytes = vertices.size() * sizeof(ParticleVertex);
+        orphanArrayBuffer(vbo, capacity, bytes);
+        extBufferSubData(GL_ARRAY_BUFFER, 0, bytes, base);
+        base = nullptr;
+    }
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GLuint program = getParticleProgram();
+    if (program) {
+        extUseProgram(program);
+        extUniform1f(pixelsPerUnitLocation, pixelsPerUnit);
+        glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+        glEnable(GL_POINT_SPRITE);
+        extEnableVertexAttribArray(ATTRIB_POSITION);
+        extVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex),
+                               base + offsetof(ParticleVertex, x));
+        extEnableVertexAttribArray(ATTRIB_SIZE);
+        extVertexAttribPointer(ATTRIB_SIZE, 1, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex),
+                               base + offsetof(ParticleVertex, size));
+        extEnableVertexAttribArray(ATTRIB_COLOR);
+        extVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ParticleVertex),
+                               base + offsetof(ParticleVertex, color));
+        glDrawArrays(GL_POINTS, 0, (GLsizei)vertices.size());
+        extDisableVertexAttribArray(ATTRIB_COLOR);
+        extDisableVertexAttribArray(ATTRIB_SIZE);
+        extDisableVertexAttribArray(ATTRIB_POSITION);
+        glDisable(GL_POINT_SPRITE);
+        glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+        extUseProgram(0);
+    } else {
+        glPointSize(std::max(1.0f, style.startSize * pixelsPerUnit));
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(2, GL_FLOAT, sizeof(ParticleVertex), base + offsetof(ParticleVertex, x));
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(ParticleVertex), base + offsetof(ParticleVertex, color));
+        glDrawArrays(GL_POINTS, 0, (GLsizei)vertices.size());
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glPointSize(1.0f);
+    }
+    glDisable(GL_BLEND);
+
+    if (hasVertexBuffers) {
+        extBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void ParticleBatch::release() {
+    if (vbo != 0) {
+        extDeleteBuffers(1, &vbo);
+        vbo = 0;
+    }
+    capacity = 0;
+}
@@ -0,0 +1,86 @@
+#ifndef CITY_VIEW_PARTICLES_H
+#define CITY_VIEW_PARTICLES_H
+
+#include "geometry.h"
+#include "simd.h"
+#include <vector>
+
+// Fixed-capacity particle pools for the scene's effects (ship smoke, bow
+// spray, car exhaust, headlight glow). Each pool keeps its particles in
+// structure-of-arrays form, allocated once: spawning past capacity drops
+// the new particles, and dead ones are replaced by the last live one, so
+// the live particles stay packed at the front. A frame is spawn, update (a vectorized
+// integration pass, then compaction), and one batched draw of point
+// sprites per pool.
+
+// How a pool's particles move and look. Sizes are world units.
+struct ParticleStyle {
+    float gravity;       // Units per second per second, negative pulls down
+    float drag;          // Fraction of velocity kept after one second
+    float startSize, endSize;
+    Color startColor, endColor; // Alpha fades with them
+};
+
+// One spawn: position, velocity (units per second) and lifetime, each
+// randomized by its spread
+struct ParticleBurst {
+    float x, y;
+    float velX, velY;
+    float spreadX, spreadY, spreadVel;
+    float life, spreadLife;
+};
+
+struct ParticleVertex {
+    float x, y;
+    float size;
+    Color color;
+};
+
+class ParticlePool {
+public:
+    ParticlePool(int capacity, const ParticleStyle& style);
+
+    // Add up to count particles; returns how many fit
+    int spawn(const ParticleBurst& burst, int count);
+    // Integrate by dt seconds and remove the particles that expired
+    void update(float dt, SimdLevel level);
+    void update(float dt) { update(dt, bestSimdLevel()); }
+    void clear() { live = 0; }
+
+    // One point sprite per live particle, colors and sizes by age
+    void buildVertices(std::vector<ParticleVertex>& out) const;
+
+    int liveCount() const { return live; }
+    int capacity() const { return (int)x.size(); }
+    int dropped() const { return droppedCount; } // Spawns that did not fit, ever
+    const ParticleStyle& getStyle() const { return style; }
+
+private:
+    ParticleStyle style;
+    std::vector<float> x, y, velX, velY, age, life;
+    int live = 0;
+    int droppedCount = 0;
+    unsigned int rngState = 0x9e3779b9u; // xorshift32; the same effects every run
+};
+
+// Upload the vertices and draw them as round, fading point sprites with a
+// single call. pixelsPerUnit converts sizes to pixels at the current zoom.
+// Without shaders the points are square and sized by the style's start
+// size.
+class ParticleBatch {
+public:
+    void draw(const std::vector<ParticleVertex>& vertices, const ParticleStyle& style, float pixelsPerUnit);
+    void release();
+
+private:
+    GLuint vbo = 0;
+    size_t capacity = 0;
+};
+
+// The integration kernel on raw arrays (exposed for the benchmark):
+// vel *= drag, velY += gravity * dt, pos += vel * dt, age += dt.
+// All levels produce bit-identical results.
+void integrateParticles(SimdLevel level, float* x, float* y, float* velX, float* velY,
+                        float* age, int n, float dt, float drag, float gravity);
+
+#endif
@@ -0,0 +1,52 @@
+#include "platform.h"
+#include <string>
+
+bool headlessMode = false;
+
+static int headlessClockMs = 0;
+
+void presentFrame() {
+    if (!headlessMode) {
+        glutSwapBuffers();
+    }
+}
+
+void requestRedisplay() {
+    if (!headlessMode) {
+        glutPostRedisplay();
+    }
+}
+
+int elapsedTimeMs() {
+    if (headlessMode) {
+        return headlessClockMs;
+    }
+    return glutGet(GLUT_ELAPSED_TIME);
+}
+
+void setWindowStatus(const char* text) {
+    if (!headlessMode) {
+        std::string title = "Realistic Scene Animation - ";
+        glutSetWindowTitle((title + text).c_str());
+    }
+}
+
+// GLX_MESA_swap_control, GLX_SGI_swap_control and WGL_EXT_swap_control
+// all take the interval alone
+typedef int (APIENTRY *SwapIntervalProc)(int interval);
+
+bool setSwapInterval(int interval) {
+    if (headlessMode) return false;
+#ifdef _WIN32
+    SwapIntervalProc wglSwapInterval = (SwapIntervalProc)glutGetProcAddress("wglSwapIntervalEXT");
+    return wglSwapInterval && wglSwapInterval(interval); // TRUE on success
+#else
+    SwapIntervalProc glxSwapInterval = (SwapIntervalProc)glutGetProcAddress("glXSwapIntervalMESA");
+    if (!glxSwapInterval) glxSwapInterval = (SwapIntervalProc)glutGetProcAddress("glXSwapIntervalSGI");
+    return glxSwapInterval && glxSwapInterval(interval) == 0; // 0 on success
+#endif
+}
+
+void setHeadlessClock(int ms) {
+    headlessClockMs = ms;
+}
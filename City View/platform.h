@@ -0,0 +1,23 @@
+#ifndef CITY_VIEW_PLATFORM_H
+#define CITY_VIEW_PLATFORM_H
+
+#include "gl_ext.h"
+
+// Window-system calls used by the scene. In a GLUT window they forward to
+// GLUT; in headless runs there is no GLUT window and time comes from a
+// virtual clock advanced once per rendered frame.
+
+extern bool headlessMode;
+
+void presentFrame();      // glutSwapBuffers
+void requestRedisplay();  // glutPostRedisplay
+int elapsedTimeMs();      // glutGet(GLUT_ELAPSED_TIME)
+void setWindowStatus(const char* text); // Appended to the window title
+
+// Swaps per frame: 1 waits for the display's refresh, 0 does not. Returns
+// false when there is no window or the driver cannot change it.
+bool setSwapInterval(int interval);
+
+void setHeadlessClock(int ms);
+
+#endif
@@ -0,0 +1,382 @@
+#include "profiler.h"
+#include "command_trace.h"
+#include "gl_ext.h"
+#include "platform.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::atomic<bool> profilerEnabled(false);
+bool profilerOverlay = false;
+std::atomic<bool> profileMeshScopes(false);
+static std::atomic<bool> profilerTracing(false);
+
+static const size_t MAX_EVENTS_PER_THREAD = 1 << 20; // Recording stops past this
+static const int MAX_PENDING_GPU_SCOPES = 4096;
+static const int GPU_TRACK_ID = 999;                 // Trace "thread" for GPU events
+
+struct ProfileEvent {
+    const char* name;
+    int frame;
+    int64_t startNs;    // Since the profiler epoch
+    int64_t durNs;
+    int vertices;
+    int64_t gpuStartNs; // On the CPU timeline; -1 without a GPU result
+    int64_t gpuDurNs;
+};
+
+struct ThreadLog {
+    std::mutex mutex;
+    int id;
+    std::vector<ProfileEvent> events;
+    size_t aggregated = 0; // Events already folded into the averages
+};
+
+// Per-scope statistics: smoothed for the overlay, totals for the summary
+struct ScopeStats {
+    double cpuMs = 0.0, gpuMs = 0.0, vertices = 0.0, calls = 0.0; // Smoothed per frame
+    double frameCpuMs = 0.0, frameGpuMs = 0.0;                      // This frame so far
+    int frameVertices = 0, frameCalls = 0;
+    double totalCpuMs = 0.0, totalGpuMs = 0.0;
+    long long totalVertices = 0, totalCalls = 0;
+};
+
+// A pair of timestamp queries bracketing one GPU scope
+struct GpuSlot {
+    GLuint queries[2];
+    ThreadLog* log;
+    size_t eventIndex;
+};
+
+static std::mutex logsMutex;
+static std::vector<ThreadLog*> logs;
+static thread_local ThreadLog* localLog = nullptr;
+static std::atomic<int> currentFrame(0);
+static std::atomic<long long> droppedEvents(0);
+static int glThreadLog = -1; // Log id of the thread running display()
+
+static std::vector<GpuSlot> gpuSlots;
+static std::vector<int> freeGpuSlots;
+static std::vector<int> pendingGpuSlots; // In issue order
+static bool gpuEpochSet = false;
+static int64_t gpuToCpuNs = 0;
+
+static std::map<std::string, ScopeStats> scopeStats;
+static int framesProfiled = 0;
+
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+static ThreadLog* threadLog() {
+    if (!localLog) {
+        localLog = new ThreadLog(); // Lives until exit, so dumps can still read it
+        std::lock_guard<std::mutex> lock(logsMutex);
+        localLog->id = (int)logs.size();
+        logs.push_back(localLog);
+    }
+    return localLog;
+}
+
+void profilerSetEnabled(bool on) {
+    profilerEnabled.store(on, std::memory_order_relaxed);
+    profileMeshScopes.store(on || profilerTracing.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void profilerSetTracing(bool on) {
+    profilerTracing.store(on, std::memory_order_relaxed);
+    profileMeshScopes.store(on || profilerEnabled.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+// ---------- SCOPES ----------
+
+void ProfileScope::begin(const char* name, const MeshBuilder* mb, bool gpu) {
+    active = true;
+    timed = true;
+    scopeName = name;
+    mesh = mb;
+    meshStart = mb ? (int)mb->getVertices().size() : 0;
+
+    if (gpu && hasTimerQueries && gpuEpochSet && (int)pendingGpuSlots.size() < MAX_PENDING_GPU_SCOPES) {
+        if (freeGpuSlots.empty()) {
+            GpuSlot slot;
+            extGenQueries(2, slot.queries);
+            gpuSlots.push_back(slot);
+            freeGpuSlots.push_back((int)gpuSlots.size() - 1);
+        }
+        gpuSlot = freeGpuSlots.back();
+        freeGpuSlots.pop_back();
+        extQueryCounter(gpuSlots[gpuSlot].queries[0], GL_TIMESTAMP);
+    }
+    startNs = nowNs();
+}
+
+void ProfileScope::beginMesh(const char* name, const MeshBuilder& mb) {
+    trace = mb.getTrace();
+    if (trace) {
+        active = true;
+        trace->beginScope(name);
+    }
+    if (profilerEnabled.load(std::memory_order_relaxed)) begin(name, &mb, false);
+}
+
+void ProfileScope::end() {
+    if (trace) trace->record(TRACE_SCOPE_END);
+    if (!timed) return;
+    int64_t endNs = nowNs();
+    if (gpuSlot >= 0) {
+        extQueryCounter(gpuSlots[gpuSlot].queries[1], GL_TIMESTAMP);
+    }
+    if (mesh) {
+        vertices += (int)mesh->getVertices().size() - meshStart;
+    }
+
+    ThreadLog* log = threadLog();
+    std::lock_guard<std::mutex> lock(log->mutex);
+    if (log->events.size() >= MAX_EVENTS_PER_THREAD) {
+        ++droppedEvents;
+        if (gpuSlot >= 0) freeGpuSlots.push_back(gpuSlot);
+        return;
+    }
+    ProfileEvent e = {scopeName, currentFrame.load(), startNs, endNs - startNs, vertices, -1, 0};
+    log->events.push_back(e);
+    if (gpuSlot >= 0) {
+        gpuSlots[gpuSlot].log = log;
+        gpuSlots[gpuSlot].eventIndex = log->events.size() - 1;
+        pendingGpuSlots.push_back(gpuSlot);
+    }
+}
+
+// ---------- FRAMES ----------
+
+void profilerBeginFrame() {
+    if (!profilerEnabled.load(std::memory_order_relaxed)) return;
+    glThreadLog = threadLog()->id;
+
+    // Map GPU timestamps onto the CPU clock once
+    if (hasTimerQueries && !gpuEpochSet) {
+        GLint64 gpuNow = 0;
+        extGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuToCpuNs = nowNs() - (int64_t)gpuNow;
+        gpuEpochSet = true;
+    }
+}
+
+// Fold finished GPU queries into their events, oldest first, without waiting
+static void resolveGpuScopes() {
+    size_t done = 0;
+    for (; done < pendingGpuSlots.size(); ++done) {
+        GpuSlot& slot = gpuSlots[pendingGpuSlots[done]];
+        GLint available = 0;
+        extGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        GLuint64 t0 = 0, t1 = 0;
+        extGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &t0);
+        extGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &t1);
+        {
+            std::lock_guard<std::mutex> lock(slot.log->mutex);
+            ProfileEvent& e = slot.log->events[slot.eventIndex];
+            e.gpuStartNs = (int64_t)t0 + gpuToCpuNs;
+            e.gpuDurNs = (int64_t)(t1 - t0);
+            ScopeStats& stats = scopeStats[e.name];
+            stats.frameGpuMs += e.gpuDurNs / 1e6;
+            stats.totalGpuMs += e.gpuDurNs / 1e6;
+        }
+        freeGpuSlots.push_back(pendingGpuSlots[done]);
+    }
+    pendingGpuSlots.erase(pendingGpuSlots.begin(), pendingGpuSlots.begin() + done);
+}
+
+void profilerEndFrame() {
+    if (!profilerEnabled.load(std::memory_order_relaxed)) return;
+
+    if (hasTimerQueries) resolveGpuScopes();
+
+    // Fold this frame's CPU events (from every thread) into the statistics
+    {
+        std::lock_guard<std::mutex> logsLock(logsMutex);
+        for (size_t t = 0; t < logs.size(); ++t) {
+            ThreadLog* log = logs[t];
+            std::lock_guard<std::mutex> lock(log->mutex);
+            for (; log->aggregated < log->events.size(); ++log->aggregated) {
+                const ProfileEvent& e = log->events[log->aggregated];
+                ScopeStats& stats = scopeStats[e.name];
+                stats.frameCpuMs += e.durNs / 1e6;
+                stats.frameVertices += e.vertices;
+                ++stats.frameCalls;
+                stats.totalCpuMs += e.durNs / 1e6;
+                stats.totalVertices += e.vertices;
+                ++stats.totalCalls;
+            }
+        }
+    }
+
+    const double SMOOTHING = 0.05;
+    for (std::map<std::string, ScopeStats>::iterator it = scopeStats.begin(); it != scopeStats.end(); ++it) {
+        ScopeStats& s = it->second;
+        s.cpuMs += (s.frameCpuMs - s.cpuMs) * SMOOTHING;
+        s.gpuMs += (s.frameGpuMs - s.gpuMs) * SMOOTHING;
+        s.vertices += (s.frameVertices - s.vertices) * SMOOTHING;
+        s.calls += (s.frameCalls - s.calls) * SMOOTHING;
+        s.frameCpuMs = s.frameGpuMs = 0.0;
+        s.frameVertices = s.frameCalls = 0;
+    }
+    ++framesProfiled;
+    ++currentFrame;
+}
+
+// ---------- OVERLAY ----------
+
+typedef std::pair<std::string, const ScopeStats*> NamedStats;
+
+static bool slowerCpu(const NamedStats& a, const NamedStats& b) {
+    return a.second->cpuMs > b.second->cpuMs;
+}
+
+void profilerDrawOverlay(int width, int height) {
+    if (!profilerOverlay || headlessMode) return; // Bitmap fonts need a GLUT window
+
+    std::vector<NamedStats> rows;
+    for (std::map<std::string, ScopeStats>::const_iterator it = scopeStats.begin(); it != scopeStats.end(); ++it) {
+        rows.push_back(NamedStats(it->first, &it->second));
+    }
+    std::sort(rows.begin(), rows.end(), slowerCpu);
+    const size_t MAX_ROWS = 24;
+    if (rows.size() > MAX_ROWS) rows.resize(MAX_ROWS);
+
+    const int LINE_HEIGHT = 14;
+    int boxHeight = (int)(rows.size() + 2) * LINE_HEIGHT + 6;
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, width, 0, height);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4f(0.0f, 0.0f, 0.0f, 0.7f);
+    glRectf(0.0f, (float)(height - boxHeight), 470.0f, (float)height);
+    glDisable(GL_BLEND);
+
+    char line[160];
+    int y = height - LINE_HEIGHT;
+    glColor3f(1.0f, 1.0f, 0.4f);
+    snprintf(line, sizeof(line), "%-28s %8s %8s %9s %6s", "scope (per frame)", "cpu ms", "gpu ms", "verts", "calls");
+    glRasterPos2i(6, y);
+    glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+    y -= LINE_HEIGHT;
+
+    glColor3f(1.0f, 1.0f, 1.0f);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const ScopeStats& s = *rows[i].second;
+        snprintf(line, sizeof(line), "%-28.28s %8.3f %8.3f %9.0f %6.1f",
+                 rows[i].first.c_str(), s.cpuMs, s.gpuMs, s.vertices, s.calls);
+        glRasterPos2i(6, y);
+        glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+        y -= LINE_HEIGHT;
+    }
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// ---------- OUTPUT ----------
+
+void profilerPrintSummary() {
+    if (framesProfiled == 0) return;
+    std::vector<NamedStats> rows;
+    for (std::map<std::string, ScopeStats>::const_iterator it = scopeStats.begin(); it != scopeStats.end(); ++it) {
+        rows.push_back(NamedStats(it->first, &it->second));
+    }
+    std::sort(rows.begin(), rows.end(), [](const NamedStats& a, const NamedStats& b) {
+        return a.second->totalCpuMs > b.second->totalCpuMs;
+    });
+
+    printf("\nProfile over %d frames (per frame)%s\n", framesProfiled,
+           hasTimerQueries ? "" : ", no GPU timer queries on this context");
+    printf("%-28s %10s %10s %11s %8s\n", "scope", "cpu ms", "gpu ms", "vertices", "calls");
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const ScopeStats& s = *rows[i].second;
+        printf("%-28.28s %10.4f %10.4f %11.0f %8.1f\n", rows[i].first.c_str(),
+               s.totalCpuMs / framesProfiled, s.totalGpuMs / framesProfiled,
+               (double)s.totalVertices / framesProfiled, (double)s.totalCalls / framesProfiled);
+    }
+    if (droppedEvents.load() > 0) {
+        printf("(%lld events dropped after the per-thread limit)\n", droppedEvents.load());
+    }
+}
+
+// JSON string escaping for scope names
+static void writeJsonString(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+bool profilerDump(const char* prefix) {
+    std::string jsonPath = std::string(prefix) + ".json";
+    std::string csvPath = std::string(prefix) + ".csv";
+    FILE* json = fopen(jsonPath.c_str(), "w");
+    FILE* csv = fopen(csvPath.c_str(), "w");
+    if (!json || !csv) {
+        fprintf(stderr, "Profiler: cannot write %s / %s\n", jsonPath.c_str(), csvPath.c_str());
+        if (json) fclose(json);
+        if (csv) fclose(csv);
+        return false;
+    }
+
+    fprintf(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(json, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", GPU_TRACK_ID);
+    fprintf(csv, "frame,thread,name,start_us,cpu_us,gpu_us,vertices\n");
+
+    size_t written = 0;
+    std::lock_guard<std::mutex> logsLock(logsMutex);
+    for (size_t t = 0; t < logs.size(); ++t) {
+        ThreadLog* log = logs[t];
+        std::lock_guard<std::mutex> lock(log->mutex);
+        bool isGlThread = log->id == glThreadLog;
+        fprintf(json, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                log->id, isGlThread ? "GL thread" : "thread", log->id);
+
+        for (size_t i = 0; i < log->events.size(); ++i) {
+            const ProfileEvent& e = log->events[i];
+            fprintf(json, ",\n{\"name\":");
+            writeJsonString(json, e.name);
+            fprintf(json, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                          "\"args\":{\"frame\":%d,\"vertices\":%d}}",
+                    log->id, e.startNs / 1000.0, e.durNs / 1000.0, e.frame, e.vertices);
+            if (e.gpuStartNs >= 0) {
+                fprintf(json, ",\n{\"name\":");
+                writeJsonString(json, e.name);
+                fprintf(json, ",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                              "\"args\":{\"frame\":%d}}",
+                        GPU_TRACK_ID, e.gpuStartNs / 1000.0, e.gpuDurNs / 1000.0, e.frame);
+            }
+            fprintf(csv, "%d,%d,%s,%.3f,%.3f,%.3f,%d\n", e.frame, log->id, e.name, e.startNs / 1000.0,
+                    e.durNs / 1000.0, e.gpuStartNs >= 0 ? e.gpuDurNs / 1000.0 : 0.0, e.vertices);
+            ++written;
+        }
+    }
+    fprintf(json, "\n]}\n");
+    bool ok = !ferror(json) && !ferror(csv);
+    fclose(json);
+    fclose(csv);
+    printf("Profiler: wrote %zu events to %s and %s\n", written, jsonPath.c_str(), csvPath.c_str());
+    return ok;
+}
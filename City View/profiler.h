@@ -0,0 +1,96 @@
+#ifndef CITY_VIEW_PROFILER_H
+#define CITY_VIEW_PROFILER_H
+
+#include "geometry.h"
+#include <atomic>
+#include <cstdint>
+
+// Scoped frame profiler. Each scope records its CPU time and thread; GPU
+// scopes also bracket their GL commands with timestamp queries, read back
+// a few frames later so the CPU never waits for the GPU. Results feed an
+// on-screen overlay and can be written as a Chrome trace (chrome://tracing,
+// Perfetto) plus a CSV.
+//
+// Scopes cost one branch on a global flag while the profiler is off and
+// no command trace is being recorded.
+// Build with -DCITY_VIEW_NO_PROFILER to compile them out entirely.
+
+// Scopes record only while this is set. Read by scopes on every thread,
+// so it is atomic; relaxed loads are enough for an on/off switch.
+extern std::atomic<bool> profilerEnabled;
+extern bool profilerOverlay; // Draw the overlay at the end of each frame
+// profilerEnabled or a command trace recording: the one flag mesh scopes
+// check, since they also name the commands they record
+extern std::atomic<bool> profileMeshScopes;
+
+void profilerSetEnabled(bool on);
+// Set around recordCommandTrace(), while mesh builders record commands
+void profilerSetTracing(bool on);
+
+// GL thread, once per frame around display()
+void profilerBeginFrame();
+void profilerEndFrame();
+
+// Per-scope averages in the top-left corner of a width x height window
+void profilerDrawOverlay(int width, int height);
+
+// Write prefix.json (Chrome trace) and prefix.csv. Returns false if a
+// file could not be written.
+bool profilerDump(const char* prefix);
+
+// Slowest scopes by CPU time per frame, to stdout
+void profilerPrintSummary();
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) {
+        if (profilerEnabled.load(std::memory_order_relaxed)) begin(name, nullptr, false);
+    }
+    // Also count the vertices appended to mb inside the scope, and name
+    // the commands mb records (see command_trace.h)
+    ProfileScope(const char* name, const MeshBuilder& mb) {
+        if (profileMeshScopes.load(std::memory_order_relaxed)) beginMesh(name, mb);
+    }
+    // GPU scope: GL thread only
+    ProfileScope(const char* name, bool gpu) {
+        if (profilerEnabled.load(std::memory_order_relaxed)) begin(name, nullptr, gpu);
+    }
+    ~ProfileScope() { if (active) end(); }
+
+    void addVertices(int n) { vertices += n; }
+
+private:
+    ProfileScope(const ProfileScope&);
+    ProfileScope& operator=(const ProfileScope&);
+
+    void begin(const char* name, const MeshBuilder* mb, bool gpu);
+    void beginMesh(const char* name, const MeshBuilder& mb);
+    void end();
+
+    bool active = false; // Timed, traced or both
+    bool timed = false;
+    const char* scopeName = nullptr;
+    const MeshBuilder* mesh = nullptr;
+    int meshStart = 0;
+    int vertices = 0;
+    int64_t startNs = 0;
+    int gpuSlot = -1;
+    TraceStream* trace = nullptr;
+};
+
+#ifndef CITY_VIEW_NO_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_MESH_SCOPE(name, mb) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, mb)
+// Declares profileGpuScope so the caller can add vertex counts
+#define PROFILE_GPU_SCOPE(name) ProfileScope profileGpuScope(name, true)
+#define PROFILE_VERTICES(n) profileGpuScope.addVertices(n)
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_MESH_SCOPE(name, mb) do {} while (0)
+#define PROFILE_GPU_SCOPE(name) do {} while (0)
+#define PROFILE_VERTICES(n) do {} while (0)
+#endif
+
+#endif
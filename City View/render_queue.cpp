@@ -0,0 +1,256 @@
+#include "render_queue.h"
+#include "gl_ext.h"
+#include "instancing.h"
+#include "profiler.h"
+#include <algorithm>
+
+bool renderQueueEnabled = true;
+
+void RenderStateCounters::add(const RenderStateCounters& o) {
+    programs += o.programs;
+    uniforms += o.uniforms;
+    buffers += o.buffers;
+    arrays += o.arrays;
+    pointers += o.pointers;
+    matrices += o.matrices;
+    draws += o.draws;
+}
+
+// ---------- RenderState ----------
+
+void RenderState::useProgram(GLuint p) {
+    if (p == program) return;
+    extUseProgram(p);
+    program = p;
+    if (counters) ++counters->programs;
+}
+
+bool RenderState::firstUse(GLuint p) {
+    if (std::find(programsUsed.begin(), programsUsed.end(), p) != programsUsed.end()) return false;
+    programsUsed.push_back(p);
+    return true;
+}
+
+void RenderState::bindArrayBuffer(GLuint buffer) {
+    if (buffer == arrayBuffer) return;
+    extBindBuffer(GL_ARRAY_BUFFER, buffer);
+    arrayBuffer = buffer;
+    if (counters) ++counters->buffers;
+}
+
+void RenderState::enableAttribs(unsigned mask) {
+    unsigned changed = mask ^ attribs;
+    for (int i = 0; changed != 0; ++i, changed >>= 1) {
+        if (!(changed & 1)) continue;
+        if (mask & (1u << i)) {
+            extEnableVertexAttribArray(i);
+        } else {
+            extDisableVertexAttribArray(i);
+        }
+        if (counters) ++counters->arrays;
+    }
+    attribs = mask;
+}
+
+bool RenderState::samePointer(const Pointer& a, const Pointer& b) {
+    return a.buffer == b.buffer && a.size == b.size && a.type == b.type && a.normalized == b.normalized &&
+           a.stride == b.stride && a.pointer == b.pointer;
+}
+
+void RenderState::attribPointer(int index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+                                const void* pointer, GLuint divisor) {
+    Pointer p = {arrayBuffer, size, type, normalized, stride, pointer};
+    unsigned bit = 1u << index;
+    if (!(pointersSet & bit) || !samePointer(p, attribPointers[index])) {
+        extVertexAttribPointer(index, size, type, normalized, stride, pointer);
+        attribPointers[index] = p;
+        pointersSet |= bit;
+        if (counters) ++counters->pointers;
+    }
+    if (((divisors & bit) != 0) != (divisor != 0)) {
+        extVertexAttribDivisor(index, divisor);
+        divisors ^= bit;
+        if (counters) ++counters->pointers;
+    }
+}
+
+void RenderState::enableClientArrays(bool vertex, bool color) {
+    if (vertex != vertexArray) {
+        if (vertex) glEnableClientState(GL_VERTEX_ARRAY); else glDisableClientState(GL_VERTEX_ARRAY);
+        vertexArray = vertex;
+        if (counters) ++counters->arrays;
+    }
+    if (color != colorArray) {
+        if (color) glEnableClientState(GL_COLOR_ARRAY); else glDisableClientState(GL_COLOR_ARRAY);
+        colorArray = color;
+        if (counters) ++counters->arrays;
+    }
+}
+
+void RenderState::vertexPointer(GLsizei stride, const void* pointer) {
+    Pointer p = {arrayBuffer, 2, GL_FLOAT, GL_FALSE, stride, pointer};
+    if (vertexPointerSet && samePointer(p, vertexSource)) return;
+    glVertexPointer(2, GL_FLOAT, stride, pointer);
+    vertexSource = p;
+    vertexPointerSet = true;
+    if (counters) ++counters->pointers;
+}
+
+void RenderState::colorPointer(GLsizei stride, const void* pointer) {
+    Pointer p = {arrayBuffer, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, pointer};
+    if (colorPointerSet && samePointer(p, colorSource)) return;
+    glColorPointer(4, GL_UNSIGNED_BYTE, stride, pointer);
+    colorSource = p;
+    colorPointerSet = true;
+    if (counters) ++counters->pointers;
+}
+
+// Pop back to the matrix saved by the first translation rather than
+// translating by the difference, so every draw sees the exact matrix
+void RenderState::translate(float x, float y) {
+    if (translated ? (x == translateX && y == translateY) : (x == 0.0f && y == 0.0f)) return;
+    if (translated) {
+        glPopMatrix();
+        if (counters) ++counters->matrices;
+    }
+    translated = x != 0.0f || y != 0.0f;
+    translateX = x;
+    translateY = y;
+    if (translated) {
+        glPushMatrix();
+        glTranslatef(x, y, 0.0f);
+        if (counters) counters->matrices += 2;
+    }
+}
+
+void RenderState::drawArrays(GLint first, GLsizei count) {
+    glDrawArrays(GL_TRIANGLES, first, count);
+    if (counters) ++counters->draws;
+}
+
+void RenderState::drawArraysInstanced(GLint first, GLsizei count, GLsizei instances) {
+    extDrawArraysInstanced(GL_TRIANGLES, first, count, instances);
+    if (counters) ++counters->draws;
+}
+
+// Code outside may change any pointer, so none of them is trusted after this
+void RenderState::reset() {
+    translate(0.0f, 0.0f);
+    for (int i = 0; divisors != 0; ++i) {
+        if (!(divisors & (1u << i))) continue;
+        extVertexAttribDivisor(i, 0);
+        divisors &= ~(1u << i);
+        if (counters) ++counters->pointers;
+    }
+    enableAttribs(0);
+    enableClientArrays(false, false);
+    bindArrayBuffer(0);
+    useProgram(0);
+    pointersSet = 0;
+    vertexPointerSet = colorPointerSet = false;
+}
+
+// ---------- RenderQueue ----------
+
+void RenderQueue::nameLayer(int layer, const char* name) {
+    layerNames[layer] = name;
+}
+
+RenderQueue::Item& RenderQueue::push(int layer, RenderPipeline pipeline, GLuint buffer) {
+    Item item;
+    item.key = ((uint64_t)layer << 56) | ((uint64_t)pipeline << 48) | (uint64_t)buffer;
+    item.pipeline = pipeline;
+    item.layer = layer;
+    item.buffer = buffer;
+    item.clientData = nullptr;
+    item.first = item.count = 0;
+    item.x = item.y = 0.0f;
+    item.prop = nullptr;
+    item.instances = nullptr;
+    item.vertices = 0;
+    items.push_back(item);
+    return items.back();
+}
+
+void RenderQueue::drawMesh(int layer, const StaticMesh& mesh, float x, float y) {
+    if (mesh.vertexCount() == 0) return;
+    Item& item = push(layer, PIPE_MESH, mesh.getBuffer());
+    item.clientData = mesh.getClientData();
+    item.count = item.vertices = mesh.vertexCount();
+    item.x = x;
+    item.y = y;
+}
+
+void RenderQueue::drawMesh(int layer, const DynamicMesh& mesh, int first, int count) {
+    if (count <= 0) return;
+    Item& item = push(layer, PIPE_MESH, mesh.getBuffer());
+    item.clientData = mesh.getClientData();
+    item.first = first;
+    item.count = item.vertices = count;
+}
+
+void RenderQueue::drawProp(int layer, const InstancedProp& prop, const InstanceBuffer& instances) {
+    if (instances.size() == 0 || prop.meshVertexCount() == 0) return;
+    Item& item = push(layer, PIPE_PROP, prop.getMesh().current().getBuffer());
+    item.prop = &prop;
+    item.instances = &instances;
+    item.vertices = instances.size() * prop.meshVertexCount();
+}
+
+void RenderQueue::drawCustom(int layer, const std::function<int()>& draw) {
+    Item& item = push(layer, PIPE_CUSTOM, 0);
+    item.custom = draw;
+}
+
+// b continues a's range of the same vertices at the same place
+bool RenderQueue::mergeable(const Item& a, const Item& b) {
+    return b.pipeline == PIPE_MESH && a.layer == b.layer && a.buffer == b.buffer &&
+           a.clientData == b.clientData && a.x == b.x && a.y == b.y && b.first == a.first + a.count;
+}
+
+void RenderQueue::execute(RenderQueueStats& stats) {
+    stats.items += (int)items.size();
+    order.resize(items.size());
+    for (size_t i = 0; i < items.size(); ++i) order[i] = &items[i];
+    if (renderQueueEnabled) {
+        // Stable, so items with the same key keep the order they were queued in
+        std::stable_sort(order.begin(), order.end(), [](const Item* a, const Item* b) { return a->key < b->key; });
+    }
+
+    RenderState shared(&stats.state);
+    for (size_t i = 0; i < order.size();) {
+        int layer = order[i]->layer;
+        ProfileScope scope(layerNames[layer] ? layerNames[layer] : "render queue", true);
+        for (; i < order.size() && order[i]->layer == layer; ++i) {
+            const Item& item = *order[i];
+            // Unsorted, every draw starts from scratch, uniforms included
+            RenderState own(&stats.state);
+            RenderState& state = renderQueueEnabled ? shared : own;
+            scope.addVertices(item.vertices);
+            ++stats.batches;
+            switch (item.pipeline) {
+                case PIPE_MESH: {
+                    Item merged = item;
+                    while (renderQueueEnabled && i + 1 < order.size() && mergeable(merged, *order[i + 1])) {
+                        merged.count += order[++i]->count;
+                        scope.addVertices(order[i]->vertices);
+                    }
+                    state.translate(item.x, item.y);
+                    drawVertexRange(state, item.buffer, item.clientData, item.first, merged.count);
+                    break;
+                }
+                case PIPE_PROP:
+                    state.translate(0.0f, 0.0f);
+                    item.prop->draw(state, *item.instances);
+                    break;
+                case PIPE_CUSTOM:
+                    state.reset();
+                    scope.addVertices(item.custom());
+                    break;
+            }
+            if (!renderQueueEnabled) state.reset();
+        }
+    }
+    shared.reset();
+    items.clear();
+}
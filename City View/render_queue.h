@@ -0,0 +1,156 @@
+#ifndef CITY_VIEW_RENDER_QUEUE_H
+#define CITY_VIEW_RENDER_QUEUE_H
+
+#include "geometry.h"
+#include <GL/glut.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class InstancedProp;
+class InstanceBuffer;
+
+// Draw submission for a frame. Draw calls are queued with a layer and
+// run sorted by layer, then pipeline, then the vertex buffer they read,
+// through a RenderState that skips every program, buffer, vertex array
+// and matrix change that would not change anything. Consecutive ranges
+// of the same buffer at the same place merge into one draw call.
+//
+// Layers are the painter's order. Items in one layer may be reordered,
+// so a layer may only hold items that do not overlap on screen, or that
+// share pipeline and buffer (those keep the order they were queued in).
+// With sorting off (--no-render-queue) items run in the order they were
+// queued, each from and back to the default state, exactly like calling
+// their draw functions one after the other.
+
+extern bool renderQueueEnabled; // --no-render-queue turns it off (for comparison)
+
+// GL state changes issued, by kind
+struct RenderStateCounters {
+    long long programs; // glUseProgram
+    long long uniforms; // Uniform uploads
+    long long buffers;  // glBindBuffer
+    long long arrays;   // Vertex arrays enabled or disabled, generic or fixed-function
+    long long pointers; // Vertex array pointers and divisors
+    long long matrices; // glPushMatrix, glPopMatrix, glTranslatef
+    long long draws;    // Draw calls
+
+    long long stateChanges() const { return programs + uniforms + buffers + arrays + pointers + matrices; }
+    void add(const RenderStateCounters& o);
+};
+
+// Shadow of the GL state the mesh and prop pipelines set. Each setter
+// compares with what is already set and issues (and counts) only real
+// changes. reset() returns to the defaults the rest of the program
+// assumes: no program, no buffer, no vertex arrays, no translation.
+class RenderState {
+public:
+    static const int MAX_ATTRIBS = 8;
+
+    explicit RenderState(RenderStateCounters* counters = nullptr) : counters(counters) {}
+
+    void useProgram(GLuint program);
+    // True the first time program is bound through this state: its
+    // uniforms are uploaded then, as they do not change within a frame
+    bool firstUse(GLuint program);
+    void countUniforms(int n) { if (counters) counters->uniforms += n; }
+    void bindArrayBuffer(GLuint buffer);
+    // Exactly the generic attributes in mask (bit i = attribute i) enabled
+    void enableAttribs(unsigned mask);
+    // Generic attribute source in the bound buffer, and its divisor
+    void attribPointer(int index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+                       const void* pointer, GLuint divisor);
+    // Fixed-function GL_VERTEX_ARRAY and GL_COLOR_ARRAY
+    void enableClientArrays(bool vertex, bool color);
+    void vertexPointer(GLsizei stride, const void* pointer);
+    void colorPointer(GLsizei stride, const void* pointer);
+    // The model-view matrix as pushed at reset() plus a translation
+    void translate(float x, float y);
+
+    void drawArrays(GLint first, GLsizei count);
+    void drawArraysInstanced(GLint first, GLsizei count, GLsizei instances);
+    void reset();
+
+private:
+    RenderState(const RenderState&);
+    RenderState& operator=(const RenderState&);
+
+    struct Pointer {
+        GLuint buffer;
+        GLint size;
+        GLenum type;
+        GLboolean normalized;
+        GLsizei stride;
+        const void* pointer;
+    };
+    static bool samePointer(const Pointer& a, const Pointer& b);
+
+    RenderStateCounters* counters;
+    GLuint program = 0;
+    GLuint arrayBuffer = 0;
+    unsigned attribs = 0;       // Enabled generic attributes
+    unsigned divisors = 0;      // Generic attributes with divisor 1
+    unsigned pointersSet = 0;   // Generic attributes whose pointer is in attribPointers
+    Pointer attribPointers[MAX_ATTRIBS];
+    bool vertexArray = false, colorArray = false;
+    bool vertexPointerSet = false, colorPointerSet = false;
+    Pointer vertexSource, colorSource;
+    bool translated = false;
+    float translateX = 0.0f, translateY = 0.0f;
+    std::vector<GLuint> programsUsed;
+};
+
+enum RenderPipeline : uint8_t {
+    PIPE_MESH,   // Triangles of a vertex buffer, palette shader or fixed function
+    PIPE_PROP,   // An instanced prop
+    PIPE_CUSTOM  // Anything else, run from and back to the default state
+};
+
+struct RenderQueueStats {
+    int items;   // Draws queued
+    int batches; // Draw calls issued after merging (custom items count one each)
+    RenderStateCounters state; // Mesh and prop pipelines only
+};
+
+class RenderQueue {
+public:
+    static const int MAX_LAYERS = 256;
+
+    void clear() { items.clear(); }
+    // Name of the GPU profiler scope around the layer's draws
+    void nameLayer(int layer, const char* name);
+
+    // The whole mesh translated by (x, y)
+    void drawMesh(int layer, const StaticMesh& mesh, float x = 0.0f, float y = 0.0f);
+    void drawMesh(int layer, const DynamicMesh& mesh, int first, int count);
+    void drawProp(int layer, const InstancedProp& prop, const InstanceBuffer& instances);
+    // Anything else; draw returns the vertices it drew, for the profiler
+    void drawCustom(int layer, const std::function<int()>& draw);
+
+    // Run the queued draws and clear the queue. Counts go into stats.
+    void execute(RenderQueueStats& stats);
+
+private:
+    struct Item {
+        uint64_t key; // Layer, pipeline, buffer
+        RenderPipeline pipeline;
+        int layer;
+        GLuint buffer;            // PIPE_MESH; 0 with clientData
+        const Vertex* clientData;
+        int first, count;
+        float x, y;
+        const InstancedProp* prop; // PIPE_PROP
+        const InstanceBuffer* instances;
+        std::function<int()> custom;
+        int vertices;
+    };
+
+    Item& push(int layer, RenderPipeline pipeline, GLuint buffer);
+    static bool mergeable(const Item& a, const Item& b);
+
+    std::vector<Item> items;
+    std::vector<const Item*> order;
+    const char* layerNames[MAX_LAYERS] = {};
+};
+
+#endif
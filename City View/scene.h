@@ -0,0 +1,113 @@
+#ifndef CITY_VIEW_SCENE_H
+#define CITY_VIEW_SCENE_H
+
+#include "geometry.h"
+#include "scene_file.h"
+#include "camera.h"
+#include "frame_capture.h"
+#include "input_recording.h"
+#include "render_queue.h"
+
+// Scene state and prop builders defined in main.cpp, shared with the
+// benchmarks and other tools that render parts of the city.
+
+extern bool isNightMode;
+extern Camera camera;
+
+void init();
+void display();
+// Run the simulation forward by real elapsed time. Returns whether anything
+// on screen moved (false only while paused, once the sky has settled).
+bool advanceScene(double seconds);
+
+// --record-input / --replay-input. While a recording is made or played,
+// the sky and the camera pan advance by simulated ticks instead of real
+// time, like the simulation, so they too follow the ticks exactly.
+extern InputRecording inputRecording;
+
+// Replace the static entities (the layout must outlive its use) and
+// rebuild the spatial index on the next frame
+void setSceneLayout(const SceneLayout& layout);
+
+// Static prop layers, in the painter's order they are drawn
+enum StaticLayer {
+    LAYER_BUILDINGS,
+    LAYER_STREET_LIGHTS,
+    LAYER_MOSQUES,
+    LAYER_PLAYGROUNDS,
+    LAYER_BENCHES,
+    LAYER_TREES,
+    NUM_STATIC_LAYERS
+};
+
+// View culling of static entities; off submits everything (for comparison)
+extern bool cullingEnabled;
+
+// Moving layers are generated on a pool of this many threads (1 = inline
+// on the GL thread, <= 0 = every hardware thread); see --frame-threads
+void setFrameThreads(int threads);
+
+// Replace the moving objects with perKind cars, ships, sailboats and birds
+void populateScene(int perKind);
+
+struct FrameBuildStats {
+    double buildMs;  // Parallel geometry generation for the moving layers
+    double submitMs; // Upload and draw on the GL thread
+    int vertices;    // Vertices in the moving layers' streams
+};
+extern FrameBuildStats lastFrameBuild;
+
+// Smoke, spray, exhaust and headlight glow in the last frame
+struct ParticleFrameStats {
+    int live;        // Particles drawn
+    int spawned;
+    double spawnMs;  // Emitting from every ship and car
+    double updateMs; // Integration and compaction
+    double drawMs;   // Vertex generation, upload and draw calls
+};
+extern ParticleFrameStats lastParticleFrame;
+
+struct CullStats {
+    int drawn;  // Static entities submitted in the last frame
+    int culled; // Static entities skipped because they were outside the view
+};
+extern CullStats lastCullStats;
+
+// Sky, ground and static structures are rendered into an offscreen cache
+// and copied into each frame until they change; off redraws them every
+// frame (for comparison)
+extern bool staticCacheEnabled;
+
+struct StaticCacheStats {
+    bool hit;           // The last frame reused the cached static layers
+    int staticVertices; // Static-layer vertices submitted in the last frame (0 on a hit)
+    int totalVertices;  // All vertices submitted in the last frame
+};
+extern StaticCacheStats lastStaticCache;
+
+// Curved geometry and distant objects in the last frame (see lod.h)
+struct LodFrameStats {
+    int vertices;     // Submitted for objects that have levels of detail
+    int fullVertices; // The same objects at full detail
+};
+extern LodFrameStats lastLodFrame;
+
+// Draws through the frame's render queue in the last frame: the static
+// layers when they were redrawn, and the moving layers
+extern RenderQueueStats lastRenderQueue;
+
+// --capture: display() reads back every frame for the writer thread
+extern FrameCapture frameCapture;
+
+// Draw one frame with every draw function's MeshBuilder commands
+// recorded into trace: the static meshes (rebuilt for it) and the moving
+// layers. GL thread only.
+void recordCommandTrace(CommandTrace& trace);
+
+void drawBuilding(MeshBuilder& mb, float x, float y, float width, float height);
+void drawTree(MeshBuilder& mb, float x, float y);
+void drawStreetLight(MeshBuilder& mb, float x, float y);
+void drawRealisticCar(MeshBuilder& mb);
+void drawRoad(MeshBuilder& mb); // One 800-unit strip of road starting at the origin
+
+#endif
@@ -0,0 +1,260 @@
+#include "scene_file.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const size_t TABLE_ALIGNMENT = 16;
+
+// ---------- LOADING ----------
+
+bool MappedSceneFile::open(const char* path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Scene: cannot open " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        std::cerr << "Scene: cannot open " << path << std::endl;
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        std::cerr << "Scene: cannot map " << path << std::endl;
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Scene: cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        std::cerr << "Scene: " << path << " is empty" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file alive
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Scene: cannot map " << path << std::endl;
+        return false;
+    }
+    data = (const unsigned char*)mapped;
+    size = (size_t)st.st_size;
+#endif
+
+    if (!data || !validate(path)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedSceneFile::validate(const char* path) {
+    if (size < sizeof(SceneFileHeader)) {
+        std::cerr << "Scene: " << path << " is truncated" << std::endl;
+        return false;
+    }
+    const SceneFileHeader* header = (const SceneFileHeader*)data;
+    if (memcmp(header->magic, SCENE_FILE_MAGIC, 4) != 0) {
+        std::cerr << "Scene: " << path << " is not a .cvscene file" << std::endl;
+        return false;
+    }
+    if (header->version != SCENE_FILE_VERSION) {
+        std::cerr << "Scene: " << path << " has version " << header->version
+                  << ", expected " << SCENE_FILE_VERSION << std::endl;
+        return false;
+    }
+    size_t directoryEnd = sizeof(SceneFileHeader) + (size_t)header->tableCount * sizeof(SceneTableEntry);
+    if (directoryEnd > size) {
+        std::cerr << "Scene: " << path << " has a truncated table directory" << std::endl;
+        return false;
+    }
+
+    const SceneTableEntry* tables = (const SceneTableEntry*)(data + sizeof(SceneFileHeader));
+    SceneLayout layout;
+    for (uint32_t t = 0; t < header->tableCount; ++t) {
+        const SceneTableEntry& table = tables[t];
+        if (table.offset % TABLE_ALIGNMENT != 0 || table.offset > size ||
+            table.count > (size - table.offset) / (table.recordSize ? table.recordSize : 1)) {
+            std::cerr << "Scene: table " << t << " in " << path << " is out of bounds" << std::endl;
+            return false;
+        }
+        const void* records = data + table.offset;
+        size_t count = (size_t)table.count;
+
+        bool sizeOk = true;
+        switch (table.type) {
+            case SCENE_TABLE_BUILDINGS:
+                sizeOk = table.recordSize == sizeof(Building);
+                layout.buildings = (const Building*)records;
+                layout.numBuildings = count;
+                break;
+            case SCENE_TABLE_TREES:
+                sizeOk = table.recordSize == sizeof(ScenePoint);
+                layout.trees = (const ScenePoint*)records;
+                layout.numTrees = count;
+                break;
+            case SCENE_TABLE_STREET_LIGHTS:
+                sizeOk = table.recordSize == sizeof(ScenePoint);
+                layout.streetLights = (const ScenePoint*)records;
+                layout.numStreetLights = count;
+                break;
+            case SCENE_TABLE_MOSQUES:
+                sizeOk = table.recordSize == sizeof(ScenePoint);
+                layout.mosques = (const ScenePoint*)records;
+                layout.numMosques = count;
+                break;
+            case SCENE_TABLE_PLAYGROUNDS:
+                sizeOk = table.recordSize == sizeof(ScenePoint);
+                layout.playgrounds = (const ScenePoint*)records;
+                layout.numPlaygrounds = count;
+                break;
+            case SCENE_TABLE_BENCHES:
+                sizeOk = table.recordSize == sizeof(ScenePoint);
+                layout.benches = (const ScenePoint*)records;
+                layout.numBenches = count;
+                break;
+            default:
+                break; // Unknown tables from newer writers are skipped
+        }
+        if (!sizeOk) {
+            std::cerr << "Scene: table " << t << " in " << path << " has record size "
+                      << table.recordSize << std::endl;
+            return false;
+        }
+    }
+    sceneLayout = layout;
+    return true;
+}
+
+void MappedSceneFile::close() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mappingHandle) CloseHandle((HANDLE)mappingHandle);
+    if (fileHandle) CloseHandle((HANDLE)fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (data) munmap((void*)data, size);
+#endif
+    data = nullptr;
+    size = 0;
+    sceneLayout = SceneLayout();
+}
+
+// ---------- CONVERTER ----------
+
+struct PendingTable {
+    SceneTableType type;
+    uint32_t recordSize;
+    std::vector<float> values; // Records flattened, recordSize / 4 floats each
+};
+
+bool convertSceneText(const char* textPath, const char* binaryPath) {
+    FILE* in = fopen(textPath, "r");
+    if (!in) {
+        std::cerr << "Scene: cannot open " << textPath << std::endl;
+        return false;
+    }
+
+    PendingTable tables[] = {
+        {SCENE_TABLE_BUILDINGS, sizeof(Building), std::vector<float>()},
+        {SCENE_TABLE_TREES, sizeof(ScenePoint), std::vector<float>()},
+        {SCENE_TABLE_STREET_LIGHTS, sizeof(ScenePoint), std::vector<float>()},
+        {SCENE_TABLE_MOSQUES, sizeof(ScenePoint), std::vector<float>()},
+        {SCENE_TABLE_PLAYGROUNDS, sizeof(ScenePoint), std::vector<float>()},
+        {SCENE_TABLE_BENCHES, sizeof(ScenePoint), std::vector<float>()},
+    };
+    const char* keywords[] = {"building", "tree", "streetlight", "mosque", "playground", "bench"};
+    const int NUM_TABLES = sizeof(tables) / sizeof(tables[0]);
+
+    char line[256];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), in)) {
+        ++lineNumber;
+        char keyword[32];
+        float v[4];
+        int fields = sscanf(line, "%31s %f %f %f %f", keyword, &v[0], &v[1], &v[2], &v[3]);
+        if (fields <= 0 || keyword[0] == '#') continue;
+
+        int t = 0;
+        while (t < NUM_TABLES && strcmp(keyword, keywords[t]) != 0) ++t;
+        int needed = (t < NUM_TABLES) ? (int)(tables[t].recordSize / sizeof(float)) : 0;
+        if (t == NUM_TABLES || fields - 1 < needed) {
+            std::cerr << "Scene: " << textPath << ":" << lineNumber << ": cannot parse '"
+                      << keyword << "'" << std::endl;
+            fclose(in);
+            return false;
+        }
+        tables[t].values.insert(tables[t].values.end(), v, v + needed);
+    }
+    fclose(in);
+
+    // Lay out the directory, then each table at the next aligned offset
+    SceneFileHeader header;
+    memcpy(header.magic, SCENE_FILE_MAGIC, 4);
+    header.version = SCENE_FILE_VERSION;
+    header.tableCount = NUM_TABLES;
+    header.reserved = 0;
+
+    std::vector<SceneTableEntry> entries(NUM_TABLES);
+    uint64_t offset = sizeof(SceneFileHeader) + NUM_TABLES * sizeof(SceneTableEntry);
+    for (int t = 0; t < NUM_TABLES; ++t) {
+        offset = (offset + TABLE_ALIGNMENT - 1) / TABLE_ALIGNMENT * TABLE_ALIGNMENT;
+        entries[t].type = tables[t].type;
+        entries[t].recordSize = tables[t].recordSize;
+        entries[t].count = tables[t].values.size() * sizeof(float) / tables[t].recordSize;
+        entries[t].offset = offset;
+        offset += tables[t].values.size() * sizeof(float);
+    }
+
+    FILE* out = fopen(binaryPath, "wb");
+    if (!out) {
+        std::cerr << "Scene: cannot write " << binaryPath << std::endl;
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(&entries[0], sizeof(SceneTableEntry), entries.size(), out);
+    const char zeros[TABLE_ALIGNMENT] = {0};
+    for (int t = 0; t < NUM_TABLES; ++t) {
+        long pos = ftell(out);
+        fwrite(zeros, 1, (size_t)(entries[t].offset - pos), out);
+        if (!tables[t].values.empty()) {
+            fwrite(&tables[t].values[0], sizeof(float), tables[t].values.size(), out);
+        }
+    }
+    bool ok = ferror(out) == 0;
+    fclose(out);
+    if (!ok) {
+        std::cerr << "Scene: cannot write " << binaryPath << std::endl;
+        return false;
+    }
+
+    uint64_t total = 0;
+    for (int t = 0; t < NUM_TABLES; ++t) total += entries[t].count;
+    printf("Scene: wrote %llu entities to %s\n", (unsigned long long)total, binaryPath);
+    return true;
+}
@@ -0,0 +1,108 @@
+#ifndef CITY_VIEW_SCENE_FILE_H
+#define CITY_VIEW_SCENE_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary scene layout (.cvscene). The file is memory-mapped and its typed
+// tables are used in place, so opening a multi-million-entity city costs
+// a mapping and a header check rather than a parse.
+//
+// Layout (little-endian):
+//   SceneFileHeader
+//   SceneTableEntry[tableCount]
+//   table data, each table 16-byte aligned, records packed
+
+struct ScenePoint {
+    float x, y;
+};
+
+struct Building {
+    float x, y, width, height;
+};
+
+enum SceneTableType {
+    SCENE_TABLE_BUILDINGS = 1,    // Building records
+    SCENE_TABLE_TREES = 2,        // ScenePoint records
+    SCENE_TABLE_STREET_LIGHTS = 3,
+    SCENE_TABLE_MOSQUES = 4,
+    SCENE_TABLE_PLAYGROUNDS = 5,
+    SCENE_TABLE_BENCHES = 6
+};
+
+const char SCENE_FILE_MAGIC[4] = {'C', 'V', 'S', 'N'};
+const uint32_t SCENE_FILE_VERSION = 1;
+
+struct SceneFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t tableCount;
+    uint32_t reserved;
+};
+
+struct SceneTableEntry {
+    uint32_t type;       // SceneTableType
+    uint32_t recordSize; // sizeof the record, checked on load
+    uint64_t count;
+    uint64_t offset;     // From the start of the file
+};
+
+// Read-only view of every static entity in a scene. Points either at the
+// compiled-in default arrays or straight into a mapped file.
+struct SceneLayout {
+    const Building* buildings = nullptr;
+    size_t numBuildings = 0;
+    const ScenePoint* trees = nullptr;
+    size_t numTrees = 0;
+    const ScenePoint* streetLights = nullptr;
+    size_t numStreetLights = 0;
+    const ScenePoint* mosques = nullptr;
+    size_t numMosques = 0;
+    const ScenePoint* playgrounds = nullptr;
+    size_t numPlaygrounds = 0;
+    const ScenePoint* benches = nullptr;
+    size_t numBenches = 0;
+
+    size_t totalCount() const {
+        return numBuildings + numTrees + numStreetLights + numMosques + numPlaygrounds + numBenches;
+    }
+};
+
+class MappedSceneFile {
+public:
+    MappedSceneFile() {}
+    ~MappedSceneFile() { close(); }
+
+    // Map and validate a .cvscene file. Prints the reason and returns
+    // false if the file is missing, truncated or of another version.
+    bool open(const char* path);
+    void close();
+
+    const SceneLayout& layout() const { return sceneLayout; }
+
+private:
+    MappedSceneFile(const MappedSceneFile&);
+    MappedSceneFile& operator=(const MappedSceneFile&);
+
+    bool validate(const char* path);
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+    SceneLayout sceneLayout;
+};
+
+// Convert the readable text format to a .cvscene file. One entity per line:
+//   building X Y WIDTH HEIGHT
+//   tree X Y
+//   streetlight X Y
+//   mosque X Y
+//   playground X Y
+//   bench X Y
+// Blank lines and lines starting with '#' are ignored.
+bool convertSceneText(const char* textPath, const char* binaryPath);
+
+#endif
@@ -0,0 +1,60 @@
+#include "shader.h"
+#include "gl_ext.h"
+#include <iostream>
+#include <vector>
+
+static GLuint compileShader(GLenum type, const char* src) {
+    GLuint shader = extCreateShader(type);
+    extShaderSource(shader, 1, &src, nullptr);
+    extCompileShader(shader);
+
+    GLint ok = GL_FALSE;
+    extGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        GLint len = 0;
+        extGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+        std::vector<char> log(len > 1 ? len : 1, '\0');
+        extGetShaderInfoLog(shader, (GLsizei)log.size(), nullptr, &log[0]);
+        std::cerr << "Shader compile failed: " << &log[0] << std::endl;
+        extDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint buildProgram(const char* vertexSrc, const char* fragmentSrc,
+                    const char* const* attribNames, int attribCount) {
+    if (!hasShaders) return 0;
+
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSrc);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSrc);
+    if (!vs || !fs) {
+        if (vs) extDeleteShader(vs);
+        if (fs) extDeleteShader(fs);
+        return 0;
+    }
+
+    GLuint program = extCreateProgram();
+    extAttachShader(program, vs);
+    extAttachShader(program, fs);
+    for (int i = 0; i < attribCount; ++i) {
+        extBindAttribLocation(program, i, attribNames[i]);
+    }
+    extLinkProgram(program);
+    // The program keeps the shaders alive while attached
+    extDeleteShader(vs);
+    extDeleteShader(fs);
+
+    GLint ok = GL_FALSE;
+    extGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        GLint len = 0;
+        extGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+        std::vector<char> log(len > 1 ? len : 1, '\0');
+        extGetProgramInfoLog(program, (GLsizei)log.size(), nullptr, &log[0]);
+        std::cerr << "Shader link failed: " << &log[0] << std::endl;
+        extDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
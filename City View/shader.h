@@ -0,0 +1,12 @@
+#ifndef CITY_VIEW_SHADER_H
+#define CITY_VIEW_SHADER_H
+
+#include <GL/glut.h>
+
+// Compile and link a GLSL program. attribNames[i] is bound to location i.
+// Returns 0 (and prints the info log) on failure so callers can fall back
+// to the fixed-function path.
+GLuint buildProgram(const char* vertexSrc, const char* fragmentSrc,
+                    const char* const* attribNames, int attribCount);
+
+#endif
@@ -0,0 +1,19 @@
+#include "simd.h"
+
+SimdLevel bestSimdLevel() {
+#ifdef CITY_VIEW_X86_SIMD
+    static const SimdLevel level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 :
+                                   __builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_SCALAR;
+    return level;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX2: return "AVX2";
+        case SIMD_SSE2: return "SSE2";
+        default:        return "scalar";
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef CITY_VIEW_SIMD_H
+#define CITY_VIEW_SIMD_H
+
+// Kernel widths for the structure-of-arrays updates (entities, flock,
+// particles, water). Each has a scalar kernel plus SSE2 and AVX2 ones on
+// x86, picked by bestSimdLevel() or forced by the benchmarks.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CITY_VIEW_X86_SIMD
+#endif
+
+// Keep the scalar kernels scalar, so the benchmark compares like with like
+#if defined(__GNUC__) && !defined(__clang__)
+#define CITY_VIEW_NO_VECTORIZE __attribute__((optimize("no-tree-vectorize")))
+#else
+#define CITY_VIEW_NO_VECTORIZE
+#endif
+
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+SimdLevel bestSimdLevel(); // Widest kernel this CPU can run
+const char* simdLevelName(SimdLevel level);
+
+#endif
@@ -0,0 +1,111 @@
+#include "simulation.h"
+#include <chrono>
+#include <cstdio>
+
+SimState::SimState() {
+    traffic.populate(2, 2);
+    // Wrap bounds are the original reset rules: past wrapMax, re-enter at wrapReset
+    entities.add(ENTITY_BOAT, 0.0f, 65.0f, 2.0f, 800.0f, -600.0f);
+    entities.add(ENTITY_SAILBOAT, -300.0f, 120.0f, 0.8f, 850.0f, -100.0f); // Slower movement
+    birds.populate(DEFAULT_FLOCK_SIZE, SKY_BOUNDS, DEFAULT_FLOCK_SEED);
+}
+
+void stepSimulation(SimState& s, TaskPool* pool) {
+    // The player car aims for the keyboard-controlled speed
+    s.traffic.update(s.carSpeed, pool);
+    s.entities.update();
+    s.birds.update(pool);
+
+    ++s.tick;
+    s.time = s.tick * SIM_TICK_SECONDS;
+}
+
+int FixedStepSimulation::advance(double seconds) {
+    return advance(seconds, std::function<bool()>());
+}
+
+int FixedStepSimulation::advance(double seconds, const std::function<bool()>& beforeTick) {
+    if (seconds > 0.0) {
+        accumulator += seconds;
+    }
+
+    int ticks = 0;
+    while (accumulator >= SIM_TICK_SECONDS) {
+        if (ticks == MAX_TICKS_PER_ADVANCE) {
+            accumulator = 0.0; // Too far behind (e.g. window was dragged); skip ahead
+            break;
+        }
+        if (beforeTick && !beforeTick()) {
+            accumulator = 0.0;
+            break;
+        }
+        previousTime = current.time;
+        stepSimulation(current, pool);
+        accumulator -= SIM_TICK_SECONDS;
+        ++ticks;
+    }
+    return ticks;
+}
+
+void FixedStepSimulation::reset(const SimState& s) {
+    current = s;
+    previousTime = s.time;
+    accumulator = 0.0;
+}
+
+// FNV-1a over the raw bytes of each field
+static void hashBytes(unsigned long long& h, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+}
+
+static void hashFloats(unsigned long long& h, const std::vector<float>& v) {
+    if (!v.empty()) hashBytes(h, &v[0], v.size() * sizeof(float));
+}
+
+unsigned long long stateChecksum(const SimState& s) {
+    unsigned long long h = 14695981039346656037ULL;
+    hashBytes(h, &s.tick, sizeof(s.tick));
+    hashBytes(h, &s.carSpeed, sizeof(s.carSpeed));
+    unsigned char braking = s.isBraking ? 1 : 0;
+    hashBytes(h, &braking, 1);
+    for (int k = 0; k < NUM_ENTITY_KINDS; ++k) {
+        const EntityBlock& b = s.entities.block((EntityKind)k);
+        hashFloats(h, b.posX);
+        hashFloats(h, b.posY);
+        hashFloats(h, b.velX);
+    }
+    for (int l = 0; l < s.traffic.laneCount(); ++l) {
+        const TrafficLane& lane = s.traffic.lane(l);
+        hashFloats(h, lane.pos);
+        hashFloats(h, lane.vel);
+    }
+    const FlockBirds& birds = s.birds.getBirds();
+    hashFloats(h, birds.posX);
+    hashFloats(h, birds.posY);
+    hashFloats(h, birds.velX);
+    hashFloats(h, birds.velY);
+    return h;
+}
+
+int runSimulationOnly(const SimState& start, unsigned long long ticks) {
+    SimState s = start;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (unsigned long long i = 0; i < ticks; ++i) {
+        stepSimulation(s);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    printf("Simulated ticks:  %llu (%.1f s of scene time)\n", ticks, s.time);
+    printf("Wall time:        %.3f s\n", seconds);
+    printf("Ticks/sec:        %.0f\n", seconds > 0.0 ? ticks / seconds : 0.0);
+    printf("Final state:      car %.2f  boat %.2f  sailboat %.2f  bird %.2f, %.2f\n",
+           s.traffic.x(0, 0), s.entities.block(ENTITY_BOAT).posX[0],
+           s.entities.block(ENTITY_SAILBOAT).posX[0], s.birds.getBirds().posX[0], s.birds.getBirds().posY[0]);
+    printf("State checksum:   %016llx\n", stateChecksum(s));
+    return 0;
+}
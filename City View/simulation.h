@@ -0,0 +1,66 @@
+#ifndef CITY_VIEW_SIMULATION_H
+#define CITY_VIEW_SIMULATION_H
+
+#include "entities.h"
+#include "flock.h"
+#include "traffic.h"
+#include <functional>
+
+class TaskPool;
+
+// Deterministic fixed-step simulation of the moving objects. Nothing here
+// touches GLUT or GL: time only moves through advance() and stepSimulation(),
+// so the same inputs always reproduce the same state.
+
+const int SIM_TICK_MS = 30;                         // The original timer period
+const double SIM_TICK_SECONDS = SIM_TICK_MS / 1000.0;
+const int MAX_TICKS_PER_ADVANCE = 8;                // Drop time after long stalls
+
+struct SimState {
+    SimState(); // Spawns the scene's traffic, boat, mini sailboat and birds
+
+    unsigned long long tick = 0;
+    double time = 0.0;            // Seconds of simulated time (tick * SIM_TICK_SECONDS)
+    float carSpeed = 6.0f;        // Player car's desired speed per tick (Keys: + / -)
+    bool isBraking = false;       // Brake lights/slowing down
+    EntityStore entities;         // Boats and sailboats
+    TrafficSim traffic;           // Cars; the player car is vehicle 0 of lane 0
+    Flock birds;
+};
+
+// Advance a state by exactly one tick. Traffic lanes and birds run on the
+// pool when one is given; the result is the same either way.
+void stepSimulation(SimState& s, TaskPool* pool = nullptr);
+
+// Accumulator that turns variable real time into whole ticks. Rendering
+// interpolates between the last two ticks with alpha().
+class FixedStepSimulation {
+public:
+    // Add real elapsed seconds and run every whole tick that fits.
+    // Returns the number of ticks run.
+    int advance(double seconds);
+    // The same, calling beforeTick() ahead of each tick; if it returns
+    // false no more ticks run and the rest of the time is dropped
+    int advance(double seconds, const std::function<bool()>& beforeTick);
+    void reset(const SimState& s);
+    void setTaskPool(TaskPool* p) { pool = p; }
+
+    SimState& state() { return current; } // Latest tick; inputs apply here
+    const SimState& state() const { return current; }
+    float alpha() const { return (float)(accumulator / SIM_TICK_SECONDS); }
+    double renderTime() const { return previousTime + (current.time - previousTime) * alpha(); }
+
+private:
+    SimState current;
+    double previousTime = 0.0;
+    double accumulator = 0.0;
+    TaskPool* pool = nullptr;
+};
+
+// Hash of every field, to compare end states across runs and builds
+unsigned long long stateChecksum(const SimState& s);
+
+// --simulate-only: step the simulation without rendering and report ticks/sec
+int runSimulationOnly(const SimState& start, unsigned long long ticks);
+
+#endif
@@ -0,0 +1,91 @@
+#include "spatial_grid.h"
+#include <algorithm>
+#include <cmath>
+
+void SpatialGrid::clear() {
+    cellsX = cellsY = 0;
+    cellStart.clear();
+    cellItems.clear();
+    itemBounds.clear();
+    lastSeen.clear();
+    queryStamp = 0;
+}
+
+void SpatialGrid::cellRange(const Bounds& b, int& x0, int& y0, int& x1, int& y1) const {
+    x0 = std::max(0, (int)std::floor((b.minX - world.minX) / cellSize));
+    y0 = std::max(0, (int)std::floor((b.minY - world.minY) / cellSize));
+    x1 = std::min(cellsX - 1, (int)std::floor((b.maxX - world.minX) / cellSize));
+    y1 = std::min(cellsY - 1, (int)std::floor((b.maxY - world.minY) / cellSize));
+}
+
+void SpatialGrid::build(const std::vector<Bounds>& items, float size) {
+    clear();
+    if (items.empty()) return;
+
+    itemBounds = items;
+    world = items[0];
+    for (size_t i = 1; i < items.size(); ++i) {
+        world.minX = std::min(world.minX, items[i].minX);
+        world.minY = std::min(world.minY, items[i].minY);
+        world.maxX = std::max(world.maxX, items[i].maxX);
+        world.maxY = std::max(world.maxY, items[i].maxY);
+    }
+
+    cellSize = size;
+    for (;;) {
+        double cx = std::floor((world.maxX - world.minX) / cellSize) + 1.0;
+        double cy = std::floor((world.maxY - world.minY) / cellSize) + 1.0;
+        if (cx * cy <= MAX_CELLS) {
+            cellsX = (int)cx;
+            cellsY = (int)cy;
+            break;
+        }
+        cellSize *= 2.0f;
+    }
+
+    // Counting sort into cells: count, prefix sum, then scatter
+    cellStart.assign((size_t)cellsX * cellsY + 1, 0);
+    int x0, y0, x1, y1;
+    for (size_t i = 0; i < items.size(); ++i) {
+        cellRange(items[i], x0, y0, x1, y1);
+        for (int cy = y0; cy <= y1; ++cy) {
+            for (int cx = x0; cx <= x1; ++cx) ++cellStart[cellIndex(cx, cy) + 1];
+        }
+    }
+    for (size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c - 1];
+
+    cellItems.resize(cellStart.back());
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < items.size(); ++i) {
+        cellRange(items[i], x0, y0, x1, y1);
+        for (int cy = y0; cy <= y1; ++cy) {
+            for (int cx = x0; cx <= x1; ++cx) cellItems[fill[cellIndex(cx, cy)]++] = (uint32_t)i;
+        }
+    }
+    lastSeen.assign(items.size(), 0);
+}
+
+void SpatialGrid::query(const Bounds& view, std::vector<uint32_t>& out) {
+    out.clear();
+    if (itemBounds.empty() || !view.overlaps(world)) return;
+
+    if (++queryStamp == 0) { // Wrapped: forget every old stamp
+        std::fill(lastSeen.begin(), lastSeen.end(), 0);
+        queryStamp = 1;
+    }
+
+    int x0, y0, x1, y1;
+    cellRange(view, x0, y0, x1, y1);
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            int c = cellIndex(cx, cy);
+            for (uint32_t k = cellStart[c]; k < cellStart[c + 1]; ++k) {
+                uint32_t id = cellItems[k];
+                if (lastSeen[id] == queryStamp) continue;
+                lastSeen[id] = queryStamp;
+                if (itemBounds[id].overlaps(view)) out.push_back(id);
+            }
+        }
+    }
+    std::sort(out.begin(), out.end());
+}
@@ -0,0 +1,45 @@
+#ifndef CITY_VIEW_SPATIAL_GRID_H
+#define CITY_VIEW_SPATIAL_GRID_H
+
+#include "geometry.h"
+#include <cstdint>
+#include <vector>
+
+// Uniform grid over static entities, so a frame only has to look at the
+// cells under the view instead of every object in the world. Items are
+// identified by their index in the array passed to build().
+class SpatialGrid {
+public:
+    // Bucket every item into the cells its bounds touch. cellSize is grown
+    // if the world would need more than MAX_CELLS cells.
+    void build(const std::vector<Bounds>& items, float cellSize);
+    void clear();
+
+    // Replace out with the ids of all items whose bounds overlap view,
+    // each once and in ascending order (so painter's order is kept).
+    void query(const Bounds& view, std::vector<uint32_t>& out);
+
+    size_t itemCount() const { return itemBounds.size(); }
+    const Bounds& worldBounds() const { return world; }
+
+    static const int MAX_CELLS = 1 << 22;
+
+private:
+    int cellIndex(int cx, int cy) const { return cy * cellsX + cx; }
+    void cellRange(const Bounds& b, int& x0, int& y0, int& x1, int& y1) const;
+
+    float cellSize = 256.0f;
+    int cellsX = 0, cellsY = 0;
+    Bounds world = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    // Compressed cell lists: the items of cell c are cellItems[cellStart[c] .. cellStart[c + 1])
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> cellItems;
+    std::vector<Bounds> itemBounds;
+
+    // Items spanning several cells are reported once per query
+    std::vector<uint32_t> lastSeen;
+    uint32_t queryStamp = 0;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "task_pool.h"
+
+void TaskPool::start(int threads) {
+    stop();
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+
+    stopping = false;
+    for (int i = 0; i < threads; ++i) queues.push_back(new Queue());
+    for (int i = 1; i < threads; ++i) {
+        workers.push_back(std::thread(&TaskPool::workerLoop, this, i));
+    }
+}
+
+void TaskPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+    workers.clear();
+    for (size_t i = 0; i < queues.size(); ++i) delete queues[i];
+    queues.clear();
+}
+
+bool TaskPool::takeTask(int self, int& index) {
+    // Own queue first, newest task (still warm in this thread's cache)
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.items.empty()) {
+            index = own.items.back();
+            own.items.pop_back();
+            return true;
+        }
+    }
+    // Then steal the oldest task from someone else
+    int n = (int)queues.size();
+    for (int k = 1; k < n; ++k) {
+        Queue& victim = *queues[(self + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty()) {
+            index = victim.items.front();
+            victim.items.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::work(int self) {
+    int index;
+    while (takeTask(self, index)) {
+        (*job)(index);
+        remaining.fetch_sub(1);
+    }
+}
+
+void TaskPool::workerLoop(int self) {
+    unsigned seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            while (!stopping && generation == seen) wake.wait(lock);
+            if (stopping) return;
+            seen = generation;
+        }
+        work(self);
+    }
+}
+
+void TaskPool::run(int count, const std::function<void(int)>& task) {
+    if (count <= 0) return;
+    if (queues.size() <= 1) {
+        for (int i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    // Publish the job before any task is visible: a worker still scanning
+    // after the previous run may pick one up straight away
+    job = &task;
+    remaining.store(count);
+
+    // Deal the tasks out round-robin, then wake everyone
+    int n = (int)queues.size();
+    for (int i = 0; i < count; ++i) {
+        Queue& q = *queues[i % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.items.push_back(i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        ++generation;
+    }
+    wake.notify_all();
+
+    work(0);
+    while (remaining.load() > 0) {
+        std::this_thread::yield(); // Others are finishing their last tasks
+    }
+}
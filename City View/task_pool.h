@@ -0,0 +1,54 @@
+#ifndef CITY_VIEW_TASK_POOL_H
+#define CITY_VIEW_TASK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join pool for work that has to finish within the frame. Every
+// thread owns a deque of task indices; it pops from the back of its own
+// and, when that runs dry, steals from the front of the others. The
+// calling thread takes part, so a pool of N threads starts N - 1 workers.
+class TaskPool {
+public:
+    TaskPool() {}
+    ~TaskPool() { stop(); }
+
+    // threads <= 0 uses every hardware thread; 1 runs everything inline
+    void start(int threads);
+    void stop();
+    int threadCount() const { return (int)queues.size(); }
+
+    // Run task(i) for every i in [0, count) and return once all are done
+    void run(int count, const std::function<void(int)>& task);
+
+private:
+    TaskPool(const TaskPool&);
+    TaskPool& operator=(const TaskPool&);
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> items;
+    };
+
+    bool takeTask(int self, int& index);
+    void work(int self);
+    void workerLoop(int self);
+
+    std::vector<std::thread> workers;
+    std::vector<Queue*> queues; // [0] belongs to the calling thread
+
+    const std::function<void(int)>* job = nullptr;
+    std::atomic<int> remaining{0};
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    unsigned generation = 0;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef CITY_VIEW_TIMING_H
+#define CITY_VIEW_TIMING_H
+
+#include <chrono>
+
+// Milliseconds since start, for the stage timings in stats and benchmarks
+inline double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "traffic.h"
+#include "task_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// ---------- MODEL ----------
+
+// IDM parameters, scaled to the scene: the original car cruises at 6 units
+// per tick and the default road holds about ten cars per lane
+const float MAX_ACCEL = 0.1f;       // Reaches 6 from standstill in 2 s
+const float COMFORT_DECEL = 0.25f;
+const float MAX_DECEL = 0.6f;       // Emergency braking, never exceeded
+const float MIN_GAP = 20.0f;        // Bumper gap when stopped
+const float HEADWAY = 15.0f;        // Ticks of following distance (0.45 s)
+const float BRAKE_LIGHT_DECEL = 0.02f;
+const float MIN_SPACING = 2.0f * CAR_LENGTH; // Initial spacing in crowded lanes
+const int MIN_PARALLEL_VEHICLES = 4096;     // Fewer are not worth waking the pool for
+
+// New speed and position of vehicle i behind a leader at leaderPos moving
+// at leaderVel (both from the previous tick)
+static inline void idmStep(TrafficLane& lane, int i, float leaderPos, float leaderVel) {
+    float v = lane.prevVel[i];
+    float room = leaderPos - lane.prevPos[i] - CAR_LENGTH;
+    float gap = std::max(room, 0.1f);
+    float dv = v - leaderVel;
+    float desiredGap = MIN_GAP + std::max(0.0f, v * HEADWAY + v * dv * (0.5f / std::sqrt(MAX_ACCEL * COMFORT_DECEL)));
+    float speedRatio = v / lane.desiredVel[i];
+    speedRatio *= speedRatio;
+    float gapRatio = desiredGap / gap;
+    float accel = MAX_ACCEL * (1.0f - speedRatio * speedRatio - gapRatio * gapRatio);
+    accel = std::max(accel, -MAX_DECEL);
+    // Never drive into the leader's old position: it only moves forward,
+    // so the order is kept whatever the parameters
+    float nv = std::min(std::max(v + accel, 0.0f), std::max(room, 0.0f));
+    lane.vel[i] = nv;
+    lane.pos[i] = lane.prevPos[i] + nv;
+}
+
+void updateLane(TrafficLane& lane) {
+    int n = lane.size();
+    if (n == 0) return;
+    memcpy(&lane.prevPos[0], &lane.pos[0], n * sizeof(float));
+    memcpy(&lane.prevVel[0], &lane.vel[0], n * sizeof(float));
+
+    // The front vehicle follows the back one, a lap ahead
+    idmStep(lane, 0, lane.prevPos[n - 1] + lane.length, lane.prevVel[n - 1]);
+    for (int i = 1; i < n; ++i) {
+        idmStep(lane, i, lane.prevPos[i - 1], lane.prevVel[i - 1]);
+    }
+
+    // Once the back vehicle has finished a lap, so has everyone: take a
+    // lap off them all, keeping positions within two laps of the start
+    if (lane.pos[n - 1] >= ROAD_START + lane.length) {
+        for (int i = 0; i < n; ++i) {
+            lane.pos[i] -= lane.length;
+            lane.prevPos[i] -= lane.length;
+        }
+    }
+}
+
+// ---------- TrafficSim ----------
+
+void TrafficSim::populate(int lanesPerDirection, int vehiclesPerLane) {
+    clear();
+    int numLanes = 2 * std::max(1, lanesPerDirection);
+    int n = std::max(0, vehiclesPerLane);
+    lanes.resize(numLanes);
+    laneStart.resize(numLanes + 1);
+
+    for (int l = 0; l < numLanes; ++l) {
+        TrafficLane& lane = lanes[l];
+        // Farthest lane first: this way up the road, then the other way
+        lane.direction = l < numLanes / 2 ? 1 : -1;
+        lane.y = -LANE_SPACING * l;
+        lane.length = std::max(ROAD_END - ROAD_START, n * MIN_SPACING);
+        laneStart[l] = l * n;
+
+        float spacing = n > 0 ? lane.length / n : 0.0f;
+        float front = (l == 0) ? 0.0f : spacing * 0.37f * l; // Stagger the lanes
+        front -= std::floor((front - ROAD_START) / lane.length) * lane.length;
+        if (front - (n - 1) * spacing < ROAD_START) front += lane.length; // Back vehicle on the road
+        for (int i = 0; i < n; ++i) {
+            // Mixed desired speeds make platoons form behind the slow ones
+            float desired = (l == 0 && i == 0) ? 6.0f : 4.5f + 0.5f * ((i * 7 + l * 3) % 5);
+            lane.pos.push_back(front - i * spacing);
+            lane.vel.push_back(desired);
+            lane.desiredVel.push_back(desired);
+        }
+        lane.prevPos = lane.pos;
+        lane.prevVel = lane.vel;
+    }
+    laneStart[numLanes] = numLanes * n;
+}
+
+void TrafficSim::clear() {
+    lanes.clear();
+    laneStart.clear();
+}
+
+void TrafficSim::update(float playerSpeed, TaskPool* pool) {
+    if (!lanes.empty() && lanes[0].size() > 0) {
+        lanes[0].desiredVel[0] = playerSpeed;
+    }
+    if (pool && vehicleCount() >= MIN_PARALLEL_VEHICLES) {
+        pool->run(laneCount(), [this](int l) { updateLane(lanes[l]); });
+    } else {
+        for (size_t l = 0; l < lanes.size(); ++l) updateLane(lanes[l]);
+    }
+}
+
+int TrafficSim::laneOf(int vehicle) const {
+    return (int)(std::upper_bound(laneStart.begin(), laneStart.end(), vehicle) - laneStart.begin()) - 1;
+}
+
+float TrafficSim::roadX(const TrafficLane& lane, float pos) {
+    float p = pos >= ROAD_START + lane.length ? pos - lane.length : pos;
+    return lane.direction > 0 ? p : ROAD_START + ROAD_END - p;
+}
+
+float TrafficSim::interpolatedX(int l, int i, float alpha) const {
+    const TrafficLane& lane = lanes[l];
+    float prev = roadX(lane, lane.prevPos[i]);
+    float cur = roadX(lane, lane.pos[i]);
+    bool wrapped = lane.direction > 0 ? cur < prev : cur > prev;
+    return wrapped ? cur : prev + (cur - prev) * alpha;
+}
+
+bool TrafficSim::isBraking(int l, int i) const {
+    const TrafficLane& lane = lanes[l];
+    return lane.vel[i] < lane.prevVel[i] - BRAKE_LIGHT_DECEL;
+}
@@ -0,0 +1,78 @@
+#ifndef CITY_VIEW_TRAFFIC_H
+#define CITY_VIEW_TRAFFIC_H
+
+#include <vector>
+
+class TaskPool;
+
+// Road traffic: lanes in both directions, each a ring that vehicles leave
+// at one end of the road and re-enter at the other. Vehicles follow the
+// intelligent driver model (IDM), accelerating towards their desired
+// speed and braking for the vehicle ahead, so one car braking hard sends
+// a shockwave back along its lane.
+//
+// A lane stores its vehicles as arrays sorted front to back. Nobody
+// overtakes, so the order never changes; positions are distances along
+// the lane and are only wrapped onto the road when read. Lanes are
+// independent, so a tick updates them in parallel and the result does
+// not depend on the thread count.
+//
+// Distances are world units, speeds units per tick, accelerations units
+// per tick per tick.
+
+const float ROAD_START = -120.0f; // Vehicles re-enter here...
+const float ROAD_END = 850.0f;    // ...after passing here (the original car's wrap)
+const float CAR_LENGTH = 90.0f;   // Bumper to bumper of the car mesh
+const float LANE_SPACING = 12.0f; // Each nearer lane is drawn this much lower
+
+struct TrafficLane {
+    int direction = 1;   // +1 drives towards +x, -1 towards -x
+    float y = 0.0f;      // Offset of the car mesh
+    float length = ROAD_END - ROAD_START; // Ring length, more when the lane is crowded
+    std::vector<float> pos;        // Distance along the lane, front vehicle first
+    std::vector<float> vel;
+    std::vector<float> desiredVel;
+    std::vector<float> prevPos;    // Before the last tick, for interpolation
+    std::vector<float> prevVel;
+
+    int size() const { return (int)pos.size(); }
+};
+
+class TrafficSim {
+public:
+    // Evenly spaced vehicles in lanesPerDirection lanes each way. Lane 0 is
+    // the farthest and carries the player car as vehicle 0, at x = 0.
+    // Rings stretch past the road when the vehicles would not fit on it.
+    void populate(int lanesPerDirection, int vehiclesPerLane);
+    void clear();
+
+    // Advance every lane by one tick, on the pool when given. The player
+    // car aims for playerSpeed.
+    void update(float playerSpeed, TaskPool* pool);
+
+    int laneCount() const { return (int)lanes.size(); }
+    const TrafficLane& lane(int l) const { return lanes[l]; }
+    int vehicleCount() const { return laneStart.empty() ? 0 : laneStart.back(); }
+    // Vehicles are numbered lane by lane, lane 0 first
+    int firstVehicle(int l) const { return laneStart[l]; }
+    int laneOf(int vehicle) const;
+
+    // Where the car mesh goes, as the origin of a car facing +x (its body
+    // spans x + 45 to x + 135), now or between the last two ticks. A
+    // vehicle that wrapped during the tick snaps to its new place.
+    float x(int l, int i) const { return roadX(lanes[l], lanes[l].pos[i]); }
+    float interpolatedX(int l, int i, float alpha) const;
+    // Slowed down noticeably during the last tick: brake lights on
+    bool isBraking(int l, int i) const;
+
+private:
+    static float roadX(const TrafficLane& lane, float pos);
+
+    std::vector<TrafficLane> lanes;
+    std::vector<int> laneStart; // First vehicle of each lane, then the total
+};
+
+// One IDM tick of a lane (exposed for the benchmark)
+void updateLane(TrafficLane& lane);
+
+#endif
@@ -0,0 +1,274 @@
+#include "water.h"
+#include "gl_ext.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// ---------- WAVES ----------
+
+struct Wave {
+    int cycles;      // Whole wavelengths per SEA_WIDTH, so strips tile
+    float depthK;    // Radians per unit of y, tilts the crests
+    float amplitude;
+    float speed;     // Radians per second
+};
+
+static const Wave WAVES[] = {
+    {9, 0.021f, 3.0f, 1.1f},
+    {14, -0.035f, 1.8f, 1.5f},
+    {23, 0.052f, 1.1f, 2.1f},
+    {37, -0.083f, 0.6f, 2.9f},
+};
+static const int NUM_WAVES = sizeof(WAVES) / sizeof(WAVES[0]);
+
+float WaterSurface::maxHeight() {
+    float sum = 0.0f;
+    for (int w = 0; w < NUM_WAVES; ++w) sum += WAVES[w].amplitude;
+    return sum;
+}
+
+// ---------- KERNELS ----------
+
+// sin(a): a = n * 2pi + r with r in [-pi, pi] (2pi split in two so n * hi
+// is exact), r folded into [-pi/2, pi/2] by sin(r) = sin(+-pi - r), then a
+// degree 9 minimax polynomial. Adding and subtracting 1.5 * 2^23 rounds to
+// the nearest integer the same way in every kernel.
+static const float ROUND_MAGIC = 12582912.0f;
+static const float INV_TWO_PI = 0.159154943f;
+static const float TWO_PI_HI = 6.28125f;
+static const float TWO_PI_LO = 1.93530717958e-3f;
+static const float PI_F = 3.14159265f;
+static const float SIN_C3 = -0.166666571f;
+static const float SIN_C5 = 8.33301712e-3f;
+static const float SIN_C7 = -1.98066112e-4f;
+static const float SIN_C9 = 2.60004715e-6f;
+
+CITY_VIEW_NO_VECTORIZE
+static void addWaveScalar(float* h, const float* x, int begin, int n, float amplitude, float k, float phase) {
+    for (int i = begin; i < n; ++i) {
+        float a = k * x[i] + phase;
+        float q = (a * INV_TWO_PI + ROUND_MAGIC) - ROUND_MAGIC;
+        float r = (a - q * TWO_PI_HI) - q * TWO_PI_LO;
+        r = std::max(std::min(r, PI_F - r), -PI_F - r);
+        float r2 = r * r;
+        float s = r + r * r2 * (SIN_C3 + r2 * (SIN_C5 + r2 * (SIN_C7 + r2 * SIN_C9)));
+        h[i] += amplitude * s;
+    }
+}
+
+#ifdef CITY_VIEW_X86_SIMD
+
+__attribute__((target("sse2")))
+static int addWaveSSE2(float* h, const float* x, int n, float amplitude, float k, float phase) {
+    const __m128 vk = _mm_set1_ps(k), vphase = _mm_set1_ps(phase), vamp = _mm_set1_ps(amplitude);
+    const __m128 magic = _mm_set1_ps(ROUND_MAGIC), pi = _mm_set1_ps(PI_F), negPi = _mm_set1_ps(-PI_F);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_add_ps(_mm_mul_ps(vk, _mm_loadu_ps(x + i)), vphase);
+        __m128 q = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(INV_TWO_PI)), magic), magic);
+        __m128 r = _mm_sub_ps(_mm_sub_ps(a, _mm_mul_ps(q, _mm_set1_ps(TWO_PI_HI))),
+                              _mm_mul_ps(q, _mm_set1_ps(TWO_PI_LO)));
+        r = _mm_max_ps(_mm_min_ps(r, _mm_sub_ps(pi, r)), _mm_sub_ps(negPi, r));
+        __m128 r2 = _mm_mul_ps(r, r);
+        __m128 p = _mm_add_ps(_mm_set1_ps(SIN_C7), _mm_mul_ps(r2, _mm_set1_ps(SIN_C9)));
+        p = _mm_add_ps(_mm_set1_ps(SIN_C5), _mm_mul_ps(r2, p));
+        p = _mm_add_ps(_mm_set1_ps(SIN_C3), _mm_mul_ps(r2, p));
+        __m128 s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), p));
+        _mm_storeu_ps(h + i, _mm_add_ps(_mm_loadu_ps(h + i), _mm_mul_ps(vamp, s)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int addWaveAVX2(float* h, const float* x, int n, float amplitude, float k, float phase) {
+    const __m256 vk = _mm256_set1_ps(k), vphase = _mm256_set1_ps(phase), vamp = _mm256_set1_ps(amplitude);
+    const __m256 magic = _mm256_set1_ps(ROUND_MAGIC), pi = _mm256_set1_ps(PI_F), negPi = _mm256_set1_ps(-PI_F);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_add_ps(_mm256_mul_ps(vk, _mm256_loadu_ps(x + i)), vphase);
+        __m256 q = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(a, _mm256_set1_ps(INV_TWO_PI)), magic), magic);
+        __m256 r = _mm256_sub_ps(_mm256_sub_ps(a, _mm256_mul_ps(q, _mm256_set1_ps(TWO_PI_HI))),
+                                 _mm256_mul_ps(q, _mm256_set1_ps(TWO_PI_LO)));
+        r = _mm256_max_ps(_mm256_min_ps(r, _mm256_sub_ps(pi, r)), _mm256_sub_ps(negPi, r));
+        __m256 r2 = _mm256_mul_ps(r, r);
+        __m256 p = _mm256_add_ps(_mm256_set1_ps(SIN_C7), _mm256_mul_ps(r2, _mm256_set1_ps(SIN_C9)));
+        p = _mm256_add_ps(_mm256_set1_ps(SIN_C5), _mm256_mul_ps(r2, p));
+        p = _mm256_add_ps(_mm256_set1_ps(SIN_C3), _mm256_mul_ps(r2, p));
+        __m256 s = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), p));
+        _mm256_storeu_ps(h + i, _mm256_add_ps(_mm256_loadu_ps(h + i), _mm256_mul_ps(vamp, s)));
+    }
+    return i;
+}
+
+#endif
+
+void addWave(SimdLevel level, float* h, const float* x, int n, float amplitude, float k, float phase) {
+    int done = 0;
+#ifdef CITY_VIEW_X86_SIMD
+    if (level == SIMD_AVX2) {
+        done = addWaveAVX2(h, x, n, amplitude, k, phase);
+    } else if (level == SIMD_SSE2) {
+        done = addWaveSSE2(h, x, n, amplitude, k, phase);
+    }
+#else
+    (void)level;
+#endif
+    addWaveScalar(h, x, done, n, amplitude, k, phase); // Remainder
+}
+
+CITY_VIEW_NO_VECTORIZE
+void addWaveReference(float* h, const float* x, int n, float amplitude, float k, float phase) {
+    for (int i = 0; i < n; ++i) {
+        h[i] += amplitude * std::sin(k * x[i] + phase);
+    }
+}
+
+// ---------- WaterSurface ----------
+
+void WaterSurface::setResolution(int newColumns, int newRows) {
+    columns = std::max(2, newColumns);
+    rows = std::max(2, newRows);
+
+    const float dx = SEA_WIDTH / columns;
+    columnX.resize(columns);
+    for (int c = 0; c < columns; ++c) columnX[c] = c * dx;
+
+    // Lift grows towards the shore but the shore row itself is pinned, so
+    // the surface never leaves its strip
+    rowLift.resize(rows);
+    for (int r = 0; r < rows; ++r) {
+        rowLift[r] = (r == rows - 1) ? 0.0f : (float)r / (rows - 1);
+    }
+
+    heights.assign((size_t)rows * columns, 0.0f);
+    vertices.resize((size_t)rows * (columns + 1));
+
+    const int stride = columns + 1;
+    indices.clear();
+    indices.reserve((size_t)(rows - 1) * columns * 6);
+    for (int r = 0; r + 1 < rows; ++r) {
+        for (int c = 0; c < columns; ++c) {
+            GLuint top = r * stride + c, bottom = top + stride;
+            GLuint quad[] = {top, bottom, bottom + 1, top, bottom + 1, top + 1};
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    indicesUploaded = false;
+}
+
+void WaterSurface::evaluate(double time, int firstRow, int endRow, Color deep, Color shallow) {
+    const float dx = SEA_WIDTH / columns;
+    const float crest = 0.6f * maxHeight();
+    const float foamRange = maxHeight() - crest;
+    // Foam is a lighter shallow color, so it dims at night with the sea
+    const float foamStrength = 0.5f * std::max(shallow.r, std::max(shallow.g, shallow.b)) / 255.0f;
+
+    for (int r = firstRow; r < endRow; ++r) {
+        const float y = SEA_HEIGHT * (1.0f - (float)r / (rows - 1));
+        float* h = &heights[(size_t)r * columns];
+        std::fill(h, h + columns, 0.0f);
+        for (int w = 0; w < NUM_WAVES; ++w) {
+            const Wave& wave = WAVES[w];
+            float k = wave.cycles * 2.0f * (float)M_PI / SEA_WIDTH;
+            // Reduce the time-dependent part in double so long runs keep
+            // the kernel's argument small
+            float phase = (float)std::fmod(wave.depthK * y - wave.speed * time, 2.0 * M_PI);
+            addWave(simdLevel, h, &columnX[0], columns, wave.amplitude, k, phase);
+        }
+
+        // Lighter where the surface slopes towards the viewer, foam on crests
+        const float depth = y / SEA_HEIGHT;
+        Color base = {mixChannel(deep.r, shallow.r, depth), mixChannel(deep.g, shallow.g, depth),
+                      mixChannel(deep.b, shallow.b, depth), 255};
+        Vertex* v = &vertices[(size_t)r * (columns + 1)];
+        for (int c = 0; c <= columns; ++c) {
+            int i = c % columns;
+            float slope = (h[(i + 1) % columns] - h[(i + columns - 1) % columns]) / (2.0f * dx);
+            float light = std::min(1.2f, std::max(0.8f, 1.0f + 0.8f * slope));
+            float foam = std::min(1.0f, std::max(0.0f, (h[i] - crest) / foamRange)) * foamStrength;
+            Vertex& out = v[c];
+            out.x = c * dx;
+            out.y = y + h[i] * rowLift[r];
+            out.color.r = mixChannel((GLubyte)std::min(255.0f, base.r * light), 255, foam);
+            out.color.g = mixChannel((GLubyte)std::min(255.0f, base.g * light), 255, foam);
+            out.color.b = mixChannel((GLubyte)std::min(255.0f, base.b * light), 255, foam);
+            out.color.a = 255;
+            out.palette = 0;
+        }
+    }
+}
+
+void WaterSurface::upload() {
+    if (hasVertexBuffers) {
+        if (vbo == 0) {
+            extGenBuffers(1, &vbo);
+            extGenBuffers(1, &ibo);
+        }
+        size_t bytes = vertices.size() * sizeof(Vertex);
+        orphanArrayBuffer(vbo, capacity, bytes);
+        extBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &vertices[0]);
+        extBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (!indicesUploaded) {
+            extBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+            extBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+            extBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            indicesUploaded = true;
+        }
+    }
+}
+
+// Colors are resolved on the CPU, so this never needs the palette shader
+void WaterSurface::draw() const {
+    const char* base = nullptr;
+    const GLuint* first = nullptr;
+    if (vbo != 0) {
+        extBindBuffer(GL_ARRAY_BUFFER, vbo);
+        extBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    } else {
+        base = (const char*)&vertices[0];
+        first = &indices[0];
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, x));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), base + offsetof(Vertex, color));
+    glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, first);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    if (vbo != 0) {
+        extBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        extBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void WaterSurface::release() {
+    if (vbo != 0) {
+        extDeleteBuffers(1, &vbo);
+        extDeleteBuffers(1, &ibo);
+        vbo = ibo = 0;
+    }
+    capacity = 0;
+    indicesUploaded = false;
+}
+
+float WaterSurface::displacementAt(float x, float y) const {
+    // Columns wrap every SEA_WIDTH; rows clamp to the sea
+    float u = x / SEA_WIDTH * columns;
+    u -= std::floor(u / columns) * columns;
+    int c0 = std::min((int)u, columns - 1);
+    int c1 = (c0 + 1) % columns;
+    float fu = u - c0;
+
+    float v = std::min(1.0f, std::max(0.0f, 1.0f - y / SEA_HEIGHT)) * (rows - 1);
+    int r0 = std::min((int)v, rows - 2);
+    int r1 = r0 + 1;
+    float fv = v - r0;
+
+    const float* h0 = &heights[(size_t)r0 * columns];
+    const float* h1 = &heights[(size_t)r1 * columns];
+    float top = (h0[c0] + (h0[c1] - h0[c0]) * fu) * rowLift[r0];
+    float bottom = (h1[c0] + (h1[c1] - h1[c0]) * fu) * rowLift[r1];
+    return top + (bottom - top) * fv;
+}
@@ -0,0 +1,67 @@
+#ifndef CITY_VIEW_WATER_H
+#define CITY_VIEW_WATER_H
+
+#include "geometry.h"
+#include "simd.h"
+#include <vector>
+
+// Animated sea: a height field summed from a few travelling sine waves,
+// evaluated on a columns x rows grid over one SEA_WIDTH strip and drawn as
+// a shaded triangle grid. Every wave fits the strip a whole number of
+// times, so strips tile seamlessly. Row 0 lies on the horizon
+// (y = SEA_HEIGHT) and the last row on the shore (y = 0); nearer rows are
+// lifted more, and both edges stay put. Boats sample the same grid.
+
+const float SEA_WIDTH = 800.0f;
+const float SEA_HEIGHT = 150.0f;
+
+class WaterSurface {
+public:
+    WaterSurface() { setResolution(256, 32); }
+
+    // Grid size, at least 2 x 2. Clears the heights.
+    void setResolution(int columns, int rows);
+    int getColumns() const { return columns; }
+    int getRows() const { return rows; }
+    void setSimdLevel(SimdLevel level) { simdLevel = level; }
+
+    // Heights and vertices of rows [firstRow, endRow) at time t (seconds),
+    // shaded from the deep to the shallow color. Rows are independent, so
+    // callers may split them across threads.
+    void evaluate(double time, int firstRow, int endRow, Color deep, Color shallow);
+
+    void upload();     // GL thread, once every row is evaluated
+    void draw() const; // One strip with its left edge at x = 0
+    void release();
+    int vertexCount() const { return (int)vertices.size(); }
+
+    // Vertical lift of the surface at world position (x, y), bilinear in
+    // the grid, as drawn; 0 before the first evaluate()
+    float displacementAt(float x, float y) const;
+
+    // Sum of the wave amplitudes, the largest possible height
+    static float maxHeight();
+
+private:
+    int columns = 0, rows = 0;
+    SimdLevel simdLevel = bestSimdLevel();
+    std::vector<float> columnX;  // x of each column, for the kernel
+    std::vector<float> rowLift;  // How much each row is lifted per unit of height
+    std::vector<float> heights;  // rows x columns
+    std::vector<Vertex> vertices; // rows x (columns + 1), the last column repeats the first
+    std::vector<GLuint> indices;
+
+    GLuint vbo = 0, ibo = 0;
+    size_t capacity = 0;
+    bool indicesUploaded = false;
+};
+
+// The kernel on raw arrays (exposed for the benchmark):
+// h[i] += amplitude * sin(k * x[i] + phase), with a polynomial sine that
+// is within 1e-6 of std::sin for |k * x + phase| up to a few hundred.
+// All levels produce bit-identical results.
+void addWave(SimdLevel level, float* h, const float* x, int n, float amplitude, float k, float phase);
+// The same with std::sin, the reference for accuracy and speed
+void addWaveReference(float* h, const float* x, int n, float amplitude, float k, float phase);
+
+#endif
@@ -0,0 +1,56 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+int WorkerPool::defaultThreadCount() {
+    int hw = (int)std::thread::hardware_concurrency();
+    return std::max(1, hw - 1); // Leave a core for the render thread
+}
+
+void WorkerPool::start(int count) {
+    stop();
+    if (count <= 0) count = defaultThreadCount();
+    stopping = false;
+    for (int i = 0; i < count; ++i) {
+        threads.push_back(std::thread(&WorkerPool::run, this));
+    }
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        tasks.clear();
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    threads.clear();
+}
+
+void WorkerPool::submit(const std::function<void()>& task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(task);
+    }
+    wake.notify_one();
+}
+
+size_t WorkerPool::queuedTasks() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tasks.size();
+}
+
+void WorkerPool::run() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping && tasks.empty()) wake.wait(lock);
+            if (stopping) return;
+            task = tasks.front();
+            tasks.pop_front();
+        }
+        task();
+    }
+}
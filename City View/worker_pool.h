@@ -0,0 +1,42 @@
+#ifndef CITY_VIEW_WORKER_POOL_H
+#define CITY_VIEW_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of background threads running queued tasks in FIFO order.
+// Tasks must not touch GL; hand results back to the render thread.
+class WorkerPool {
+public:
+    WorkerPool() {}
+    ~WorkerPool() { stop(); }
+
+    // threads <= 0 picks one less than the hardware threads (at least one)
+    void start(int threads);
+    // Drops tasks that have not started and waits for running ones
+    void stop();
+
+    void submit(const std::function<void()>& task);
+    int threadCount() const { return (int)threads.size(); }
+    size_t queuedTasks();
+
+    static int defaultThreadCount();
+
+private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    void run();
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+#endif